@@ -73,7 +73,8 @@ BatchPrimitiveProcessorJL::BatchPrimitiveProcessorJL(const ResourceManager& rm)
 	threadCount(1),
 	fJoinerChunkSize(rm.getJlJoinerChunkSize()),
 	hasSmallOuterJoin(false),
-	_priority(1)
+	_priority(1),
+	topNLimit(0)
 {
 }
 
@@ -956,6 +957,20 @@ void BatchPrimitiveProcessorJL::createBPP(ByteStream &bs) const
 		{
 			bs << (uint8_t) 0;
 		}
+
+		bs << (uint32_t) bloomFilters.size();
+		for (i = 0; i < bloomFilters.size(); i++)
+			bloomFilters[i]->serialize(bs);
+
+		bs << (uint32_t) topNLimit;
+		if (topNLimit > 0) {
+			bs << (uint32_t) topNSpec.size();
+			for (i = 0; i < topNSpec.size(); i++) {
+				bs << (int32_t) topNSpec[i].fIndex;
+				bs << (int32_t) topNSpec[i].fAsc;
+				bs << (int32_t) topNSpec[i].fNf;
+			}
+		}
 	}
 	// decide which rowgroup is received by PrimProc
 	if (ot == ROW_GROUP) {
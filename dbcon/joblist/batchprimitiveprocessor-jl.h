@@ -162,6 +162,14 @@ public:
 	/* Tuple hashjoin */
 	void useJoiners(const std::vector<boost::shared_ptr<joiner::TupleJoiner> > &);
 	bool nextTupleJoinerMsg(messageqcpp::ByteStream &);
+
+	/* Runtime join filters from UM joins, applied on the PM */
+	void addBloomFilter(boost::shared_ptr<joiner::JoinBloomFilter> bf) { bloomFilters.push_back(bf); }
+
+	/* ORDER BY ... LIMIT.  Each PM job keeps the first 'limit' rows by spec and sends
+	 * only those; the UM's LimitedOrderBy merges them. */
+	void setTopN(const std::vector<ordering::IdbSortSpec> &spec, uint64_t limit)
+		{ topNSpec = spec; topNLimit = limit; }
 // 	void setSmallSideKeyColumn(uint col);
 
 	/* OR hacks */
@@ -268,6 +276,7 @@ private:
 	boost::scoped_array<uint> tlKeyLens;
 	bool sendTupleJoinRowGroupData;
 	uint PMJoinerCount;
+	std::vector<boost::shared_ptr<joiner::JoinBloomFilter> > bloomFilters;
 
 	/* OR hack */
 	uint8_t bop;   // BOP_AND or BOP_OR
@@ -290,6 +299,10 @@ private:
 
 	uint _priority;
 
+	/* PM top-N */
+	std::vector<ordering::IdbSortSpec> topNSpec;
+	uint64_t topNLimit;
+
 	friend class CommandJL;
 	friend class ColumnCommandJL;
 	friend class PassThruCommandJL;
@@ -0,0 +1,593 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation;
+   version 2.1 of the License.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+using namespace boost;
+
+#include "calpontsystemcatalog.h"
+using namespace execplan;
+
+#include "rowgroup.h"
+#include "rowgroupfile.h"
+using namespace rowgroup;
+
+#include "idborderby.h"
+using namespace ordering;
+
+#include "jlf_common.h"
+#include "resourcemanager.h"
+#include "externalorderby.h"
+
+
+namespace
+{
+// smallest run worth giving its own thread
+const uint64_t MIN_RUN_SIZE = 16 * 1024 * 1024;
+
+// runs read by one merge; more than this are merged into bigger runs first
+const uint MAX_MERGE_RUNS = 64;
+
+const uint ROWS_PER_RG = 8192;
+}
+
+
+namespace joblist
+{
+
+
+ExternalOrderBy::ExternalOrderBy() :
+	fStart(0),
+	fCount(-1),
+	fRowsSkipped(0),
+	fRowsReturned(0),
+	fPrefixType(NO_PREFIX),
+	fPrefixCol(0),
+	fPrefixDesc(false),
+	fNullsFirst(true),
+	fRm(NULL),
+	fMaxMemory(0),
+	fMemSize(0),
+	fRunSize(MIN_RUN_SIZE),
+	fThreadCount(1),
+	fRunsOnDisk(0),
+	fMergeLess(NULL)
+{
+}
+
+
+ExternalOrderBy::~ExternalOrderBy()
+{
+	// the sorters still running after an error
+	while (!fSorters.empty())
+	{
+		fSorters.front()->join();
+		fSorters.pop_front();
+	}
+
+	if (fRm)
+		fRm->returnMemory(fMemSize);
+}
+
+
+void ExternalOrderBy::initialize(const RowGroup& rg, const JobInfo& jobInfo)
+{
+	fRm = &jobInfo.rm;
+	fRowGroup = rg;
+	fRowGroupIn = rg;
+	fRowGroupOut = rg;
+	fRowGroupIn.initRow(&fRowIn);
+	fRowGroupOut.initRow(&fRowOut);
+
+	// locate column position in the rowgroup
+	map<uint, uint> keyToIndexMap;
+	for (uint64_t i = 0; i < rg.getKeys().size(); ++i)
+	{
+		if (keyToIndexMap.find(rg.getKeys()[i]) == keyToIndexMap.end())
+			keyToIndexMap.insert(make_pair(rg.getKeys()[i], i));
+	}
+
+	vector<pair<uint32_t, bool> >::const_iterator i = jobInfo.orderByColVec.begin();
+	for ( ; i != jobInfo.orderByColVec.end(); i++)
+	{
+		map<uint, uint>::iterator j = keyToIndexMap.find(i->first);
+		idbassert(j != keyToIndexMap.end());
+		fOrderByCond.push_back(IdbSortSpec(j->second, i->second));
+	}
+
+	// limit row count info
+	fStart = jobInfo.limitStart;
+	fCount = jobInfo.limitCount;
+
+	fTmpDir = fRm->getScTempDiskPath();
+	fMaxMemory = fRm->getOrderByLimitMaxMemory();
+	fThreadCount = fRm->numCores();
+	if (fThreadCount == 0)
+		fThreadCount = 1;
+
+	// about half of the memory for the runs being sorted
+	fRunSize = fMaxMemory / (fThreadCount * 2);
+	if (fRunSize < MIN_RUN_SIZE)
+		fRunSize = MIN_RUN_SIZE;
+
+	// the prefix takes the types CompareRule::compileRules() knows about
+	if (fOrderByCond.size() > 0)
+	{
+		fPrefixCol = fOrderByCond[0].fIndex;
+		fPrefixDesc = (fOrderByCond[0].fAsc < 0);
+		fNullsFirst = (fOrderByCond[0].fNf > 0);
+
+		switch (rg.getColTypes()[fPrefixCol])
+		{
+			case CalpontSystemCatalog::TINYINT:
+			case CalpontSystemCatalog::SMALLINT:
+			case CalpontSystemCatalog::MEDINT:
+			case CalpontSystemCatalog::INT:
+			case CalpontSystemCatalog::BIGINT:
+			case CalpontSystemCatalog::DECIMAL:
+			case CalpontSystemCatalog::UDECIMAL:
+				fPrefixType = INT_PREFIX;
+				break;
+			case CalpontSystemCatalog::UTINYINT:
+			case CalpontSystemCatalog::USMALLINT:
+			case CalpontSystemCatalog::UMEDINT:
+			case CalpontSystemCatalog::UINT:
+			case CalpontSystemCatalog::UBIGINT:
+			case CalpontSystemCatalog::DATE:
+			case CalpontSystemCatalog::DATETIME:
+				fPrefixType = UINT_PREFIX;
+				break;
+			case CalpontSystemCatalog::CHAR:
+			case CalpontSystemCatalog::VARCHAR:
+				fPrefixType = STRING_PREFIX;
+				break;
+			case CalpontSystemCatalog::DOUBLE:
+			case CalpontSystemCatalog::UDOUBLE:
+				fPrefixType = DOUBLE_PREFIX;
+				break;
+			case CalpontSystemCatalog::FLOAT:
+			case CalpontSystemCatalog::UFLOAT:
+				fPrefixType = FLOAT_PREFIX;
+				break;
+			default:
+				fPrefixType = NO_PREFIX;
+				break;
+		}
+	}
+
+	fMergeOrderBy.reset(new OrderByData(fOrderByCond, fRowGroup));
+	fMergeLess = KeyLess(fMergeOrderBy.get());
+}
+
+
+// Maps the first sort column to a number that never sorts two rows the wrong
+// way.  Rows with the same prefix are left to the full compare.
+uint64_t ExternalOrderBy::keyPrefix(const Row& row) const
+{
+	const uint64_t maxPrefix = numeric_limits<uint64_t>::max();
+	uint64_t ret = 0;
+
+	if (fPrefixType == NO_PREFIX)
+		return 0;
+
+	// 0 and max are kept for NULL
+	if (row.isNullValue(fPrefixCol))
+		return (fNullsFirst ? 0 : maxPrefix);
+
+	switch (fPrefixType)
+	{
+		case INT_PREFIX:
+			ret = (uint64_t) row.getIntField(fPrefixCol) ^ 0x8000000000000000ULL;
+			break;
+		case UINT_PREFIX:
+			ret = row.getUintField(fPrefixCol);
+			break;
+		case DOUBLE_PREFIX:
+		case FLOAT_PREFIX:
+		{
+			double d = (fPrefixType == DOUBLE_PREFIX ?
+				row.getDoubleField(fPrefixCol) : row.getFloatField(fPrefixCol));
+			if (d == 0)
+				d = 0;     // -0.0 compares equal to 0.0
+			memcpy(&ret, &d, sizeof(ret));
+			ret = ((ret & 0x8000000000000000ULL) ? ~ret : ret | 0x8000000000000000ULL);
+			break;
+		}
+		case STRING_PREFIX:
+		{
+			// the first 8 bytes, as std::string compares them
+			const uint8_t* s = row.getStringPointer(fPrefixCol);
+			uint len = row.getStringLength(fPrefixCol);
+			for (uint i = 0; i < 8; i++)
+				ret = (ret << 8) | (i < len ? s[i] : 0);
+			break;
+		}
+		default:
+			break;
+	}
+
+	if (fPrefixDesc)
+		ret = ~ret;
+
+	if (ret == 0)
+		ret = 1;
+	else if (ret == maxPrefix)
+		ret = maxPrefix - 1;
+
+	return ret;
+}
+
+
+void ExternalOrderBy::processRowGroup(const RGData& rgData)
+{
+	RGData data = rgData;
+	uint64_t rowCount;
+
+	fRowGroupIn.setData(&data);
+	rowCount = fRowGroupIn.getRowCount();
+	if (rowCount == 0)
+		return;
+
+	if (!fCurrent)
+		fCurrent.reset(new Run());
+
+	fCurrent->fData.push_back(data);
+	fCurrent->fRowCount += rowCount;
+	fCurrent->fMemSize += fRowGroupIn.getSizeWithStrings() + rowCount * sizeof(SortKey);
+
+	if (fCurrent->fMemSize >= fRunSize)
+		startSort();
+}
+
+
+// Hands the current run to a sorter thread, after waiting for the oldest
+// one if all of them are busy.
+void ExternalOrderBy::startSort()
+{
+	if (fSorters.size() >= fThreadCount)
+	{
+		fSorters.front()->join();
+		fSorters.pop_front();
+		checkError();
+	}
+
+	fRuns.push_back(fCurrent);
+	fSorters.push_back(shared_ptr<thread>(new thread(Sorter(this, fCurrent))));
+	fCurrent.reset();
+}
+
+
+void ExternalOrderBy::sortRun(SRun run)
+{
+	try
+	{
+		RowGroup rg = fRowGroup;
+		Row row;
+		OrderByData orderBy(fOrderByCond, fRowGroup);
+		SortKey key;
+		bool keep;
+
+		rg.initRow(&row);
+		run->fKeys.reserve(run->fRowCount);
+		for (vector<RGData>::iterator i = run->fData.begin(); i != run->fData.end(); i++)
+		{
+			rg.setData(&(*i));
+			rg.getRow(0, &row);
+			for (uint64_t j = 0; j < rg.getRowCount(); j++, row.nextRow())
+			{
+				key.fPrefix = keyPrefix(row);
+				key.fData = row.getPointer();
+				run->fKeys.push_back(key);
+			}
+		}
+
+		sort(run->fKeys.begin(), run->fKeys.end(), KeyLess(&orderBy));
+
+		mutex::scoped_lock lk(fMutex);
+		keep = (fMemSize + run->fMemSize <= fMaxMemory);
+		if (keep && !fRm->getMemory(run->fMemSize))
+		{
+			fRm->returnMemory(run->fMemSize);
+			keep = false;
+		}
+
+		if (keep)
+		{
+			fMemSize += run->fMemSize;
+			return;
+		}
+
+		fRunsOnDisk++;
+		lk.unlock();
+		writeRun(run.get());
+	}
+	catch (const std::exception& ex)
+	{
+		mutex::scoped_lock lk(fMutex);
+		if (fError.empty())
+			fError = ex.what();
+	}
+	catch (...)
+	{
+		mutex::scoped_lock lk(fMutex);
+		if (fError.empty())
+			fError = "ExternalOrderBy caught an unknown exception while sorting";
+	}
+}
+
+
+// Writes a sorted run to a file and frees its memory.
+void ExternalOrderBy::writeRun(Run* run)
+{
+	RowGroup rg = fRowGroup;
+	RGData data(rg, ROWS_PER_RG);
+	Row in, out;
+
+	run->fFile.reset(new RowGroupFile(fTmpDir, "OrderBy"));
+
+	rg.initRow(&in);
+	rg.initRow(&out);
+	rg.setData(&data);
+	rg.resetRowGroup(0);
+	rg.getRow(0, &out);
+	for (vector<SortKey>::iterator i = run->fKeys.begin(); i != run->fKeys.end(); i++)
+	{
+		in.setData(i->fData);
+		copyRow(in, &out);
+		rg.incRowCount();
+		out.nextRow();
+
+		if (rg.getRowCount() == ROWS_PER_RG)
+		{
+			run->fFile->write(rg);
+			rg.resetRowGroup(0);
+			rg.getRow(0, &out);
+		}
+	}
+
+	if (rg.getRowCount() > 0)
+		run->fFile->write(rg);
+
+	vector<SortKey>().swap(run->fKeys);
+	run->fData.clear();
+	run->fMemSize = 0;
+}
+
+
+void ExternalOrderBy::checkError()
+{
+	mutex::scoped_lock lk(fMutex);
+	if (!fError.empty())
+		throw runtime_error(fError);
+}
+
+
+void ExternalOrderBy::finalize()
+{
+	if (fCurrent)
+		startSort();
+
+	while (!fSorters.empty())
+	{
+		fSorters.front()->join();
+		fSorters.pop_front();
+	}
+
+	checkError();
+
+	while (fRuns.size() > MAX_MERGE_RUNS)
+	{
+		vector<SRun> runs(fRuns.begin(), fRuns.begin() + MAX_MERGE_RUNS);
+		fRuns.erase(fRuns.begin(), fRuns.begin() + MAX_MERGE_RUNS);
+		fRuns.push_back(mergeRuns(runs));
+	}
+
+	startMerge(fRuns);
+	fRuns.clear();
+}
+
+
+// Merges some runs into one run on disk.
+ExternalOrderBy::SRun ExternalOrderBy::mergeRuns(const vector<SRun>& runs)
+{
+	SRun run(new Run());
+	RowGroup rg = fRowGroup;
+	RGData data(rg, ROWS_PER_RG);
+	Row in, out;
+	int i;
+
+	run->fFile.reset(new RowGroupFile(fTmpDir, "OrderBy"));
+	fRunsOnDisk++;
+
+	startMerge(runs);
+	rg.initRow(&in);
+	rg.initRow(&out);
+	rg.setData(&data);
+	rg.resetRowGroup(0);
+	rg.getRow(0, &out);
+	while ((i = mergeTop()) >= 0)
+	{
+		in.setData(fSources[i].fKey.fData);
+		copyRow(in, &out);
+		rg.incRowCount();
+		out.nextRow();
+		mergePop();
+
+		if (rg.getRowCount() == ROWS_PER_RG)
+		{
+			run->fFile->write(rg);
+			rg.resetRowGroup(0);
+			rg.getRow(0, &out);
+		}
+	}
+
+	if (rg.getRowCount() > 0)
+		run->fFile->write(rg);
+
+	fSources.clear();
+	return run;
+}
+
+
+void ExternalOrderBy::startMerge(const vector<SRun>& runs)
+{
+	fSources.clear();
+	fHeap.clear();
+	fSources.resize(runs.size());
+	for (uint i = 0; i < runs.size(); i++)
+	{
+		MergeSource& s = fSources[i];
+		s.fRun = runs[i];
+		s.fNext = 0;
+		s.fRows = 0;
+		s.fRowGroup = fRowGroup;
+		s.fRowGroup.initRow(&s.fRow);
+		if (s.fRun->fFile)
+			s.fRun->fFile->rewind();
+
+		if (nextRow(s))
+			fHeap.push_back(i);
+	}
+
+	make_heap(fHeap.begin(), fHeap.end(), MergeGreater(this));
+}
+
+
+// Moves a source to its next row.  A run is let go when it is used up.
+bool ExternalOrderBy::nextRow(MergeSource& s)
+{
+	Run* run = s.fRun.get();
+
+	if (!run->fFile)
+	{
+		if (s.fNext < run->fKeys.size())
+		{
+			s.fKey = run->fKeys[s.fNext++];
+			return true;
+		}
+
+		fRm->returnMemory(run->fMemSize);
+		fMemSize -= run->fMemSize;
+		s.fRun.reset();
+		return false;
+	}
+
+	if (s.fNext == s.fRows)
+	{
+		do
+		{
+			if (!run->fFile->read(s.fData))
+			{
+				s.fData = RGData();
+				s.fRun.reset();
+				return false;
+			}
+			s.fRowGroup.setData(&s.fData);
+			s.fRows = s.fRowGroup.getRowCount();
+		} while (s.fRows == 0);
+
+		s.fNext = 0;
+		s.fRowGroup.getRow(0, &s.fRow);
+	}
+	else
+	{
+		s.fRow.nextRow();
+	}
+
+	s.fNext++;
+	s.fKey.fData = s.fRow.getPointer();
+	s.fKey.fPrefix = keyPrefix(s.fRow);
+	return true;
+}
+
+
+void ExternalOrderBy::mergePop()
+{
+	pop_heap(fHeap.begin(), fHeap.end(), MergeGreater(this));
+	if (nextRow(fSources[fHeap.back()]))
+		push_heap(fHeap.begin(), fHeap.end(), MergeGreater(this));
+	else
+		fHeap.pop_back();
+}
+
+
+bool ExternalOrderBy::getData(RGData& data)
+{
+	int i;
+
+	if (fRowsReturned >= fCount)
+		return false;
+
+	data.reinit(fRowGroupOut, ROWS_PER_RG);
+	fRowGroupOut.setData(&data);
+	fRowGroupOut.resetRowGroup(0);
+	fRowGroupOut.getRow(0, &fRowOut);
+	while (fRowGroupOut.getRowCount() < ROWS_PER_RG && fRowsReturned < fCount &&
+		(i = mergeTop()) >= 0)
+	{
+		// skip first limit-start rows
+		if (fRowsSkipped < fStart)
+		{
+			fRowsSkipped++;
+			mergePop();
+			continue;
+		}
+
+		fRowIn.setData(fSources[i].fKey.fData);
+		copyRow(fRowIn, &fRowOut);
+		fRowGroupOut.incRowCount();
+		fRowOut.nextRow();
+		fRowsReturned++;
+		mergePop();
+	}
+
+	return (fRowGroupOut.getRowCount() > 0);
+}
+
+
+const string ExternalOrderBy::toString() const
+{
+	ostringstream oss;
+	oss << "ExternalOrderBy   cols: ";
+	vector<IdbSortSpec>::const_iterator i = fOrderByCond.begin();
+	for (; i != fOrderByCond.end(); i++)
+		oss << "(" << i->fIndex << ","
+			<< ((i->fAsc > 0)?"Asc":"Desc") << ","
+			<< ((i->fNf > 0)?"null first":"null last") << ") ";
+
+	oss << " start-" << fStart << " count-" << fCount;
+	if (fRunsOnDisk > 0)
+		oss << " runs on disk-" << fRunsOnDisk;
+	oss << endl;
+
+	return oss.str();
+}
+
+
+}
+// vim:ts=4 sw=4:
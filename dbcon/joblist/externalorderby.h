@@ -0,0 +1,183 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation;
+   version 2.1 of the License.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+
+/** @file */
+
+#ifndef EXTERNAL_ORDER_BY_H
+#define EXTERNAL_ORDER_BY_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "rowgroup.h"
+#include "rowgroupfile.h"
+#include "idborderby.h"
+
+class ExternalOrderByTestSuite;
+
+
+namespace joblist
+{
+
+
+// forward reference
+struct JobInfo;
+class ResourceManager;
+
+
+// ORDER BY class for results that are too big for LimitedOrderBy's heap.
+// The input is cut into runs, and each run is sorted by its own thread on
+// (key prefix, row pointer) pairs.  Sorted runs stay in memory up to the
+// memory limit, the others are written to files under TempDiskPath.
+// getData() merges the runs and returns the rows in order, LIMIT applied.
+class ExternalOrderBy
+{
+public:
+	ExternalOrderBy();
+	~ExternalOrderBy();
+
+	void initialize(const rowgroup::RowGroup&, const JobInfo&);
+	void processRowGroup(const rowgroup::RGData&);
+	void finalize();
+	bool getData(rowgroup::RGData&);
+	const std::string toString() const;
+
+	friend class ::ExternalOrderByTestSuite;
+
+private:
+	ExternalOrderBy(const ExternalOrderBy&);
+	ExternalOrderBy& operator=(const ExternalOrderBy&);
+
+	// the first ORDER BY column, mapped to a uint64 that sorts the same way
+	struct SortKey
+	{
+		uint64_t fPrefix;
+		rowgroup::Row::Pointer fData;
+	};
+
+	struct KeyLess
+	{
+		KeyLess(ordering::OrderByData* o) : fOrderBy(o) { }
+		bool operator()(const SortKey& a, const SortKey& b) const
+		{
+			if (a.fPrefix != b.fPrefix)
+				return a.fPrefix < b.fPrefix;
+			return (*fOrderBy)(a.fData, b.fData);
+		}
+		ordering::OrderByData* fOrderBy;
+	};
+
+	struct Run
+	{
+		Run() : fRowCount(0), fMemSize(0) { }
+		std::vector<rowgroup::RGData> fData;
+		std::vector<SortKey> fKeys;
+		uint64_t fRowCount;
+		uint64_t fMemSize;
+		boost::shared_ptr<rowgroup::RowGroupFile> fFile;
+	};
+	typedef boost::shared_ptr<Run> SRun;
+
+	// a run being read by the merge
+	struct MergeSource
+	{
+		SRun fRun;
+		uint64_t fNext;
+		uint64_t fRows;      // rows in fData, for a run on disk
+		rowgroup::RGData fData;
+		rowgroup::RowGroup fRowGroup;
+		rowgroup::Row fRow;
+		SortKey fKey;
+	};
+
+	class Sorter
+	{
+	public:
+		Sorter(ExternalOrderBy* o, SRun r) : fOrderBy(o), fRun(r) { }
+		void operator()() { fOrderBy->sortRun(fRun); }
+
+		ExternalOrderBy* fOrderBy;
+		SRun fRun;
+	};
+
+	struct MergeGreater
+	{
+		MergeGreater(ExternalOrderBy* o) : fOrderBy(o) { }
+		bool operator()(uint a, uint b) const
+		{ return fOrderBy->fMergeLess(fOrderBy->fSources[b].fKey, fOrderBy->fSources[a].fKey); }
+		ExternalOrderBy* fOrderBy;
+	};
+
+	uint64_t keyPrefix(const rowgroup::Row&) const;
+	void startSort();
+	void sortRun(SRun);
+	void writeRun(Run*);
+	SRun mergeRuns(const std::vector<SRun>&);
+	void startMerge(const std::vector<SRun>&);
+	bool nextRow(MergeSource&);
+	int  mergeTop() const { return (fHeap.empty() ? -1 : (int) fHeap.front()); }
+	void mergePop();
+	void checkError();
+
+	std::vector<ordering::IdbSortSpec>  fOrderByCond;
+	rowgroup::RowGroup                  fRowGroup;   // read-only once initialized, the sorters copy it
+	rowgroup::RowGroup                  fRowGroupIn;
+	rowgroup::RowGroup                  fRowGroupOut;
+	rowgroup::Row                       fRowIn;
+	rowgroup::Row                       fRowOut;
+	uint64_t                            fStart;
+	uint64_t                            fCount;
+	uint64_t                            fRowsSkipped;
+	uint64_t                            fRowsReturned;
+
+	enum { NO_PREFIX, INT_PREFIX, UINT_PREFIX, DOUBLE_PREFIX, FLOAT_PREFIX, STRING_PREFIX }
+	                                    fPrefixType;
+	uint                                fPrefixCol;
+	bool                                fPrefixDesc;
+	bool                                fNullsFirst;
+
+	ResourceManager*                    fRm;
+	std::string                         fTmpDir;
+	uint64_t                            fMaxMemory;
+	uint64_t                            fMemSize;    // sorted runs kept in memory
+	uint64_t                            fRunSize;
+	uint                                fThreadCount;
+	uint                                fRunsOnDisk;
+
+	SRun                                fCurrent;
+	std::vector<SRun>                   fRuns;
+	std::deque<boost::shared_ptr<boost::thread> > fSorters;
+	boost::mutex                        fMutex;
+	std::string                         fError;
+
+	boost::scoped_ptr<ordering::OrderByData> fMergeOrderBy;
+	KeyLess                             fMergeLess;
+	std::vector<MergeSource>            fSources;
+	std::vector<uint>                   fHeap;
+};
+
+
+}
+
+#endif  // EXTERNAL_ORDER_BY_H
+
+// vim:ts=4 sw=4:
@@ -502,7 +502,12 @@ void adjustLastStep(JobStepVector& querySteps, DeliveredTableMap& deliverySteps,
 		jobInfo.annexStep->outputAssociation(jsaOut);
 
 		querySteps.push_back(jobInfo.annexStep);
-		dynamic_cast<TupleAnnexStep*>(jobInfo.annexStep.get())->initialize(rg2, jobInfo);
+		TupleAnnexStep* tas = dynamic_cast<TupleAnnexStep*>(jobInfo.annexStep.get());
+		tas->initialize(rg2, jobInfo);
+
+		// trim the rows on the PMs if they come straight from a scan; DML needs the rids
+		if (jobInfo.queryType == "SELECT" || jobInfo.queryType == "INSERT_SELECT")
+			tas->setPmTopN(dynamic_cast<JobStep*>(ds));
 		deliverySteps[CNX_VTABLE_ID] = jobInfo.annexStep;
 	}
 
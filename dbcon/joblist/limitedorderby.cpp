@@ -84,6 +84,10 @@ void LimitedOrderBy::initialize(const RowGroup& rg, const JobInfo& jobInfo)
 
 //	fMemSize = (fStart + fCount) * rg.getRowSize();
 
+	// a small LIMIT doesn't need whole RowGroups to keep its rows in
+	if (fStart + fCount > 0 && fStart + fCount < fRowsPerRG)
+		fRowsPerRG = fStart + fCount;
+
 	IdbOrderBy::initialize(rg);
 }
 
@@ -91,7 +95,8 @@ void LimitedOrderBy::initialize(const RowGroup& rg, const JobInfo& jobInfo)
 uint64_t LimitedOrderBy::getKeyLength() const
 {
 	//return (fRow0.getSize() - 2);
-	return fRow0.getColumnCount();
+	// the last column the distinct map compares, as in GroupConcatOrderBy
+	return fRow0.getColumnCount() - 1;
 }
 
 
@@ -150,7 +155,10 @@ void LimitedOrderBy::processRow(const rowgroup::Row& row)
 		}
 		else
 		{
-			fDistinctMap->erase(row.getPointer());
+			// the map's hasher moves row1, and it's the row being replaced
+			// that leaves the map
+			fDistinctMap->erase(swapRow.fData);
+			row1.setData(swapRow.fData);
 			copyRow(row, &row1);
 			fDistinctMap->insert(row1.getPointer());
 			//fDistinctMap->erase(fDistinctMap->find(row.getData() + 2));
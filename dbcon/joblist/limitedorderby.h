@@ -53,6 +53,10 @@ public:
 
 	void finalize();
 
+	const std::vector<ordering::IdbSortSpec>& getOrderByCond() const { return fOrderByCond; }
+	uint64_t getLimit() const { return fStart + fCount; }
+	void setLimit(uint64_t start, uint64_t count) { fStart = start; fCount = count; }
+
 protected:
 	uint64_t                            fStart;
 	uint64_t                            fCount;
@@ -64,6 +64,7 @@
 #include "tuplejoiner.h"
 #include "rowgroup.h"
 #include "rowaggregation.h"
+#include "idborderby.h"
 #include "funcexpwrapper.h"
 
 namespace joblist
@@ -958,6 +959,10 @@ public:
 
 	void setAggregateStep(const rowgroup::SP_ROWAGG_PM_t& agg, const rowgroup::RowGroup &rg);
 
+	/* Pushes ORDER BY ... LIMIT down to the PMs.  spec indexes the delivered RG.
+	 * Returns false if this step's output can't be trimmed on the PM. */
+	bool setTopN(const std::vector<ordering::IdbSortSpec> &spec, uint64_t limit);
+
 	/* This is called by TupleHashJoin only */
 	void setJoinedResultRG(const rowgroup::RowGroup &rg);
 
@@ -1018,6 +1023,10 @@ public:
 	 */
 	void addCPPredicates(uint32_t OID, const std::vector<int64_t> &vals, bool isRange);
 
+	/* Runtime join filter.  The PMs drop the rows whose key can't be in bf
+	 * instead of sending them to the UM join. */
+	void addBloomFilter(boost::shared_ptr<joiner::JoinBloomFilter> bf);
+
     /* semijoin adds */
 	void setJoinFERG(const rowgroup::RowGroup &rg);
 
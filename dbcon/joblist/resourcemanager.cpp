@@ -166,6 +166,15 @@ namespace joblist {
 	else
 		fAggNumRowGroups = fConfig->uFromText(nr);
 
+	string da = fConfig->getConfig("RowAggregation", "AllowDiskBasedAggregation");
+	fAllowDiskAggregation = (da.empty() || da == "Y" || da == "y");
+
+	string sp = fConfig->getConfig("RowAggregation", "RowAggrSpillPartitions");
+	if (sp.empty() || fConfig->uFromText(sp) == 0)
+		fAggSpillPartitions = 32;
+	else
+		fAggSpillPartitions = fConfig->uFromText(sp);
+
 	// window function
 	string wt = fConfig->getConfig("WindowFunction", "WorkThreads");
 	if (nt.empty())
@@ -119,6 +119,12 @@ namespace joblist
   /* HJ CP feedback, see bug #1465 */
   const uint defaultHjCPUniqueLimit = 100;
 
+  /* Largest bloom filter a UM join will send to the PMs, 0 disables them */
+  const uint64_t defaultHjRuntimeFilterMaxSize = 16 * 1024 * 1024;
+
+  /* Files each side of a disk-based hash join is split into */
+  const uint defaultHjDiskJoinPartitions = 32;
+
   // Order By and Limit
   const uint64_t defaultOrderByLimitMaxMemory = 1 * 1024 * 1024 * 1024ULL;
 
@@ -161,6 +167,14 @@ namespace joblist
     uint64_t  	getHjMaxElems()  const { return  getUintVal(fHashJoinStr, "MaxElems", defaultHJMaxElems); }
     uint32_t  	getHjFifoSizeLargeSide() const { return  getUintVal(fHashJoinStr, "FifoSizeLargeSide", defaultHJFifoSizeLargeSide); }
 	uint 		getHjCPUniqueLimit() const { return getUintVal(fHashJoinStr, "CPUniqueLimit", defaultHjCPUniqueLimit); }
+	uint64_t	getHjRuntimeFilterMaxSize() const { return getUintVal(fHashJoinStr, "RuntimeFilterMaxSize", defaultHjRuntimeFilterMaxSize); }
+	bool		getHjAllowDiskJoin() const
+	{
+		std::string val(getStringVal(fHashJoinStr, "AllowDiskBasedJoin", "Y"));
+		boost::to_upper(val);
+		return "Y" == val;
+	}
+	uint		getHjDiskJoinPartitions() const { return getUintVal(fHashJoinStr, "DiskJoinPartitions", defaultHjDiskJoinPartitions); }
 	uint64_t	getPMJoinMemLimit() const { return pmJoinMemLimit; }
 
     uint32_t  	getJLFlushInterval() const { return  getUintVal(fJobListStr, "FlushInterval", defaultFlushInterval); }
@@ -327,6 +341,12 @@ namespace joblist
     void aggNumRowGroups(uint numRowGroups) { fAggNumRowGroups = numRowGroups; }
     uint aggNumRowGroups() const { return fAggNumRowGroups; }
 
+    void allowDiskAggregation(bool b) { fAllowDiskAggregation = b; }
+    bool allowDiskAggregation() const { return fAllowDiskAggregation; }
+
+    void aggSpillPartitions(uint n) { fAggSpillPartitions = n; }
+    uint aggSpillPartitions() const { return fAggSpillPartitions; }
+
     void windowFunctionThreads(uint n) { fWindowFunctionThreads = n; }
     uint windowFunctionThreads() const { return fWindowFunctionThreads; }
 	
@@ -390,6 +410,8 @@ namespace joblist
 	uint fAggNumThreads;
 	uint fAggNumBuckets;
 	uint fAggNumRowGroups;
+	bool fAllowDiskAggregation;
+	uint fAggSpillPartitions;
 
 	// window function
 	uint fWindowFunctionThreads;
@@ -27,6 +27,7 @@
 #include <vector>
 
 #include <pthread.h>
+#include <dirent.h>
 #include <time.h>
 #include <sys/time.h>
 
@@ -49,6 +50,9 @@
 #include "simplecolumn.h"
 #include "dataconvert.h"
 #include "largehashjoin.h"
+#include "rowgroup.h"
+#include "rowaggregation.h"
+#include "rowgroupfile.h"
 
 using namespace dataconvert;
  
@@ -453,6 +457,8 @@ CPPUNIT_TEST_SUITE(AggDriver);
 //CPPUNIT_TEST(hashmap_ET);
 //CPPUNIT_TEST(tuplewsdl_multi);
 CPPUNIT_TEST(bdl_multi);
+CPPUNIT_TEST(aggSpill);
+CPPUNIT_TEST(spillPartitionsWithoutRows);
 CPPUNIT_TEST_SUITE_END();
 typedef boost::shared_ptr<SimpleFilter> SSFP;
        
@@ -663,6 +669,142 @@ public:
 		timer1.finish();
     }
     
+	/* A GROUP BY with no memory to grow into: all but the first 256 groups go to
+	   disk, and the partitions that are still too big spill again */
+	void aggSpill()
+	{
+		const uint KEYS = 3000, ROWS_PER_KEY = 3, RG_ROWS = 1000;
+		vector<uint> pos, oids, keys, scale(2, 0), precision(2, 19);
+		vector<CalpontSystemCatalog::ColDataType> types(2, CalpontSystemCatalog::BIGINT);
+		vector<rowgroup::SP_ROWAGG_GRPBY_t> groupBy;
+		vector<rowgroup::SP_ROWAGG_FUNC_t> functions;
+		vector<uint> sums(KEYS, 0);
+		uint64_t groups = 0, i;
+		int64_t available = fRm.availableMemory();
+		rowgroup::Row r;
+
+		pos.push_back(2);
+		pos.push_back(10);
+		pos.push_back(18);
+		oids.push_back(3000);
+		oids.push_back(3001);
+		keys.push_back(1);
+		keys.push_back(2);
+		rowgroup::RowGroup rgIn(2, pos, oids, keys, types, scale, precision, 20, false);
+		rowgroup::RowGroup rgOut(rgIn);
+		rowgroup::RGData dataIn(rgIn, RG_ROWS);
+		rowgroup::RGData dataOut(rgOut, 256);
+		rgIn.setData(&dataIn);
+		rgOut.setData(&dataOut);
+
+		groupBy.push_back(rowgroup::SP_ROWAGG_GRPBY_t(new rowgroup::RowAggGroupByCol(0, 0)));
+		functions.push_back(rowgroup::SP_ROWAGG_FUNC_t(new rowgroup::RowAggFunctionCol(
+			rowgroup::ROWAGG_SUM, rowgroup::ROWAGG_FUNCT_UNDEFINE, 1, 1)));
+
+		fRm.getMemory(available);
+		{
+			rowgroup::RowAggregationUM agg(groupBy, functions, &fRm);
+			agg.allowDiskAggregation(true);
+			agg.spillPartitions(8);
+			agg.setInputOutput(rgIn, &rgOut);
+
+			rgIn.initRow(&r);
+			for (i = 0; i < KEYS * ROWS_PER_KEY; i++)
+			{
+				if (i % RG_ROWS == 0)
+				{
+					rgIn.resetRowGroup(0);
+					rgIn.getRow(0, &r);
+				}
+				r.setIntField(i % KEYS, 0);
+				r.setIntField(1, 1);
+				r.nextRow();
+				rgIn.incRowCount();
+				if (rgIn.getRowCount() == RG_ROWS)
+					agg.addRowGroup(&rgIn);
+			}
+			agg.endOfInput();
+
+			while (agg.nextRowGroup())
+			{
+				agg.finalize();
+				rgOut.initRow(&r);
+				rgOut.getRow(0, &r);
+				for (i = 0; i < rgOut.getRowCount(); i++, r.nextRow())
+				{
+					CPPUNIT_ASSERT(r.getIntField(0) >= 0 && r.getIntField(0) < KEYS);
+					sums[r.getIntField(0)] += r.getIntField(1);
+					groups++;
+				}
+			}
+		}
+
+		// every group came out once, and the spill buffers' memory was given back
+		CPPUNIT_ASSERT(groups == KEYS);
+		for (i = 0; i < KEYS; i++)
+			CPPUNIT_ASSERT(sums[i] == ROWS_PER_KEY);
+		CPPUNIT_ASSERT(fRm.availableMemory() == 0);
+		fRm.returnMemory(available);
+	}
+
+	/* Only the partitions that got rows have files */
+	void spillPartitionsWithoutRows()
+	{
+		const uint PARTITIONS = 8, ROWS = 10;
+		vector<uint> pos, oids, keys, scale(1, 0), precision(1, 19);
+		vector<CalpontSystemCatalog::ColDataType> types(1, CalpontSystemCatalog::BIGINT);
+		char dir[] = "/tmp/aggspillXXXXXX";
+		rowgroup::Row r;
+		uint i;
+
+		pos.push_back(2);
+		pos.push_back(10);
+		oids.push_back(3000);
+		keys.push_back(1);
+		rowgroup::RowGroup rg(1, pos, oids, keys, types, scale, precision, 20, false);
+		rowgroup::RGData data(rg, ROWS);
+		rg.setData(&data);
+		rg.resetRowGroup(0);
+		rg.initRow(&r);
+		rg.getRow(0, &r);
+		for (i = 0; i < ROWS; i++, r.nextRow())
+		{
+			r.setIntField(i, 0);
+			rg.incRowCount();
+		}
+
+		CPPUNIT_ASSERT(mkdtemp(dir) != NULL);
+		{
+			rowgroup::RowGroupPartitioner partitioner(rg, PARTITIONS, dir, "Agg", 4);
+			rg.getRow(0, &r);
+			for (i = 0; i < ROWS; i++, r.nextRow())
+				partitioner.insert(r, 3);
+			partitioner.flush();
+
+			for (i = 0; i < PARTITIONS; i++)
+				CPPUNIT_ASSERT(partitioner.partitionRows(i) == (i == 3 ? ROWS : 0));
+			CPPUNIT_ASSERT(countFiles(dir) == 1);
+			CPPUNIT_ASSERT(partitioner.partition(3).rowCount() == ROWS);
+			partitioner.release(3);
+			CPPUNIT_ASSERT(countFiles(dir) == 0);
+		}
+		CPPUNIT_ASSERT(rmdir(dir) == 0);
+	}
+
+	uint countFiles(const char *dir)
+	{
+		DIR *d = opendir(dir);
+		struct dirent *e;
+		uint n = 0;
+
+		CPPUNIT_ASSERT(d != NULL);
+		while ((e = readdir(d)) != NULL)
+			if (e->d_name[0] != '.')
+				n++;
+		closedir(d);
+		return n;
+	}
+
     void tuplewsdl()
     {
       TupleBucketDataList *tbdl = new TupleBucketDataList(NUM_BUCKETS, numConsumers, MAX_SIZE, fRm);
@@ -0,0 +1,316 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+// $Id$
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+using namespace std;
+
+#include <boost/scoped_ptr.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "bytestream.h"
+#include "funcexp.h"
+#include "jobstep.h"
+#include "jlf_common.h"
+#include "joblist.h"
+#include "resourcemanager.h"
+#include "limitedorderby.h"
+#include "tupleannexstep.h"
+
+using namespace messageqcpp;
+using namespace execplan;
+using namespace rowgroup;
+using namespace joblist;
+
+class TupleAnnexTestSuite : public CppUnit::TestFixture
+{
+
+	CPPUNIT_TEST_SUITE( TupleAnnexTestSuite );
+
+	CPPUNIT_TEST( orderByThreads_small );
+	CPPUNIT_TEST( orderByThreads_memory );
+	CPPUNIT_TEST( orderByThreads_serial );
+	CPPUNIT_TEST( orderByMerge );
+	CPPUNIT_TEST( orderByDistinct );
+	CPPUNIT_TEST( parallelDistinct );
+	CPPUNIT_TEST( parallelDistinctLimit );
+
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	static const uint64_t MB = 1024 * 1024;
+	static const uint ROWS = 100000;
+	static const uint RG_ROWS = 1000;
+	static const int64_t KEYS = 5003;
+
+	boost::scoped_ptr<ResourceManager> fRm;
+
+	/* A BIGINT key & a BIGINT that only depends on it */
+	RowGroup makeRG()
+	{
+		vector<uint> pos, oids, keys, scale(2, 0), precision(2, 19);
+		vector<CalpontSystemCatalog::ColDataType> types(2, CalpontSystemCatalog::BIGINT);
+
+		pos.push_back(2);
+		for (uint i = 0; i < 2; i++) {
+			pos.push_back(pos.back() + 8);
+			oids.push_back(3000 + i);
+			keys.push_back(i + 1);
+		}
+		return RowGroup(2, pos, oids, keys, types, scale, precision, 20, false);
+	}
+
+	/* Every key shows up about 20 times, all over the input, as the same row */
+	void fill(RowGroupDL *dl, RowGroup rg)
+	{
+		RGData data;
+		Row r;
+
+		rg.initRow(&r);
+		for (uint i = 0; i < ROWS; i++, r.nextRow(), rg.incRowCount()) {
+			if (i % RG_ROWS == 0) {
+				if (i > 0)
+					dl->insert(data);
+				data.reinit(rg, RG_ROWS);
+				rg.setData(&data);
+				rg.resetRowGroup(i);
+				rg.getRow(0, &r);
+			}
+			r.setIntField<8>((i * 7919) % KEYS, 0);
+			r.setIntField<8>((i * 7919) % KEYS * 3, 1);
+		}
+		dl->insert(data);
+		dl->endOfInput();
+	}
+
+	/* All the input's keys, sorted, once each with distinct */
+	vector<int64_t> sortedKeys(bool asc, bool distinct)
+	{
+		vector<int64_t> keys;
+
+		for (uint i = 0; i < ROWS; i++)
+			keys.push_back((i * 7919) % KEYS);
+		sort(keys.begin(), keys.end());
+		if (distinct)
+			keys.erase(unique(keys.begin(), keys.end()), keys.end());
+		if (!asc)
+			reverse(keys.begin(), keys.end());
+		return keys;
+	}
+
+	/* Runs the input through a TupleAnnexStep on a UM with the given number of
+	   cores and returns the keys it delivered, in order */
+	vector<int64_t> runAnnex(bool orderBy, bool asc, bool distinct, uint64_t start,
+		uint64_t count, uint cores)
+	{
+		RowGroup rg = makeRG(), outputRG;
+		AnyDataListSPtr inDL(new AnyDataList()), outDL(new AnyDataList());
+		JobStepAssociation in, out;
+		TupleJobList jobList;
+		vector<int64_t> keys;
+		ByteStream bs;
+		RGData data;
+		Row r;
+		uint rowCount;
+
+		fRm->numCores(cores);
+		JobInfo jobInfo(*fRm);
+		jobInfo.status.reset(new ErrorInfo());
+		jobInfo.jobListPtr = &jobList;
+		jobInfo.nonConstDelCols.resize(2);
+		jobInfo.limitStart = start;
+		jobInfo.limitCount = count;
+		if (orderBy)
+			jobInfo.orderByColVec.push_back(make_pair(rg.getKeys()[0], asc));
+
+		TupleAnnexStep tas(jobInfo);
+		if (orderBy)
+			tas.addOrderBy(new LimitedOrderBy());
+		if (distinct)
+			tas.setDistinct();
+		tas.setLimit(start, count);
+		tas.initialize(rg, jobInfo);
+		if (orderBy)
+			CPPUNIT_ASSERT(tas.fOrderBys.size() == (cores > 1 ? cores : 0));
+		else if (distinct)
+			CPPUNIT_ASSERT(tas.fDistinctData.size() == (cores > 1 ? cores : 0));
+
+		inDL->rowGroupDL(new RowGroupDL(1, 200));
+		outDL->rowGroupDL(new RowGroupDL(1, 200));
+		fill(inDL->rowGroupDL(), rg);
+		in.outAdd(inDL);
+		out.outAdd(outDL);
+		tas.inputAssociation(in);
+		tas.outputAssociation(out);
+		tas.delivery(true);
+
+		outputRG = tas.getDeliveredRowGroup();
+		tas.run();
+		do {
+			bs.restart();
+			rowCount = tas.nextBand(bs);
+			data.deserialize(bs, true);
+			outputRG.setData(&data);
+			outputRG.initRow(&r);
+			outputRG.getRow(0, &r);
+			for (uint i = 0; i < outputRG.getRowCount(); i++, r.nextRow()) {
+				CPPUNIT_ASSERT(r.getIntField(1) == r.getIntField(0) * 3);
+				keys.push_back(r.getIntField(0));
+			}
+		} while (rowCount > 0);
+		tas.join();
+
+		CPPUNIT_ASSERT(tas.status() == 0);
+		CPPUNIT_ASSERT(tas.fRowsReturned == keys.size());
+		return keys;
+	}
+
+	/* The ORDER BY on 4 threads and on 1 picks the slice of the sorted keys.  The
+	   heaps give their rows back in heap order, so the slices are compared sorted. */
+	void checkOrderBy(bool asc, bool distinct, uint64_t start, uint64_t count)
+	{
+		vector<int64_t> sorted = sortedKeys(asc, distinct);
+		vector<int64_t> expected(sorted.begin() + min<uint64_t>(start, sorted.size()),
+			sorted.begin() + min<uint64_t>(start + count, sorted.size()));
+		vector<int64_t> threads = runAnnex(true, asc, distinct, start, count, 4);
+		vector<int64_t> serial = runAnnex(true, asc, distinct, start, count, 1);
+
+		sort(expected.begin(), expected.end());
+		sort(threads.begin(), threads.end());
+		sort(serial.begin(), serial.end());
+		CPPUNIT_ASSERT(threads == expected);
+		CPPUNIT_ASSERT(serial == expected);
+	}
+
+	/* DISTINCT without ORDER BY returns each key once, in no order.  Anything
+	   past the distinct keys is cut by the LIMIT, but no key is returned twice. */
+	void checkDistinct(uint64_t count, uint cores)
+	{
+		vector<int64_t> keys = runAnnex(false, true, true, 0, count, cores);
+		vector<int64_t> all = sortedKeys(true, true);
+
+		CPPUNIT_ASSERT(keys.size() == min<uint64_t>(count, all.size()));
+		sort(keys.begin(), keys.end());
+		CPPUNIT_ASSERT(unique(keys.begin(), keys.end()) == keys.end());
+		if (keys.size() == all.size())
+			CPPUNIT_ASSERT(keys == all);
+		else
+			CPPUNIT_ASSERT(includes(all.begin(), all.end(), keys.begin(), keys.end()));
+	}
+
+public:
+	void setUp()
+	{
+		fRm.reset(new ResourceManager());
+	}
+
+	void tearDown()
+	{
+		fRm.reset();
+	}
+
+	/* A small LIMIT gets a heap on every core */
+	void orderByThreads_small()
+	{
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(100, 64, 1024 * MB, 16) == 16);
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(1, 1, 3, 2) == 2);
+	}
+
+	/* 1M rows of 100 bytes fit 10 times in 1000MB: 9 threads and the final heap,
+	   not one heap per core */
+	void orderByThreads_memory()
+	{
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(MB, 100, 1000 * MB, 32) == 9);
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(MB, 100, 300 * MB, 32) == 2);
+
+		// the heaps never add up to more than the limit
+		for (uint cores = 2; cores <= 64; cores *= 2)
+		{
+			uint threads = TupleAnnexStep::orderByThreads(MB, 100, 1000 * MB, cores);
+			CPPUNIT_ASSERT(threads <= cores);
+			CPPUNIT_ASSERT((threads + 1) * MB * 100 <= 1000 * MB);
+		}
+	}
+
+	/* Fewer than 2 threads and the final heap won't fit, or nothing to run them on */
+	void orderByThreads_serial()
+	{
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(MB, 100, 299 * MB, 32) == 1);
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(MB, 100, 50 * MB, 32) == 1);
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(100, 64, 1024 * MB, 1) == 1);
+		CPPUNIT_ASSERT(TupleAnnexStep::orderByThreads(0, 64, 1024 * MB, 16) == 1);
+	}
+
+	/* Each thread keeps its first start + count rows, the OFFSET is taken from
+	   the merged rows, not from any one thread's */
+	void orderByMerge()
+	{
+		checkOrderBy(true, false, 0, 10);
+		checkOrderBy(false, false, 0, 500);
+		checkOrderBy(true, false, 250, 100);
+		checkOrderBy(false, false, 2000, 10);
+		checkOrderBy(true, false, ROWS - 5, 100);
+	}
+
+	/* The same row in the heaps of several threads is returned once */
+	void orderByDistinct()
+	{
+		checkOrderBy(true, true, 0, 300);
+		checkOrderBy(false, true, 1000, 300);
+		checkOrderBy(true, true, KEYS - 13, 100);
+		checkOrderBy(false, true, KEYS + 10, 100);
+	}
+
+	/* The copies of a key read by different threads land in the same partition */
+	void parallelDistinct()
+	{
+		checkDistinct(-1, 4);
+		checkDistinct(-1, 8);
+		checkDistinct(KEYS + 100, 4);
+		checkDistinct(-1, 1);
+	}
+
+	/* The threads stop at the LIMIT between them, whichever finds the last row */
+	void parallelDistinctLimit()
+	{
+		checkDistinct(1, 4);
+		checkDistinct(1000, 4);
+		checkDistinct(KEYS - 1, 8);
+		checkDistinct(KEYS, 8);
+		checkDistinct(1000, 1);
+	}
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( TupleAnnexTestSuite );
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
@@ -0,0 +1,288 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+// $Id$
+
+/** @file tdriver-diskjoin.cpp
+ * Runs UM joins with the small side forced to disk and checks they return what
+ * the same joins return in memory.  The settings are changed in the loaded
+ * Calpont.xml only, so this needs one, like the other joblist drivers.
+ */
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <set>
+#include <iostream>
+using namespace std;
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "bytestream.h"
+#include "configcpp.h"
+#include "funcexp.h"
+#include "jobstep.h"
+#include "jlf_common.h"
+#include "resourcemanager.h"
+#include "tuplehashjoin.h"
+
+using namespace messageqcpp;
+using namespace execplan;
+using namespace rowgroup;
+using namespace joblist;
+
+class DiskJoinTestSuite : public CppUnit::TestFixture
+{
+
+	CPPUNIT_TEST_SUITE( DiskJoinTestSuite );
+
+	CPPUNIT_TEST( innerJoin );
+	CPPUNIT_TEST( largeOuterJoin );
+	CPPUNIT_TEST( smallOuterJoin );
+	CPPUNIT_TEST( semiJoin );
+	CPPUNIT_TEST( antiJoin );
+
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	static const uint SMALL_ROWS = 20000;
+	static const uint LARGE_ROWS = 30000;
+	static const uint RG_ROWS = 8192;
+
+	boost::scoped_ptr<ResourceManager> fRm;
+	string fTempDir;
+
+	/* A BIGINT key & a BIGINT row number */
+	RowGroup makeRG(uint firstOid, uint firstKey)
+	{
+		vector<uint> pos, oids, keys, scale(2, 0), precision(2, 19);
+		vector<CalpontSystemCatalog::ColDataType> types(2, CalpontSystemCatalog::BIGINT);
+
+		pos.push_back(2);
+		pos.push_back(10);
+		pos.push_back(18);
+		oids.push_back(firstOid);
+		oids.push_back(firstOid + 1);
+		keys.push_back(firstKey);
+		keys.push_back(firstKey + 1);
+		return RowGroup(2, pos, oids, keys, types, scale, precision, 20, false);
+	}
+
+	/* The small side's columns, then the large side's */
+	RowGroup makeOutputRG()
+	{
+		vector<uint> pos, oids, keys, scale(4, 0), precision(4, 19);
+		vector<CalpontSystemCatalog::ColDataType> types(4, CalpontSystemCatalog::BIGINT);
+
+		pos.push_back(2);
+		for (uint i = 0; i < 4; i++) {
+			pos.push_back(10 + i * 8);
+			oids.push_back(i < 2 ? 3000 + i : 3010 + i - 2);
+			keys.push_back(i + 1);
+		}
+		return RowGroup(4, pos, oids, keys, types, scale, precision, 20, false);
+	}
+
+	/* Every key the small side has appears twice, some of the large side's keys
+	   aren't there, and both sides have NULLs.  The small side's NULLs are few;
+	   they all land in one partition however it's split. */
+	void fill(RowGroupDL *dl, RowGroup rg, uint rows, bool smallSide)
+	{
+		RGData data;
+		Row r;
+
+		rg.initRow(&r);
+		for (uint i = 0; i < rows; i++, r.nextRow(), rg.incRowCount()) {
+			if (i % RG_ROWS == 0) {
+				if (i > 0)
+					dl->insert(data);
+				data.reinit(rg, RG_ROWS);
+				rg.setData(&data);
+				rg.resetRowGroup(i);
+				rg.getRow(0, &r);
+			}
+			if (i % (smallSide ? 1000 : 11) == 0)
+				r.setIntField<8>(NULL_INT64, 0);
+			else
+				r.setIntField<8>(smallSide ? i / 2 : i % 15000, 0);
+			r.setIntField<8>(i, 1);
+		}
+		dl->insert(data);
+		dl->endOfInput();
+	}
+
+	/* Joins the two sides as jt and returns the rows it delivered.  With allowDisk
+	   the small side outgrows UmMaxMemorySmallSide; leaveMemory > 0 takes all but
+	   that much of the UM memory for the duration, so the partitions don't fit either. */
+	void runJoin(JoinType jt, bool allowDisk, int64_t leaveMemory, multiset<string> &rows)
+	{
+		const int64_t available = fRm->availableMemory();
+		RowGroup smallRG = makeRG(3000, 1), largeRG = makeRG(3010, 3), outputRG = makeOutputRG();
+		AnyDataListSPtr smallDL(new AnyDataList()), largeDL(new AnyDataList());
+		JobStepAssociation in;
+		ByteStream bs;
+		RGData data;
+		Row r;
+		uint rowCount;
+
+		config::Config::makeConfig()->setConfig("HashJoin", "AllowDiskBasedJoin",
+			(allowDisk ? "Y" : "N"));
+		if (leaveMemory > 0)
+			fRm->getMemory(available - leaveMemory);
+
+		rows.clear();
+		{
+			JobInfo jobInfo(*fRm);
+			jobInfo.status.reset(new ErrorInfo());
+			TupleHashJoinStep thjs(jobInfo);
+
+			smallDL->rowGroupDL(new RowGroupDL(1, 100));
+			largeDL->rowGroupDL(new RowGroupDL(1, 100));
+			fill(smallDL->rowGroupDL(), smallRG, SMALL_ROWS, true);
+			fill(largeDL->rowGroupDL(), largeRG, LARGE_ROWS, false);
+			in.outAdd(smallDL);
+			in.outAdd(largeDL);
+			thjs.inputAssociation(in);
+			thjs.delivery(true);
+
+			thjs.addSmallSideRG(vector<RowGroup>(1, smallRG), vector<string>(1, "small"));
+			thjs.configLargeSideRG(largeRG);
+			thjs.addJoinKeyIndex(vector<JoinType>(1, jt), vector<bool>(1, false),
+				vector<vector<uint> >(1, vector<uint>(1, 0)),
+				vector<vector<uint> >(1, vector<uint>(1, 0)));
+			thjs.setOutputRowGroup(outputRG);
+
+			thjs.run();
+			do {
+				bs.restart();
+				rowCount = thjs.nextBand(bs);
+				data.deserialize(bs, true);
+				outputRG.setData(&data);
+				outputRG.initRow(&r);
+				outputRG.getRow(0, &r);
+				for (uint i = 0; i < outputRG.getRowCount(); i++, r.nextRow())
+					rows.insert(r.toString());
+			} while (rowCount > 0);
+			thjs.join();
+
+			CPPUNIT_ASSERT(thjs.status() == 0);
+			CPPUNIT_ASSERT((thjs.extendedInfo().find("disk join") != string::npos) == allowDisk);
+		}
+
+		if (leaveMemory > 0)
+			fRm->returnMemory(available - leaveMemory);
+		// the join gave back everything it took, and left no files behind
+		CPPUNIT_ASSERT(fRm->availableMemory() == available);
+		CPPUNIT_ASSERT(tempFileCount() == 0);
+	}
+
+	/* The join in memory, through resident & spilled partitions, and with the
+	   partitions split up because not even those fit */
+	void checkJoin(JoinType jt)
+	{
+		multiset<string> inMemory, onDisk, split;
+
+		runJoin(jt, false, 0, inMemory);
+		CPPUNIT_ASSERT(!inMemory.empty());
+
+		runJoin(jt, true, 0, onDisk);
+		CPPUNIT_ASSERT(onDisk == inMemory);
+
+		runJoin(jt, true, 32 * 1024, split);
+		CPPUNIT_ASSERT(split == inMemory);
+	}
+
+	uint tempFileCount()
+	{
+		DIR *dir = opendir(fTempDir.c_str());
+		struct dirent *entry;
+		uint count = 0;
+
+		CPPUNIT_ASSERT(dir != NULL);
+		while ((entry = readdir(dir)) != NULL)
+			if (entry->d_name[0] != '.')
+				count++;
+		closedir(dir);
+		return count;
+	}
+
+public:
+	void setUp()
+	{
+		config::Config *cf = config::Config::makeConfig();
+		char dirTemplate[] = "/tmp/diskjoin-XXXXXX";
+
+		CPPUNIT_ASSERT(mkdtemp(dirTemplate) != NULL);
+		fTempDir = dirTemplate;
+		cf->setConfig("SystemConfig", "TempDiskPath", fTempDir);
+		cf->setConfig("HashJoin", "UmMaxMemorySmallSide", "262144");
+		cf->setConfig("HashJoin", "DiskJoinPartitions", "8");
+		fRm.reset(new ResourceManager());
+	}
+
+	void tearDown()
+	{
+		fRm.reset();
+		rmdir(fTempDir.c_str());
+	}
+
+	void innerJoin()
+	{
+		checkJoin(INNER);
+	}
+
+	void largeOuterJoin()
+	{
+		checkJoin(LARGEOUTER);
+	}
+
+	void smallOuterJoin()
+	{
+		checkJoin(SMALLOUTER);
+	}
+
+	void semiJoin()
+	{
+		checkJoin(SEMI);
+	}
+
+	void antiJoin()
+	{
+		checkJoin(ANTI);
+	}
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( DiskJoinTestSuite );
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
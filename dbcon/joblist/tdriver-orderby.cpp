@@ -0,0 +1,336 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+// $Id$
+
+/** @file tdriver-orderby.cpp
+ * Sorts rows with ExternalOrderBy, with most of the UM memory taken so the runs
+ * go to disk, and checks the order against a sort of the same rows in memory.
+ * The settings are changed in the loaded Calpont.xml only, so this needs one,
+ * like the other joblist drivers.
+ */
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+using namespace std;
+
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "configcpp.h"
+#include "jobstep.h"
+#include "jlf_common.h"
+#include "resourcemanager.h"
+#include "idborderby.h"
+#include "externalorderby.h"
+
+using namespace execplan;
+using namespace rowgroup;
+using namespace ordering;
+using namespace joblist;
+
+class ExternalOrderByTestSuite : public CppUnit::TestFixture
+{
+
+	CPPUNIT_TEST_SUITE( ExternalOrderByTestSuite );
+
+	CPPUNIT_TEST( intKey );
+	CPPUNIT_TEST( uintKey );
+	CPPUNIT_TEST( stringKey );
+	CPPUNIT_TEST( doubleKey );
+	CPPUNIT_TEST( floatKey );
+	CPPUNIT_TEST( limitAndOffset );
+
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	// 100 RowGroups, each its own run, so the merge has to merge runs first
+	static const uint ROWS = 50000;
+	static const uint RG_ROWS = 500;
+
+	enum { INT_COL, UINT_COL, STRING_COL, DOUBLE_COL, FLOAT_COL, ID_COL, COL_COUNT };
+
+	boost::scoped_ptr<ResourceManager> fRm;
+	string fTempDir;
+	RowGroup fRG;
+	vector<RGData> fInput;
+
+	struct PointerLess
+	{
+		PointerLess(OrderByData *o) : fOrderBy(o) { }
+		bool operator()(Row::Pointer a, Row::Pointer b) const { return (*fOrderBy)(a, b); }
+		OrderByData *fOrderBy;
+	};
+
+	/* BIGINT, UBIGINT, VARCHAR(32), DOUBLE, FLOAT, and a BIGINT row number */
+	RowGroup makeRG()
+	{
+		const uint widths[] = { 8, 8, 33, 8, 4, 8 };
+		const CalpontSystemCatalog::ColDataType colTypes[] = {
+			CalpontSystemCatalog::BIGINT, CalpontSystemCatalog::UBIGINT,
+			CalpontSystemCatalog::VARCHAR, CalpontSystemCatalog::DOUBLE,
+			CalpontSystemCatalog::FLOAT, CalpontSystemCatalog::BIGINT };
+		vector<uint> pos, oids, keys, scale(COL_COUNT, 0), precision(COL_COUNT, 19);
+		vector<CalpontSystemCatalog::ColDataType> types;
+
+		pos.push_back(2);
+		for (uint i = 0; i < COL_COUNT; i++) {
+			pos.push_back(pos.back() + widths[i]);
+			oids.push_back(3000 + i);
+			keys.push_back(i + 1);
+			types.push_back(colTypes[i]);
+		}
+		return RowGroup(COL_COUNT, pos, oids, keys, types, scale, precision, 20, false);
+	}
+
+	/* Lots of duplicates in every key, a NULL in every 17th row, negative and
+	   >2^63 numbers, -0.0 next to 0.0, and strings that only differ past the
+	   8 bytes ExternalOrderBy sorts on first */
+	void makeInput()
+	{
+		RGData data;
+		Row r;
+
+		fRG = makeRG();
+		fRG.initRow(&r);
+		for (uint i = 0; i < ROWS; i++, r.nextRow(), fRG.incRowCount()) {
+			if (i % RG_ROWS == 0) {
+				if (i > 0)
+					fInput.push_back(data);
+				data.reinit(fRG, RG_ROWS);
+				fRG.setData(&data);
+				fRG.resetRowGroup(i);
+				fRG.getRow(0, &r);
+			}
+
+			int64_t n = (int64_t) ((i * 7919) % 2001) - 1000;
+			ostringstream os;
+			if (i % 7 == 0)
+				os << (char) ('a' + (i * 13) % 26);
+			else
+				os << "customer-" << (i * 31) % 500;
+
+			r.setIntField<8>(n, INT_COL);
+			r.setUintField<8>((i % 5 == 0 ? 0xF000000000000000ULL : 0) + (i * 104729) % 3001,
+				UINT_COL);
+			r.setStringField(os.str(), STRING_COL);
+			r.setDoubleField((i % 101 == 0 ? -0.0 : n / 8.0), DOUBLE_COL);
+			r.setFloatField((float) n / 4, FLOAT_COL);
+			r.setIntField<8>(i, ID_COL);
+
+			if (i % 17 == 0) {
+				r.setIntField<8>(joblist::BIGINTNULL, INT_COL);
+				r.setUintField<8>(joblist::UBIGINTNULL, UINT_COL);
+				r.setStringField("", STRING_COL);
+				r.setUintField<8>(joblist::DOUBLENULL, DOUBLE_COL);
+				r.setUintField<4>(joblist::FLOATNULL, FLOAT_COL);
+			}
+		}
+		fInput.push_back(data);
+	}
+
+	/* The row numbers in ORDER BY col, row number order, sorted in memory */
+	vector<int64_t> sortInMemory(uint col, bool asc)
+	{
+		vector<IdbSortSpec> spec;
+		vector<Row::Pointer> rows;
+		vector<int64_t> ret;
+		RowGroup rg = fRG;
+		Row r;
+
+		spec.push_back(IdbSortSpec(col, asc));
+		spec.push_back(IdbSortSpec(ID_COL, true));
+		OrderByData orderBy(spec, rg);
+
+		rg.initRow(&r);
+		for (uint i = 0; i < fInput.size(); i++) {
+			rg.setData(&fInput[i]);
+			rg.getRow(0, &r);
+			for (uint j = 0; j < rg.getRowCount(); j++, r.nextRow())
+				rows.push_back(r.getPointer());
+		}
+		sort(rows.begin(), rows.end(), PointerLess(&orderBy));
+
+		for (uint i = 0; i < rows.size(); i++) {
+			r.setPointer(rows[i]);
+			ret.push_back(r.getIntField(ID_COL));
+		}
+		return ret;
+	}
+
+	/* The row numbers ExternalOrderBy returns.  leaveMemory > 0 makes every
+	   RowGroup its own run and takes all but that much of the UM memory while
+	   it runs, so only the first few runs stay in memory and there are too
+	   many to merge at once.  Otherwise it's all one run in memory. */
+	vector<int64_t> sortExternally(uint col, bool asc, uint64_t start, uint64_t count,
+		int64_t leaveMemory)
+	{
+		const int64_t available = fRm->availableMemory();
+		vector<int64_t> ret;
+		RowGroup rg = fRG;
+		RGData data;
+		Row r;
+
+		if (leaveMemory > 0)
+			fRm->getMemory(available - leaveMemory);
+		{
+			JobInfo jobInfo(*fRm);
+			jobInfo.orderByColVec.push_back(make_pair(fRG.getKeys()[col], asc));
+			jobInfo.orderByColVec.push_back(make_pair(fRG.getKeys()[ID_COL], true));
+			jobInfo.limitStart = start;
+			jobInfo.limitCount = count;
+
+			ExternalOrderBy orderBy;
+			orderBy.initialize(fRG, jobInfo);
+			if (leaveMemory > 0)
+				orderBy.fRunSize = 1;
+			for (uint i = 0; i < fInput.size(); i++)
+				orderBy.processRowGroup(fInput[i]);
+			orderBy.finalize();
+
+			rg.initRow(&r);
+			while (orderBy.getData(data)) {
+				rg.setData(&data);
+				rg.getRow(0, &r);
+				for (uint i = 0; i < rg.getRowCount(); i++, r.nextRow())
+					ret.push_back(r.getIntField(ID_COL));
+			}
+
+			CPPUNIT_ASSERT((orderBy.fRunsOnDisk > 0) == (leaveMemory > 0));
+		}
+
+		if (leaveMemory > 0)
+			fRm->returnMemory(available - leaveMemory);
+		// it gave back everything it took, and left no files behind
+		CPPUNIT_ASSERT(fRm->availableMemory() == available);
+		CPPUNIT_ASSERT(tempFileCount() == 0);
+		return ret;
+	}
+
+	/* Both directions, in memory and with 256KB of memory left */
+	void checkKey(uint col)
+	{
+		for (uint asc = 0; asc < 2; asc++) {
+			vector<int64_t> expected = sortInMemory(col, asc);
+
+			CPPUNIT_ASSERT(expected.size() == ROWS);
+			CPPUNIT_ASSERT(sortExternally(col, asc, 0, -1, 0) == expected);
+			CPPUNIT_ASSERT(sortExternally(col, asc, 0, -1, 256 * 1024) == expected);
+		}
+	}
+
+	uint tempFileCount()
+	{
+		DIR *dir = opendir(fTempDir.c_str());
+		struct dirent *entry;
+		uint count = 0;
+
+		CPPUNIT_ASSERT(dir != NULL);
+		while ((entry = readdir(dir)) != NULL)
+			if (entry->d_name[0] != '.')
+				count++;
+		closedir(dir);
+		return count;
+	}
+
+public:
+	void setUp()
+	{
+		config::Config *cf = config::Config::makeConfig();
+		char dirTemplate[] = "/tmp/orderby-XXXXXX";
+
+		CPPUNIT_ASSERT(mkdtemp(dirTemplate) != NULL);
+		fTempDir = dirTemplate;
+		cf->setConfig("SystemConfig", "TempDiskPath", fTempDir);
+		fRm.reset(new ResourceManager());
+		makeInput();
+	}
+
+	void tearDown()
+	{
+		fInput.clear();
+		fRm.reset();
+		rmdir(fTempDir.c_str());
+	}
+
+	void intKey()
+	{
+		checkKey(INT_COL);
+	}
+
+	void uintKey()
+	{
+		checkKey(UINT_COL);
+	}
+
+	void stringKey()
+	{
+		checkKey(STRING_COL);
+	}
+
+	void doubleKey()
+	{
+		checkKey(DOUBLE_COL);
+	}
+
+	void floatKey()
+	{
+		checkKey(FLOAT_COL);
+	}
+
+	/* The OFFSET and LIMIT cut the merged rows, wherever the runs they came
+	   from start and end */
+	void limitAndOffset()
+	{
+		const uint64_t limits[][2] = {
+			{ 0, 1 }, { 0, 777 }, { 1234, 5000 }, { ROWS - 10, 100 }, { ROWS, 10 }, { 100, 0 }
+		};
+		vector<int64_t> expected = sortInMemory(STRING_COL, false);
+
+		for (uint i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+			const uint64_t start = limits[i][0], count = limits[i][1];
+			vector<int64_t> cut(expected.begin() + min<uint64_t>(start, ROWS),
+				expected.begin() + min<uint64_t>(start + count, ROWS));
+
+			CPPUNIT_ASSERT(sortExternally(STRING_COL, false, start, count, 256 * 1024) == cut);
+		}
+	}
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( ExternalOrderByTestSuite );
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
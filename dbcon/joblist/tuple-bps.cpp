@@ -2505,6 +2505,19 @@ void TupleBPS::setAggregateStep(const rowgroup::SP_ROWAGG_PM_t& agg, const rowgr
 	}
 }
 
+bool TupleBPS::setTopN(const vector<ordering::IdbSortSpec> &spec, uint64_t limit)
+{
+	/* The PM sends its candidates as one RG at the end of each job, and it has to
+	 * produce the delivered RG itself. */
+	if (limit == 0 || limit > 8192 || doJoin || fAggregatorPm || (fe2 && !runFEonPM))
+		return false;
+
+	/* The candidates come from different blocks, so they can't carry rids */
+	fBPP->setTopN(spec, limit);
+	fBPP->setNeedRidsAtDelivery(false);
+	return true;
+}
+
 void TupleBPS::setBOP(uint8_t op)
 {
 	bop = op;
@@ -2849,6 +2862,11 @@ void TupleBPS::addCPPredicates(uint32_t OID, const vector<int64_t> &vals, bool i
 	}
 }
 
+void TupleBPS::addBloomFilter(boost::shared_ptr<joiner::JoinBloomFilter> bf)
+{
+	fBPP->addBloomFilter(bf);
+}
+
 void TupleBPS::dec(DistributedEngineComm* dec)
 {
 	if (fDec)
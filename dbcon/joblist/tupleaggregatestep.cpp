@@ -552,6 +552,33 @@ bool TupleAggregateStep::nextDeliveredRowGroup()
 }
 
 
+//------------------------------------------------------------------------------
+// Puts the next result of a group by without distinct in fRowGroupOut.  The
+// in-memory groups of all the buckets have been moved to fAggregator; the
+// groups a bucket had to spill to disk come after them.
+//------------------------------------------------------------------------------
+bool TupleAggregateStep::nextAggregatedRowGroup()
+{
+	if (fAggregator->nextRowGroup())
+	{
+		fAggregator->finalize();
+		return true;
+	}
+
+	for (; fBucketNum < fAggregators.size(); fBucketNum++)
+	{
+		if (fAggregators[fBucketNum]->nextSpilledRowGroup())
+		{
+			fAggregators[fBucketNum]->finalize();
+			fRowGroupOut.setData(fAggregators[fBucketNum]->getOutputRowGroup()->getRGData());
+			return true;
+		}
+	}
+	fBucketNum = 0;
+	return false;
+}
+
+
 uint TupleAggregateStep::nextBand(messageqcpp::ByteStream &bs)
 {
 	// use the orignal single thread model when no group by and distnct.
@@ -4274,6 +4301,16 @@ void TupleAggregateStep::threadedAggregateRowGroups(uint8_t threadID)
 								hashLens.push_back(fAggregator->aggMapKeyLength());
 						}
 
+						// a plain group by is delivered one RowGroup at a time, so the
+						// buckets can finish on disk if they outgrow memory
+						fAggregator->allowDiskAggregation(fRm.allowDiskAggregation() &&
+							dynamic_cast<RowAggregationDistinct*>(fAggregator.get()) == NULL &&
+							fAggregator->groupConcat().empty());
+
+						// every bucket spills to its own files, so they split the partitions
+						uint spillPartitions = fRm.aggSpillPartitions() / fNumOfBuckets;
+						fAggregator->spillPartitions((spillPartitions < 2) ? 2 : spillPartitions);
+
 						fRowGroupIns[threadID] = fRowGroupIn;
 						fRowGroupIns[threadID].initRow(&rowIn);
 						firstRead = false;
@@ -4283,8 +4320,18 @@ void TupleAggregateStep::threadedAggregateRowGroups(uint8_t threadID)
 					{
 						fRowGroupIns[threadID].setData(&rgData);
 						fMemUsage[threadID] += fRowGroupIns[threadID].getSizeWithStrings();
+						// these are given back after each batch.  When the buckets can
+						// spill, running out cuts the batch short instead of failing the
+						// query; with no memory left the buckets send the groups that
+						// don't fit to disk, and the batch's memory comes back.
 						if (!fRm.getMemory(fRowGroupIns[threadID].getSizeWithStrings()))
 						{
+							if (fAggregator->allowDiskAggregation())
+							{
+								rgDatas.push_back(rgData);
+								break;
+							}
+
 							rgDatas.clear();    // to short-cut the rest of processing
 							abort();
 							more = false;
@@ -4697,10 +4744,9 @@ uint64_t TupleAggregateStep::doThreadedAggregate(ByteStream& bs, RowGroupDL* dlp
 
 			bool done = true;
 			//@bug4459
-			while (fAggregator->nextRowGroup() && !cancelled())
+			while (nextAggregatedRowGroup() && !cancelled())
 			{
 				done = false;
-				fAggregator->finalize();
 				rowCount = fRowGroupOut.getRowCount();
 				fRowsReturned += rowCount;
 				fRowGroupDelivered.setData(fRowGroupOut.getRGData());
@@ -99,6 +99,7 @@ private:
 	void threadedAggregateRowGroups(uint8_t threadID);
 	void doThreadedSecondPhaseAggregate(uint8_t threadID);
 	bool nextDeliveredRowGroup();
+	bool nextAggregatedRowGroup();
 	void pruneAuxColumns();
 	void formatMiniStats();
 	void printCalTrace();
@@ -52,50 +52,80 @@ using namespace rowgroup;
 #include "stlpoolallocator.h"
 using namespace utils;
 
+#include "atomicops.h"
+
 #include "funcexp.h"
 #include "jobstep.h"
 #include "jlf_common.h"
+#include "primitivestep.h"
 #include "tupleconstantstep.h"
 #include "limitedorderby.h"
+#include "externalorderby.h"
 
 #include "tupleannexstep.h"
 
 namespace
 {
+// a row whose hash the parallel DISTINCT has already taken to pick its partition
+struct TAKnownHash {
+	TAKnownHash() : data(NULL), hash(0) { }
+	const uint8_t *data;
+	uint64_t hash;
+};
 struct TAHasher {
-	joblist::TupleAnnexStep *ts;
+	rowgroup::Row *row;
+	const TAKnownHash *known;
 	utils::Hasher_r h;
-	TAHasher(joblist::TupleAnnexStep *t) : ts(t) { }
+	TAHasher(rowgroup::Row *r, const TAKnownHash *k = NULL) : row(r), known(k) { }
 	uint64_t operator()(const rowgroup::Row::Pointer &) const;
 };
 struct TAEq {
-	joblist::TupleAnnexStep *ts;
-	TAEq(joblist::TupleAnnexStep *t) : ts(t) { }
+	rowgroup::Row *row1, *row2;
+	TAEq(rowgroup::Row *r1, rowgroup::Row *r2) : row1(r1), row2(r2) { }
 	bool operator()(const rowgroup::Row::Pointer &, const rowgroup::Row::Pointer &) const;
 };
 //TODO:  Generalize these and put them back in utils/common/hasher.h
 typedef tr1::unordered_set<rowgroup::Row::Pointer, TAHasher, TAEq,
 							STLPoolAllocator<rowgroup::Row::Pointer> > DistinctMap_t;
+
+// partitions per thread for the parallel DISTINCT, more partitions less waiting
+const uint DISTINCT_PARTITIONS_PER_THREAD = 4;
 };
 
 inline uint64_t TAHasher::operator()(const Row::Pointer &p) const
 {
-	Row &row = ts->row1;
-	row.setPointer(p);
-	return row.hash();
+	if (known && p.data == known->data)
+		return known->hash;
+
+	row->setPointer(p);
+	return row->hash();
 }
 
 inline bool TAEq::operator()(const Row::Pointer &d1, const Row::Pointer &d2) const
 {
-	Row &r1 = ts->row1, &r2 = ts->row2;
-	r1.setPointer(d1);
-	r2.setPointer(d2);
-	return r1.equals(r2);
+	row1->setPointer(d1);
+	row2->setPointer(d2);
+	return row1->equals(*row2);
 }
 
 namespace joblist
 {
 
+struct TupleAnnexStep::DistinctPartition
+{
+	DistinctPartition(const RowGroup& rg)
+	{
+		rg.initRow(&fRow1);
+		rg.initRow(&fRow2);
+		fMap.reset(new DistinctMap_t(10, TAHasher(&fRow1, &fKnown), TAEq(&fRow1, &fRow2)));
+	}
+
+	boost::mutex                fMutex;
+	Row                         fRow1, fRow2;    // scratch rows of fMap's hasher and equal
+	TAKnownHash                 fKnown;          // the row being inserted or erased
+	scoped_ptr<DistinctMap_t>   fMap;
+};
+
 TupleAnnexStep::TupleAnnexStep(const JobInfo& jobInfo) :
 		JobStep(jobInfo),
 		fInputDL(NULL),
@@ -110,6 +140,8 @@ TupleAnnexStep::TupleAnnexStep(const JobInfo& jobInfo) :
 		fEndOfResult(false),
 		fDistinct(false),
 		fOrderBy(NULL),
+		fSort(NULL),
+		fMoreInput(true),
 		fConstant(NULL),
 		fFeInstance(funcexp::FuncExp::instance()),
 		fJobList(jobInfo.jobListPtr)
@@ -124,6 +156,10 @@ TupleAnnexStep::~TupleAnnexStep()
 		delete fOrderBy;
 	fOrderBy = NULL;
 
+	if (fSort)
+		delete fSort;
+	fSort = NULL;
+
 	if (fConstant)
 		delete fConstant;
 	fConstant = NULL;
@@ -143,8 +179,36 @@ void TupleAnnexStep::initialize(const RowGroup& rgIn, const JobInfo& jobInfo)
 
 	if (fOrderBy)
 	{
-		fOrderBy->distinct(fDistinct);
-		fOrderBy->initialize(rgIn, jobInfo);
+		// A LIMIT whose rows would outgrow OrderByLimit/MaxMemory in the heap is
+		// done with a full sort that can go to disk.  DISTINCT needs the heap.
+		uint64_t limitRows = jobInfo.limitStart + jobInfo.limitCount;
+		if (!fDistinct && (limitRows < jobInfo.limitCount ||
+			limitRows > jobInfo.rm.getOrderByLimitMaxMemory() / rgIn.getRowSizeWithStrings()))
+		{
+			delete fOrderBy;
+			fOrderBy = NULL;
+			fSort = new ExternalOrderBy();
+			fSort->initialize(rgIn, jobInfo);
+		}
+		else
+		{
+			fOrderBy->distinct(fDistinct);
+			fOrderBy->initialize(rgIn, jobInfo);
+
+			// each input thread keeps the first start + count rows it sees
+			uint threads = 1;
+			if (limitRows >= jobInfo.limitCount)
+				threads = orderByThreads(limitRows, rgIn.getRowSizeWithStrings(),
+					jobInfo.rm.getOrderByLimitMaxMemory(), jobInfo.rm.numCores());
+			for (uint i = 0; threads > 1 && i < threads; i++)
+			{
+				shared_ptr<LimitedOrderBy> orderBy(new LimitedOrderBy());
+				orderBy->distinct(fDistinct);
+				orderBy->initialize(rgIn, jobInfo);
+				orderBy->setLimit(0, limitRows);
+				fOrderBys.push_back(orderBy);
+			}
+		}
 	}
 
 	if (fConstant == NULL)
@@ -174,6 +238,36 @@ void TupleAnnexStep::initialize(const RowGroup& rgIn, const JobInfo& jobInfo)
 
 	fRowGroupOut.initRow(&fRowOut);
 	fRowGroupDeliver = fRowGroupOut;
+
+	// DISTINCT without ORDER BY is done by the input threads
+	if (fDistinct && fOrderBy == NULL && fSort == NULL && jobInfo.rm.numCores() > 1)
+		fDistinctData.resize(jobInfo.rm.numCores());
+}
+
+
+uint TupleAnnexStep::orderByThreads(uint64_t limitRows, uint64_t rowSize, uint64_t maxMemory,
+	uint cores)
+{
+	if (limitRows == 0 || rowSize == 0)
+		return 1;
+
+	// one heap goes to fOrderBy, it takes at least two threads to be worth it
+	uint64_t heaps = maxMemory / rowSize / limitRows;
+	if (heaps < 3 || cores < 2)
+		return 1;
+
+	return (heaps - 1 < cores) ? (uint) (heaps - 1) : cores;
+}
+
+
+bool TupleAnnexStep::setPmTopN(JobStep* step)
+{
+	// the PM keeps its own top rows per job; this step still does the real ORDER BY & LIMIT
+	TupleBPS* bps = dynamic_cast<TupleBPS*>(step);
+	if (bps == NULL || fOrderBy == NULL || fDistinct)
+		return false;
+
+	return bps->setTopN(fOrderBy->getOrderByCond(), fOrderBy->getLimit());
 }
 
 
@@ -282,8 +376,10 @@ uint TupleAnnexStep::nextBand(messageqcpp::ByteStream &bs)
 
 void TupleAnnexStep::execute()
 {
-	if (fOrderBy)
+	if (fOrderBy || fSort)
 		executeWithOrderBy();
+	else if (fDistinct && fDistinctData.size() > 0)
+		executeNoOrderByWithParallelDistinct();
 	else if (fDistinct)
 		executeNoOrderByWithDistinct();
 	else
@@ -380,7 +476,7 @@ void TupleAnnexStep::executeNoOrderBy()
 
 void TupleAnnexStep::executeNoOrderByWithDistinct()
 {
-	scoped_ptr<DistinctMap_t> distinctMap(new DistinctMap_t(10, TAHasher(this), TAEq(this)));
+	scoped_ptr<DistinctMap_t> distinctMap(new DistinctMap_t(10, TAHasher(&row1), TAEq(&row1, &row2)));
 	vector<RGData> dataVec;
 	RGData rgDataIn;
 	RGData rgDataOut;
@@ -478,6 +574,187 @@ void TupleAnnexStep::executeNoOrderByWithDistinct()
 }
 
 
+void TupleAnnexStep::executeNoOrderByWithParallelDistinct()
+{
+	RGData rgDataIn;
+	bool more = false;
+
+	try
+	{
+		// the output rowgroup is final now, string table or not
+		for (uint i = 0; i < fDistinctData.size() * DISTINCT_PARTITIONS_PER_THREAD; i++)
+			fDistinctPartitions.push_back(
+				shared_ptr<DistinctPartition>(new DistinctPartition(fRowGroupOut)));
+
+		vector<shared_ptr<thread> > runners;
+		for (uint i = 0; i < fDistinctData.size(); i++)
+			runners.push_back(shared_ptr<thread>(new thread(DistinctRunner(this, i))));
+
+		for (uint i = 0; i < runners.size(); i++)
+			runners[i]->join();
+
+		more = fMoreInput;
+	}
+	catch(const std::exception& ex)
+	{
+		catchHandler(ex.what(), fSessionId);
+		if (status() == 0)
+			status(ERR_IN_PROCESS);
+	}
+	catch(...)
+	{
+		catchHandler("TupleAnnexStep execute caught an unknown exception", fSessionId);
+		if (status() == 0)
+			status(ERR_IN_PROCESS);
+	}
+
+	while (more)
+		more = fInputDL->next(fInputIterator, &rgDataIn);
+
+	// the rows are delivered, release the sets
+	fDistinctPartitions.clear();
+	fDistinctData.clear();
+
+	if (traceOn() && !fDelivery)
+	{
+		dlTimes.setLastReadTime();
+		dlTimes.setEndOfInputTime();
+		printCalTrace();
+	}
+
+	// Bug 3136, let mini stats to be formatted if traceOn.
+	fOutputDL->endOfInput();
+}
+
+
+void TupleAnnexStep::executeParallelDistinct(uint threadID)
+{
+	RGData rgDataIn;
+	RGData rgDataOut;
+	RowGroup rowGroupIn = fRowGroupIn;
+	RowGroup rowGroupOut = fRowGroupOut;
+	Row rowIn;
+	Row rowOut;
+	vector<RGData>& dataVec = fDistinctData[threadID];
+	uint64_t rowsProcessed = 0;
+
+	rowGroupIn.initRow(&rowIn);
+	rowGroupOut.initRow(&rowOut);
+	rgDataOut.reinit(rowGroupOut);
+	rowGroupOut.setData(&rgDataOut);
+	rowGroupOut.resetRowGroup(0);
+	rowGroupOut.getRow(0, &rowOut);
+
+	try
+	{
+		while (!cancelled() && !fLimitHit)
+		{
+			{
+				mutex::scoped_lock lk(fInputMutex);
+				if (fMoreInput)
+					fMoreInput = fInputDL->next(fInputIterator, &rgDataIn);
+				if (traceOn() && dlTimes.FirstReadTime().tv_sec == 0)
+					dlTimes.setFirstReadTime();
+				if (!fMoreInput)
+					break;
+			}
+
+			rowGroupIn.setData(&rgDataIn);
+			rowGroupIn.getRow(0, &rowIn);
+
+			for (uint64_t i = 0; i < rowGroupIn.getRowCount() && !cancelled() && !fLimitHit; ++i)
+			{
+				if (fConstant)
+					fConstant->fillInConstants(rowIn, rowOut);
+				else
+					copyRow(rowIn, &rowOut);
+
+				++rowsProcessed;
+				rowIn.nextRow();
+
+				// the partition's hasher reuses the hash that picked the partition
+				uint64_t hash = rowOut.hash();
+				DistinctPartition& part = *fDistinctPartitions[hash % fDistinctPartitions.size()];
+				bool inserted = false;
+				{
+					mutex::scoped_lock lk(part.fMutex);
+					part.fKnown.data = rowOut.getPointer().data;
+					part.fKnown.hash = hash;
+					inserted = part.fMap->insert(rowOut.getPointer()).second;
+					part.fKnown.data = NULL;
+				}
+
+				if (!inserted)
+					continue;
+
+				// the row is new, return it if it's within the limit
+				uint64_t rowsReturned = atomicops::atomicInc(&fRowsReturned);
+				if (UNLIKELY(rowsReturned > fLimitCount))
+				{
+					// another thread filled the limit first, the row isn't returned so
+					// take it back out of the set before its slot gets reused
+					atomicops::atomicDec(&fRowsReturned);
+					{
+						mutex::scoped_lock lk(part.fMutex);
+						part.fKnown.data = rowOut.getPointer().data;
+						part.fKnown.hash = hash;
+						part.fMap->erase(rowOut.getPointer());
+						part.fKnown.data = NULL;
+					}
+					atomicops::atomicCAS<uint32_t>(&fLimitHit, 0, 1);
+					break;
+				}
+
+				rowGroupOut.incRowCount();
+				rowOut.nextRow();
+				if (UNLIKELY(rowsReturned == fLimitCount))
+				{
+					atomicops::atomicCAS<uint32_t>(&fLimitHit, 0, 1);
+					fJobList->abortOnLimit((JobStep*) this);
+				}
+
+				if (UNLIKELY(rowGroupOut.getRowCount() >= 8192))
+				{
+					dataVec.push_back(rgDataOut);
+					{
+						mutex::scoped_lock lk(fOutputMutex);
+						fOutputDL->insert(rgDataOut);
+					}
+
+					rgDataOut.reinit(rowGroupOut);
+					rowGroupOut.setData(&rgDataOut);
+					rowGroupOut.resetRowGroup(0);
+					rowGroupOut.getRow(0, &rowOut);
+				}
+			}
+		}
+
+		if (rowGroupOut.getRowCount() > 0)
+		{
+			mutex::scoped_lock lk(fOutputMutex);
+			fOutputDL->insert(rgDataOut);
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		catchHandler(ex.what(), fSessionId);
+		if (status() == 0)
+			status(ERR_IN_PROCESS);
+	}
+	catch(...)
+	{
+		catchHandler("TupleAnnexStep execute caught an unknown exception", fSessionId);
+		if (status() == 0)
+			status(ERR_IN_PROCESS);
+	}
+
+	// the sets can still point into rgDataOut while the other threads run, even when
+	// none of its rows were returned, so it has to outlive them
+	dataVec.push_back(rgDataOut);
+	atomicops::atomicAdd(&fRowsProcessed, rowsProcessed);
+}
+
+
 void TupleAnnexStep::executeWithOrderBy()
 {
 	RGData rgDataIn;
@@ -486,15 +763,50 @@ void TupleAnnexStep::executeWithOrderBy()
 
 	try
 	{
-		more = fInputDL->next(fInputIterator, &rgDataIn);
-		if (traceOn()) dlTimes.setFirstReadTime();
+		if (fOrderBys.size() > 0)
+		{
+			vector<shared_ptr<thread> > runners;
+			for (uint i = 0; i < fOrderBys.size(); i++)
+				runners.push_back(shared_ptr<thread>(new thread(OrderByRunner(this, i))));
+
+			for (uint i = 0; i < runners.size(); i++)
+				runners[i]->join();
+
+			more = fMoreInput;
+
+			// the result is in the top rows of the threads
+			for (uint i = 0; i < fOrderBys.size() && !cancelled(); i++)
+			{
+				fOrderBys[i]->finalize();
+				while (fOrderBys[i]->getData(rgDataIn) && !cancelled())
+				{
+					fRowGroupIn.setData(&rgDataIn);
+					fRowGroupIn.getRow(0, &fRowIn);
+					for (uint64_t j = 0; j < fRowGroupIn.getRowCount(); ++j)
+					{
+						fOrderBy->processRow(fRowIn);
+						fRowIn.nextRow();
+					}
+				}
+
+				fOrderBys[i].reset();
+			}
+		}
+		else
+		{
+			more = fInputDL->next(fInputIterator, &rgDataIn);
+			if (traceOn()) dlTimes.setFirstReadTime();
+		}
 
 		while (more && !cancelled())
 		{
 			fRowGroupIn.setData(&rgDataIn);
 			fRowGroupIn.getRow(0, &fRowIn);
 
-			for (uint64_t i = 0; i < fRowGroupIn.getRowCount() && !cancelled(); ++i)
+			if (fSort)
+				fSort->processRowGroup(rgDataIn);
+
+			for (uint64_t i = 0; i < fRowGroupIn.getRowCount() && fOrderBy && !cancelled(); ++i)
 			{
 				fOrderBy->processRow(fRowIn);
 				fRowIn.nextRow();
@@ -503,11 +815,14 @@ void TupleAnnexStep::executeWithOrderBy()
 			more = fInputDL->next(fInputIterator, &rgDataIn);
 		}
 
-		fOrderBy->finalize();
+		if (fOrderBy)
+			fOrderBy->finalize();
+		else if (!cancelled())
+			fSort->finalize();
 
 		if (!cancelled())
 		{
-			while (fOrderBy->getData(rgDataIn))
+			while (fOrderBy ? fOrderBy->getData(rgDataIn) : fSort->getData(rgDataIn))
 			{
 				if (fConstant == NULL &&
 					fRowGroupOut.getColumnCount() == fRowGroupIn.getColumnCount())
@@ -575,6 +890,52 @@ void TupleAnnexStep::executeWithOrderBy()
 }
 
 
+void TupleAnnexStep::executeParallelOrderBy(uint threadID)
+{
+	RGData rgDataIn;
+	RowGroup rowGroupIn = fRowGroupIn;
+	Row rowIn;
+	rowGroupIn.initRow(&rowIn);
+	LimitedOrderBy* orderBy = fOrderBys[threadID].get();
+
+	try
+	{
+		while (!cancelled())
+		{
+			{
+				mutex::scoped_lock lk(fInputMutex);
+				if (fMoreInput)
+					fMoreInput = fInputDL->next(fInputIterator, &rgDataIn);
+				if (traceOn() && dlTimes.FirstReadTime().tv_sec == 0)
+					dlTimes.setFirstReadTime();
+				if (!fMoreInput)
+					break;
+			}
+
+			rowGroupIn.setData(&rgDataIn);
+			rowGroupIn.getRow(0, &rowIn);
+			for (uint64_t i = 0; i < rowGroupIn.getRowCount() && !cancelled(); ++i)
+			{
+				orderBy->processRow(rowIn);
+				rowIn.nextRow();
+			}
+		}
+	}
+	catch(const std::exception& ex)
+	{
+		catchHandler(ex.what(), fSessionId);
+		if (status() == 0)
+			status(ERR_IN_PROCESS);
+	}
+	catch(...)
+	{
+		catchHandler("TupleAnnexStep execute caught an unknown exception", fSessionId);
+		if (status() == 0)
+			status(ERR_IN_PROCESS);
+	}
+}
+
+
 const RowGroup& TupleAnnexStep::getOutputRowGroup() const
 {
 	return fRowGroupOut;
@@ -616,6 +977,8 @@ const string TupleAnnexStep::toString() const
 
 	if (fOrderBy)
 		oss << "    " << fOrderBy->toString();
+	if (fSort)
+		oss << "    " << fSort->toString();
 	if (fConstant)
 		oss << "    " << fConstant->toString();
 	oss << endl;
@@ -25,6 +25,8 @@
 
 
 // forward reference
+class TupleAnnexTestSuite;
+
 namespace fucexp
 {
 class FuncExp;
@@ -35,6 +37,7 @@ namespace joblist
 {
 class TupleConstantStep;
 class LimitedOrderBy;
+class ExternalOrderBy;
 }
 
 
@@ -77,16 +80,29 @@ public:
 	void addConstant(TupleConstantStep* tcs) { fConstant = tcs; }
 	void setDistinct()                       { fDistinct = true; }
 	void setLimit(uint64_t s, uint64_t c)    { fLimitStart = s; fLimitCount = c; }
+	bool setPmTopN(JobStep* step);
+
+	/** @brief How many input threads can keep their own top-N heap
+	 *
+	 * Each thread's heap and the final one can hold limitRows rows, and all of them
+	 * have to fit in maxMemory.  Returns 1 when the serial path should be used.
+	 */
+	static uint orderByThreads(uint64_t limitRows, uint64_t rowSize, uint64_t maxMemory, uint cores);
 	
 	virtual bool stringTableFriendly() { return true; }
 	
 	rowgroup::Row row1, row2;  // scratch space for distinct comparisons todo: make them private
 
+	friend class ::TupleAnnexTestSuite;
+
 protected:
 	void execute();
 	void executeNoOrderBy();
 	void executeWithOrderBy();
 	void executeNoOrderByWithDistinct();
+	void executeParallelOrderBy(uint threadID);
+	void executeNoOrderByWithParallelDistinct();
+	void executeParallelDistinct(uint threadID);
 	void formatMiniStats();
 	void printCalTrace();
 
@@ -113,15 +129,49 @@ protected:
 	};
 	boost::scoped_ptr<boost::thread> fRunner;
 
+	class OrderByRunner
+	{
+	public:
+		OrderByRunner(TupleAnnexStep* step, uint threadID) : fStep(step), fThreadID(threadID) { }
+		void operator()() { fStep->executeParallelOrderBy(fThreadID); }
+
+		TupleAnnexStep*     fStep;
+		uint                fThreadID;
+	};
+
+	class DistinctRunner
+	{
+	public:
+		DistinctRunner(TupleAnnexStep* step, uint threadID) : fStep(step), fThreadID(threadID) { }
+		void operator()() { fStep->executeParallelDistinct(fThreadID); }
+
+		TupleAnnexStep*     fStep;
+		uint                fThreadID;
+	};
+
 	uint64_t                fRowsProcessed;
 	uint64_t                fRowsReturned;
 	uint64_t                fLimitStart;
 	uint64_t                fLimitCount;
-	bool                    fLimitHit;
+	volatile uint32_t       fLimitHit;  // set by any of the DISTINCT threads
 	bool                    fEndOfResult;
 	bool                    fDistinct;
 
 	LimitedOrderBy*         fOrderBy;
+	ExternalOrderBy*        fSort;      // replaces fOrderBy when its heap would be too big
+
+	// top-N heaps of the input threads, fOrderBy picks the result from their rows
+	std::vector<boost::shared_ptr<LimitedOrderBy> > fOrderBys;
+	boost::mutex            fInputMutex;
+	bool                    fMoreInput;
+
+	// DISTINCT without ORDER BY on the input threads: a row is checked in the
+	// partition its hash picks, and the rows the partitions point to are kept
+	// in the RowGroups of the thread that found them.
+	struct DistinctPartition;
+	std::vector<boost::shared_ptr<DistinctPartition> > fDistinctPartitions;
+	std::vector<std::vector<rowgroup::RGData> > fDistinctData;
+	boost::mutex            fOutputMutex;
 	TupleConstantStep*      fConstant;
 
 	funcexp::FuncExp*       fFeInstance;
@@ -51,6 +51,12 @@ using namespace funcexp;
 
 #include "atomicops.h"
 
+namespace
+{
+// how many times a disk join partition gets split before the join gives up
+const uint MAX_DISK_JOIN_LEVEL = 4;
+}
+
 namespace joblist
 {
 
@@ -77,6 +83,10 @@ TupleHashJoinStep::TupleHashJoinStep(const JobInfo& jobInfo) :
 	joinIsTooBig(false),
 	isExeMgr(jobInfo.isExeMgr),
 	lastSmallOuterJoiner(-1),
+	diskJoinIndex(-1),
+	diskJoinMemUsage(0),
+	spillLargeSide(false),
+	largeInputFile(NULL),
 	fStatsMutexPtr(new boost::mutex())
 {
 	/* Need to figure out how much memory these use...
@@ -86,6 +96,13 @@ TupleHashJoinStep::TupleHashJoinStep(const JobInfo& jobInfo) :
 
 	pmMemLimit = resourceManager.getHjPmMaxMemorySmallSide(fSessionId);
 	uniqueLimit = resourceManager.getHjCPUniqueLimit();
+	bloomFilterMaxSize = resourceManager.getHjRuntimeFilterMaxSize();
+	umMemLimit = resourceManager.getHjUmMaxMemorySmallSide(fSessionId);
+	allowDiskJoin = resourceManager.getHjAllowDiskJoin();
+	diskJoinPartitionCount = resourceManager.getHjDiskJoinPartitions();
+	if (diskJoinPartitionCount == 0)
+		diskJoinPartitionCount = 1;
+	tempDiskPath = resourceManager.getScTempDiskPath();
 
 	fExtendedInfo = "THJS: ";
 	joinType = INIT;
@@ -132,6 +149,12 @@ void TupleHashJoinStep::run()
 		outputDL = new RowGroupDL(1, 5);
 		outputIt = outputDL->getIterator();
 	}
+	else {
+		/* largeBPS writes the joined rows to the large side DL.  A disk join replaces
+		 * the one largeBPS writes to, so nextBand() keeps its own reference. */
+		outputDL = largeDL;
+		outputIt = largeIt;
+	}
 
 	joiners.resize(smallDLs.size());
 	mainRunner.reset(new boost::thread(HJRunner(this)));
@@ -152,7 +175,7 @@ void TupleHashJoinStep::join()
 /* Index is which small input to read. */
 void TupleHashJoinStep::smallRunnerFcn(uint index)
 {
-	uint64_t i;
+	uint64_t i, memUsage, rowCount = 0, residentBudget = 0, bytesPerRow = 0;
 	bool more, flippedUMSwitch = false, gotMem;
 	RGData oneRG;
 	//shared_array<uint8_t> oneRG;
@@ -173,16 +196,7 @@ void TupleHashJoinStep::smallRunnerFcn(uint index)
 
 	//cout << "    smallRunner " << index << " sees jointype " << jt << " joinTypes has " << joinTypes.size()
 	//	<< " elements" << endl;
-	if (typelessJoin[index]) {
-		joiner.reset(new TupleJoiner(smallRG, largeRG, smallSideKeys[index],
-			largeSideKeys[index], jt));
-	}
-	else {
-		joiner.reset(new TupleJoiner(smallRG, largeRG, smallSideKeys[index][0],
-			largeSideKeys[index][0], jt));
-	}
-	joiner->setUniqueLimit(uniqueLimit);
-	joiner->setTableName(smallTableNames[index]);
+	joiner = makeJoiner(index);
 	joiners[index] = joiner;
 
 	/*
@@ -210,6 +224,7 @@ void TupleHashJoinStep::smallRunnerFcn(uint index)
 
 	resourceManager.getMemory(joiner->getMemUsage());
 	(void)atomicops::atomicAdd(&totalUMMemoryUsage, joiner->getMemUsage());
+	memUsage = joiner->getMemUsage();
 
 	while (more && !cancelled()) {
 		uint64_t memUseBefore, memUseAfter;
@@ -220,6 +235,12 @@ void TupleHashJoinStep::smallRunnerFcn(uint index)
 
 		smallRG.getRow(0, &r);
 
+		if (diskJoinIndex == index) {
+			for (i = 0; i < smallRG.getRowCount(); i++, r.nextRow())
+				diskJoinSmall->insert(r, diskJoinPartition(joiner->getSmallKeyHash(r), 0));
+			goto next;
+		}
+
 		memUseBefore = joiner->getMemUsage() + rgDataSize;
 
 		// TupleHJ owns the row memory
@@ -244,8 +265,22 @@ void TupleHashJoinStep::smallRunnerFcn(uint index)
 
 		gotMem = resourceManager.getMemory(memUseAfter - memUseBefore);
 		atomicops::atomicAdd(&totalUMMemoryUsage, memUseAfter - memUseBefore);
+		memUsage += memUseAfter - memUseBefore;
+		rowCount += smallRG.getRowCount();
+		if (UNLIKELY(!gotMem || (allowDiskJoin && memUsage > umMemLimit))) {
+			/* Use what fit to guess how many partitions can stay in memory */
+			if (startDiskJoin(index, joiner, memUsage)) {
+				flippedUMSwitch = true;
+				residentBudget = memUsage / 2;
+				bytesPerRow = memUsage / rowCount + 1;
+				oss.str("");
+				oss << "disk join (" << index << ") ";
+				extendedInfo += oss.str();
+				goto next;
+			}
+		}
 		if (UNLIKELY(!gotMem)) {
-			/* bail out until we get an LHJ impl */
+			/* bail out, this one can't go to disk */
 			fLogger->logMessage(logging::LOG_TYPE_INFO, logging::ERR_JOIN_TOO_BIG);
 			status(logging::ERR_JOIN_TOO_BIG);
 			errorMessage(logging::IDBErrorInfo::instance()->errorMsg(logging::ERR_JOIN_TOO_BIG));
@@ -262,6 +297,11 @@ next:
 		more = smallDL->next(smallIt, &oneRG);
 	}
 
+	if (diskJoinIndex == index && !cancelled()) {
+		diskJoinSmall->flush();
+		loadResidentPartitions(index, joiner, residentBudget, bytesPerRow);
+	}
+
 	if (!flippedUMSwitch && !cancelled()) {
 		oss << "PM join (" << index << ")";
 #ifdef JLF_DEBUG
@@ -289,6 +329,23 @@ next:
 	formatMiniStats(index);
 }
 
+shared_ptr<TupleJoiner> TupleHashJoinStep::makeJoiner(uint index)
+{
+	shared_ptr<TupleJoiner> joiner;
+
+	if (typelessJoin[index]) {
+		joiner.reset(new TupleJoiner(smallRGs[index], largeRG, smallSideKeys[index],
+			largeSideKeys[index], joinTypes[index]));
+	}
+	else {
+		joiner.reset(new TupleJoiner(smallRGs[index], largeRG, smallSideKeys[index][0],
+			largeSideKeys[index][0], joinTypes[index]));
+	}
+	joiner->setUniqueLimit(uniqueLimit);
+	joiner->setTableName(smallTableNames[index]);
+	return joiner;
+}
+
 void TupleHashJoinStep::forwardCPData()
 {
 	uint i, col;
@@ -299,6 +356,9 @@ void TupleHashJoinStep::forwardCPData()
 	for (i = 0; i < joiners.size(); i++) {
 		if (joiners[i]->antiJoin() || joiners[i]->largeOuterJoin())
 			continue;
+		// only some of its rows are in memory
+		if (i == diskJoinIndex)
+			continue;
 
 		for (col = 0; col < joiners[i]->getSmallKeyColumns().size(); col++) {
 			if (smallRGs[i].isLongString(joiners[i]->getSmallKeyColumns()[col]))
@@ -309,9 +369,29 @@ void TupleHashJoinStep::forwardCPData()
 	}
 }
 
+/* The filters go out with the large side's BPP, so this has to run after the
+ * joiners are placed and before largeBPS is started. */
+void TupleHashJoinStep::forwardBloomFilters()
+{
+	uint i;
+	boost::shared_ptr<JoinBloomFilter> bf;
+
+	if (largeBPS == NULL || bloomFilterMaxSize == 0)
+		return;
+
+	for (i = 0; i < joiners.size(); i++) {
+		if (i == diskJoinIndex)
+			continue;
+		bf = joiners[i]->makeBloomFilter(bloomFilterMaxSize);
+		if (bf)
+			largeBPS->addBloomFilter(bf);
+	}
+}
+
 void TupleHashJoinStep::hjRunner()
 {
 	uint i;
+	bool diskJoin;
 
 	if (cancelled()) {
 		if (fOutputJobStepAssociation.outSize() > 0)
@@ -379,8 +459,14 @@ void TupleHashJoinStep::hjRunner()
 	for (uint i = 0; i < feIndexes.size() && joiners.size() > 0; i++)
 		joiners[feIndexes[i]]->setFcnExpFilter(fe[i]);
 
+	/* A disk join runs all of the joins here, on the large side's unjoined rows */
+	diskJoin = (diskJoinIndex != (uint32_t) -1 && !cancelled());
+	for (i = 0; diskJoin && i < joiners.size(); i++)
+		if (joiners[i]->inPM())
+			joiners[i]->setInUM();
+
 	// decide if perform aggregation on PM
-	if (dynamic_cast<TupleAggregateStep*>(fDeliveryStep.get()) != NULL && largeBPS)
+	if (dynamic_cast<TupleAggregateStep*>(fDeliveryStep.get()) != NULL && largeBPS && !diskJoin)
 	{
 		bool pmAggregation = !(dynamic_cast<TupleAggregateStep*>(fDeliveryStep.get())->umOnly());
 		for (i = 0; i < joiners.size() && pmAggregation; ++i)
@@ -392,10 +478,11 @@ void TupleHashJoinStep::hjRunner()
 	// can we sort the joiners?  Currently they all have to be inner joins.
 	// Note, any vars that used to parallel the joiners list will be invalidated
 	// (ie. smallTableNames)
+	// A disk join keeps them in place; diskJoinIndex refers to that order.
 	for (i = 0; i < joiners.size(); i++)
 		if (!joiners[i]->innerJoin())
 			break;
-	if (i == joiners.size())
+	if (i == joiners.size() && !diskJoin)
 		sort(joiners.begin(), joiners.end(), JoinerSorter());
 
 	/* Each thread independently decides whether a given join can execute on the PM.
@@ -413,7 +500,8 @@ void TupleHashJoinStep::hjRunner()
 		}
 	}
 
-	if (largeBPS) {
+	if (largeBPS && !diskJoin) {
+		forwardBloomFilters();
 		largeBPS->useJoiners(joiners);
 		largeBPS->setJoinedResultRG(outputRG);
 		if (!feIndexes.empty())
@@ -455,6 +543,26 @@ void TupleHashJoinStep::hjRunner()
 		}
 		startAdjoiningSteps();
 	}
+	else if (largeBPS) {
+		/* largeBPS sends its rows unjoined to a DL of our own, the join threads
+		 * write the results where largeBPS would have. */
+		JobStepAssociation newJsa;
+		AnyDataListSPtr spdl(new AnyDataList());
+		RowGroupDL *dl = new RowGroupDL(1, resourceManager.getJlFifoSize());
+		spdl->rowGroupDL(dl);
+		dl->OID(largeDL->OID());
+		newJsa.outAdd(spdl);
+		for (unsigned i = 1; i < largeBPS->outputAssociation().outSize(); i++)
+			newJsa.outAdd(largeBPS->outputAssociation().outAt(i));
+		largeBPS->outputAssociation(newJsa);
+		diskJoinLargeDL = spdl;
+		largeDL = dl;
+		largeIt = largeDL->getIterator();
+
+		forwardBloomFilters();
+		startAdjoiningSteps();
+		startJoinThreads();
+	}
 	else
 		startJoinThreads();
 }
@@ -464,8 +572,8 @@ uint TupleHashJoinStep::nextBand(messageqcpp::ByteStream &bs)
 	RGData oneRG;
 	bool more;
 	uint ret = 0;
-	RowGroupDL *dl;
-	uint64_t it;
+	RowGroupDL *dl = outputDL;
+	uint64_t it = outputIt;
 
 	idbassert(fDelivery);
 
@@ -475,15 +583,6 @@ uint TupleHashJoinStep::nextBand(messageqcpp::ByteStream &bs)
 	else
 		deliveredRG = &outputRG;
 
-	if (largeBPS) {
-		dl = largeDL;
-		it = largeIt;
-	}
-	else {
-		dl = outputDL;
-		it = outputIt;
-	}
-
 	while (ret == 0) {
 		if (cancelled()) {
 			oneRG.reinit(*deliveredRG, 0);
@@ -784,19 +883,40 @@ void TupleHashJoinStep::startJoinThreads()
 
 	makeDupList(fe2 ? fe2Output : outputRG);
 
+	if (diskJoinIndex != (uint32_t) -1) {
+		diskJoinLarge.reset(new RowGroupPartitioner(largeRG, diskJoinPartitionCount,
+		  tempDiskPath, "Join"));
+		spillLargeSide = true;
+	}
+
+	runJoinThreads();
+
+	if (diskJoinIndex != (uint32_t) -1) {
+		spillLargeSide = false;
+		diskJoinLarge->flush();
+		if (lastSmallOuterJoiner == diskJoinIndex && !cancelled())
+			finishSmallOuterJoin();
+		joinSpilledPartitions();
+	}
+
+	if (lastSmallOuterJoiner != (uint) -1 && lastSmallOuterJoiner != diskJoinIndex)
+		finishSmallOuterJoin();
+
+	outputDL->endOfInput();
+}
+
+void TupleHashJoinStep::runJoinThreads()
+{
+	uint i;
+
 	/* Start join runners */
 	joinRunners.reset(new shared_ptr<boost::thread>[joinThreadCount]);
 	for (i = 0; i < joinThreadCount; i++)
 		joinRunners[i].reset(new boost::thread(JoinRunner(this, i)));
 
-	/* Join them and call endOfInput */
+	/* Join them */
 	for (i = 0; i < joinThreadCount; i++)
 		joinRunners[i]->join();
-
-	if (lastSmallOuterJoiner != (uint) -1)
-		finishSmallOuterJoin();
-
-	outputDL->endOfInput();
 }
 
 void TupleHashJoinStep::finishSmallOuterJoin()
@@ -884,6 +1004,7 @@ void TupleHashJoinStep::joinRunnerFcn(uint threadID)
 	RowGroup local_inputRG, local_outputRG, local_joinFERG;
 	uint smallSideCount = smallDLs.size();
 	vector<RGData> inputData, joinedRowData;
+	RGData residentData;
 	bool hasJoinFE = !fe.empty();
 	uint i;
 
@@ -933,6 +1054,13 @@ void TupleHashJoinStep::joinRunnerFcn(uint threadID)
 			if (local_inputRG.getRowCount() == 0)
 				continue;
 
+			if (spillLargeSide) {
+				spillLargeRows(local_inputRG, largeRow, &residentData);
+				local_inputRG.setData(&residentData);
+				if (local_inputRG.getRowCount() == 0)
+					continue;
+			}
+
 			joinOneRG(threadID, &joinedRowData, local_inputRG, local_outputRG, largeRow,
 			  joinFERow, joinedRow, baseRow, joinMatches, smallRowTemplates);
 		}
@@ -1035,6 +1163,12 @@ void TupleHashJoinStep::grabSomeWork(vector<RGData> *work)
 		return;
 
 	RGData e;
+	if (largeInputFile) {
+		for (uint i = 0; i < 10 && (moreInput = largeInputFile->read(e)); i++)
+			work->push_back(e);
+		return;
+	}
+
 	moreInput = largeDL->next(largeIt, &e);
 	/* Tunable number here, but it probably won't change things much */
 	for (uint i = 0; i < 10 && moreInput; i++) {
@@ -1185,5 +1319,278 @@ void TupleHashJoinStep::generateJoinResultSet(const vector<vector<Row::Pointer>
 }
 
 
+/* Disk join.  Only one small side per step can go to disk.  NOT IN joins (MATCHNULLS)
+ * can't; a NULL on either side has to see the whole small side. */
+bool TupleHashJoinStep::startDiskJoin(uint index, shared_ptr<TupleJoiner> &joiner,
+	uint64_t memUsage)
+{
+	RowGroup smallRG = smallRGs[index];
+	Row r;
+	uint i, j;
+
+	if (!allowDiskJoin || joiner->matchnulls() ||
+	  !atomicops::atomicCAS<uint32_t>(&diskJoinIndex, -1, index))
+		return false;
+
+	/* The rows read so far go to the partitions too, then start over with an empty joiner */
+	diskJoinSmall.reset(new RowGroupPartitioner(smallRG, diskJoinPartitionCount,
+	  tempDiskPath, "Join"));
+	smallRG.initRow(&r);
+	for (i = 0; i < rgData[index].size(); i++) {
+		smallRG.setData(&rgData[index][i]);
+		smallRG.getRow(0, &r);
+		for (j = 0; j < smallRG.getRowCount(); j++, r.nextRow())
+			diskJoinSmall->insert(r, diskJoinPartition(joiner->getSmallKeyHash(r), 0));
+	}
+
+	joiner = makeJoiner(index);
+	joiner->setInUM();
+	joiners[index] = joiner;
+	rgData[index].clear();
+	resourceManager.returnMemory(memUsage);
+	atomicops::atomicSub(&totalUMMemoryUsage, memUsage);
+	return true;
+}
+
+/* Joins as many small-side partitions as the budget allows in memory during the main pass */
+void TupleHashJoinStep::loadResidentPartitions(uint index, shared_ptr<TupleJoiner> &joiner,
+	uint64_t budget, uint64_t bytesPerRow)
+{
+	uint64_t estimate;
+	uint i;
+
+	diskJoinResident.assign(diskJoinPartitionCount, false);
+	for (i = 0; i < diskJoinPartitionCount && !cancelled(); i++) {
+		estimate = diskJoinSmall->partition(i).rowCount() * bytesPerRow;
+		if (estimate > budget)
+			continue;
+
+		if (!loadSmallPartition(diskJoinSmall->partition(i), joiner, &rgData[index])) {
+			/* The estimate was off; join every partition from disk */
+			joiner = makeJoiner(index);
+			joiner->setInUM();
+			joiners[index] = joiner;
+			rgData[index].clear();
+			returnDiskJoinMemory();
+			diskJoinResident.assign(diskJoinPartitionCount, false);
+			return;
+		}
+		budget -= estimate;
+		diskJoinResident[i] = true;
+	}
+
+	for (i = 0; i < diskJoinPartitionCount; i++)
+		if (diskJoinResident[i])
+			diskJoinSmall->release(i);
+}
+
+/* Returns false if the partition doesn't fit in memory.  The joiner & data are
+ * left partly filled in that case. */
+bool TupleHashJoinStep::loadSmallPartition(RowGroupFile &file,
+	const shared_ptr<TupleJoiner> &joiner, vector<RGData> *data)
+{
+	RowGroup smallRG = joiner->getSmallRG();
+	RGData oneRG;
+	Row r;
+	uint64_t i, memUseBefore, memUseAfter;
+	bool gotMem;
+
+	smallRG.initRow(&r);
+	file.rewind();
+	while (file.read(oneRG)) {
+		smallRG.setData(&oneRG);
+		if (smallRG.getRowCount() == 0)
+			continue;
+
+		memUseBefore = joiner->getMemUsage();
+		data->push_back(oneRG);
+		smallRG.getRow(0, &r);
+		for (i = 0; i < smallRG.getRowCount(); i++, r.nextRow())
+			joiner->insert(r);
+		memUseAfter = joiner->getMemUsage() + smallRG.getSizeWithStrings();
+
+		gotMem = resourceManager.getMemory(memUseAfter - memUseBefore);
+		atomicops::atomicAdd(&totalUMMemoryUsage, memUseAfter - memUseBefore);
+		diskJoinMemUsage += memUseAfter - memUseBefore;
+		if (!gotMem)
+			return false;
+	}
+	return true;
+}
+
+void TupleHashJoinStep::returnDiskJoinMemory()
+{
+	resourceManager.returnMemory(diskJoinMemUsage);
+	atomicops::atomicSub(&totalUMMemoryUsage, diskJoinMemUsage);
+	diskJoinMemUsage = 0;
+}
+
+inline uint TupleHashJoinStep::diskJoinPartition(uint64_t hash, uint level) const
+{
+	// each level splits a partition with a different mix of the same hash
+	return utils::fmix((uint64_t) (hash + (level + 1) * 0x9e3779b97f4a7c15ULL)) % diskJoinPartitionCount;
+}
+
+/* Sends the large-side rows of the partitions on disk to their files, and leaves the
+ * rest in 'resident' for the in-memory join. */
+void TupleHashJoinStep::spillLargeRows(RowGroup &inputRG, Row &largeRow, RGData *resident)
+{
+	RowGroup residentRG = inputRG;
+	Row residentRow;
+	shared_ptr<TupleJoiner> joiner = joiners[diskJoinIndex];
+	mutex::scoped_lock lk(diskJoinLock, defer_lock);
+	uint i, partition;
+
+	resident->reinit(inputRG, inputRG.getRowCount());
+	residentRG.setData(resident);
+	residentRG.resetRowGroup(inputRG.getBaseRid());
+	residentRG.setDBRoot(inputRG.getDBRoot());
+	residentRG.initRow(&residentRow);
+	residentRG.getRow(0, &residentRow);
+
+	inputRG.getRow(0, &largeRow);
+	for (i = 0; i < inputRG.getRowCount(); i++, largeRow.nextRow()) {
+		partition = diskJoinPartition(joiner->getLargeKeyHash(largeRow), 0);
+		if (diskJoinResident[partition]) {
+			copyRow(largeRow, &residentRow);
+			residentRow.nextRow();
+			residentRG.incRowCount();
+		}
+		else {
+			if (!lk.owns_lock())
+				lk.lock();
+			diskJoinLarge->insert(largeRow, partition);
+		}
+	}
+}
+
+/* Joins the partitions that didn't fit during the main pass, one at a time */
+void TupleHashJoinStep::joinSpilledPartitions()
+{
+	vector<DiskJoinPartition> work;
+	DiskJoinPartition p;
+	shared_ptr<TupleJoiner> joiner;
+	shared_ptr<FuncExpWrapper> joinFE;
+	uint index = diskJoinIndex;
+	uint i;
+
+	if (cancelled())
+		return;
+
+	/* The main pass is done with the resident partitions */
+	joinFE = joiners[index]->getFcnExpFilter();
+	joiners[index] = makeJoiner(index);
+	rgData[index].clear();
+	returnDiskJoinMemory();
+
+	for (i = 0; i < diskJoinPartitionCount; i++) {
+		if (diskJoinResident[i]) {
+			diskJoinSmall->release(i);
+			diskJoinLarge->release(i);
+			continue;
+		}
+		p.small = diskJoinSmall;
+		p.large = diskJoinLarge;
+		p.index = i;
+		p.level = 0;
+		work.push_back(p);
+	}
+	diskJoinSmall.reset();
+	diskJoinLarge.reset();
+
+	while (!work.empty() && !cancelled()) {
+		p = work.back();
+		work.pop_back();
+		RowGroupFile &smallFile = p.small->partition(p.index);
+		RowGroupFile &largeFile = p.large->partition(p.index);
+
+		/* Skip it if nothing can come out of it */
+		if ((largeFile.rowCount() == 0 && index != lastSmallOuterJoiner) ||
+		  (smallFile.rowCount() == 0 && !(joinTypes[index] & (LARGEOUTER | ANTI)))) {
+			p.small->release(p.index);
+			p.large->release(p.index);
+			continue;
+		}
+
+		joiner = makeJoiner(index);
+		joiner->setInUM();
+		if (!loadSmallPartition(smallFile, joiner, &rgData[index])) {
+			joiner.reset();
+			rgData[index].clear();
+			returnDiskJoinMemory();
+			if (p.level + 1 == MAX_DISK_JOIN_LEVEL) {
+				fLogger->logMessage(logging::LOG_TYPE_INFO, logging::ERR_JOIN_TOO_BIG);
+				status(logging::ERR_JOIN_TOO_BIG);
+				errorMessage(logging::IDBErrorInfo::instance()->errorMsg(logging::ERR_JOIN_TOO_BIG));
+				fDie = true;
+				joinIsTooBig = true;
+				break;
+			}
+
+			/* Split it up with the next level's hash */
+			DiskJoinPartition sub;
+			sub.small.reset(new RowGroupPartitioner(smallRGs[index], diskJoinPartitionCount,
+			  tempDiskPath, "Join"));
+			sub.large.reset(new RowGroupPartitioner(largeRG, diskJoinPartitionCount,
+			  tempDiskPath, "Join"));
+			sub.level = p.level + 1;
+			splitPartition(smallFile, sub.small.get(), smallRGs[index], true, sub.level);
+			splitPartition(largeFile, sub.large.get(), largeRG, false, sub.level);
+			p.small->release(p.index);
+			p.large->release(p.index);
+			for (i = 0; i < diskJoinPartitionCount; i++) {
+				sub.index = i;
+				work.push_back(sub);
+			}
+			continue;
+		}
+
+		joiner->setFcnExpFilter(joinFE);
+		joiner->setThreadCount(joinThreadCount);
+		joiners[index] = joiner;
+
+		largeFile.rewind();
+		largeInputFile = &largeFile;
+		moreInput = true;
+		runJoinThreads();
+		largeInputFile = NULL;
+
+		if (index == lastSmallOuterJoiner && !cancelled())
+			finishSmallOuterJoin();
+
+		joiners[index] = makeJoiner(index);
+		joiner.reset();
+		rgData[index].clear();
+		returnDiskJoinMemory();
+		p.small->release(p.index);
+		p.large->release(p.index);
+	}
+}
+
+void TupleHashJoinStep::splitPartition(RowGroupFile &in, RowGroupPartitioner *out,
+	const RowGroup &rg, bool smallSide, uint level)
+{
+	RowGroup l_rg = rg;
+	RGData oneRG;
+	Row r;
+	uint64_t hash;
+	uint i;
+
+	l_rg.initRow(&r);
+	in.rewind();
+	while (in.read(oneRG)) {
+		l_rg.setData(&oneRG);
+		l_rg.getRow(0, &r);
+		for (i = 0; i < l_rg.getRowCount(); i++, r.nextRow()) {
+			if (smallSide)
+				hash = joiners[diskJoinIndex]->getSmallKeyHash(r);
+			else
+				hash = joiners[diskJoinIndex]->getLargeKeyHash(r);
+			out->insert(r, diskJoinPartition(hash, level));
+		}
+	}
+	out->flush();
+}
+
 }
 // vim:ts=4 sw=4:
@@ -25,6 +25,7 @@
 #include "calpontsystemcatalog.h"
 #include "hasher.h"
 #include "tuplejoiner.h"
+#include "rowgroupfile.h"
 #include <boost/shared_ptr.hpp>
 #include <map>
 #include <string>
@@ -255,6 +256,7 @@ private:
 
 	void hjRunner();
 	void smallRunnerFcn(uint index);
+	boost::shared_ptr<joiner::TupleJoiner> makeJoiner(uint index);
 
 	struct HJRunner {
 		HJRunner(TupleHashJoinStep *hj) : HJ(hj) { }
@@ -304,6 +306,10 @@ private:
 	void forwardCPData();
 	uint uniqueLimit;
 
+	/* Runtime bloom filters for UM joins */
+	void forwardBloomFilters();
+	uint64_t bloomFilterMaxSize;
+
 	/* UM Join support.  Most of this code is ported from the UM join code in tuple-bps.cpp.
 	 * They should be kept in sync as much as possible. */
 	struct JoinRunner {
@@ -333,6 +339,7 @@ private:
 	void makeDupList(const rowgroup::RowGroup &rg);
 	void processDupList(uint threadID, rowgroup::RowGroup &ingrp,
 		std::vector<rowgroup::RGData> *rowData);
+	void runJoinThreads();
 
 	boost::scoped_array<boost::shared_ptr<boost::thread> > joinRunners;
 	boost::mutex inputDLLock, outputDLLock;
@@ -348,6 +355,43 @@ private:
 	bool isExeMgr;
 	uint lastSmallOuterJoiner;
 
+	/* Disk-based join support.  When a small side outgrows memory, it and the large
+	 * side are hash-partitioned into files by join key (a hybrid hash join).  The
+	 * partitions that fit are joined as the large side streams by, the others are
+	 * joined one at a time afterward.  A partition that still doesn't fit is split
+	 * again with a different hash. */
+	struct DiskJoinPartition {
+		boost::shared_ptr<rowgroup::RowGroupPartitioner> small, large;
+		uint index;
+		uint level;
+	};
+	bool startDiskJoin(uint index, boost::shared_ptr<joiner::TupleJoiner> &joiner,
+		uint64_t memUsage);
+	void loadResidentPartitions(uint index, boost::shared_ptr<joiner::TupleJoiner> &joiner,
+		uint64_t budget, uint64_t bytesPerRow);
+	bool loadSmallPartition(rowgroup::RowGroupFile &file,
+		const boost::shared_ptr<joiner::TupleJoiner> &joiner, std::vector<rowgroup::RGData> *data);
+	void returnDiskJoinMemory();
+	inline uint diskJoinPartition(uint64_t hash, uint level) const;
+	void spillLargeRows(rowgroup::RowGroup &inputRG, rowgroup::Row &largeRow,
+		rowgroup::RGData *resident);
+	void joinSpilledPartitions();
+	void splitPartition(rowgroup::RowGroupFile &in, rowgroup::RowGroupPartitioner *out,
+		const rowgroup::RowGroup &rg, bool smallSide, uint level);
+
+	bool allowDiskJoin;
+	uint diskJoinPartitionCount;
+	uint64_t umMemLimit;
+	std::string tempDiskPath;
+	volatile uint32_t diskJoinIndex;     // the small side on disk, -1 if there isn't one
+	std::vector<bool> diskJoinResident;  // partitions the main pass joins in memory
+	boost::shared_ptr<rowgroup::RowGroupPartitioner> diskJoinSmall, diskJoinLarge;
+	uint64_t diskJoinMemUsage;
+	bool spillLargeSide;
+	rowgroup::RowGroupFile *largeInputFile;
+	boost::mutex diskJoinLock;
+	AnyDataListSPtr diskJoinLargeDL;
+
 	// moved from base class JobStep
 	boost::mutex* fStatsMutexPtr;
 };
@@ -0,0 +1,147 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <cstring>
+#include <errno.h>
+#include <boost/scoped_array.hpp>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/aio_abi.h>
+#endif
+
+#include "asyncreader.h"
+
+using namespace boost;
+
+namespace
+{
+#if defined(__linux__) && defined(__NR_io_setup)
+inline int io_setup(unsigned nr, aio_context_t *ctx)
+{
+	return syscall(__NR_io_setup, nr, ctx);
+}
+
+inline int io_destroy(aio_context_t ctx)
+{
+	return syscall(__NR_io_destroy, ctx);
+}
+
+inline int io_submit(aio_context_t ctx, long nr, struct iocb **iocbpp)
+{
+	return syscall(__NR_io_submit, ctx, nr, iocbpp);
+}
+
+inline int io_getevents(aio_context_t ctx, long min_nr, long nr, struct io_event *events)
+{
+	return syscall(__NR_io_getevents, ctx, min_nr, nr, events, NULL);
+}
+#endif
+}
+
+namespace dbbc {
+
+AsyncReader::AsyncReader(uint32_t depth) : fCtx(0), fDepth(depth), fValid(false)
+{
+#if defined(__linux__) && defined(__NR_io_setup)
+	aio_context_t ctx = 0;
+
+	if (fDepth > 0 && io_setup(fDepth, &ctx) == 0) {
+		fCtx = ctx;
+		fValid = true;
+	}
+#endif
+}
+
+AsyncReader::~AsyncReader()
+{
+#if defined(__linux__) && defined(__NR_io_setup)
+	if (fValid)
+		io_destroy(fCtx);
+#endif
+}
+
+void AsyncReader::readAll(Read *reads, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		reads[i].result = -ENOSYS;
+
+#if defined(__linux__) && defined(__NR_io_setup)
+	if (!fValid)
+		return;
+
+	scoped_array<struct iocb> cbs(new struct iocb[fDepth]);
+	scoped_array<struct iocb *> cbps(new struct iocb *[fDepth]);
+	scoped_array<struct io_event> events(new struct io_event[fDepth]);
+	uint32_t next = 0, batch, submitted, reaped;
+	int rc;
+
+	// The context only has room for fDepth reads, so go in batches of that size
+	while (next < count) {
+		batch = (count - next < fDepth ? count - next : fDepth);
+		memset(cbs.get(), 0, batch * sizeof(struct iocb));
+		for (i = 0; i < batch; i++) {
+			Read &r = reads[next + i];
+			cbs[i].aio_data = next + i;
+			cbs[i].aio_lio_opcode = IOCB_CMD_PREAD;
+			cbs[i].aio_fildes = r.fd;
+			cbs[i].aio_buf = (uint64_t) (uintptr_t) r.buf;
+			cbs[i].aio_nbytes = r.len;
+			cbs[i].aio_offset = r.offset;
+			cbps[i] = &cbs[i];
+		}
+
+		// io_submit() can take fewer than it was given; whatever it refuses
+		// outright is left with an error result
+		submitted = 0;
+		while (submitted < batch) {
+			rc = io_submit(fCtx, batch - submitted, &cbps[submitted]);
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc <= 0) {
+				for (i = submitted; i < batch; i++)
+					reads[next + i].result = (rc < 0 ? -errno : -EAGAIN);
+				break;
+			}
+			submitted += rc;
+		}
+
+		reaped = 0;
+		while (reaped < submitted) {
+			rc = io_getevents(fCtx, submitted - reaped, submitted - reaped, events.get());
+			if (rc < 0 && errno == EINTR)
+				continue;
+			if (rc < 0) {
+				// Can't happen with a valid context.  The iocbs still belong to the
+				// kernel, so give up on this context rather than reuse them.
+				fValid = false;
+				return;
+			}
+			for (i = 0; i < (uint32_t) rc; i++)
+				reads[events[i].data].result = events[i].res;
+			reaped += rc;
+		}
+
+		next += batch;
+	}
+#endif
+}
+
+}
+// vim:ts=4 sw=4:
@@ -0,0 +1,75 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#ifndef ASYNCREADER_H
+#define ASYNCREADER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace dbbc {
+
+/**
+ * @brief A kernel AIO context owned by one ioManager reader thread.
+ *
+ * readAll() hands a whole batch of reads to the kernel with one io_submit()
+ * and reaps them together, so a single reader keeps up to depth() reads
+ * outstanding instead of one.  The syscalls are made directly so there's
+ * no dependency on libaio.  The reads are only truly asynchronous on files
+ * opened with O_DIRECT, and buffers, offsets and lengths have to be aligned
+ * accordingly.
+ *
+ * Where kernel AIO isn't available valid() returns false and the caller is
+ * expected to use pread().
+ **/
+class AsyncReader
+{
+public:
+	struct Read
+	{
+		int fd;
+		char *buf;
+		uint64_t offset;
+		uint32_t len;
+		ssize_t result;		// bytes read or -errno
+	};
+
+	AsyncReader(uint32_t depth);
+	~AsyncReader();
+
+	bool valid() const { return fValid; }
+	uint32_t depth() const { return fDepth; }
+
+	/**
+	 * @brief submits count reads and waits for all of them to finish.
+	 * Each Read's result is set; nothing is retried here.
+	 **/
+	void readAll(Read *reads, uint32_t count);
+
+private:
+	unsigned long fCtx;
+	uint32_t fDepth;
+	bool fValid;
+
+	// do not implement
+	AsyncReader(const AsyncReader &);
+	AsyncReader& operator=(const AsyncReader &);
+};
+
+}
+#endif
+// vim:ts=4 sw=4:
@@ -81,6 +81,23 @@ BlockRequestProcessor::~BlockRequestProcessor()
 		fLogFile.close();
 }
 
+void BlockRequestProcessor::flushChunk(BRM::LBID_t lbid)
+{
+	CompressedChunkCache &chunks = fIOMgr.chunkCache();
+	BRM::OID_t oid;
+	uint16_t dbroot;
+	uint32_t partNum;
+	uint16_t segNum;
+	uint32_t fbo;
+
+	if (chunks.size() == 0)
+		return;
+
+	if (fdbrm.lookupLocal(lbid, 0, false, oid, dbroot, partNum, segNum, fbo) == 0)
+		chunks.erase(ChunkKey(oid, dbroot, partNum, segNum,
+			((uint64_t) fbo * BLOCK_SIZE) / (4ULL * 1024ULL * 1024ULL)));
+}
+
 void BlockRequestProcessor::stop() {
 	fBRPRequestQueue.stop();
 	fIOMgr.stop();	
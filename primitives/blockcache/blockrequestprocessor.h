@@ -38,6 +38,8 @@
 	@author Jason Rodriguez <jrodriguez@calpont.com>
 */
 
+class ColumnCommandTest;
+
 namespace dbbc {
 
 typedef std::list<FileBuffer> FileBufferList_t;
@@ -107,25 +109,41 @@ public:
 	 * @brief 
 	 **/
 	void flushCache() {
-		fbMgr.flushCache(); }
+		fbMgr.flushCache();
+		fIOMgr.chunkCache().flushCache();
+		fIOMgr.runIndex().flushCache(); }
 
 	/**
 	 * @brief 
 	 **/
 	void flushOne(BRM::LBID_t lbid, BRM::VER_t ver) {
-		fbMgr.flushOne(lbid, ver); }
+		fbMgr.flushOne(lbid, ver);
+		fIOMgr.runIndex().erase(lbid);
+		flushChunk(lbid); }
 
 	void flushMany(const LbidAtVer* laVptr, uint32_t cnt) {
-		fbMgr.flushMany(laVptr, cnt); }
+		fbMgr.flushMany(laVptr, cnt);
+		for (uint32_t i = 0; i < cnt; i++) {
+			fIOMgr.runIndex().erase(laVptr[i].LBID);
+			flushChunk(laVptr[i].LBID);
+		} }
 		
 	void flushManyAllversion(const BRM::LBID_t* laVptr, uint32_t cnt) {
-		fbMgr.flushManyAllversion(laVptr, cnt); }
+		fbMgr.flushManyAllversion(laVptr, cnt);
+		for (uint32_t i = 0; i < cnt; i++) {
+			fIOMgr.runIndex().erase(laVptr[i]);
+			flushChunk(laVptr[i]);
+		} }
 
 	void flushOIDs(const uint32_t *oids, uint32_t count) {
-		fbMgr.flushOIDs(oids, count); }
+		fbMgr.flushOIDs(oids, count);
+		fIOMgr.chunkCache().flushOIDs(oids, count);
+		fIOMgr.runIndex().flushCache(); }
 
 	void flushPartition(const std::vector<BRM::OID_t> &oids, const std::set<BRM::LogicalPartition> &partitions) {
-		fbMgr.flushPartition(oids, partitions); }
+		fbMgr.flushPartition(oids, partitions);
+		fIOMgr.chunkCache().flushPartition(oids, partitions);
+		fIOMgr.runIndex().flushCache(); }
 
 	void setReportingFrequency(const uint32_t d) {
 		fbMgr.setReportingFrequency(d); }
@@ -134,6 +152,27 @@ public:
 
 	std::ostream& formatLRUList(std::ostream& os) const {
 		return fbMgr.formatLRUList(os); }
+
+	uint64_t blocksNotUsed() const {
+		return fbMgr.blocksNotUsed(); }
+
+	void getCachedLBIDs(std::vector<BRM::LBID_t> &lbids) const {
+		fbMgr.getLBIDs(lbids); }
+	/**
+	 * @brief copies the runs of equal values in lbid@ver into runs, if they're known
+	 **/
+	bool getBlockRuns(BRM::LBID_t lbid, BRM::VER_t ver, compress::BlockRuns &runs) const {
+		return fIOMgr.runIndex().find(lbid, ver, runs); }
+
+	/**
+	 * @brief the # of requests waiting for the IO manager
+	 **/
+	uint32_t pendingRequests() const {
+		return fBRPRequestQueue.size(); }
+
+	std::ostream& formatStats(std::ostream& os) const {
+		fbMgr.formatStats(os);
+		return fIOMgr.chunkCache().formatStats(os); }
 	
 private:
 	
@@ -142,6 +181,11 @@ private:
 	ioManager fIOMgr;
 	boost::mutex check_mutex;
 
+	/**
+	 * drops the compressed chunk holding lbid from the ioManager's chunk cache
+	 **/
+	void flushChunk(BRM::LBID_t lbid);
+
 	/**
 	 * helper function for public check functions
 	 **/
@@ -160,7 +204,8 @@ private:
 	// do not implement
 	BlockRequestProcessor(const BlockRequestProcessor& brp);
 	BlockRequestProcessor& operator=(const BlockRequestProcessor& brp);
-	
+
+	friend class ::ColumnCommandTest;
 };
 
 }
@@ -0,0 +1,87 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include "blockrunindex.h"
+
+using namespace std;
+using namespace BRM;
+using namespace compress;
+
+namespace dbbc {
+
+BlockRunIndex::BlockRunIndex(uint32_t maxEntries) :
+	fMaxEntries(maxEntries)
+{
+}
+
+BlockRunIndex::~BlockRunIndex()
+{
+}
+
+void BlockRunIndex::setMaxSize(uint32_t maxEntries)
+{
+	flushCache();
+	fMaxEntries = maxEntries;
+}
+
+bool BlockRunIndex::find(LBID_t lbid, VER_t ver, BlockRuns &runs) const
+{
+	const uint32_t shard = lbid % SHARDS;
+	boost::mutex::scoped_lock lk(fLocks[shard]);
+	EntryMap_t::const_iterator it = fEntries[shard].find(lbid);
+
+	if (it == fEntries[shard].end() || it->second.ver != ver)
+		return false;
+	runs = it->second.runs;
+	return true;
+}
+
+void BlockRunIndex::insert(LBID_t lbid, VER_t ver, const BlockRuns &runs)
+{
+	const uint32_t shard = lbid % SHARDS;
+	Entry entry;
+
+	if (runs.count == 0 || fMaxEntries == 0)
+		return;
+
+	entry.ver = ver;
+	entry.runs = runs;
+
+	boost::mutex::scoped_lock lk(fLocks[shard]);
+	if (fEntries[shard].size() >= fMaxEntries / SHARDS)
+		fEntries[shard].clear();
+	fEntries[shard][lbid] = entry;
+}
+
+void BlockRunIndex::erase(LBID_t lbid)
+{
+	const uint32_t shard = lbid % SHARDS;
+	boost::mutex::scoped_lock lk(fLocks[shard]);
+
+	fEntries[shard].erase(lbid);
+}
+
+void BlockRunIndex::flushCache()
+{
+	for (uint32_t i = 0; i < SHARDS; i++) {
+		boost::mutex::scoped_lock lk(fLocks[i]);
+		fEntries[i].clear();
+	}
+}
+
+}
+// vim:ts=4 sw=4:
@@ -0,0 +1,88 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#ifndef BLOCKRUNINDEX_H
+#define BLOCKRUNINDEX_H
+
+#ifndef _MSC_VER
+#include <tr1/unordered_map>
+#else
+#include <unordered_map>
+#endif
+#include <boost/thread.hpp>
+
+#include "brmtypes.h"
+#include "blockencoding.h"
+
+namespace dbbc {
+
+/**
+ * @brief The runs of equal values in cached blocks that were read from
+ * RLE or dictionary encoded chunks, so p_Col can evaluate a filter once per
+ * run instead of once per value.
+ *
+ * ioManager fills it in as it decodes chunks and it's looked up by LBID and
+ * version like the blocks themselves.  Entries are dropped whenever the
+ * matching blocks are flushed from the cache.  When it fills up it starts over
+ * rather than keeping an LRU; an entry is small next to the block it describes.
+ **/
+class BlockRunIndex
+{
+public:
+	/**
+	 * @brief ctor.  A maxEntries of 0 disables the index.
+	 **/
+	BlockRunIndex(uint32_t maxEntries = 0);
+	virtual ~BlockRunIndex();
+
+	bool enabled() const {return fMaxEntries > 0;}
+	void setMaxSize(uint32_t maxEntries);
+
+	/**
+	 * @brief copies the runs of lbid@ver into runs and returns true if there are any
+	 **/
+	bool find(BRM::LBID_t lbid, BRM::VER_t ver, compress::BlockRuns &runs) const;
+
+	/**
+	 * @brief records the runs of lbid@ver, does nothing if runs.count is 0
+	 **/
+	void insert(BRM::LBID_t lbid, BRM::VER_t ver, const compress::BlockRuns &runs);
+
+	void erase(BRM::LBID_t lbid);
+	void flushCache();
+
+private:
+	struct Entry {
+		BRM::VER_t ver;
+		compress::BlockRuns runs;
+	};
+	typedef std::tr1::unordered_map<BRM::LBID_t, Entry> EntryMap_t;
+
+	static const uint32_t SHARDS = 16;
+
+	uint32_t fMaxEntries;
+	EntryMap_t fEntries[SHARDS];
+	mutable boost::mutex fLocks[SHARDS];
+
+	// do not implement
+	BlockRunIndex(const BlockRunIndex &);
+	BlockRunIndex& operator=(const BlockRunIndex &);
+};
+
+}
+#endif
+// vim:ts=4 sw=4:
@@ -0,0 +1,77 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <unistd.h>
+using namespace std;
+
+#include "cachesnapshotfile.h"
+using namespace BRM;
+
+namespace dbbc {
+
+bool writeCacheSnapshot(const string &file, vector<LBID_t> &lbids)
+{
+	string tmpFile = file + ".tmp";
+	uint32_t i, j;
+
+	sort(lbids.begin(), lbids.end());
+	lbids.erase(unique(lbids.begin(), lbids.end()), lbids.end());
+
+	ofstream out(tmpFile.c_str());
+	out << "# PrimProc block cache snapshot" << endl;
+	for (i = 0; i < lbids.size(); i = j) {
+		for (j = i + 1; j < lbids.size() && lbids[j] == lbids[j - 1] + 1; j++) ;
+		out << lbids[i] << ' ' << (j - i) << '\n';
+	}
+	out.close();
+
+	// write the new one beside the old one so a crash can't leave half a snapshot
+	if (!out) {
+		unlink(tmpFile.c_str());
+		return false;
+	}
+#ifdef _MSC_VER
+	// rename() won't replace an existing file on Windows
+	unlink(file.c_str());
+#endif
+	return (rename(tmpFile.c_str(), file.c_str()) == 0);
+}
+
+bool readCacheSnapshot(const string &file, vector<LBIDRun> &runs)
+{
+	ifstream in(file.c_str());
+	string line;
+	LBIDRun run;
+
+	if (!in)
+		return false;
+
+	while (getline(in, line)) {
+		istringstream is(line);
+		if (line.empty() || line[0] == '#' || !(is >> run.start >> run.count) || run.count == 0)
+			continue;
+		runs.push_back(run);
+	}
+	return true;
+}
+
+}
+// vim:ts=4 sw=4:
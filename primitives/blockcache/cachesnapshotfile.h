@@ -0,0 +1,56 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#ifndef CACHESNAPSHOTFILE_H
+#define CACHESNAPSHOTFILE_H
+
+#include <string>
+#include <vector>
+
+#include "brmtypes.h"
+
+namespace dbbc {
+
+/**
+ * @brief A run of consecutive LBIDs in a block cache snapshot.
+ *
+ * The snapshot file is a comment line followed by one "<first LBID> <count>"
+ * run per line, sorted by LBID.  PrimProc writes one periodically and reads
+ * it back at startup to warm the caches.
+ **/
+struct LBIDRun
+{
+	BRM::LBID_t start;
+	uint32_t count;
+};
+
+/**
+ * @brief sorts and dedups lbids, then writes them to file as runs.
+ * The runs go to file.tmp first, which replaces file only once it's complete.
+ * Returns false if the file couldn't be written.
+ **/
+bool writeCacheSnapshot(const std::string &file, std::vector<BRM::LBID_t> &lbids);
+
+/**
+ * @brief appends the runs in file to runs, skipping lines it can't parse.
+ * Returns false if the file can't be opened.
+ **/
+bool readCacheSnapshot(const std::string &file, std::vector<LBIDRun> &runs);
+
+}
+#endif
+// vim:ts=4 sw=4:
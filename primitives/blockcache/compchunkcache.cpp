@@ -0,0 +1,193 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <cstring>
+#ifndef _MSC_VER
+#include <tr1/unordered_set>
+#else
+#include <unordered_set>
+#endif
+
+#include "compchunkcache.h"
+
+using namespace std;
+using namespace boost;
+using namespace BRM;
+
+namespace dbbc {
+
+CompressedChunkCache::CompressedChunkCache(uint64_t maxBytes) :
+	fMaxBytes(maxBytes),
+	fCurrentBytes(0),
+	fHits(0),
+	fMisses(0),
+	fEvictions(0)
+{
+}
+
+CompressedChunkCache::~CompressedChunkCache()
+{
+}
+
+void CompressedChunkCache::setMaxSize(uint64_t maxBytes)
+{
+	boost::mutex::scoped_lock lk(fLock);
+
+	fMaxBytes = maxBytes;
+	makeRoom(0);
+}
+
+// Needs fLock
+void CompressedChunkCache::drop(EntryMap_t::iterator it)
+{
+	fCurrentBytes -= it->second->len;
+	fLRU.erase(it->second);
+	fEntries.erase(it);
+}
+
+// Evicts from the back of the LRU until there are len bytes free.  Needs fLock.
+void CompressedChunkCache::makeRoom(uint64_t len)
+{
+	while (!fLRU.empty() && fCurrentBytes + len > fMaxBytes) {
+		EntryMap_t::iterator it = fEntries.find(fLRU.back().key);
+		drop(it);
+		fEvictions++;
+	}
+}
+
+bool CompressedChunkCache::find(const ChunkKey &key, time_t mtime, uint64_t offset,
+  uint64_t len, char *buf)
+{
+	shared_array<char> data;
+	boost::mutex::scoped_lock lk(fLock);
+
+	EntryMap_t::iterator it = fEntries.find(key);
+	if (it == fEntries.end()) {
+		fMisses++;
+		return false;
+	}
+
+	Entry &e = *(it->second);
+	if (e.mtime != mtime || e.offset != offset || e.len != len) {
+		// the chunk has been rewritten since it was cached
+		drop(it);
+		fMisses++;
+		return false;
+	}
+
+	fLRU.splice(fLRU.begin(), fLRU, it->second);
+	fHits++;
+	// the shared_array keeps the data alive if it's evicted while we copy it
+	data = e.data;
+	lk.unlock();
+	memcpy(buf, data.get(), len);
+	return true;
+}
+
+void CompressedChunkCache::insert(const ChunkKey &key, time_t mtime, uint64_t offset,
+  const char *data, uint64_t len)
+{
+	if (len > fMaxBytes)
+		return;
+
+	Entry e = { key, mtime, offset, len, shared_array<char>(new char[len]) };
+	memcpy(e.data.get(), data, len);
+
+	boost::mutex::scoped_lock lk(fLock);
+
+	EntryMap_t::iterator it = fEntries.find(key);
+	if (it != fEntries.end())
+		drop(it);
+
+	makeRoom(len);
+	fLRU.push_front(e);
+	fEntries[key] = fLRU.begin();
+	fCurrentBytes += len;
+}
+
+void CompressedChunkCache::erase(const ChunkKey &key)
+{
+	boost::mutex::scoped_lock lk(fLock);
+
+	EntryMap_t::iterator it = fEntries.find(key);
+	if (it != fEntries.end())
+		drop(it);
+}
+
+void CompressedChunkCache::flushCache()
+{
+	boost::mutex::scoped_lock lk(fLock);
+
+	fLRU.clear();
+	fEntries.clear();
+	fCurrentBytes = 0;
+}
+
+void CompressedChunkCache::flushOIDs(const uint32_t *oids, uint32_t count)
+{
+	tr1::unordered_set<OID_t> uniquer;
+	EntryList_t::iterator it, tmpIt;
+
+	boost::mutex::scoped_lock lk(fLock);
+
+	if (fEntries.empty() || count == 0)
+		return;
+
+	for (uint32_t i = 0; i < count; i++)
+		uniquer.insert(oids[i]);
+
+	for (it = fLRU.begin(); it != fLRU.end();) {
+		tmpIt = it++;
+		if (uniquer.find(tmpIt->key.oid) != uniquer.end())
+			drop(fEntries.find(tmpIt->key));
+	}
+}
+
+void CompressedChunkCache::flushPartition(const vector<OID_t> &oids,
+  const set<LogicalPartition> &partitions)
+{
+	tr1::unordered_set<OID_t> uniquer;
+	EntryList_t::iterator it, tmpIt;
+
+	boost::mutex::scoped_lock lk(fLock);
+
+	if (fEntries.empty() || oids.empty() || partitions.empty())
+		return;
+
+	uniquer.insert(oids.begin(), oids.end());
+
+	for (it = fLRU.begin(); it != fLRU.end();) {
+		tmpIt = it++;
+		if (uniquer.find(tmpIt->key.oid) != uniquer.end() &&
+		  partitions.find(LogicalPartition(tmpIt->key.dbroot, tmpIt->key.partNum,
+		  tmpIt->key.segNum)) != partitions.end())
+			drop(fEntries.find(tmpIt->key));
+	}
+}
+
+ostream& CompressedChunkCache::formatStats(ostream& os) const
+{
+	boost::mutex::scoped_lock lk(fLock);
+
+	os << "compressed chunks " << fEntries.size() << " bytes " << fCurrentBytes
+		<< " max " << fMaxBytes << " hits " << fHits << " misses " << fMisses
+		<< " evictions " << fEvictions << endl;
+	return os;
+}
+
+}
+// vim:ts=4 sw=4:
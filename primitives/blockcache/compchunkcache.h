@@ -0,0 +1,138 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#ifndef COMPCHUNKCACHE_H
+#define COMPCHUNKCACHE_H
+
+#include <iostream>
+#include <list>
+#include <set>
+#include <vector>
+#ifndef _MSC_VER
+#include <tr1/unordered_map>
+#else
+#include <unordered_map>
+#endif
+#include <boost/thread.hpp>
+#include <boost/shared_array.hpp>
+
+#include "brmtypes.h"
+
+namespace dbbc {
+
+/**
+ * @brief identifies one compressed chunk of a segment file
+ **/
+struct ChunkKey
+{
+	ChunkKey(BRM::OID_t o, uint16_t d, uint32_t p, uint16_t s, uint32_t c) :
+		oid(o), dbroot(d), partNum(p), segNum(s), chunk(c) { }
+	BRM::OID_t oid;
+	uint16_t dbroot;
+	uint32_t partNum;
+	uint16_t segNum;
+	uint32_t chunk;
+
+	bool operator==(const ChunkKey &k) const {
+		return (oid == k.oid && chunk == k.chunk && partNum == k.partNum &&
+			segNum == k.segNum && dbroot == k.dbroot);
+	}
+};
+
+class ChunkKeyHasher
+{
+	public:
+		inline size_t operator()(const ChunkKey &k) const
+		{
+			return (((size_t) k.oid << 32) ^ ((size_t) k.partNum << 20) ^
+				((size_t) k.segNum << 16) ^ ((size_t) k.dbroot << 12) ^ k.chunk);
+		}
+};
+
+/**
+ * @brief A second cache tier that keeps compressed chunks as they were read
+ * from disk.  When the decompressed blocks have been evicted from the
+ * FileBufferMgr, ioManager can rebuild them from here without any I/O.
+ *
+ * An entry is only used if the chunk's header pointer (offset & length) and
+ * the file's mtime still match what they were when it was cached; the flush
+ * fcns drop entries when BRM tells PrimProc a file has changed.
+ **/
+class CompressedChunkCache
+{
+public:
+	/**
+	 * @brief ctor.  A maxBytes of 0 disables the cache.
+	 **/
+	CompressedChunkCache(uint64_t maxBytes = 0);
+	virtual ~CompressedChunkCache();
+
+	bool enabled() const {return fMaxBytes > 0;}
+	uint64_t maxSize() const {return fMaxBytes;}
+	void setMaxSize(uint64_t maxBytes);
+
+	/**
+	 * @brief copies the chunk into buf and returns true if it's cached and still valid
+	 **/
+	bool find(const ChunkKey &key, time_t mtime, uint64_t offset, uint64_t len, char *buf);
+
+	/**
+	 * @brief adds a copy of the compressed chunk read from offset in a file with the given mtime
+	 **/
+	void insert(const ChunkKey &key, time_t mtime, uint64_t offset, const char *data, uint64_t len);
+
+	void erase(const ChunkKey &key);
+	void flushCache();
+	void flushOIDs(const uint32_t *oids, uint32_t count);
+	void flushPartition(const std::vector<BRM::OID_t> &oids,
+		const std::set<BRM::LogicalPartition> &partitions);
+
+	uint64_t size() const {return fCurrentBytes;}
+	std::ostream& formatStats(std::ostream& os) const;
+
+private:
+	struct Entry {
+		ChunkKey key;
+		time_t mtime;
+		uint64_t offset;
+		uint64_t len;
+		boost::shared_array<char> data;
+	};
+	typedef std::list<Entry> EntryList_t;
+	typedef std::tr1::unordered_map<ChunkKey, EntryList_t::iterator, ChunkKeyHasher> EntryMap_t;
+
+	void drop(EntryMap_t::iterator it);
+	void makeRoom(uint64_t len);
+
+	uint64_t fMaxBytes;
+	uint64_t fCurrentBytes;
+	EntryList_t fLRU;		// most recently used at the front
+	EntryMap_t fEntries;
+	mutable boost::mutex fLock;
+
+	uint64_t fHits;
+	uint64_t fMisses;
+	uint64_t fEvictions;
+
+	// do not implement
+	CompressedChunkCache(const CompressedChunkCache &);
+	CompressedChunkCache& operator=(const CompressedChunkCache &);
+};
+
+}
+#endif
+// vim:ts=4 sw=4:
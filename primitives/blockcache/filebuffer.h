@@ -50,7 +50,9 @@ namespace dbbc {
 typedef struct FBData{
 	BRM::LBID_t lbid;
 	BRM::VER_t ver;
-	uint8_t hits;
+	volatile uint32_t hits;	// lookups, counted atomically under the shard's shared lock
+	uint32_t seenHits;	// hits when the block was last moved, under the exclusive lock
+	uint8_t queue;	// which of the cache's lists holds this entry, see FileBufferMgr
 } FBData_t;
 
 //@bug 669 Change to list for least recently used cache 
@@ -31,6 +31,7 @@
 //#define NDEBUG
 #include <cassert>
 #include <limits>
+#include <algorithm>
 #include <boost/thread.hpp>
 
 #ifndef _MSC_VER
@@ -40,6 +41,7 @@
 #include "stats.h"
 #include "configcpp.h"
 #include "filebuffermgr.h"
+#include "atomicops.h"
 
 using namespace config;
 using namespace boost;
@@ -53,20 +55,43 @@ extern uint32_t gSession;
 namespace dbbc {
 const uint32_t gReportingFrequencyMin(32768);
 
+// Smaller shards make the per-shard LRU lists a poor stand-in for a global one
+const uint32_t gMinBlocksPerShard(1024);
+
 FileBufferMgr::FileBufferMgr(const uint32_t numBlcks, const uint32_t blkSz, const uint32_t deleteBlocks)
 	:fMaxNumBlocks(numBlcks),
 	fBlockSz(blkSz), 
-	fWLock(),
-	fbSet(), 
-	fbList(), 
-	fCacheSize(0), 
-	fFBPool(), 
+	fShardCount(1),
 	fDeleteBlocks(deleteBlocks), 
-	fEmptyPoolSlots(),
+	fPolicy(LRU_POLICY),
+	fBlksLoaded(0),
+	fBlksNotUsed(0),
 	fReportFrequency(0)
 {
-	fFBPool.reserve(numBlcks);
+	uint32_t i, maxShards = 16;
+
 	fConfig = Config::makeConfig();
+	const string val = fConfig->getConfig("DBBC", "NumShards");
+	if (val.length() > 0)
+		maxShards = static_cast<uint32_t>(Config::fromText(val));
+	const string policy = fConfig->getConfig("DBBC", "ReplacementPolicy");
+	if (policy == "2Q" || policy == "2q")
+		fPolicy = TWOQ_POLICY;
+
+	while (fShardCount * 2 <= maxShards && numBlcks / (fShardCount * 2) >= gMinBlocksPerShard)
+		fShardCount *= 2;
+
+	fShards.reset(new Shard[fShardCount]);
+	for (i = 0; i < fShardCount; i++) {
+		fShards[i].fMaxNumBlocks = numBlcks / fShardCount + (i < numBlcks % fShardCount ? 1 : 0);
+		fShards[i].fFBPool.reserve(fShards[i].fMaxNumBlocks);
+		// 2Q's Kin; probation gets a quarter of the shard
+		fShards[i].fProbationMax = max<uint32_t>(fShards[i].fMaxNumBlocks / 4, 1);
+	}
+	fDeleteBlocks = deleteBlocks / fShardCount;
+	if (deleteBlocks > 0 && fDeleteBlocks == 0)
+		fDeleteBlocks = 1;
+
 	setReportingFrequency(0);
 #ifdef _MSC_VER
 	fLog.open("C:/Calpont/log/trace/bc", ios_base::app | ios_base::ate);
@@ -99,53 +124,196 @@ void FileBufferMgr::setReportingFrequency(const uint32_t d)
 
 }
 
-void FileBufferMgr::flushCache()
+uint32_t FileBufferMgr::size() const
 {
-	mutex::scoped_lock lk(fWLock);
-	{
-		filebuffer_uset_t sEmpty;
-		filebuffer_list_t lEmpty;
-		emptylist_t vEmpty;
+	uint32_t i, ret = 0;
+
+	for (i = 0; i < fShardCount; i++)
+		ret += fShards[i].fbSet.size();
+	return ret;
+}
+
+uint32_t FileBufferMgr::listSize() const
+{
+	uint32_t i, ret = 0;
+
+	for (i = 0; i < fShardCount; i++)
+		ret += fShards[i].fbList.size() + fShards[i].fProbationSize;
+	return ret;
+}
 
-		fbList.swap(lEmpty);
-		fbSet.swap(sEmpty);
-		fEmptyPoolSlots.swap(vEmpty);
+void FileBufferMgr::getStats(uint64_t &hits, uint64_t &misses, uint64_t &evictions) const
+{
+	hits = misses = evictions = 0;
+	for (uint32_t i = 0; i < fShardCount; i++) {
+		hits += fShards[i].fHits;
+		misses += fShards[i].fMisses;
+		evictions += fShards[i].fEvictions;
 	}
-	fCacheSize = 0;
+}
 
-	// the block pool should not be freed in the above block to allow us
-	// to continue doing concurrent unprotected-but-"safe" memcpys
-	// from that memory
+ostream& FileBufferMgr::formatStats(ostream& os) const
+{
+	uint64_t hits, misses, evictions;
 
-	fFBPool.clear();
-//	fFBPool.reserve(fMaxNumBlocks);
+	getStats(hits, misses, evictions);
+	os << "policy " << (fPolicy == TWOQ_POLICY ? "2Q" : "LRU") << " shards " << fShardCount
+		<< " blocks " << size() << " hits " << hits << " misses " << misses
+		<< " evictions " << evictions << endl;
+	return os;
 }
 
-void FileBufferMgr::flushOne(const BRM::LBID_t lbid, const BRM::VER_t ver)
+// Readers hold the shard lock shared, so counting the hit is the only change they
+// make, and other readers may count the same block at once.  secondChance() moves
+// the blocks hit since they were last moved back to the front.
+inline void FileBufferMgr::touch(const Shard &s, uint32_t poolIdx) const
 {
-	//similar in function to depleteCache()
-	mutex::scoped_lock lk(fWLock);
+	atomicops::atomicInc(&s.fFBPool[poolIdx].listLoc()->hits);
+}
 
-	filebuffer_uset_iter_t iter = fbSet.find(HashObject_t(lbid, ver, 0));
-	if (iter != fbSet.end())
-	{
-		//remove it from fbList
-		uint32_t idx = iter->poolIdx;
-		fbList.erase(fFBPool[idx].listLoc());
-		//add to fEmptyPoolSlots
-		fEmptyPoolSlots.push_back(idx);
-		//remove it from fbSet
-		fbSet.erase(iter);
-		//adjust fCacheSize
-		fCacheSize--;
+// Rotates blocks referenced since the last pass from the back of the LRU list to
+// the front, so that back() is the block to evict.  Needs s.fLock exclusively.
+void FileBufferMgr::secondChance(Shard &s)
+{
+	filebuffer_list_iter_t last;
+
+	while (!s.fbList.empty() && s.fbList.back().hits != s.fbList.back().seenHits) {
+		last = s.fbList.end();
+		--last;
+		last->seenHits = last->hits;
+		s.fbList.splice(s.fbList.begin(), s.fbList, last);
 	}
+}
+
+// Needs s.fLock exclusively
+void FileBufferMgr::dropBlock(Shard &s, filebuffer_uset_iter_t it)
+{
+	const uint32_t idx = it->poolIdx;
 
+	//remove it from its list
+	const filebuffer_list_iter_t &loc = s.fFBPool[idx].listLoc();
+	if (loc->queue == PROBATION_QUEUE) {
+		s.fProbation.erase(loc);
+		s.fProbationSize--;
+	}
+	else
+		s.fbList.erase(loc);
+	//add to fEmptyPoolSlots
+	s.fEmptyPoolSlots.push_back(idx);
+	//remove it from fbSet
+	s.fbSet.erase(it);
+	//adjust fCacheSize
+	s.fCacheSize--;
 }
 
-void FileBufferMgr::flushMany(const LbidAtVer* laVptr, uint32_t cnt)
+/* Evicts one block as the replacement policy sees fit and frees its pool slot.
+ * Needs s.fLock exclusively. */
+void FileBufferMgr::evictOne(Shard &s)
+{
+	filebuffer_list_t *victims = &s.fbList;
+	filebuffer_list_iter_t last;
+
+	if (fPolicy == TWOQ_POLICY) {
+		// blocks that were used while on probation move to the main queue
+		while (!s.fProbation.empty() && s.fProbation.back().hits != s.fProbation.back().seenHits) {
+			last = s.fProbation.end();
+			--last;
+			last->seenHits = last->hits;
+			last->queue = MAIN_QUEUE;
+			s.fbList.splice(s.fbList.begin(), s.fProbation, last);
+			s.fProbationSize--;
+		}
+		if (s.fProbationSize > s.fProbationMax || (s.fbList.empty() && s.fProbationSize > 0))
+			victims = &s.fProbation;
+	}
+	if (victims == &s.fbList)
+		secondChance(s);
+	if (victims->empty())
+		return;
+
+	FBData_t &fbdata = victims->back();	//the lru block
+	HashObject_t lastFB(fbdata.lbid, fbdata.ver, 0);
+	filebuffer_uset_iter_t iter = s.fbSet.find(lastFB);	//should be there
+
+	idbassert(iter != s.fbSet.end());
+	if (fbdata.hits == 0)
+		atomicops::atomicInc(&fBlksNotUsed);
+	if (victims == &s.fProbation && s.fGhostSet.insert(lastFB).second) {
+		s.fGhosts.push_back(lastFB);
+		// 2Q's Kout; remember half a shard's worth
+		if (s.fGhosts.size() > s.fMaxNumBlocks / 2) {
+			s.fGhostSet.erase(s.fGhosts.front());
+			s.fGhosts.pop_front();
+		}
+	}
+	dropBlock(s, iter);
+	atomicops::atomicInc(&s.fEvictions);
+}
+
+/* Puts a new block at the front of the queue the policy picks for it.  Needs
+ * s.fLock exclusively. */
+void FileBufferMgr::addBlock(Shard &s, const BRM::LBID_t &lbid, const BRM::VER_t &ver,
+  uint32_t poolIdx)
+{
+	FBData_t fbdata = {lbid, ver, 0, 0, MAIN_QUEUE};
+
+	if (fPolicy == TWOQ_POLICY &&
+	  s.fGhostSet.find(HashObject_t(lbid, ver, 0)) == s.fGhostSet.end()) {
+		fbdata.queue = PROBATION_QUEUE;
+		s.fProbation.push_front(fbdata);
+		s.fProbationSize++;
+		s.fFBPool[poolIdx].listLoc(s.fProbation.begin());
+	}
+	else {
+		s.fbList.push_front(fbdata);
+		s.fFBPool[poolIdx].listLoc(s.fbList.begin());
+	}
+	s.fCacheSize++;
+}
+
+void FileBufferMgr::flushCache()
+{
+	for (uint32_t i = 0; i < fShardCount; i++) {
+		Shard &s = fShards[i];
+		boost::unique_lock<boost::shared_mutex> lk(s.fLock);
+		{
+			filebuffer_uset_t sEmpty, gEmpty;
+			filebuffer_list_t lEmpty, pEmpty;
+			emptylist_t vEmpty;
+			deque<HashObject_t> dEmpty;
+
+			s.fbList.swap(lEmpty);
+			s.fbSet.swap(sEmpty);
+			s.fEmptyPoolSlots.swap(vEmpty);
+			s.fProbation.swap(pEmpty);
+			s.fGhostSet.swap(gEmpty);
+			s.fGhosts.swap(dEmpty);
+		}
+		s.fCacheSize = 0;
+		s.fProbationSize = 0;
+
+		// the block pool should not be freed in the above block to allow us
+		// to continue doing concurrent unprotected-but-"safe" memcpys
+		// from that memory
+
+		s.fFBPool.clear();
+	//	s.fFBPool.reserve(s.fMaxNumBlocks);
+	}
+}
+
+void FileBufferMgr::flushOne(const BRM::LBID_t lbid, const BRM::VER_t ver)
 {
-	mutex::scoped_lock lk(fWLock);
+	//similar in function to depleteCache()
+	Shard &s = shardFor(lbid);
+	boost::unique_lock<boost::shared_mutex> lk(s.fLock);
 
+	filebuffer_uset_iter_t iter = s.fbSet.find(HashObject_t(lbid, ver, 0));
+	if (iter != s.fbSet.end())
+		dropBlock(s, iter);
+}
+
+void FileBufferMgr::flushMany(const LbidAtVer* laVptr, uint32_t cnt)
+{
 	BRM::LBID_t lbid;
 	BRM::VER_t ver;
 	filebuffer_uset_iter_t iter;
@@ -153,19 +321,11 @@ void FileBufferMgr::flushMany(const LbidAtVer* laVptr, uint32_t cnt)
 	{
 		lbid = static_cast<BRM::LBID_t>(laVptr->LBID);
 		ver = static_cast<BRM::VER_t>(laVptr->Ver);
-		iter = fbSet.find(HashObject_t(lbid, ver, 0));
-		if (iter != fbSet.end())
-		{
-			//remove it from fbList
-			uint32_t idx = iter->poolIdx;
-			fbList.erase(fFBPool[idx].listLoc());
-			//add to fEmptyPoolSlots
-			fEmptyPoolSlots.push_back(idx);
-			//remove it from fbSet
-			fbSet.erase(iter);
-			//adjust fCacheSize
-			fCacheSize--;
-		}
+		Shard &s = shardFor(lbid);
+		boost::unique_lock<boost::shared_mutex> lk(s.fLock);
+		iter = s.fbSet.find(HashObject_t(lbid, ver, 0));
+		if (iter != s.fbSet.end())
+			dropBlock(s, iter);
 		++laVptr;
 	}
 }
@@ -174,28 +334,53 @@ void FileBufferMgr::flushManyAllversion(const LBID_t* laVptr, uint32_t cnt)
 {
 	filebuffer_uset_t::iterator it, tmpIt;
 	tr1::unordered_set<LBID_t> uniquer;
-	tr1::unordered_set<LBID_t>::iterator uit;
 
-	mutex::scoped_lock lk(fWLock);
-
-	if (fCacheSize == 0 || cnt == 0)
+	if (cnt == 0)
 		return;
 
 	for (uint i = 0; i < cnt; i++)
 		uniquer.insert(laVptr[i]);
 
-	for (it = fbSet.begin(); it != fbSet.end();) {
-		if (uniquer.find(it->lbid) != uniquer.end()) {
-			const uint32_t idx = it->poolIdx;
-			fbList.erase(fFBPool[idx].listLoc());
-			fEmptyPoolSlots.push_back(idx);
+	for (uint32_t i = 0; i < fShardCount; i++) {
+		Shard &s = fShards[i];
+		boost::unique_lock<boost::shared_mutex> lk(s.fLock);
+
+		if (s.fCacheSize == 0)
+			continue;
+
+		for (it = s.fbSet.begin(); it != s.fbSet.end();) {
 			tmpIt = it;
 			++it;
-			fbSet.erase(tmpIt);
-			fCacheSize--;
+			if (uniquer.find(tmpIt->lbid) != uniquer.end())
+				dropBlock(s, tmpIt);
 		}
-		else
+	}
+}
+
+/* Drops every cached block that falls in one of the ranges.  The ranges come from
+ * distinct extents, so they don't overlap. */
+void FileBufferMgr::flushRanges(lbidRanges_t &ranges)
+{
+	filebuffer_uset_t::iterator it, tmpIt;
+	lbidRanges_t::iterator r;
+
+	if (ranges.empty())
+		return;
+
+	sort(ranges.begin(), ranges.end());
+	for (uint32_t i = 0; i < fShardCount; i++) {
+		Shard &s = fShards[i];
+		boost::unique_lock<boost::shared_mutex> lk(s.fLock);
+
+		for (it = s.fbSet.begin(); it != s.fbSet.end();) {
+			tmpIt = it;
 			++it;
+			// the last range that starts at or before this LBID
+			r = upper_bound(ranges.begin(), ranges.end(),
+			  make_pair(tmpIt->lbid, numeric_limits<LBID_t>::max()));
+			if (r != ranges.begin() && tmpIt->lbid < (--r)->second)
+				dropBlock(s, tmpIt);
+		}
 	}
 }
 
@@ -206,50 +391,30 @@ void FileBufferMgr::flushOIDs(const uint32_t *oids, uint32_t count)
 	vector<EMEntry> extents;
 	int err;
 	uint currentExtent;
-	LBID_t currentLBID;
-	typedef tr1::unordered_multimap<LBID_t, filebuffer_uset_t::iterator> byLBID_t;
-	byLBID_t byLBID;
-	pair<byLBID_t::iterator, byLBID_t::iterator> itList;
-	filebuffer_uset_t::iterator it;
+	lbidRanges_t ranges;
 
 	// If there are more than this # of extents to drop, the whole cache will be cleared
 	const uint clearThreshold = 50000;
 
-	mutex::scoped_lock lk(fWLock);
-	
-	if (fCacheSize == 0 || count == 0)
+	if (size() == 0 || count == 0)
 		return;
 
-	/* Index the cache by LBID */
-	for (it = fbSet.begin(); it != fbSet.end(); it++)
-		byLBID.insert(pair<LBID_t, filebuffer_uset_t::iterator>(it->lbid, it));
-
 	for (i = 0; i < count; i++) {
 		extents.clear();
 		err = dbrm.getExtents(oids[i], extents, true,true,true);  // @Bug 3838 Include outofservice extents
 		if (err < 0 || (i == 0 && (extents.size() * count) > clearThreshold)) {
 			// (The i == 0 should ensure it's not a dictionary column)
-			lk.unlock();
 			flushCache();
 			return;
 		}
 
 		for (currentExtent = 0; currentExtent < extents.size(); currentExtent++) {
 			EMEntry &range = extents[currentExtent];
-			LBID_t lastLBID = range.range.start + (range.range.size * 1024);
-			for (currentLBID = range.range.start; currentLBID < lastLBID;
-			  currentLBID++) {
-				itList = byLBID.equal_range(currentLBID);
-				for (byLBID_t::iterator tmpIt = itList.first; tmpIt != itList.second;
-						tmpIt++) {
-					fbList.erase(fFBPool[tmpIt->second->poolIdx].listLoc());
-					fEmptyPoolSlots.push_back(tmpIt->second->poolIdx);
-					fbSet.erase(tmpIt->second);
-					fCacheSize--;
-				}
-			}
+			ranges.push_back(make_pair(range.range.start,
+			  range.range.start + (LBID_t) (range.range.size * 1024)));
 		}
 	}
+	flushRanges(ranges);
 }
 
 void FileBufferMgr::flushPartition(const vector<OID_t> &oids, const set<BRM::LogicalPartition> &partitions)
@@ -259,27 +424,16 @@ void FileBufferMgr::flushPartition(const vector<OID_t> &oids, const set<BRM::Log
 	vector<EMEntry> extents;
 	int err;
 	uint currentExtent;
-	LBID_t currentLBID;
-	typedef tr1::unordered_multimap<LBID_t, filebuffer_uset_t::iterator> byLBID_t;
-	byLBID_t byLBID;
-	pair<byLBID_t::iterator, byLBID_t::iterator> itList;
-	filebuffer_uset_t::iterator it;
+	lbidRanges_t ranges;
 	uint32_t count = oids.size();
 
-	mutex::scoped_lock lk(fWLock);
-
-	if (fCacheSize == 0 || oids.size() == 0 || partitions.size() == 0)
+	if (size() == 0 || oids.size() == 0 || partitions.size() == 0)
 		return;
 
-	/* Index the cache by LBID */
-	for (it = fbSet.begin(); it != fbSet.end(); it++)
-		byLBID.insert(pair<LBID_t, filebuffer_uset_t::iterator>(it->lbid, it));
-
 	for (i = 0; i < count; i++) {
 		extents.clear();
 		err = dbrm.getExtents(oids[i], extents, true, true,true); // @Bug 3838 Include outofservice extents
 		if (err < 0) {
-			lk.unlock();
 			flushCache();   // better than returning an error code to the user
 			return;
 		}
@@ -291,19 +445,11 @@ void FileBufferMgr::flushPartition(const vector<OID_t> &oids, const set<BRM::Log
 			if (partitions.find(logicalPartNum) == partitions.end())
 				continue;
 
-			LBID_t lastLBID = range.range.start + (range.range.size * 1024);
-			for (currentLBID = range.range.start; currentLBID < lastLBID; currentLBID++) {
-				itList = byLBID.equal_range(currentLBID);
-				for (byLBID_t::iterator tmpIt = itList.first; tmpIt != itList.second;
-						tmpIt++) {
-					fbList.erase(fFBPool[tmpIt->second->poolIdx].listLoc());
-					fEmptyPoolSlots.push_back(tmpIt->second->poolIdx);
-					fbSet.erase(tmpIt->second);
-					fCacheSize--;
-				}
-			}
+			ranges.push_back(make_pair(range.range.start,
+			  range.range.start + (LBID_t) (range.range.size * 1024)));
 		}
 	}
+	flushRanges(ranges);
 }
 
 
@@ -316,16 +462,18 @@ bool FileBufferMgr::exists(const BRM::LBID_t& lbid, const BRM::VER_t& ver) const
 
 FileBuffer* FileBufferMgr::findPtr(const HashObject_t& keyFb)
 {
-	mutex::scoped_lock lk(fWLock);
+	Shard &s = shardFor(keyFb.lbid);
+	boost::shared_lock<boost::shared_mutex> lk(s.fLock);
 
-	filebuffer_uset_iter_t it = fbSet.find(keyFb);
-	if (fbSet.end()!=it)
+	filebuffer_uset_iter_t it = s.fbSet.find(keyFb);
+	if (s.fbSet.end()!=it)
 	{
-		FileBuffer* fb=&(fFBPool[it->poolIdx]);
-		fFBPool[it->poolIdx].listLoc()->hits++;
-		fbList.splice( fbList.begin(), fbList, (fFBPool[it->poolIdx]).listLoc() );
+		FileBuffer* fb=&(s.fFBPool[it->poolIdx]);
+		touch(s, it->poolIdx);
+		atomicops::atomicInc(&s.fHits);
 		return fb;
 	}	
+	atomicops::atomicInc(&s.fMisses);
 	return NULL;
 }
 
@@ -334,16 +482,17 @@ bool FileBufferMgr::find(const HashObject_t& keyFb, FileBuffer& fb)
 {
 	bool ret = false;
 
-	mutex::scoped_lock lk(fWLock);
+	Shard &s = shardFor(keyFb.lbid);
+	boost::shared_lock<boost::shared_mutex> lk(s.fLock);
 
-	filebuffer_uset_iter_t it = fbSet.find(keyFb);
-	if (fbSet.end()!=it)
+	filebuffer_uset_iter_t it = s.fbSet.find(keyFb);
+	if (s.fbSet.end()!=it)
 	{
-		fFBPool[it->poolIdx].listLoc()->hits++;
-		fbList.splice( fbList.begin(), fbList, (fFBPool[it->poolIdx]).listLoc() );
-		fb = fFBPool[it->poolIdx];
+		touch(s, it->poolIdx);
+		fb = s.fFBPool[it->poolIdx];
 		ret = true;
 	}
+	atomicops::atomicInc(ret ? &s.fHits : &s.fMisses);
 	return ret;
 }
 
@@ -357,7 +506,8 @@ bool FileBufferMgr::find(const HashObject_t& keyFb, void* bufferPtr)
 #else
 		gPMStatsPtr->markEvent(keyFb.lbid, pthread_self(), gSession, 'L');
 #endif
-	mutex::scoped_lock lk(fWLock);
+	Shard &s = shardFor(keyFb.lbid);
+	boost::shared_lock<boost::shared_mutex> lk(s.fLock);
 
 	if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
@@ -365,16 +515,16 @@ bool FileBufferMgr::find(const HashObject_t& keyFb, void* bufferPtr)
 #else
 		gPMStatsPtr->markEvent(keyFb.lbid, pthread_self(), gSession, 'M');
 #endif
-	filebuffer_uset_iter_t it = fbSet.find(keyFb);
-	if (fbSet.end()!=it)
+	filebuffer_uset_iter_t it = s.fbSet.find(keyFb);
+	if (s.fbSet.end()!=it)
 	{
 		uint idx = it->poolIdx;
 
-		//@bug 669 LRU cache, move block to front of list as last recently used.
-		fFBPool[idx].listLoc()->hits++;
-		fbList.splice(fbList.begin(), fbList, (fFBPool[idx]).listLoc());
+		//@bug 669 LRU cache, mark the block as recently used.
+		touch(s, idx);
 		lk.unlock();
-		memcpy(bufferPtr, (fFBPool[idx]).getData(), 8192);
+		atomicops::atomicInc(&s.fHits);
+		memcpy(bufferPtr, (s.fFBPool[idx]).getData(), 8192);
 		if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
 			gPMStatsPtr->markEvent(keyFb.lbid, GetCurrentThreadId(), gSession, 'U');
@@ -383,6 +533,8 @@ bool FileBufferMgr::find(const HashObject_t& keyFb, void* bufferPtr)
 #endif
 		ret = true;
 	}
+	else
+		atomicops::atomicInc(&s.fMisses);
 
 	return ret;
 }
@@ -390,8 +542,9 @@ bool FileBufferMgr::find(const HashObject_t& keyFb, void* bufferPtr)
 uint FileBufferMgr::bulkFind(const BRM::LBID_t *lbids, const BRM::VER_t *vers, uint8_t **buffers,
   bool *wasCached, uint count)
 {
-	uint i, ret = 0;
-	filebuffer_uset_iter_t *it = (filebuffer_uset_iter_t *) alloca(count * sizeof(filebuffer_uset_iter_t));
+	uint i, shard, ret = 0;
+	uint64_t hits, misses;
+	filebuffer_uset_iter_t it;
 	uint *indexes = (uint *) alloca(count * 4);
 	
 	if (gPMProfOn && gPMStatsPtr) {
@@ -403,37 +556,48 @@ uint FileBufferMgr::bulkFind(const BRM::LBID_t *lbids, const BRM::VER_t *vers, u
 #endif	
 		}
 	}
-	
-	mutex::scoped_lock lk(fWLock);
 
-	if (gPMProfOn && gPMStatsPtr) {
+	/* Look up the blocks one shard at a time so each lock is taken once */
+	for (shard = 0; shard < fShardCount; shard++) {
+		Shard &s = fShards[shard];
+		boost::shared_lock<boost::shared_mutex> lk(s.fLock, boost::defer_lock);
+
+		hits = misses = 0;
 		for (i = 0; i < count; i++) {
+			if ((lbids[i] & (fShardCount - 1)) != shard)
+				continue;
+			if (!lk.owns_lock())
+				lk.lock();
+
+			if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
-			gPMStatsPtr->markEvent(lbids[i], GetCurrentThreadId(), gSession, 'M');
+				gPMStatsPtr->markEvent(lbids[i], GetCurrentThreadId(), gSession, 'M');
 #else
-			gPMStatsPtr->markEvent(lbids[i], pthread_self(), gSession, 'M');
+				gPMStatsPtr->markEvent(lbids[i], pthread_self(), gSession, 'M');
 #endif	
-		}
-	}
 
-	for (i = 0; i < count; i++) {
-		new ((void *) &it[i]) filebuffer_uset_iter_t();
-		it[i] = fbSet.find(HashObject_t(lbids[i], vers[i], 0));
-		if (it[i] != fbSet.end()) {
-			indexes[i] = it[i]->poolIdx;
-			wasCached[i] = true;
-			fFBPool[it[i]->poolIdx].listLoc()->hits++;
-			fbList.splice(fbList.begin(), fbList, (fFBPool[it[i]->poolIdx]).listLoc());
-		}
-		else {
-			wasCached[i] = false;
-			indexes[i] = 0;
+			it = s.fbSet.find(HashObject_t(lbids[i], vers[i], 0));
+			if (it != s.fbSet.end()) {
+				indexes[i] = it->poolIdx;
+				wasCached[i] = true;
+				touch(s, it->poolIdx);
+				hits++;
+			}
+			else {
+				wasCached[i] = false;
+				indexes[i] = 0;
+				misses++;
+			}
 		}
+		if (hits > 0)
+			atomicops::atomicAdd(&s.fHits, hits);
+		if (misses > 0)
+			atomicops::atomicAdd(&s.fMisses, misses);
 	}
-	lk.unlock();   
+
 	for (i = 0; i < count; i++) {
 		if (wasCached[i]) {
-			memcpy(buffers[i], fFBPool[indexes[i]].getData(), 8192);
+			memcpy(buffers[i], shardFor(lbids[i]).fFBPool[indexes[i]].getData(), 8192);
 			ret++;
 			if (gPMProfOn && gPMStatsPtr) {
 #ifdef _MSC_VER
@@ -443,7 +607,6 @@ uint FileBufferMgr::bulkFind(const BRM::LBID_t *lbids, const BRM::VER_t *vers, u
 #endif	
 			}
 		}
-		it[i].filebuffer_uset_iter_t::~filebuffer_uset_iter_t();
 	}
 	return ret;
 }
@@ -451,14 +614,14 @@ uint FileBufferMgr::bulkFind(const BRM::LBID_t *lbids, const BRM::VER_t *vers, u
 bool FileBufferMgr::exists(const HashObject_t& fb) const
 {
 	bool find_bool=false;
-	mutex::scoped_lock lk(fWLock);
+	Shard &s = shardFor(fb.lbid);
+	boost::shared_lock<boost::shared_mutex> lk(s.fLock);
 
-	filebuffer_uset_iter_t it = fbSet.find(fb);
-	if (it != fbSet.end())
+	filebuffer_uset_iter_t it = s.fbSet.find(fb);
+	if (it != s.fbSet.end())
 	{
 		find_bool = true;
-		fFBPool[it->poolIdx].listLoc()->hits++;
-		fbList.splice(fbList.begin(), fbList, (fFBPool[it->poolIdx]).listLoc());
+		touch(s, it->poolIdx);
 	}
 	return find_bool;
 }
@@ -480,28 +643,12 @@ int FileBufferMgr::insert(const BRM::LBID_t lbid, const BRM::VER_t ver, const ui
 		gPMStatsPtr->markEvent(lbid, pthread_self(), gSession, 'I');
 #endif
 
-	mutex::scoped_lock lk(fWLock);
+	Shard &s = shardFor(lbid);
+	boost::unique_lock<boost::shared_mutex> lk(s.fLock);
 
 	HashObject_t fbIndex(lbid, ver, 0);
-	filebuffer_pair_t pr = fbSet.insert(fbIndex);
-	if (pr.second) {
-		// It was inserted (it wasn't there before)
-		// Right now we have an invalid cache: we have inserted an entry with a -1 index.
-		// We need to fix this quickly...
-		fCacheSize++;
-		FBData_t fbdata = {lbid, ver, 0};
-		fbList.push_front(fbdata);
-		fBlksLoaded++;
-		if (fReportFrequency && (fBlksLoaded%fReportFrequency)==0) {
-			struct timespec tm;
-			clock_gettime(CLOCK_MONOTONIC, &tm);
-			fLog 
-				<< left << fixed << ((double)(tm.tv_sec+(1.e-9*tm.tv_nsec))) << " "
-				<< right << setw(12) << fBlksLoaded << " "
-				<< right << setw(12) << fBlksNotUsed << endl;
-		}
-	}
-	else {  
+	filebuffer_pair_t pr = s.fbSet.insert(fbIndex);
+	if (!pr.second) {
 		// if it's a duplicate there's nothing to do
 		if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
@@ -512,63 +659,36 @@ int FileBufferMgr::insert(const BRM::LBID_t lbid, const BRM::VER_t ver, const ui
 		return ret;
 	}
 
-	uint32_t pi = numeric_limits<int>::max();
-	if (fCacheSize > maxCacheSize())
+	// It was inserted (it wasn't there before)
+	// Right now we have an invalid cache: we have inserted an entry with a -1 index.
+	// We need to fix this quickly...
+	if (s.fCacheSize >= s.fMaxNumBlocks)
 	{
-		// If the insert above caused the cache to exceed its max size, find the lru block in
-		// the cache and use its pool index to store the block data.
-		FBData_t &fbdata = fbList.back();	//the lru block
-		HashObject_t lastFB(fbdata.lbid, fbdata.ver, 0);
-		filebuffer_uset_iter_t iter = fbSet.find( lastFB ); //should be there
-
-		idbassert(iter != fbSet.end());
-		pi = iter->poolIdx;
-		idbassert(pi < maxCacheSize());
-		idbassert(pi < fFBPool.size());
-
-		// set iters are always const. We are not changing the hash here, and this gets us
-		// the pointer we need cheaply...
-		HashObject_t &ref = const_cast<HashObject_t &>(*pr.first);
-		ref.poolIdx = pi;
-
-		//replace the lru block with this block
-		FileBuffer fb(lbid, ver, NULL, 0);
-		fFBPool[pi] = fb;
-		fFBPool[pi].setData(data, 8192);
-		fbSet.erase(iter);
-		if (fbList.back().hits==0)
-			fBlksNotUsed++;
-		fbList.pop_back();
-		fCacheSize--;
-		depleteCache();
-		ret=1;
+		// If the shard is full, evict the block the policy picks and reuse its pool slot.
+		evictOne(s);
+		depleteCache(s);
 	}
-	else
-	{
-		if ( ! fEmptyPoolSlots.empty() )
-		{
-			pi = fEmptyPoolSlots.front();
-			fEmptyPoolSlots.pop_front();
-			FileBuffer fb(lbid, ver, NULL, 0);
-			fFBPool[pi] = fb;
-			fFBPool[pi].setData(data, 8192);
-		}
-		else
-		{
-			pi = fFBPool.size();
-			FileBuffer fb(lbid, ver, NULL, 0);
-			fFBPool.push_back(fb);
-			fFBPool[pi].setData(data, 8192);
-		}
 
-		// See comment above
-		HashObject_t &ref = const_cast<HashObject_t &>(*pr.first);
-		ref.poolIdx = pi;
-		ret=1;
+	uint32_t pi = doBlockCopy(s, lbid, ver, data);
+	// set iters are always const. We are not changing the hash here, and this gets us
+	// the pointer we need cheaply...
+	HashObject_t &ref = const_cast<HashObject_t &>(*pr.first);
+	ref.poolIdx = pi;
+	addBlock(s, lbid, ver, pi);
+	ret=1;
+
+	uint64_t loaded = atomicops::atomicInc(&fBlksLoaded);
+	if (fReportFrequency && (loaded%fReportFrequency)==0) {
+		struct timespec tm;
+		clock_gettime(CLOCK_MONOTONIC, &tm);
+		boost::mutex::scoped_lock llk(fLogLock);
+		fLog 
+			<< left << fixed << ((double)(tm.tv_sec+(1.e-9*tm.tv_nsec))) << " "
+			<< right << setw(12) << loaded << " "
+			<< right << setw(12) << fBlksNotUsed << endl;
 	}
 
-	idbassert(pi < fFBPool.size());
-	fFBPool[pi].listLoc(fbList.begin());
+	idbassert(pi < s.fFBPool.size());
 
 	if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
@@ -577,141 +697,128 @@ int FileBufferMgr::insert(const BRM::LBID_t lbid, const BRM::VER_t ver, const ui
 		gPMStatsPtr->markEvent(lbid, pthread_self(), gSession, 'J');
 #endif
 
-	idbassert(fCacheSize <= maxCacheSize());
-// 	idbassert(fCacheSize == fbSet.size());
-// 	idbassert(fCacheSize == fbList.size());
+	idbassert(s.fCacheSize <= s.fMaxNumBlocks);
+// 	idbassert(s.fCacheSize == s.fbSet.size());
 	return ret;
 }
 
 
-void FileBufferMgr::depleteCache() 
+void FileBufferMgr::depleteCache(Shard &s) 
 {
-	for (uint32_t i = 0; i < fDeleteBlocks && !fbList.empty(); ++i) 
-	{
-		FBData_t fbdata(fbList.back());	//the lru block
-		HashObject_t lastFB(fbdata.lbid, fbdata.ver, 0);
-		filebuffer_uset_iter_t iter = fbSet.find( lastFB ); 
-
-		idbassert(iter != fbSet.end());
-		uint32_t idx = iter->poolIdx;
-		idbassert(idx < fFBPool.size());
-		//Save position in FileBuffer pool for reuse.
-		fEmptyPoolSlots.push_back(idx);
-		fbSet.erase(iter);
-		if (fbList.back().hits==0)
-			fBlksNotUsed++;
-		fbList.pop_back();
-		fCacheSize--;
-	}
+	for (uint32_t i = 0; i < fDeleteBlocks && s.fCacheSize > 0; ++i) 
+		evictOne(s);
 }
 
 ostream& FileBufferMgr::formatLRUList(ostream& os) const
 {
-	filebuffer_list_t::const_iterator iter=fbList.begin();
-	filebuffer_list_t::const_iterator end=fbList.end();
+	filebuffer_list_t::const_iterator iter, end;
 
-	while (iter != end)
-	{
-		os << iter->lbid << '\t' << iter->ver << endl;
-		++iter;
+	for (uint32_t i = 0; i < fShardCount; i++) {
+		const Shard &s = fShards[i];
+		boost::shared_lock<boost::shared_mutex> lk(s.fLock);
+
+		for (iter = s.fbList.begin(), end = s.fbList.end(); iter != end; ++iter)
+			os << iter->lbid << '\t' << iter->ver << endl;
+		for (iter = s.fProbation.begin(), end = s.fProbation.end(); iter != end; ++iter)
+			os << iter->lbid << '\t' << iter->ver << endl;
 	}
 
 	return os;
 }
 
-// puts the new entry at the front of the list
-void FileBufferMgr::updateLRU(const FBData_t &f)
+void FileBufferMgr::getLBIDs(vector<BRM::LBID_t> &lbids) const
 {
-	if (fCacheSize > maxCacheSize()) {
-		list<FBData_t>::iterator last = fbList.end();
-		last--;
-		FBData_t &fbdata = *last;
-		HashObject_t lastFB(fbdata.lbid, fbdata.ver, 0);
-		filebuffer_uset_iter_t iter = fbSet.find(lastFB);
-		fEmptyPoolSlots.push_back(iter->poolIdx);
-		if (fbdata.hits == 0)
-			fBlksNotUsed++;
-		fbSet.erase(iter);
-		fbList.splice(fbList.begin(), fbList, last);
-		fbdata = f;
-		fCacheSize--;
-		//cout << "booted an entry\n";
-	}
-	else {
-		//cout << "new entry\n";
-		fbList.push_front(f);
+	filebuffer_list_t::const_iterator iter, end;
+
+	for (uint32_t i = 0; i < fShardCount; i++) {
+		const Shard &s = fShards[i];
+		boost::shared_lock<boost::shared_mutex> lk(s.fLock);
+
+		lbids.reserve(lbids.size() + s.fbList.size() + s.fProbation.size());
+		for (iter = s.fbList.begin(), end = s.fbList.end(); iter != end; ++iter)
+			lbids.push_back(iter->lbid);
+		for (iter = s.fProbation.begin(), end = s.fProbation.end(); iter != end; ++iter)
+			lbids.push_back(iter->lbid);
 	}
 }
 
-uint32_t FileBufferMgr::doBlockCopy(const BRM::LBID_t &lbid, const BRM::VER_t &ver, const uint8_t *data)
+uint32_t FileBufferMgr::doBlockCopy(Shard &s, const BRM::LBID_t &lbid, const BRM::VER_t &ver, const uint8_t *data)
 {
 	uint32_t poolIdx;
 	
-	if (!fEmptyPoolSlots.empty()) {
-		poolIdx = fEmptyPoolSlots.front();
-		fEmptyPoolSlots.pop_front();
+	if (!s.fEmptyPoolSlots.empty()) {
+		poolIdx = s.fEmptyPoolSlots.front();
+		s.fEmptyPoolSlots.pop_front();
 	}
 	else {
-		poolIdx = fFBPool.size();
-		fFBPool.resize(poolIdx + 1);   //shouldn't trigger a 'real' resize b/c of the reserve call
+		poolIdx = s.fFBPool.size();
+		s.fFBPool.resize(poolIdx + 1);   //shouldn't trigger a 'real' resize b/c of the reserve call
 	}
 
-	fFBPool[poolIdx].Lbid(lbid);
-	fFBPool[poolIdx].Verid(ver);
-	fFBPool[poolIdx].setData(data);
+	s.fFBPool[poolIdx].Lbid(lbid);
+	s.fFBPool[poolIdx].Verid(ver);
+	s.fFBPool[poolIdx].setData(data);
 	return poolIdx;
 }
 
 int FileBufferMgr::bulkInsert(const vector<CacheInsert_t> &ops)
 {
-	uint i;
+	uint i, shard;
 	int32_t pi;
 	int ret = 0;
 
-	mutex::scoped_lock lk(fWLock);
+	/* Insert the blocks one shard at a time so each lock is taken once */
+	for (shard = 0; shard < fShardCount; shard++) {
+		Shard &s = fShards[shard];
+		boost::unique_lock<boost::shared_mutex> lk(s.fLock, boost::defer_lock);
 
-	for (i = 0; i < ops.size(); i++) {
-		const CacheInsert_t &op = ops[i];
+		for (i = 0; i < ops.size(); i++) {
+			const CacheInsert_t &op = ops[i];
 
-		if (gPMProfOn && gPMStatsPtr)
+			if ((op.lbid & (fShardCount - 1)) != shard)
+				continue;
+			if (!lk.owns_lock())
+				lk.lock();
+
+			if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
-			gPMStatsPtr->markEvent(op.lbid, GetCurrentThreadId(), gSession, 'I');
+				gPMStatsPtr->markEvent(op.lbid, GetCurrentThreadId(), gSession, 'I');
 #else
-			gPMStatsPtr->markEvent(op.lbid, pthread_self(), gSession, 'I');
+				gPMStatsPtr->markEvent(op.lbid, pthread_self(), gSession, 'I');
 #endif
 
-		HashObject_t fbIndex(op.lbid, op.ver, 0);
-		filebuffer_pair_t pr = fbSet.insert(fbIndex);
-		
-		if (!pr.second) {
-			if (gPMProfOn && gPMStatsPtr)
+			HashObject_t fbIndex(op.lbid, op.ver, 0);
+			filebuffer_pair_t pr = s.fbSet.insert(fbIndex);
+			
+			if (!pr.second) {
+				if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
-				gPMStatsPtr->markEvent(op.lbid, GetCurrentThreadId(), gSession, 'D');
+					gPMStatsPtr->markEvent(op.lbid, GetCurrentThreadId(), gSession, 'D');
 #else
-				gPMStatsPtr->markEvent(op.lbid, pthread_self(), gSession, 'D');
+					gPMStatsPtr->markEvent(op.lbid, pthread_self(), gSession, 'D');
 #endif
-			continue;
-		}
-		
-		//cout << "FBM: inserting <" << op.lbid << ", " << op.ver << endl;
-		fCacheSize++;
-		fBlksLoaded++;
-		FBData_t fbdata = {op.lbid, op.ver, 0};
-		updateLRU(fbdata);
-		pi = doBlockCopy(op.lbid, op.ver, op.data);
-		
-		HashObject_t &ref = const_cast<HashObject_t &>(*pr.first);
-		ref.poolIdx = pi;
-		fFBPool[pi].listLoc(fbList.begin());
-		if (gPMProfOn && gPMStatsPtr)
+				continue;
+			}
+			
+			//cout << "FBM: inserting <" << op.lbid << ", " << op.ver << endl;
+			if (s.fCacheSize >= s.fMaxNumBlocks)
+				evictOne(s);
+			atomicops::atomicInc(&fBlksLoaded);
+			pi = doBlockCopy(s, op.lbid, op.ver, op.data);
+			
+			HashObject_t &ref = const_cast<HashObject_t &>(*pr.first);
+			ref.poolIdx = pi;
+			addBlock(s, op.lbid, op.ver, pi);
+			if (gPMProfOn && gPMStatsPtr)
 #ifdef _MSC_VER
-			gPMStatsPtr->markEvent(op.lbid, GetCurrentThreadId(), gSession, 'J');
+				gPMStatsPtr->markEvent(op.lbid, GetCurrentThreadId(), gSession, 'J');
 #else
-			gPMStatsPtr->markEvent(op.lbid, pthread_self(), gSession, 'J');
+				gPMStatsPtr->markEvent(op.lbid, pthread_self(), gSession, 'J');
 #endif
-		ret++;
+			ret++;
+		}
+		idbassert(s.fCacheSize <= s.fMaxNumBlocks);
 	}
-	idbassert(fCacheSize <= maxCacheSize());
 
 	return ret;
 }
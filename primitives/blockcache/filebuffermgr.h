@@ -33,6 +33,8 @@
 #include <unordered_set>
 #endif
 #include <boost/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/scoped_array.hpp>
 #include <deque>
 
 #include "primitivemsg.h"
@@ -107,6 +109,16 @@ public:
 
 	typedef std::deque<uint32_t> emptylist_t;
 
+	/**
+	 * @brief the block replacement policies.  LRU approximates LRU with a reference bit.
+	 * 2Q puts new blocks on a probation queue and only moves the ones that are used
+	 * again to the main LRU queue, so a large scan can't push the working set out.
+	 **/
+	enum ReplacementPolicy {
+		LRU_POLICY,
+		TWOQ_POLICY
+	};
+
 	/**
 	 * @brief ctor. Set max buffer size to numBlcks and block buffer size to blckSz
 	 **/
@@ -138,7 +150,7 @@ public:
 	/**
 	 * @brief returns the total number of Disk Blocks in the Cache
 	 **/
-	uint32_t size() const {return fbSet.size();}
+	uint32_t size() const;
 
 	/**
 	 * @brief 
@@ -181,44 +193,102 @@ public:
 	
 	uint32_t maxCacheSize() const {return fMaxNumBlocks;}
 
-	uint32_t listSize() const {return fbList.size();}
+	uint32_t listSize() const;
 
- 	const filebuffer_uset_iter_t end() const {return fbSet.end();}
+	uint32_t shardCount() const {return fShardCount;}
+
+	/**
+	 * @brief the # of blocks that were evicted without being used
+	 **/
+	uint64_t blocksNotUsed() const {return fBlksNotUsed;}
 
 	void setReportingFrequency(const uint32_t d);
 	const uint32_t  ReportingFrequency() const {return fReportFrequency;}
 
 	std::ostream& formatLRUList(std::ostream& os) const;
 
-private:
+	/**
+	 * @brief appends the LBIDs of the cached blocks to lbids
+	 **/
+	void getLBIDs(std::vector<BRM::LBID_t> &lbids) const;
 
-	uint32_t fMaxNumBlocks; 	// the max number of blockSz blocks to keep in the Cache list
-	uint32_t fBlockSz; 		// size in bytes size of a data block - probably 8
+	ReplacementPolicy replacementPolicy() const {return fPolicy;}
+
+	/**
+	 * @brief lookup hits & misses and evictions, summed over the shards
+	 **/
+	void getStats(uint64_t &hits, uint64_t &misses, uint64_t &evictions) const;
+	std::ostream& formatStats(std::ostream& os) const;
+
+private:
 
- 	mutable boost::mutex fWLock;
-	mutable filebuffer_uset_t fbSet;
+	// values of FBData_t::queue
+	enum { MAIN_QUEUE = 0, PROBATION_QUEUE = 1 };
 
-	mutable filebuffer_list_t fbList; // rename this
-	uint32_t fCacheSize;
+	/**
+	 * @brief One lock stripe of the cache.  Blocks are assigned to a shard by LBID, and
+	 * each shard has its own index, LRU list and block pool.  Lookups take the lock
+	 * shared and only set the block's reference bit; the list is reordered when
+	 * blocks are inserted or evicted, which takes the lock exclusively.
+	 **/
+	struct Shard {
+		Shard() : fMaxNumBlocks(0), fCacheSize(0), fProbationSize(0), fProbationMax(0),
+			fHits(0), fMisses(0), fEvictions(0) { }
+
+		mutable boost::shared_mutex fLock;
+		mutable filebuffer_uset_t fbSet;
+		mutable filebuffer_list_t fbList;	// the LRU list; the main queue for 2Q
+		uint32_t fMaxNumBlocks;
+		uint32_t fCacheSize;
+		FileBufferPool_t fFBPool; // vector<FileBuffer>
+		emptylist_t fEmptyPoolSlots;	//keep track of FBPool slots that can be reused
+
+		/* 2Q only.  fGhosts remembers blocks recently evicted from probation; if
+		   one of them is read again it goes straight to the main queue. */
+		mutable filebuffer_list_t fProbation;
+		uint32_t fProbationSize;
+		uint32_t fProbationMax;
+		filebuffer_uset_t fGhostSet;
+		std::deque<HashObject_t> fGhosts;
+
+		volatile uint64_t fHits;
+		volatile uint64_t fMisses;
+		volatile uint64_t fEvictions;
+	};
+
+	// [first, last) LBID ranges to drop, used by flushOIDs() & flushPartition()
+	typedef std::vector<std::pair<BRM::LBID_t, BRM::LBID_t> > lbidRanges_t;
 
-	FileBufferPool_t fFBPool; // vector<FileBuffer>
-	uint32_t fDeleteBlocks;
-	emptylist_t fEmptyPoolSlots;	//keep track of FBPool slots that can be reused
+	uint32_t fMaxNumBlocks; 	// the max number of blockSz blocks to keep in the Cache list
+	uint32_t fBlockSz; 		// size in bytes size of a data block - probably 8
 
-	void depleteCache();
-	uint64_t fBlksLoaded; // number of blocks inserted into cache
-	uint64_t fBlksNotUsed; // number of blocks inserted and not used
+	uint32_t fShardCount;	// a power of 2
+	boost::scoped_array<Shard> fShards;
+	inline Shard& shardFor(const BRM::LBID_t lbid) const {
+		return fShards[lbid & (fShardCount - 1)]; }
+
+	uint32_t fDeleteBlocks;	// per shard
+	ReplacementPolicy fPolicy;
+
+	void depleteCache(Shard &s);
+	void secondChance(Shard &s);
+	void evictOne(Shard &s);
+	void addBlock(Shard &s, const BRM::LBID_t &lbid, const BRM::VER_t &ver, uint32_t poolIdx);
+	void dropBlock(Shard &s, filebuffer_uset_iter_t it);
+	void flushRanges(lbidRanges_t &ranges);
+	inline void touch(const Shard &s, uint32_t poolIdx) const;
+	volatile uint64_t fBlksLoaded; // number of blocks inserted into cache
+	volatile uint64_t fBlksNotUsed; // number of blocks inserted and not used
 	uint64_t fReportFrequency; // how many blocks are read between reports
 	std::ofstream fLog;
+	boost::mutex fLogLock;
 	config::Config* fConfig;
 	
 	// do not implement
 	FileBufferMgr(const FileBufferMgr& fbm);
 	const FileBufferMgr& operator =(const FileBufferMgr& fbm);
 	
-	// used by bulkInsert
-	void updateLRU(const FBData_t &f);
-	uint32_t doBlockCopy(const BRM::LBID_t &lbid, const BRM::VER_t &ver, const uint8_t *data);
+	uint32_t doBlockCopy(Shard &s, const BRM::LBID_t &lbid, const BRM::VER_t &ver, const uint8_t *data);
 };
 
 }
@@ -64,6 +64,7 @@
 #include <errno.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_array.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/thread/condition.hpp>
 #ifdef _MSC_VER
@@ -92,6 +93,8 @@ using namespace logging;
 #include "rwlock_local.h"
 
 #include "iomanager.h"
+#include "asyncreader.h"
+#include "subchunkread.h"
 #include "liboamcpp.h"
 
 #include "idbcompress.h"
@@ -131,6 +134,7 @@ const std::string boldStop = "\033[0;39m";
 
 const uint32_t MAX_OPEN_FILES=16384;
 const uint32_t DECREASE_OPEN_FILES=4096;
+const uint32_t ASYNC_IO_DEPTH=64;
 
 void timespec_sub(const struct timespec &tv1,
 				const struct timespec &tv2,
@@ -152,13 +156,13 @@ class FdEntry
 {
 public:
 	FdEntry() : oid(0), dbroot(0), partNum(0), segNum(0),
-		fp(0), c(0), inUse(0), compType(0)
+		fp(0), aioFd(-1), c(0), inUse(0), compType(0)
 	{
 		cmpMTime = 0;
 	}
 
     FdEntry(const BRM::OID_t o, const uint16_t d, const uint32_t p, const uint16_t s, const int ct, IDBDataFile* f) :
-			oid(o), dbroot(d), partNum(p), segNum(s), fp(f), c(0), inUse(0), compType(0)
+			oid(o), dbroot(d), partNum(p), segNum(s), fp(f), aioFd(-1), c(0), inUse(0), compType(0)
 	{
 		cmpMTime = 0;
 		if (oid >= 1000)
@@ -169,6 +173,10 @@ public:
 	{
 		delete fp;
 		fp = 0;
+#ifndef _MSC_VER
+		if (aioFd >= 0)
+			close(aioFd);
+#endif
 	}
 
 	BRM::OID_t oid;
@@ -176,6 +184,7 @@ public:
 	uint32_t partNum;
 	uint16_t segNum;
 	IDBDataFile* fp;
+	int aioFd;		// O_DIRECT fd for the async reads, -1 if there isn't one
 	uint32_t c;
 	int inUse;
 
@@ -439,6 +448,11 @@ void* thr_popper(ioManager *arg) {
 	int blocksRead=0;
 	const unsigned pageSize = 4096;
 	fbm = &iom->fileBufferManager();
+	CompressedChunkCache* chunkCache = &iom->chunkCache();
+	bool chunkFromCache = false;
+	time_t chunkMTime = -1;
+	bool subChunkRead = false;
+	uint64_t subChunkOffset = 0, subChunkLen = 0;
 	char fileName[WriteEngine::FILE_NAME_SIZE];
 	const uint64_t fileBlockSize = BLOCK_SIZE;
 	bool flg=false;
@@ -469,6 +483,12 @@ void* thr_popper(ioManager *arg) {
 	IDBCompressInterface decompressor;
 	vector<CacheInsert_t> cacheInsertOps;
 	bool copyLocked = false;
+	boost::scoped_ptr<AsyncReader> aio;
+	vector<AsyncReader::Read> asyncReads;
+	boost::scoped_array<char> realAsyncBuff;
+	char* asyncBuff = 0;
+	uint32_t asyncBuffBlocks = 0;
+	char* blockBuff;
 
 	if (iom->IOTrace())
 	{
@@ -502,6 +522,18 @@ void* thr_popper(ioManager *arg) {
 	uint8_t* uCmpBuf = 0;
 	uCmpBuf = new uint8_t[4 * 1024 * 1024 + 4];
 
+	// the runs in each block of uCmpBuf, for the run index
+	BlockRunIndex* runIndex = &iom->runIndex();
+	boost::scoped_array<BlockRuns> blockRuns(
+		new BlockRuns[IDBCompressInterface::UNCOMPRESSED_INBUF_LEN / BLOCK_SIZE]);
+	bool haveRuns = false;
+
+	if (iom->asyncIO()) {
+		aio.reset(new AsyncReader(ASYNC_IO_DEPTH));
+		if (!aio->valid())
+			aio.reset();
+	}
+
 	for ( ; ; ) {
 		if (copyLocked) {
 			iom->dbrm()->releaseLBIDRange(lbid, blocksRequested);
@@ -733,6 +765,11 @@ if (compType != 0) cout << boldStop;
 			}
 
 			fe.reset( new FdEntry(oid, dbroot, partNum, segNum, compType, fp) );
+#ifndef _MSC_VER
+			if (iom->asyncIO() && !fe->isCompressed() &&
+			  IDBPolicy::getType(fileNamePtr, IDBPolicy::PRIMPROC) == IDBDataFile::UNBUFFERED)
+				fe->aioFd = open(fileNamePtr, O_RDONLY | O_DIRECT | O_LARGEFILE);
+#endif
 			fe->inUse++;
 			fdcache[fdKey] = fe;
 			fdit = fdcache.find(fdKey);
@@ -789,6 +826,27 @@ bool debugWrite=false;
 		if (blocksRequested % iom->blocksPerRead)
 			jend++;
 
+		// Hand all of an uncompressed request's reads to the kernel at once so the
+		// device sees the whole queue.  Any read that comes back short or with an
+		// error is redone by the pread loop below.
+		asyncReads.clear();
+		if (aio && jend > 1 && !fdit->second->isCompressed() && fdit->second->aioFd >= 0) {
+			if (asyncBuffBlocks < blocksRequested) {
+				realAsyncBuff.reset(new char[blocksRequested * BLOCK_SIZE + pageSize]);
+				asyncBuff = alignTo(realAsyncBuff.get(), pageSize);
+				asyncBuffBlocks = blocksRequested;
+			}
+			for (j = 0; j < jend; j++) {
+				AsyncReader::Read r;
+				r.fd = fdit->second->aioFd;
+				r.buf = &asyncBuff[(uint64_t) j * iom->blocksPerRead * BLOCK_SIZE];
+				r.offset = longSeekOffset + (uint64_t) j * iom->blocksPerRead * BLOCK_SIZE;
+				r.len = std::min(blocksRequested - j * iom->blocksPerRead, iom->blocksPerRead) * BLOCK_SIZE;
+				asyncReads.push_back(r);
+			}
+			aio->readAll(&asyncReads[0], jend);
+		}
+
 		for (j = 0; j < jend; j++) {
 
 			int decompRetryCount = 0;
@@ -797,6 +855,7 @@ bool debugWrite=false;
 decompRetry:
 			blocksThisRead = std::min(dlen, iom->blocksPerRead);
 			readSize = blocksThisRead * BLOCK_SIZE;
+			blockBuff = alignedbuff;
 
 			acc = 0;
 			while (acc < readSize) {
@@ -879,7 +938,25 @@ retryReadHeaders:
 						break;
 					}
 
-					i = fp->pread(&alignedbuff[0], fdit->second->ptrList[idx].first, fdit->second->ptrList[idx].second );
+					// The compressed chunk tier can save the read if the chunk hasn't changed.
+					// Without an mtime there's no telling, so it's bypassed.
+					chunkMTime = fp_mtime;
+					chunkFromCache = (chunkMTime != (time_t) -1 && chunkCache->enabled() &&
+						chunkCache->find(ChunkKey(oid, dbroot, partNum, segNum, idx), chunkMTime,
+						fdit->second->ptrList[idx].first, fdit->second->ptrList[idx].second,
+						&alignedbuff[0]));
+					// A read of part of a chunk made of sub-chunks only needs those
+					// sub-chunks.  A retry reads the whole chunk.
+					subChunkRead = (!chunkFromCache && decompRetryCount == 0 &&
+						retryReadHeadersCount == 0 &&
+						IDBCompressInterface::hasSubChunks(fdit->second->compType) &&
+						readSize < IDBCompressInterface::UNCOMPRESSED_INBUF_LEN &&
+						readSubChunks(fp, fdit->second->ptrList[idx], cmpOffFact.rem, readSize,
+						&alignedbuff[0], decompressor, &subChunkOffset, &subChunkLen));
+					if (chunkFromCache || subChunkRead)
+						i = fdit->second->ptrList[idx].second;
+					else
+						i = fp->pread(&alignedbuff[0], fdit->second->ptrList[idx].first, fdit->second->ptrList[idx].second );
 #ifdef IDB_COMP_POC_DEBUG
 {
 boost::mutex::scoped_lock lk(primitiveprocessor::compDebugMutex);
@@ -920,7 +997,15 @@ cout << boldStart << "pread1.1(" << fp << ", 0x" << hex << (ptrdiff_t)&alignedbu
 						}
 					}
 
-					compressedBytesRead+=i; // @Bug 3149.
+					if (subChunkRead)
+						compressedBytesRead += subChunkLen;
+					else if (!chunkFromCache)
+						compressedBytesRead+=i; // @Bug 3149.
+					i = readSize;
+				}
+				else if (acc == 0 && !asyncReads.empty() && asyncReads[j].result == (ssize_t) readSize)
+				{
+					blockBuff = asyncReads[j].buf;
 					i = readSize;
 				}
 				else
@@ -1016,14 +1101,28 @@ cout << "pread1.2(" << fp << ", 0x" << hex << (ptrdiff_t)&alignedbuff[acc] << de
 	cout << "decompress(0x" << hex << (ptrdiff_t)&alignedbuff[0] << dec << ", " << fdit->second->ptrList[cmpOffFact.quot].second << ", 0x" << hex << (ptrdiff_t)uCmpBuf << dec << ", " << blen << ")" << endl;
 }
 #endif
-					int dcrc = decompressor.uncompressBlock(&alignedbuff[0],
-						fdit->second->ptrList[cmpOffFact.quot].second, uCmpBuf, blen);
+					int dcrc;
+					haveRuns = (runIndex->enabled() &&
+						fdit->second->compType == IDBCompressInterface::ENCODED_COMPRESSION);
+					if (subChunkRead) {
+						blen -= subChunkOffset;
+						dcrc = decompressor.uncompressSubChunks(&alignedbuff[0], subChunkLen,
+							&uCmpBuf[subChunkOffset], blen,
+							(haveRuns ? &blockRuns[subChunkOffset / BLOCK_SIZE] : NULL));
+					}
+					else
+						dcrc = decompressor.uncompressBlock(&alignedbuff[0],
+							fdit->second->ptrList[cmpOffFact.quot].second, uCmpBuf, blen,
+							(haveRuns ? &blockRuns[0] : NULL));
 
 					if (dcrc != 0)
 					{
 #ifdef IDB_COMP_POC_DEBUG
 						boost::mutex::scoped_lock lk(primitiveprocessor::compDebugMutex);
 #endif
+						// don't trust the cached copy; the retry will go to disk
+						if (chunkFromCache)
+							chunkCache->erase(ChunkKey(oid, dbroot, partNum, segNum, cmpOffFact.quot));
 						if (++decompRetryCount < 30)
 						{
 							blocksRead -= blocksThisRead;
@@ -1057,10 +1156,21 @@ cout << "pread1.2(" << fp << ", 0x" << hex << (ptrdiff_t)&alignedbuff[acc] << de
 						break;
 					}
 
+					if (!chunkFromCache && !subChunkRead && chunkMTime != (time_t) -1 &&
+					  chunkCache->enabled())
+						chunkCache->insert(ChunkKey(oid, dbroot, partNum, segNum, cmpOffFact.quot),
+							chunkMTime, fdit->second->ptrList[cmpOffFact.quot].first, &alignedbuff[0],
+							fdit->second->ptrList[cmpOffFact.quot].second);
+
 					//FIXME: why doesn't this work??? (See later for why)
 					//ptr = &uCmpBuf[cmpOffFact.rem];
 					memcpy(ptr, &uCmpBuf[cmpOffFact.rem], blocksThisRead * BLOCK_SIZE);
 
+					for (i = 0; haveRuns && (uint) i < lbids.size(); i++)
+						if (!isLocked[i])
+							runIndex->insert(lbids[i], versions[i],
+								blockRuns[cmpOffFact.rem / BLOCK_SIZE + i]);
+
 					// log the retries, if any
 					if (retryReadHeadersCount > 0 || decompRetryCount > 0)
 					{
@@ -1112,7 +1222,7 @@ cout << "pread1.2(" << fp << ", 0x" << hex << (ptrdiff_t)&alignedbuff[acc] << de
 }
 #endif
 						cacheInsertOps.push_back(CacheInsert_t(lbids[i], versions[i], (uint8_t *)
-							  &alignedbuff[i*BLOCK_SIZE]));
+							  &blockBuff[i*BLOCK_SIZE]));
 					}
 				}
 				if (useCache) {
@@ -1231,6 +1341,8 @@ ioManager::ioManager(FileBufferMgr& fbm,
 					int bsPerRead):
 		blocksPerRead(bsPerRead),
 		fIOMfbMgr(fbm),
+		fChunkCache(0),
+		fRunIndex(fbm.maxCacheSize()),	// entries are small, one per cached block is plenty
 		fIOMRequestQueue(fbrq),
 		fFileOp(false)
 {
@@ -1264,10 +1376,27 @@ ioManager::ioManager(FileBufferMgr& fbm,
 	if (temp > 0)
 		fDecreaseOpenFilesCount = temp;
 
+	// Kernel AIO only avoids blocking on O_DIRECT files
+	val = fConfig->getConfig("DBBC", "AsyncIO");
+	fAsyncIO = ((val == "y" || val == "Y") && primitiveprocessor::directIOFlag != 0);
+
 	// limit the number of files closed
 	if (fDecreaseOpenFilesCount > (uint32_t)(0.75*fMaxOpenFiles))
 		fDecreaseOpenFilesCount = (uint32_t)(0.75*fMaxOpenFiles);
 
+	// The compressed chunk tier is off unless it's given a size.  Like the block
+	// cache, it's divided among the caches.
+	val = fConfig->getConfig("DBBC", "CompressedCacheSize");
+	if (val.length() > 0) {
+		uint64_t chunkCacheSize = Config::uFromText(val);
+		val = fConfig->getConfig("DBBC", "NumCaches");
+		temp = 0;
+		if (val.length() > 0) temp = static_cast<int>(Config::fromText(val));
+		if (temp > 1)
+			chunkCacheSize /= temp;
+		fChunkCache.setMaxSize(chunkCacheSize);
+	}
+
 	val = fConfig->getConfig("DBBC", "FDCacheTrace");
 	temp=0;
 	fFDCacheTrace=false;
@@ -42,6 +42,8 @@
 #include "brm.h"
 #include "fileblockrequestqueue.h"
 #include "filebuffermgr.h"
+#include "compchunkcache.h"
+#include "blockrunindex.h"
 
 //#define SHARED_NOTHING_DEMO_2
 
@@ -60,6 +62,10 @@ public:
 	void go(void);
 	void stop();
 	FileBufferMgr& fileBufferManager() {return fIOMfbMgr;}
+	CompressedChunkCache& chunkCache() {return fChunkCache;}
+	const CompressedChunkCache& chunkCache() const {return fChunkCache;}
+	BlockRunIndex& runIndex() {return fRunIndex;}
+	const BlockRunIndex& runIndex() const {return fRunIndex;}
 	config::Config* configPtr() {return fConfig;}
 
     const int localLbidLookup(BRM::LBID_t lbid,
@@ -89,6 +95,8 @@ public:
 
 	bool FDCacheTrace() const { return fFDCacheTrace;}
 
+	bool asyncIO() const { return fAsyncIO;}
+
 	void handleBlockReadError ( fileRequest* fr,
 		const std::string& errMsg, bool *copyLocked, int errorCode=fileRequest::FAILED );
 
@@ -104,6 +112,8 @@ public:
 private:
 
 	FileBufferMgr& fIOMfbMgr;
+	CompressedChunkCache fChunkCache;
+	BlockRunIndex fRunIndex;
 	fileBlockRequestQueue& fIOMRequestQueue;
 	int fThreadCount;
 	boost::thread_group fThreadArr;
@@ -121,6 +131,7 @@ private:
 	uint32_t fDecreaseOpenFilesCount;
 	bool fFDCacheTrace;
 	std::ofstream fFDTraceFile;
+	bool fAsyncIO;
 
 };
 
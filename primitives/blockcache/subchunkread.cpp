@@ -0,0 +1,73 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <cstring>
+#include <algorithm>
+#include <boost/scoped_array.hpp>
+using namespace std;
+
+#include "subchunkread.h"
+using namespace idbdatafile;
+using namespace compress;
+
+namespace
+{
+// the largest sector size O_DIRECT has to line up with
+const uint64_t DIRECT_IO_ALIGN = 4096;
+}
+
+namespace dbbc {
+
+bool alignedPread(IDBDataFile* fp, char* buf, uint64_t offset, uint64_t len)
+{
+	uint64_t start = offset & ~(DIRECT_IO_ALIGN - 1);
+	uint64_t alignedLen = (offset + len - start + DIRECT_IO_ALIGN - 1) & ~(DIRECT_IO_ALIGN - 1);
+	boost::scoped_array<char> realBuf(new char[alignedLen + DIRECT_IO_ALIGN - 1]);
+	char* alignedBuf = realBuf.get();
+	ssize_t i;
+
+	if ((uint64_t) alignedBuf % DIRECT_IO_ALIGN != 0)
+		alignedBuf += DIRECT_IO_ALIGN - (uint64_t) alignedBuf % DIRECT_IO_ALIGN;
+
+	i = fp->pread(alignedBuf, start, alignedLen);
+	if (i < 0 || (uint64_t) i < offset - start + len)
+		return false;
+	memcpy(buf, &alignedBuf[offset - start], len);
+	return true;
+}
+
+bool readSubChunks(IDBDataFile* fp, const CompChunkPtr& chunk, uint64_t uncompOffset,
+	uint64_t uncompLen, char* buf, const IDBCompressInterface& decompressor,
+	uint64_t* outOffset, uint64_t* compLen)
+{
+	uint64_t hdrLen = min<uint64_t>(IDBCompressInterface::SUBCHUNK_HDR_LEN, chunk.second);
+	uint64_t compOffset;
+
+	// chunks start on 8KB boundaries, but the index length and the sub-chunk
+	// offsets in it can be anything
+	if (!alignedPread(fp, buf, chunk.first, hdrLen))
+		return false;
+	if (decompressor.getSubChunkRange(buf, hdrLen, uncompOffset, uncompLen, compOffset,
+	  *compLen, *outOffset) != 0)
+		return false;
+	if (compOffset + *compLen > chunk.second)
+		return false;
+	return alignedPread(fp, buf, chunk.first + compOffset, *compLen);
+}
+
+}
+// vim:ts=4 sw=4:
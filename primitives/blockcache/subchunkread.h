@@ -0,0 +1,50 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#ifndef SUBCHUNKREAD_H
+#define SUBCHUNKREAD_H
+
+#include <stdint.h>
+
+#include "IDBDataFile.h"
+#include "idbcompress.h"
+
+namespace dbbc {
+
+/**
+ * @brief pread() that works on O_DIRECT files.
+ * O_DIRECT needs the offset and length to be multiples of the sector size, so
+ * this reads the 4KB-aligned range around [offset, offset + len) into an
+ * aligned buffer and copies out the part asked for.  The last 4KB can be short
+ * at the end of the file.  Returns false if fewer than len bytes came back.
+ **/
+bool alignedPread(idbdatafile::IDBDataFile* fp, char* buf, uint64_t offset, uint64_t len);
+
+/**
+ * @brief reads only the sub-chunks of chunk that hold uncompLen bytes at uncompOffset.
+ * They go to buf, which must hold the whole compressed chunk.  outOffset is where
+ * they start in the uncompressed chunk and compLen is how much was read.  Returns
+ * false if the chunk isn't made of sub-chunks or the reads fail, and the caller
+ * should read the whole chunk.
+ **/
+bool readSubChunks(idbdatafile::IDBDataFile* fp, const compress::CompChunkPtr& chunk,
+	uint64_t uncompOffset, uint64_t uncompLen, char* buf,
+	const compress::IDBCompressInterface& decompressor, uint64_t* outOffset, uint64_t* compLen);
+
+}
+#endif
+// vim:ts=4 sw=4:
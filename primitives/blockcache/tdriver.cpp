@@ -16,340 +16,537 @@
    MA 02110-1301, USA. */
 
 //
-// C++ Implementation: bcTest
-//
-// Description:  A simple Test driver for the Disk Block Buffer Cache
-//
-//
-// Author: Jason Rodriguez <jrodriguez@calpont.com>, (C) 2007
-//
-// Copyright: See COPYING file that comes with this distribution
+// C++ Implementation: tdriver
 //
+// Description:  Unit tests for the Disk Block Buffer Cache.  bcTest is the
+// multi-threaded load driver.
 //
 
-#include <vector>
 #include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
 #include <iostream>
-#include <sys/time.h>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
 #include <unistd.h>
-
-#include "blockcacheclient.h"
+#include <fcntl.h>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+#include "configcpp.h"
+#include "filebuffermgr.h"
+#include "compchunkcache.h"
+#include "asyncreader.h"
+#include "cachesnapshotfile.h"
+#include "subchunkread.h"
+#include "IDBDataFile.h"
+#include "IDBFactory.h"
+#include "idbcompress.h"
 #include "stats.h"
-#include "brm.h"
-using namespace BRM;
-using namespace dbbc;
+
 using namespace std;
+using namespace config;
+using namespace dbbc;
+using namespace BRM;
+using namespace idbdatafile;
+using namespace compress;
 
 Stats* gPMStatsPtr=NULL;
 bool gPMProfOn=false;
 uint32_t gSession=0;
 
-int fLoops=1;
-int thr_cnt=1;
-uint64_t bfoundTot=0;
-uint64_t bnfoundTot=0;
-uint64_t rfoundTot=0;
-uint64_t rnfoundTot=0;
-uint64_t rangeOpCountTot=0;
-uint64_t blockOpCountTot=0;
-uint64_t noOpCountTot=0;
-
-struct thr_wait_struct {
-	int predicate;
-	pthread_mutex_t fMutex;
-	pthread_cond_t fCond;
-	vector<LBIDRange_v> range_thr;
-};
-typedef thr_wait_struct thr_wait_t;
-
-const int32_t cacheSize=175000;
-BlockRequestProcessor BRP(cacheSize, 4, 16);
-BRM::VER_t ver=0xFFFF;
-u_int64_t totBlocks=0;
-
-void* thr_client(void* clientArgs) {
-	blockCacheClient bc(BRP);
-	uint64_t bfound=0;
-	uint64_t bnfound=0;
-	uint64_t rfound=0;
-	uint64_t rnfound=0;
-	uint64_t rangeOpCount=0;
-	uint64_t blockOpCount=0;
-	uint64_t noOpCount=0;
-	thr_wait_t* clientWait = (thr_wait_t*)clientArgs;
-	struct timeval tv, tv2;
-	uint randstate=0;
-	randstate = static_cast<uint>(tv.tv_usec);
-	pthread_mutex_lock(&clientWait->fMutex);
-	clientWait->predicate++;
-	pthread_mutex_unlock(&clientWait->fMutex);
-	vector<LBIDRange_v>& range_thr = clientWait->range_thr;
-
-	gettimeofday(&tv, NULL);
-	int j=0;
-	int s=0;
-	uint8_t fb[8192]={0};
-	LBIDRange_v& r=range_thr[0];
-	for(int idx=0; idx<fLoops; idx++) {
-		for (int jdx=0; jdx<range_thr.size(); jdx++) {
-			uint32_t lbid=0;
-			bool b;
-			int ret=0;
-			r = range_thr[jdx];
-			for(int l=0; l<r.size(); l++) {
-				for(int m=r[l].start;m<r[l].start+r[l].size; m++) {
-					//ret=bc.getBlock(m, ver, &fb, false, b);
-					ret=bc.read(m, ver, &fb);
-					if (ret) {
-						bfound++;
-					} else {
-						bnfound++;
-					}
-				}
-			}
+class BlockCacheTest : public CppUnit::TestFixture {
+
+CPPUNIT_TEST_SUITE( BlockCacheTest );
+
+CPPUNIT_TEST( shardCapacity );
+CPPUNIT_TEST( evictionOrder );
+CPPUNIT_TEST( concurrentHits );
+CPPUNIT_TEST( twoQScan );
+CPPUNIT_TEST( compressedChunks );
+CPPUNIT_TEST( asyncReads );
+CPPUNIT_TEST( snapshotRoundTrip );
+CPPUNIT_TEST( subChunkReads );
+
+CPPUNIT_TEST_SUITE_END();
+
+private:
+	uint8_t block[8192];
+
+	// the FileBufferMgr ctor reads these
+	void setConfig(const string &policy, const string &shards)
+	{
+		Config *cf = Config::makeConfig();
+
+		cf->setConfig("DBBC", "ReplacementPolicy", policy);
+		cf->setConfig("DBBC", "NumShards", shards);
+	}
+
+	void insertRange(FileBufferMgr &fbm, LBID_t first, LBID_t last)
+	{
+		for (LBID_t lbid = first; lbid < last; lbid++) {
+			memcpy(block, &lbid, sizeof(lbid));
+			fbm.insert(lbid, 0, block);
 		}
 	}
 
-	gettimeofday(&tv2, NULL);
-	time_t tm=time(0);
-	char t[50];
-	ctime_r(&tm, t);
-	t[strlen(t)-1]=0;
-	uint32_t elTime=tv2.tv_sec-tv.tv_sec;
-	uint64_t avgTot=0;
-	uint64_t rangeAvg=0;
-	uint64_t blkAvg=0;
-
-	if (elTime>0) {
-		avgTot=(bfound+rfound)/elTime;
-		rangeAvg=(rfound)/elTime;
-		blkAvg=(bfound)/elTime;
-	} else {
-		avgTot=bfound+rfound;
-		rangeAvg=rfound;
-		blkAvg=bfound;
+	// exists() counts as a hit, getLBIDs() doesn't
+	uint32_t countCached(FileBufferMgr &fbm, LBID_t first, LBID_t last)
+	{
+		vector<LBID_t> lbids;
+		uint32_t i, ret = 0;
+
+		fbm.getLBIDs(lbids);
+		for (i = 0; i < lbids.size(); i++)
+			if (lbids[i] >= first && lbids[i] < last)
+				ret++;
+		return ret;
 	}
 
-	cout << "thr(" << pthread_self() << ") tm " << t << " " << (tv2.tv_sec-tv.tv_sec) << endl <<
-		"\tBlk: c " << blockOpCount << " pass " << bfound << " fail " << bnfound <<
-		" Blks/Sec Blk " << blkAvg << endl << endl;
-
-	pthread_mutex_lock(&clientWait->fMutex);
-	bfoundTot+=bfound;
-	bnfoundTot+=bnfound;
-	rfoundTot+=rfound;
-	rnfoundTot+=rnfound;
-	rangeOpCountTot+=rangeOpCount;
-	blockOpCountTot+=blockOpCount;
-	noOpCountTot+=noOpCount;
-	clientWait->predicate--;
-	pthread_cond_signal(&clientWait->fCond);
-	pthread_mutex_unlock(&clientWait->fMutex);
-
-	return NULL;
-	
-} // end thr_client
-
-void LoadRange(const LBIDRange_v& v, uint32_t& loadCount)
-{
-	blockCacheClient bc(BRP);
+	bool cached(FileBufferMgr &fbm, LBID_t lbid)
+	{
+		return (countCached(fbm, lbid, lbid + 1) == 1);
+	}
 
-	uint32_t rCount=0;
-	for (uint i =0; i<v.size() ; i++)
+	static void readRange(FileBufferMgr *fbm, LBID_t first, LBID_t last, int loops)
 	{
-		const InlineLBIDRange r={v[i].start, v[i].size};
-		if (r.size<=1024) {
-			bc.check(r, ver, rCount );
-			loadCount+=rCount;
-		}
-		rCount=0;
+		uint8_t buf[8192];
 
+		for (int i = 0; i < loops; i++)
+			for (LBID_t lbid = first; lbid < last; lbid++)
+				fbm->find(HashObject_t(lbid, 0, 0), buf);
 	}
 
-}
-
-void ReadRange(const LBIDRange_v& v)
-{
-	blockCacheClient bc(BRP);
-	int found=0;
-	int notfound=0;
-	int ret=0;
-	for(uint i=0; i<v.size(); i++)
+public:
+	void setUp()
 	{
-		const InlineLBIDRange r={v[i].start, v[i].size};
-		FileBuffer fb(-1, -1);
-		for(int j=r.start; j<r.start+r.size; j++)
-		{
-			if (r.size > 1024)
-				continue;
-			ret=bc.read(j, ver, fb);
-			if (ret)
-				found++;
-			else
-				notfound++;
-			ret=0;
-		}
-		
-		totBlocks+=found;	
-		totBlocks+=notfound;	
-		found=0;
-		notfound=0;
+		memset(block, 0, sizeof(block));
+		setConfig("LRU", "16");
 	}
 
-}
+	void tearDown()
+	{
+		setConfig("LRU", "16");
+	}
 
-void  LoadLbid(const BRM::LBID_t lbid, const BRM::VER_t ver)
-{
-	blockCacheClient bc(BRP);
-	bool b;
-	bc.check(lbid, ver, false, b);
-}
+	// the shards split the capacity between them and never hold more than it
+	void shardCapacity()
+	{
+		uint64_t hits, misses, evictions;
+		FileBufferMgr fbm(8192);
+
+		CPPUNIT_ASSERT(fbm.shardCount() == 8);
+		CPPUNIT_ASSERT(fbm.maxCacheSize() == 8192);
+
+		insertRange(fbm, 0, 8192 * 3);
+		CPPUNIT_ASSERT(fbm.size() == 8192);
+		CPPUNIT_ASSERT(fbm.listSize() == 8192);
+		// the LBIDs are spread evenly, so each shard keeps its newest blocks
+		CPPUNIT_ASSERT(countCached(fbm, 8192 * 2, 8192 * 3) == 8192);
+		CPPUNIT_ASSERT(fbm.blocksNotUsed() == 8192 * 2);
+		fbm.getStats(hits, misses, evictions);
+		CPPUNIT_ASSERT(evictions == 8192 * 2);
+
+		// fewer blocks than 1024 per shard get fewer shards
+		FileBufferMgr small(3000);
+		CPPUNIT_ASSERT(small.shardCount() == 2);
+		insertRange(small, 0, 10000);
+		CPPUNIT_ASSERT(small.size() == 3000);
+
+		setConfig("LRU", "1");
+		FileBufferMgr one(8192);
+		CPPUNIT_ASSERT(one.shardCount() == 1);
+		insertRange(one, 0, 10000);
+		CPPUNIT_ASSERT(one.size() == 8192);
+
+		fbm.flushCache();
+		CPPUNIT_ASSERT(fbm.size() == 0 && fbm.listSize() == 0);
+		insertRange(fbm, 0, 100);
+		CPPUNIT_ASSERT(fbm.size() == 100);
+	}
 
-void ReadLbid(const BRM::LBID_t lbid, const BRM::VER_t ver)
-{
-	static int found=0, notfound=0;
-	u_int8_t d[8192];
-	blockCacheClient bc(BRP);
-	//FileBuffer fb(-1, -1);
-	//bc.read(lbid, ver, fb);
-	int ret = bc.read(lbid, ver, d);
-	if (ret)
-		found++;
-	else
-		notfound++;
-
-	if ((found+notfound)%10000==0)
-			cout << "found " << found << " notfound " << notfound << endl;
-}
+	// the least recently used block goes first, unless it was read since the
+	// last eviction pass
+	void evictionOrder()
+	{
+		uint8_t buf[8192];
+		LBID_t val;
+		FileBufferMgr fbm(1024);
+
+		CPPUNIT_ASSERT(fbm.shardCount() == 1);
+		insertRange(fbm, 0, 1024);
+
+		CPPUNIT_ASSERT(fbm.find(HashObject_t(0, 0, 0), buf));
+		memcpy(&val, buf, sizeof(val));
+		CPPUNIT_ASSERT(val == 0);
+		insertRange(fbm, 1024, 1025);
+		// 0 was read, so 1 was the oldest unused block
+		CPPUNIT_ASSERT(cached(fbm, 0));
+		CPPUNIT_ASSERT(!cached(fbm, 1));
+		CPPUNIT_ASSERT(cached(fbm, 2));
+
+		insertRange(fbm, 1025, 1027);
+		CPPUNIT_ASSERT(!cached(fbm, 2) && !cached(fbm, 3));
+		CPPUNIT_ASSERT(cached(fbm, 0) && cached(fbm, 4));
+		CPPUNIT_ASSERT(fbm.blocksNotUsed() == 3);
+
+		// a second pass without reads in between evicts it
+		insertRange(fbm, 2000, 3024);
+		CPPUNIT_ASSERT(countCached(fbm, 0, 1027) == 0);
+		CPPUNIT_ASSERT(countCached(fbm, 2000, 3024) == 1024);
+		CPPUNIT_ASSERT(fbm.size() == 1024);
+	}
 
-//
-int main(int argc, char *argv[]) {
-
-	if (argc>=2) thr_cnt=atoi(argv[1]);
-	if (argc>=3) fLoops=atoi(argv[2]);
-	if (thr_cnt<=0) thr_cnt=1;
-	if (thr_cnt>1024) thr_cnt=1024;
-	if (fLoops<=0) fLoops=1;
-
-	LBIDRange_v r;
-	vector<LBIDRange_v> ranges;
-	DBRM dbrm;
-	uint32_t hwm, lowfbo, highfbo, fbo, extentSize, lowlbid;
-	struct timeval tv, tv2;
-
-	cout << "Starting " << endl;
-	extentSize = dbrm.getExtentSize();
-	BRM::OID_t oid=3000;
-	uint32_t totalExt=0;
-	do {
-		int ret = dbrm.lookup(oid, r);
-		if (ret==0 && r.size() > 0) {
-			lowlbid = (r[0].start/extentSize) * extentSize;
-			dbrm.lookup(r[0].start, ver, false, oid, fbo);  // need the oid
-			dbrm.getHWM(oid, hwm);
-			lowfbo = fbo - (r[0].start - lowlbid);
-			highfbo = lowfbo + extentSize;
-			r[0].start=lowlbid;
-			if (hwm < highfbo)
-				r[0].size = hwm - lowfbo + 1;
-			else
-				r[0].size = extentSize;
-			for (uint idx=0; idx<r.size(); idx++)
-				totalExt+=r[idx].size;
-			ranges.push_back(r);
-		}
-		oid++;
+	// hits counted by concurrent readers all keep their blocks
+	void concurrentHits()
+	{
+		boost::thread_group readers;
+		int i;
+		FileBufferMgr fbm(1024);
+
+		insertRange(fbm, 0, 1024);
+		for (i = 0; i < 8; i++)
+			readers.create_thread(boost::bind(&BlockCacheTest::readRange, &fbm, 0, 512, 200));
+		readers.join_all();
+
+		insertRange(fbm, 5000, 5512);
+		CPPUNIT_ASSERT(countCached(fbm, 0, 512) == 512);
+		CPPUNIT_ASSERT(countCached(fbm, 512, 1024) == 0);
+		CPPUNIT_ASSERT(fbm.size() == 1024);
 	}
-	while ( (r.size() > 0 || oid < 900000) );
 
-	cout << ranges.size() << " ranges found" << endl;
+	// a block read once stays on probation; one read again survives a large scan
+	void twoQScan()
+	{
+		uint8_t buf[8192];
+		LBID_t lbid;
+
+		setConfig("2Q", "1");
+		FileBufferMgr fbm(1024);
+		CPPUNIT_ASSERT(fbm.replacementPolicy() == FileBufferMgr::TWOQ_POLICY);
+
+		insertRange(fbm, 0, 100);
+		for (lbid = 0; lbid < 100; lbid++)
+			CPPUNIT_ASSERT(fbm.find(HashObject_t(lbid, 0, 0), buf));
+		insertRange(fbm, 10000, 20000);
+		CPPUNIT_ASSERT(countCached(fbm, 0, 100) == 100);
+		CPPUNIT_ASSERT(fbm.size() == 1024 && fbm.listSize() == 1024);
+
+		// a block that was just evicted from probation goes to the main queue
+		CPPUNIT_ASSERT(!cached(fbm, 19000));
+		insertRange(fbm, 19000, 19001);
+		insertRange(fbm, 30000, 32000);
+		CPPUNIT_ASSERT(cached(fbm, 19000));
+		CPPUNIT_ASSERT(countCached(fbm, 0, 100) == 100);
+
+		// LRU lets the scan push everything out
+		setConfig("LRU", "1");
+		FileBufferMgr lru(1024);
+		CPPUNIT_ASSERT(lru.replacementPolicy() == FileBufferMgr::LRU_POLICY);
+		insertRange(lru, 0, 100);
+		for (lbid = 0; lbid < 100; lbid++)
+			CPPUNIT_ASSERT(lru.find(HashObject_t(lbid, 0, 0), buf));
+		insertRange(lru, 10000, 20000);
+		CPPUNIT_ASSERT(countCached(lru, 0, 100) == 0);
+	}
 
-	gettimeofday(&tv, NULL);
-	uint32_t blksLoaded=0;
-	int rangesLoaded=0;
-	for (uint i =0; i<ranges.size() && blksLoaded < cacheSize; i++)
+	void compressedChunks()
 	{
-		LoadRange(ranges[i], blksLoaded);
-		rangesLoaded++;
+		char data[4000], buf[4000];
+		const ChunkKey key1(3000, 1, 0, 0, 1), key2(3000, 1, 0, 0, 2), key3(3001, 2, 1, 0, 1);
+		set<LogicalPartition> partitions;
+		vector<OID_t> oids;
+		uint32_t oid = 3000;
+
+		CompressedChunkCache off;
+		CPPUNIT_ASSERT(!off.enabled());
+		off.insert(key1, 1, 0, data, sizeof(data));
+		CPPUNIT_ASSERT(off.size() == 0);
+
+		CompressedChunkCache ccc(10000);
+		CPPUNIT_ASSERT(ccc.enabled());
+		memset(data, 1, sizeof(data));
+		ccc.insert(key1, 100, 8192, data, sizeof(data));
+		memset(data, 2, sizeof(data));
+		ccc.insert(key2, 100, 12192, data, sizeof(data));
+		CPPUNIT_ASSERT(ccc.size() == 8000);
+
+		// key1 was used last, so key2 makes room for key3
+		CPPUNIT_ASSERT(ccc.find(key1, 100, 8192, sizeof(data), buf));
+		CPPUNIT_ASSERT(buf[0] == 1 && buf[sizeof(buf) - 1] == 1);
+		memset(data, 3, sizeof(data));
+		ccc.insert(key3, 100, 8192, data, sizeof(data));
+		CPPUNIT_ASSERT(ccc.size() == 8000);
+		CPPUNIT_ASSERT(!ccc.find(key2, 100, 12192, sizeof(data), buf));
+		CPPUNIT_ASSERT(ccc.find(key3, 100, 8192, sizeof(data), buf));
+		CPPUNIT_ASSERT(buf[0] == 3);
+
+		// a chunk that moved or a file that changed drops the entry
+		CPPUNIT_ASSERT(!ccc.find(key1, 100, 9000, sizeof(data), buf));
+		CPPUNIT_ASSERT(!ccc.find(key1, 100, 8192, sizeof(data), buf));
+		CPPUNIT_ASSERT(!ccc.find(key3, 101, 8192, sizeof(data), buf));
+		CPPUNIT_ASSERT(ccc.size() == 0);
+
+		// bigger than the whole cache
+		char big[10001];
+		ccc.insert(key1, 100, 0, big, sizeof(big));
+		CPPUNIT_ASSERT(ccc.size() == 0);
+
+		ccc.insert(key1, 100, 0, data, sizeof(data));
+		ccc.insert(key2, 100, 4000, data, sizeof(data));
+		ccc.insert(key3, 100, 0, data, sizeof(data));
+		CPPUNIT_ASSERT(ccc.size() == 8000);
+		ccc.setMaxSize(5000);
+		CPPUNIT_ASSERT(ccc.size() == 4000);
+		CPPUNIT_ASSERT(ccc.find(key3, 100, 0, sizeof(data), buf));
+
+		ccc.setMaxSize(20000);
+		ccc.insert(key1, 100, 0, data, sizeof(data));
+		ccc.insert(key2, 100, 4000, data, sizeof(data));
+		ccc.flushOIDs(&oid, 1);
+		CPPUNIT_ASSERT(ccc.size() == 4000);
+		CPPUNIT_ASSERT(ccc.find(key3, 100, 0, sizeof(data), buf));
+
+		// key3 is dbroot 2, partition 1, segment 0
+		oids.push_back(3001);
+		partitions.insert(LogicalPartition(1, 1, 0));
+		ccc.flushPartition(oids, partitions);
+		CPPUNIT_ASSERT(ccc.size() == 4000);
+		partitions.insert(LogicalPartition(2, 1, 0));
+		ccc.flushPartition(oids, partitions);
+		CPPUNIT_ASSERT(ccc.size() == 0);
+
+		ccc.insert(key1, 100, 0, data, sizeof(data));
+		ccc.insert(key2, 100, 4000, data, sizeof(data));
+		ccc.erase(key2);
+		CPPUNIT_ASSERT(ccc.size() == 4000);
+		CPPUNIT_ASSERT(!ccc.find(key2, 100, 4000, sizeof(data), buf));
+		ccc.flushCache();
+		CPPUNIT_ASSERT(ccc.size() == 0);
+		CPPUNIT_ASSERT(!ccc.find(key1, 100, 0, sizeof(data), buf));
 	}
-	cout << endl;
 
-	gettimeofday(&tv2, NULL);
-	cout << "Loaded: " <<  blksLoaded << " blks " << rangesLoaded << " ranges sec: " << tv2.tv_sec - tv.tv_sec <<endl;
+	void asyncReads()
+	{
+		const uint32_t blocks = 10;
+		char path[] = "/tmp/bctdriverXXXXXX";
+		char block[8192];
+		uint32_t i;
+		int fd;
+
+		// more reads than the context's depth, so readAll() has to batch them
+		AsyncReader reader(4);
+		if (!reader.valid()) {
+			cout << "asyncReads: kernel AIO isn't available, skipping" << endl;
+			return;
+		}
 
-	while (ranges.size() > rangesLoaded) ranges.pop_back();
+		fd = mkstemp(path);
+		CPPUNIT_ASSERT(fd >= 0);
+		for (i = 0; i < blocks; i++) {
+			memset(block, 'a' + i, sizeof(block));
+			CPPUNIT_ASSERT(write(fd, block, sizeof(block)) == sizeof(block));
+		}
+		close(fd);
+
+		// ioManager opens compressed files with O_DIRECT; fall back to buffered
+		// reads on filesystems that don't support it
+		fd = open(path, O_RDONLY | O_DIRECT);
+		if (fd < 0)
+			fd = open(path, O_RDONLY);
+		unlink(path);
+		CPPUNIT_ASSERT(fd >= 0);
+
+		void *mem;
+		CPPUNIT_ASSERT(posix_memalign(&mem, 4096, (blocks + 2) * 8192) == 0);
+		char *bufs = (char *) mem;
+		AsyncReader::Read reads[blocks + 2];
+
+		// read the blocks in reverse order, plus one past EOF and one on a bad fd
+		for (i = 0; i < blocks; i++) {
+			reads[i].fd = fd;
+			reads[i].buf = &bufs[i * 8192];
+			reads[i].offset = (blocks - 1 - i) * 8192;
+			reads[i].len = 8192;
+		}
+		reads[blocks].fd = fd;
+		reads[blocks].buf = &bufs[blocks * 8192];
+		reads[blocks].offset = blocks * 8192;
+		reads[blocks].len = 8192;
+		reads[blocks + 1].fd = -1;
+		reads[blocks + 1].buf = &bufs[(blocks + 1) * 8192];
+		reads[blocks + 1].offset = 0;
+		reads[blocks + 1].len = 8192;
+
+		reader.readAll(reads, blocks + 2);
+		CPPUNIT_ASSERT(reader.valid());
+		for (i = 0; i < blocks; i++) {
+			CPPUNIT_ASSERT(reads[i].result == 8192);
+			CPPUNIT_ASSERT(reads[i].buf[0] == (char) ('a' + blocks - 1 - i));
+			CPPUNIT_ASSERT(reads[i].buf[8191] == (char) ('a' + blocks - 1 - i));
+		}
+		CPPUNIT_ASSERT(reads[blocks].result == 0);
+		CPPUNIT_ASSERT(reads[blocks + 1].result < 0);
 
-#ifdef BLAH
-	for (uint i =0; i<ranges; i++)
-		ReadRange(ranges[i]);
+		close(fd);
+		free(mem);
+	}
 
-	for (uint i =0; i<ranges.size(); i++)
+	// what one cache saves, another loads back
+	void snapshotRoundTrip()
 	{
-		LBIDRange_v rv=ranges[i];
-		for(uint j=0; j < rv.size(); j++)
+		char path[] = "/tmp/bcsnapshotXXXXXX";
+		vector<LBID_t> saved, loaded;
+		vector<LBIDRun> runs;
+		uint32_t i;
+		int fd;
+
+		fd = mkstemp(path);
+		CPPUNIT_ASSERT(fd >= 0);
+		close(fd);
+		string file(path);
+
+		FileBufferMgr fbm(8192);
+		insertRange(fbm, 100, 200);
+		insertRange(fbm, 5000, 5001);
+		insertRange(fbm, 300, 350);
+		insertRange(fbm, 200, 210);
+		fbm.getLBIDs(saved);
+		// the same block cached twice only goes in once
+		saved.push_back(150);
+		CPPUNIT_ASSERT(writeCacheSnapshot(file, saved));
+		CPPUNIT_ASSERT(access((file + ".tmp").c_str(), F_OK) != 0);
+
+		CPPUNIT_ASSERT(readCacheSnapshot(file, runs));
+		CPPUNIT_ASSERT(runs.size() == 3);
+		CPPUNIT_ASSERT(runs[0].start == 100 && runs[0].count == 110);
+		CPPUNIT_ASSERT(runs[1].start == 300 && runs[1].count == 50);
+		CPPUNIT_ASSERT(runs[2].start == 5000 && runs[2].count == 1);
+
+		FileBufferMgr warm(8192);
+		for (i = 0; i < runs.size(); i++)
+			insertRange(warm, runs[i].start, runs[i].start + runs[i].count);
+		warm.getLBIDs(loaded);
+		sort(loaded.begin(), loaded.end());
+		CPPUNIT_ASSERT(loaded == saved);
+
+		// an empty cache leaves just the comment line
+		saved.clear();
+		CPPUNIT_ASSERT(writeCacheSnapshot(file, saved));
+		runs.clear();
+		CPPUNIT_ASSERT(readCacheSnapshot(file, runs));
+		CPPUNIT_ASSERT(runs.empty());
+
+		// lines that don't parse are skipped
 		{
-			const InlineLBIDRange l = {rv[j].start, rv[j].size};
-			for(uint k=l.start; k<l.start+l.size; k++)
-			{
-				LoadLbid(k, ver);
-				ReadLbid(k, ver);
-			}
+			ofstream out(file.c_str());
+			out << "# comment\n\n10 5\ngarbage\n20\n30 0\n40 2\n";
 		}
-	}
-#endif
-
-	pthread_t thr_id[thr_cnt];
-	thr_wait_t thr_wait={0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, ranges};
-	
-	//start threads running
-	cout << "Starting driver threads" << endl;
-	gettimeofday(&tv, NULL);
-	memset(thr_id, 0, thr_cnt*(sizeof(pthread_t)));
-	for(int i=0; i<thr_cnt; i++) {
-		pthread_create(&thr_id[i], NULL, thr_client, &thr_wait);
+		CPPUNIT_ASSERT(readCacheSnapshot(file, runs));
+		CPPUNIT_ASSERT(runs.size() == 2);
+		CPPUNIT_ASSERT(runs[0].start == 10 && runs[0].count == 5);
+		CPPUNIT_ASSERT(runs[1].start == 40 && runs[1].count == 2);
+
+		unlink(path);
+		CPPUNIT_ASSERT(!readCacheSnapshot(file, runs));
+		CPPUNIT_ASSERT(!writeCacheSnapshot("/nonexistent/dir/snapshot", saved));
 	}
 
-	// waiting until all threads have indicated completion
-	pthread_mutex_lock(&thr_wait.fMutex);
-	while (thr_wait.predicate>0) {
-		pthread_cond_wait(&thr_wait.fCond, &thr_wait.fMutex);
-	}
-	pthread_mutex_unlock(&thr_wait.fMutex);
+	// ioManager's partial reads of type 3 chunks, on a file opened with O_DIRECT
+	void subChunkReads()
+	{
+		const uint64_t len = IDBCompressInterface::UNCOMPRESSED_INBUF_LEN;
+		const uint64_t S = IDBCompressInterface::SUBCHUNK_LEN;
+		// a block, the end of one sub-chunk & the start of the next, a span of
+		// several, and the last block, which ends the unpadded file
+		const uint64_t ranges[][2] = {
+			{ 8192, 8192 }, { S - 100, 200 }, { S * 3 + 8192, S * 4 }, { len - 8192, 8192 }
+		};
+		char path[] = "/tmp/bcsubchunkXXXXXX";
+		char path2[] = "/tmp/bcsubchunkXXXXXX";
+		IDBCompressInterface comp;
+		boost::scoped_array<char> in(new char[len]);
+		boost::scoped_array<unsigned char> chunk(new unsigned char[IDBCompressInterface::maxCompressedSize(len)]);
+		boost::scoped_array<char> buf(new char[IDBCompressInterface::maxCompressedSize(len)]);
+		boost::scoped_array<unsigned char> back(new unsigned char[len]);
+		unsigned int chunkLen = IDBCompressInterface::maxCompressedSize(len), backLen;
+		uint64_t outOffset, compLen, i;
+		char hdr[8192];
+		int fd;
+
+		for (i = 0; i < len; i++)
+			in[i] = (char) ((i / 7) ^ (i * 31 >> 9));
+		CPPUNIT_ASSERT(comp.compressBlock(in.get(), len, chunk.get(), chunkLen,
+			IDBCompressInterface::SUBCHUNK_COMPRESSION) == 0);
+
+		// the chunk starts after the file header like the first one in a segment file
+		fd = mkstemp(path);
+		CPPUNIT_ASSERT(fd >= 0);
+		memset(hdr, 0, sizeof(hdr));
+		CPPUNIT_ASSERT(write(fd, hdr, sizeof(hdr)) == sizeof(hdr));
+		CPPUNIT_ASSERT(write(fd, chunk.get(), chunkLen) == (ssize_t) chunkLen);
+		close(fd);
+
+		IDBFactory::installDefaultPlugins();
+		IDBDataFile *fp = IDBDataFile::open(IDBDataFile::UNBUFFERED, path, "r",
+			IDBDataFile::USE_ODIRECT);
+		if (fp == NULL) {
+			cout << "subChunkReads: O_DIRECT isn't supported in /tmp, using buffered reads" << endl;
+			fp = IDBDataFile::open(IDBDataFile::UNBUFFERED, path, "r", 0);
+		}
+		unlink(path);
+		CPPUNIT_ASSERT(fp != NULL);
+		CompChunkPtr ptr(sizeof(hdr), chunkLen);
+
+		for (i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+			CPPUNIT_ASSERT(readSubChunks(fp, ptr, ranges[i][0], ranges[i][1], buf.get(), comp,
+				&outOffset, &compLen));
+			backLen = len;
+			CPPUNIT_ASSERT(comp.uncompressSubChunks(buf.get(), compLen, back.get(), backLen) == 0);
+			CPPUNIT_ASSERT(outOffset <= ranges[i][0]);
+			CPPUNIT_ASSERT(outOffset + backLen >= ranges[i][0] + ranges[i][1]);
+			CPPUNIT_ASSERT(memcmp(&in[outOffset], back.get(), backLen) == 0);
+		}
 
-	// join threads back to main
-	for(int i=0; i<thr_cnt; i++) {
-		pthread_join(thr_id[i], NULL);
+		// unaligned reads on their own, including one that runs to EOF
+		CPPUNIT_ASSERT(alignedPread(fp, buf.get(), sizeof(hdr) + 1, 5000));
+		CPPUNIT_ASSERT(memcmp(buf.get(), &chunk[1], 5000) == 0);
+		CPPUNIT_ASSERT(alignedPread(fp, buf.get(), sizeof(hdr) + chunkLen - 3, 3));
+		CPPUNIT_ASSERT(memcmp(buf.get(), &chunk[chunkLen - 3], 3) == 0);
+		CPPUNIT_ASSERT(!alignedPread(fp, buf.get(), sizeof(hdr) + chunkLen - 3, 4));
+
+		// the caller falls back to reading the whole chunk when it isn't split up
+		chunkLen = IDBCompressInterface::maxCompressedSize(len);
+		CPPUNIT_ASSERT(comp.compressBlock(in.get(), len, chunk.get(), chunkLen) == 0);
+		delete fp;
+		fd = mkstemp(path2);
+		CPPUNIT_ASSERT(fd >= 0);
+		CPPUNIT_ASSERT(write(fd, chunk.get(), chunkLen) == (ssize_t) chunkLen);
+		close(fd);
+		fp = IDBDataFile::open(IDBDataFile::UNBUFFERED, path2, "r", 0);
+		unlink(path2);
+		CPPUNIT_ASSERT(fp != NULL);
+		CPPUNIT_ASSERT(!readSubChunks(fp, CompChunkPtr(0, chunkLen), 0, 8192, buf.get(), comp,
+			&outOffset, &compLen));
+		delete fp;
 	}
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( BlockCacheTest );
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
 
-	gettimeofday(&tv2, NULL);
-	time_t tm=time(0);
-	char t[50];
-	ctime_r(&tm, t);
-	t[strlen(t)-1]=0;
-	uint32_t elTime=tv2.tv_sec-tv.tv_sec;
-	uint64_t total = bfoundTot + rfoundTot;	
-	uint64_t avgTot=0;
-	uint64_t rangeAvg=0;
-	uint64_t blkAvg=0;
-
-	if (elTime>0) {
-		avgTot=(bfoundTot+rfoundTot)/elTime;
-		rangeAvg=(rfoundTot)/elTime;
-		blkAvg=(bfoundTot)/elTime;
-	} else {
-		avgTot=bfoundTot+rfoundTot;
-		rangeAvg=rfoundTot;
-		blkAvg=bfoundTot;
-	}
-	
-	cout << "Summary tm " << t << " " << (tv2.tv_sec-tv.tv_sec) << endl <<
-		"\tBlk: c " << blockOpCountTot << " pass " << bfoundTot << " fail " << bnfoundTot << 
-		//"\tRng: c "<< rangeOpCountTot << " pass " << rfoundTot << " fail " << rnfoundTot << endl <<
-		//"\tNoOp: c " << noOpCountTot << " Total " << total << endl <<
-		//"\tblks/sec Blk " << blkAvg << " Rng " << rangeAvg << " Tot " << avgTot << " Thr " << avgTot/thr_cnt <<  endl << endl;
-		" Blks/Sec Blk " << blkAvg << " Thr " << avgTot/thr_cnt << endl << endl;
-			
-
-	return 0;
-	
-} // end main
@@ -155,6 +155,10 @@ bool isLike(const char *val, const idb_regex_t *regex)
 	if (!regex)
 		throw runtime_error("PrimitiveProcessor::isLike: Missing regular expression for LIKE operator");
 
+	int match = PrimitiveProcessor::likeMatch(regex, val, strlen(val));
+	if (match >= 0)
+		return match;
+
 #ifdef POSIX_REGEX
 	return (regexec(&regex->regex, val, 0, NULL, 0) == 0);
 #else
@@ -921,13 +925,669 @@ inline void p_Col_noprid(const NewColRequestHeader *in, NewColResultHeader *out,
 	}
 }
 #endif
+
+/* Block scan kernels.
+ *
+ * When p_Col is asked to scan a whole block (no RID list), the filter is a plain
+ * list of comparisons and the column compares as an integer, the block is evaluated
+ * one predicate at a time across all of its values instead of one value at a time
+ * across all predicates.  The result is a match vector for the block, and min/max is
+ * gathered in the same pass.  The loops are written so the compiler can vectorize them;
+ * the same template is compiled for each instruction set we care about and the best
+ * one the CPU supports is selected at startup (see PrimitiveProcessor::initBlockScan()).
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+	(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define BLOCKSCAN_HAVE_MULTIVERSION
+#if __GNUC__ >= 6
+#define BLOCKSCAN_HAVE_AVX512
+#endif
+#define BLOCKSCAN_INLINE inline __attribute__((always_inline))
+#else
+#define BLOCKSCAN_INLINE inline
+#endif
+
+enum BlockScanLevel
+{
+	BLOCKSCAN_DISABLED,
+	BLOCKSCAN_GENERIC,
+	BLOCKSCAN_SSE42,
+	BLOCKSCAN_AVX2,
+	BLOCKSCAN_AVX512
+};
+
+BlockScanLevel detectBlockScanLevel()
+{
+#ifdef BLOCKSCAN_HAVE_MULTIVERSION
+	__builtin_cpu_init();
+#ifdef BLOCKSCAN_HAVE_AVX512
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return BLOCKSCAN_AVX512;
+#endif
+	if (__builtin_cpu_supports("avx2"))
+		return BLOCKSCAN_AVX2;
+	if (__builtin_cpu_supports("sse4.2"))
+		return BLOCKSCAN_SSE42;
+#endif
+	return BLOCKSCAN_GENERIC;
+}
+
+BlockScanLevel blockScanLevel = detectBlockScanLevel();
+
+template<int W> struct BlockScanTypes { };
+template<> struct BlockScanTypes<1> { typedef int8_t signed_t;  typedef uint8_t unsigned_t; };
+template<> struct BlockScanTypes<2> { typedef int16_t signed_t; typedef uint16_t unsigned_t; };
+template<> struct BlockScanTypes<4> { typedef int32_t signed_t; typedef uint32_t unsigned_t; };
+template<> struct BlockScanTypes<8> { typedef int64_t signed_t; typedef uint64_t unsigned_t; };
+
+template<typename T>
+struct BlockScanParams
+{
+	const T* vals;
+	unsigned count;
+	const T* args;
+	const uint8_t* cops;
+	unsigned nops;
+	bool isOr;
+	T emptyVal;
+	T nullVal;
+	T nullVal2;
+	uint8_t* match;		// out, 1 byte per value
+	T min;				// out
+	T max;				// out
+};
+
+template<typename T, bool OR, int COP>
+BLOCKSCAN_INLINE void blockScanOp(const T* vals, unsigned count, T arg, uint8_t* match)
+{
+	for (unsigned i = 0; i < count; i++)
+	{
+		uint8_t cmp;
+
+		// COP is a constant, this switch goes away
+		switch (COP)
+		{
+			case COMPARE_LT: cmp = (vals[i] < arg); break;
+			case COMPARE_LE: cmp = (vals[i] <= arg); break;
+			case COMPARE_EQ: cmp = (vals[i] == arg); break;
+			case COMPARE_NE: cmp = (vals[i] != arg); break;
+			case COMPARE_GE: cmp = (vals[i] >= arg); break;
+			default:         cmp = (vals[i] > arg); break;
+		}
+		if (OR)
+			match[i] |= cmp;
+		else
+			match[i] &= cmp;
+	}
+}
+
+template<typename T, bool OR>
+BLOCKSCAN_INLINE void blockScanFilter(const T* vals, unsigned count, T arg, uint8_t cop,
+  uint8_t* match)
+{
+	switch (cop)
+	{
+		case COMPARE_LT: blockScanOp<T, OR, COMPARE_LT>(vals, count, arg, match); break;
+		case COMPARE_LE: blockScanOp<T, OR, COMPARE_LE>(vals, count, arg, match); break;
+		case COMPARE_EQ: blockScanOp<T, OR, COMPARE_EQ>(vals, count, arg, match); break;
+		case COMPARE_NE: blockScanOp<T, OR, COMPARE_NE>(vals, count, arg, match); break;
+		case COMPARE_GE: blockScanOp<T, OR, COMPARE_GE>(vals, count, arg, match); break;
+		case COMPARE_GT: blockScanOp<T, OR, COMPARE_GT>(vals, count, arg, match); break;
+		default:
+			// COMPARE_NIL never matches
+			if (!OR)
+				memset(match, 0, count);
+			break;
+	}
+}
+
+// Returns the number of values that are neither NULL nor empty.
+template<typename T>
+BLOCKSCAN_INLINE unsigned blockScan_(BlockScanParams<T>& p)
+{
+	const T* vals = p.vals;
+	uint8_t* match = p.match;
+	const unsigned count = p.count;
+	// with no filter NULLs pass, otherwise no comparison with a NULL is true
+	const uint8_t nullsMatch = (p.nops == 0);
+	unsigned validCount = 0;
+	T lo = numeric_limits<T>::max();
+	T hi = numeric_limits<T>::min();
+	unsigned i;
+
+	memset(match, (p.isOr ? 0 : 1), count);
+	for (unsigned op = 0; op < p.nops; op++)
+	{
+		if (p.isOr)
+			blockScanFilter<T, true>(vals, count, p.args[op], p.cops[op], match);
+		else
+			blockScanFilter<T, false>(vals, count, p.args[op], p.cops[op], match);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		const T v = vals[i];
+		const uint8_t notNull = (v != p.nullVal) & (v != p.nullVal2);
+		const uint8_t valid = (v != p.emptyVal) & notNull;
+
+		match[i] &= (v != p.emptyVal) & (notNull | nullsMatch);
+		validCount += valid;
+		lo = (valid && v < lo) ? v : lo;
+		hi = (valid && v > hi) ? v : hi;
+	}
+
+	p.min = lo;
+	p.max = hi;
+	return validCount;
+}
+
+#ifdef BLOCKSCAN_HAVE_MULTIVERSION
+template<typename T> __attribute__((target("sse4.2")))
+unsigned blockScanSSE42(BlockScanParams<T>& p)
+{
+	return blockScan_<T>(p);
+}
+
+template<typename T> __attribute__((target("avx2")))
+unsigned blockScanAVX2(BlockScanParams<T>& p)
+{
+	return blockScan_<T>(p);
+}
+
+#ifdef BLOCKSCAN_HAVE_AVX512
+template<typename T> __attribute__((target("avx512f,avx512bw")))
+unsigned blockScanAVX512(BlockScanParams<T>& p)
+{
+	return blockScan_<T>(p);
+}
+#endif
+#endif
+
+template<typename T>
+unsigned blockScan(BlockScanParams<T>& p)
+{
+	switch (blockScanLevel)
+	{
+#ifdef BLOCKSCAN_HAVE_MULTIVERSION
+#ifdef BLOCKSCAN_HAVE_AVX512
+		case BLOCKSCAN_AVX512:
+			return blockScanAVX512<T>(p);
+#endif
+		case BLOCKSCAN_AVX2:
+			return blockScanAVX2<T>(p);
+		case BLOCKSCAN_SSE42:
+			return blockScanSSE42<T>(p);
+#endif
+		default:
+			return blockScan_<T>(p);
+	}
+}
+
+inline bool isBlockScanType(uint8_t type)
+{
+	switch (type)
+	{
+		case CalpontSystemCatalog::TINYINT:
+		case CalpontSystemCatalog::SMALLINT:
+		case CalpontSystemCatalog::MEDINT:
+		case CalpontSystemCatalog::INT:
+		case CalpontSystemCatalog::BIGINT:
+		case CalpontSystemCatalog::DECIMAL:
+		case CalpontSystemCatalog::UDECIMAL:
+		case CalpontSystemCatalog::DATE:
+		case CalpontSystemCatalog::DATETIME:
+		case CalpontSystemCatalog::UTINYINT:
+		case CalpontSystemCatalog::USMALLINT:
+		case CalpontSystemCatalog::UMEDINT:
+		case CalpontSystemCatalog::UINT:
+		case CalpontSystemCatalog::UBIGINT:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/* Find the empty and NULL markers for a type by running the known markers through
+   isEmptyVal() and isNullVal(), so the block scan and the value-at-a-time path can't
+   disagree on what they are.  Returns false if the type doesn't have exactly one empty
+   marker and one or two NULL markers. */
+template<int W>
+bool blockScanMarkers(uint8_t type, uint64_t* emptyVal, uint64_t* nullVal, uint64_t* nullVal2)
+{
+	static const uint64_t markers[] = {
+		joblist::BIGINTNULL, joblist::BIGINTEMPTYROW, joblist::INTNULL, joblist::INTEMPTYROW,
+		joblist::SMALLINTNULL, joblist::SMALLINTEMPTYROW, joblist::TINYINTNULL,
+		joblist::TINYINTEMPTYROW, joblist::UBIGINTNULL, joblist::UBIGINTEMPTYROW,
+		joblist::UINTNULL, joblist::UINTEMPTYROW, joblist::USMALLINTNULL,
+		joblist::USMALLINTEMPTYROW, joblist::UTINYINTNULL, joblist::UTINYINTEMPTYROW,
+		joblist::DATENULL, joblist::DATEEMPTYROW, joblist::DATETIMENULL,
+		joblist::DATETIMEEMPTYROW, joblist::CHAR1NULL, joblist::CHAR1EMPTYROW,
+		joblist::CHAR2NULL, joblist::CHAR2EMPTYROW, joblist::CHAR4NULL,
+		joblist::CHAR4EMPTYROW, joblist::CHAR8NULL, joblist::CHAR8EMPTYROW
+	};
+	const unsigned markerCount = sizeof(markers) / sizeof(markers[0]);
+	const uint64_t mask = (W == 8 ? ~0ULL : (1ULL << (W * 8)) - 1);
+	unsigned emptyCount = 0, nullCount = 0;
+
+	for (unsigned i = 0; i < markerCount; i++)
+	{
+		uint64_t m = markers[i] & mask;
+
+		if (isEmptyVal<W>(type, reinterpret_cast<const uint8_t*>(&m)))
+		{
+			if (emptyCount == 0 || *emptyVal != m)
+			{
+				*emptyVal = m;
+				emptyCount++;
+			}
+		}
+		if (isNullVal<W>(type, reinterpret_cast<const uint8_t*>(&m)))
+		{
+			if (nullCount == 0)
+			{
+				*nullVal = *nullVal2 = m;
+				nullCount++;
+			}
+			else if (*nullVal != m && *nullVal2 != m)
+			{
+				*nullVal2 = m;
+				nullCount++;
+			}
+		}
+	}
+	return (emptyCount == 1 && nullCount >= 1 && nullCount <= 2);
+}
+
+/* Scans the whole block with the block scan kernel if the request allows it.
+   If selection isn't NULL, only the selected rows that pass are stored.
+   Returns false if the caller has to use the value-at-a-time path. */
+template<int W, typename T>
+bool p_Col_blockScan(const NewColRequestHeader *in, NewColResultHeader *out,
+	unsigned outSize, unsigned *written, int* block, unsigned itemsPerBlk,
+	const int64_t* argVals, const uint8_t* cops, const uint8_t* rfs,
+	const uint64_t* selection)
+{
+	uint64_t emptyVal, nullVal, nullVal2;
+	uint8_t match[BLOCK_SIZE];
+	BlockScanParams<T> p;
+	unsigned i, validCount;
+
+	// in logical block mode the caller's buffer holds BLOCK_SIZE values of width W
+	if (!isBlockScanType(in->DataType) || !(in->OutputType & OT_RID) ||
+	  itemsPerBlk > BLOCK_SIZE ||
+	  (in->NOPS > 1 && in->BOP != BOP_AND && in->BOP != BOP_OR))
+		return false;
+
+	if (!blockScanMarkers<W>(in->DataType, &emptyVal, &nullVal, &nullVal2))
+		return false;
+
+	T* args = (T*) alloca(in->NOPS * sizeof(T));
+	for (i = 0; i < in->NOPS; i++)
+	{
+		// comparisons against NULL and rounded values have extra rules; leave them
+		// to colCompare()
+		if (rfs[i] != 0 || isNullVal<W>(in->DataType, reinterpret_cast<const uint8_t*>(&argVals[i])))
+			return false;
+		switch (cops[i])
+		{
+			case COMPARE_NIL:
+			case COMPARE_LT:
+			case COMPARE_LE:
+			case COMPARE_EQ:
+			case COMPARE_NE:
+			case COMPARE_GE:
+			case COMPARE_GT:
+				break;
+			default:
+				return false;
+		}
+		args[i] = static_cast<T>(argVals[i]);
+	}
+
+	p.vals = reinterpret_cast<const T*>(block);
+	p.count = itemsPerBlk;
+	p.args = args;
+	p.cops = cops;
+	p.nops = in->NOPS;
+	p.isOr = (in->NOPS > 1 && in->BOP == BOP_OR);
+	p.emptyVal = static_cast<T>(emptyVal);
+	p.nullVal = static_cast<T>(nullVal);
+	p.nullVal2 = static_cast<T>(nullVal2);
+	p.match = match;
+	validCount = blockScan<T>(p);
+
+	for (i = 0; i < itemsPerBlk; i++)
+		if (match[i] && (selection == NULL || ((selection[i >> 6] >> (i & 63)) & 1)))
+			store(in, out, outSize, written, i, reinterpret_cast<const uint8_t *>(block));
+
+	if (out->ValidMinMax && validCount > 0)
+	{
+		out->Min = static_cast<int64_t>(p.min);
+		out->Max = static_cast<int64_t>(p.max);
+	}
+	return true;
+}
+
+/* A projection step, no filter.  Copies out the values at the given rids, dropping
+   empty rows the same way nextColValue() does. */
+template<int W>
+inline void p_Col_gather(const NewColRequestHeader *in, NewColResultHeader *out,
+	unsigned outSize, unsigned *written, const uint16_t *ridArray, int* block)
+{
+	const uint8_t *block8 = reinterpret_cast<const uint8_t *>(block);
+	uint8_t *out8 = reinterpret_cast<uint8_t *>(out);
+	const uint8_t *vp;
+	uint8_t *outVals;
+	unsigned i, n;
+
+	if (in->OutputType != OT_DATAVALUE)
+	{
+		for (i = 0; i < in->NVALS; i++)
+		{
+			vp = &block8[ridArray[i] * W];
+			if (!isEmptyVal<W>(in->DataType, vp))
+				store(in, out, outSize, written, ridArray[i], block8);
+		}
+		return;
+	}
+
+#ifdef PRIM_DEBUG
+	if (*written + (in->NVALS * W) > outSize) {
+		logIt(35, 2);
+		throw logic_error("PrimitiveProcessor::p_Col_gather(): output buffer is too small");
+	}
+#endif
+	outVals = &out8[*written];
+	for (i = 0, n = 0; i < in->NVALS; i++)
+	{
+		vp = &block8[ridArray[i] * W];
+		if (!isEmptyVal<W>(in->DataType, vp))
+		{
+			memcpy(&outVals[n * W], vp, W);
+			n++;
+		}
+	}
+	out->NVALS += n;
+	*written += n * W;
+}
+
+/* Specialized filter evaluators.  parseColumnFilter() picks one of these once per
+   filter, so the comparisons below have no per-value dispatch on the operator, type,
+   width or signedness.  They only cover what the block scan covers: integer-like
+   types, no rounding flags and no NULL arguments.  NULLs never match then, which is
+   what colCompare() does for those filters. */
+template<typename T, int COP>
+inline bool colFilterOp(T v, T arg)
+{
+	switch (COP)
+	{
+		case COMPARE_LT: return v < arg;
+		case COMPARE_LE: return v <= arg;
+		case COMPARE_EQ: return v == arg;
+		case COMPARE_NE: return v != arg;
+		case COMPARE_GE: return v >= arg;
+		default:         return v > arg;
+	}
+}
+
+// a single comparison
+template<typename T, int COP>
+struct ColFilterOne
+{
+	static inline bool match(T v, const T* args, const uint8_t*, unsigned)
+	{
+		return colFilterOp<T, COP>(v, args[0]);
+	}
+};
+
+// a lower and an upper bound ANDed together, ie BETWEEN
+template<typename T, int LOCOP, int HICOP>
+struct ColFilterRange
+{
+	static inline bool match(T v, const T* args, const uint8_t*, unsigned)
+	{
+		return colFilterOp<T, LOCOP>(v, args[0]) & colFilterOp<T, HICOP>(v, args[1]);
+	}
+};
+
+// anything else ANDed or ORed
+template<typename T, bool OR>
+struct ColFilterAny
+{
+	static inline bool match(T v, const T* args, const uint8_t* cops, unsigned nops)
+	{
+		for (unsigned i = 0; i < nops; i++)
+		{
+			if (colCompare_(v, args[i], cops[i]) == OR)
+				return OR;
+		}
+		return !OR;
+	}
+};
+
+template<int W, typename T, class F>
+bool p_Col_filter(const NewColRequestHeader *in, NewColResultHeader *out,
+	unsigned outSize, unsigned *written, const uint8_t *block, unsigned itemsPerBlk,
+	const uint16_t *ridArray, const ParsedColumnFilter *filter)
+{
+	const T* vals = reinterpret_cast<const T*>(block);
+	const unsigned count = (ridArray ? in->NVALS : itemsPerBlk);
+	const uint8_t* cops = filter->prestored_cops.get();
+	const unsigned nops = in->NOPS;
+	uint64_t emptyVal, nullVal, nullVal2;
+	T empty, null1, null2, v;
+	T lo = numeric_limits<T>::max();
+	T hi = numeric_limits<T>::min();
+	bool valid = false;
+	unsigned i;
+	uint16_t rid;
+
+	// without rids, empty rows are only skipped when the caller wants rids back
+	if ((ridArray == NULL && !(in->OutputType & OT_RID)) ||
+	  !blockScanMarkers<W>(in->DataType, &emptyVal, &nullVal, &nullVal2))
+		return false;
+	empty = static_cast<T>(emptyVal);
+	null1 = static_cast<T>(nullVal);
+	null2 = static_cast<T>(nullVal2);
+
+	T* args = (T*) alloca(nops * sizeof(T));
+	for (i = 0; i < nops; i++)
+		args[i] = static_cast<T>(filter->prestored_argVals[i]);
+
+	for (i = 0; i < count; i++)
+	{
+		rid = (ridArray ? ridArray[i] : i);
+		v = vals[rid];
+		if (v == empty || v == null1 || v == null2)
+			continue;
+		if (F::match(v, args, cops, nops))
+			store(in, out, outSize, written, rid, block);
+		lo = (v < lo ? v : lo);
+		hi = (v > hi ? v : hi);
+		valid = true;
+	}
+
+	if (out->ValidMinMax && valid)
+	{
+		out->Min = static_cast<int64_t>(lo);
+		out->Max = static_cast<int64_t>(hi);
+	}
+	return true;
+}
+
+template<int W, typename T>
+ColumnFilterEvaluator selectColumnFilter(const uint8_t* cops, uint filterCount, uint BOP)
+{
+	if (filterCount == 1)
+	{
+		switch (cops[0])
+		{
+			case COMPARE_LT: return &p_Col_filter<W, T, ColFilterOne<T, COMPARE_LT> >;
+			case COMPARE_LE: return &p_Col_filter<W, T, ColFilterOne<T, COMPARE_LE> >;
+			case COMPARE_EQ: return &p_Col_filter<W, T, ColFilterOne<T, COMPARE_EQ> >;
+			case COMPARE_NE: return &p_Col_filter<W, T, ColFilterOne<T, COMPARE_NE> >;
+			case COMPARE_GE: return &p_Col_filter<W, T, ColFilterOne<T, COMPARE_GE> >;
+			case COMPARE_GT: return &p_Col_filter<W, T, ColFilterOne<T, COMPARE_GT> >;
+			default: return NULL;
+		}
+	}
+
+	if (filterCount == 2 && BOP == BOP_AND &&
+	  (cops[0] == COMPARE_GE || cops[0] == COMPARE_GT) &&
+	  (cops[1] == COMPARE_LE || cops[1] == COMPARE_LT))
+	{
+		if (cops[0] == COMPARE_GE)
+			return (cops[1] == COMPARE_LE ?
+			  &p_Col_filter<W, T, ColFilterRange<T, COMPARE_GE, COMPARE_LE> > :
+			  &p_Col_filter<W, T, ColFilterRange<T, COMPARE_GE, COMPARE_LT> >);
+		else
+			return (cops[1] == COMPARE_LE ?
+			  &p_Col_filter<W, T, ColFilterRange<T, COMPARE_GT, COMPARE_LE> > :
+			  &p_Col_filter<W, T, ColFilterRange<T, COMPARE_GT, COMPARE_LT> >);
+	}
+
+	if (BOP == BOP_AND)
+		return &p_Col_filter<W, T, ColFilterAny<T, false> >;
+	if (BOP == BOP_OR)
+		return &p_Col_filter<W, T, ColFilterAny<T, true> >;
+	return NULL;
+}
+
+// Returns NULL if the filter needs colCompare()'s general rules.
+template<int W>
+ColumnFilterEvaluator selectColumnFilter(const ParsedColumnFilter* filter, uint colType,
+	uint filterCount, uint BOP)
+{
+	uint64_t emptyVal, nullVal, nullVal2;
+
+	if (!isBlockScanType(colType) || filter->likeOps != 0 ||
+	  !blockScanMarkers<W>(colType, &emptyVal, &nullVal, &nullVal2))
+		return NULL;
+
+	for (uint i = 0; i < filterCount; i++)
+	{
+		switch (filter->prestored_cops[i])
+		{
+			case COMPARE_NIL:
+			case COMPARE_LT:
+			case COMPARE_LE:
+			case COMPARE_EQ:
+			case COMPARE_NE:
+			case COMPARE_GE:
+			case COMPARE_GT:
+				break;
+			default:
+				return NULL;
+		}
+		if (filter->prestored_rfs[i] != 0 ||
+		  isNullVal<W>(colType, reinterpret_cast<const uint8_t*>(&filter->prestored_argVals[i])))
+			return NULL;
+	}
+
+	if (isUnsigned((CalpontSystemCatalog::ColDataType)colType))
+		return selectColumnFilter<W, typename BlockScanTypes<W>::unsigned_t>(
+		  filter->prestored_cops.get(), filterCount, BOP);
+	else
+		return selectColumnFilter<W, typename BlockScanTypes<W>::signed_t>(
+		  filter->prestored_cops.get(), filterCount, BOP);
+}
+
+/* A whole block filter over blocks whose runs of equal values are known (see
+   PrimitiveProcessor::setBlockRuns()).  The filter's own evaluator runs once over
+   the runs' values, then the rows of the runs that passed are stored without
+   being compared.  A block that's only described by its distinct values is
+   skipped if none of them pass, and otherwise checked against the ones that did.
+   Returns false if it can't handle the request. */
+template<int W>
+bool p_Col_runs(const NewColRequestHeader *in, NewColResultHeader *out,
+	unsigned outSize, unsigned *written, const uint8_t *block, unsigned itemsPerBlk,
+	const compress::BlockRuns *runs, unsigned runCount, const ParsedColumnFilter *filter)
+{
+	typedef typename BlockScanTypes<W>::unsigned_t U;
+	const unsigned rowsPerBlock = BLOCK_SIZE / W;
+	const unsigned maxVals = compress::BlockRuns::MAX_RUNS * 8;
+	const U* vals = reinterpret_cast<const U*>(block);
+	U runVals[maxVals], passVals[compress::BlockRuns::MAX_RUNS];
+	bool pass[maxVals];
+	uint8_t evalBuf[sizeof(NewColResultHeader) + maxVals * sizeof(uint16_t)];
+	NewColResultHeader *evalOut = reinterpret_cast<NewColResultHeader *>(evalBuf);
+	const uint16_t *passed = reinterpret_cast<const uint16_t *>(evalOut + 1);
+	NewColRequestHeader evalIn;
+	unsigned evalWritten = sizeof(NewColResultHeader);
+	unsigned i, j, k, n, first, end, nPass;
+
+	if (!(in->OutputType & OT_RID) || runCount == 0 || runCount > 8 ||
+	  runCount * rowsPerBlock != itemsPerBlk)
+		return false;
+
+	for (i = 0, n = 0; i < runCount; i++)
+	{
+		if (runs[i].count == 0)
+			return false;
+		for (k = 0; k < runs[i].count; k++)
+			runVals[n++] = static_cast<U>(runs[i].values[k]);
+	}
+
+	evalIn = *in;
+	evalIn.OutputType = OT_RID;
+	evalIn.NVALS = 0;
+	evalOut->NVALS = 0;
+	evalOut->RidFlags = 0;
+	evalOut->ValidMinMax = out->ValidMinMax;
+	evalOut->Min = out->Min;
+	evalOut->Max = out->Max;
+	if (!filter->evaluator(&evalIn, evalOut, sizeof(evalBuf), &evalWritten,
+	  reinterpret_cast<const uint8_t *>(runVals), n, NULL, filter))
+		return false;
+
+	// the runs hold every value in the blocks, so their min & max are the blocks'
+	out->Min = evalOut->Min;
+	out->Max = evalOut->Max;
+
+	memset(pass, 0, n);
+	for (i = 0; i < evalOut->NVALS; i++)
+		pass[passed[i]] = true;
+
+	for (i = 0, n = 0; i < runCount; n += runs[i].count, i++)
+	{
+		first = i * rowsPerBlock;
+		if (runs[i].ordered)
+		{
+			for (k = 0; k < runs[i].count; k++)
+			{
+				if (!pass[n + k])
+					continue;
+				end = first + (k + 1 < runs[i].count ? runs[i].starts[k + 1] : rowsPerBlock);
+				for (j = first + runs[i].starts[k]; j < end; j++)
+					store(in, out, outSize, written, j, block);
+			}
+			continue;
+		}
+
+		for (k = 0, nPass = 0; k < runs[i].count; k++)
+			if (pass[n + k])
+				passVals[nPass++] = runVals[n + k];
+		if (nPass == 0)
+			continue;
+		for (j = first; j < first + rowsPerBlock; j++)
+			for (k = 0; k < nPass; k++)
+				if (vals[j] == passVals[k])
+				{
+					store(in, out, outSize, written, j, block);
+					break;
+				}
+	}
+	return true;
+}
+
 template<int W>
 inline void p_Col_ridArray(NewColRequestHeader *in,
                            NewColResultHeader *out,
                            unsigned outSize,
                            unsigned *written, int* block, Stats* fStatsPtr, unsigned itemsPerBlk,
                            boost::shared_ptr<ParsedColumnFilter> parsedColumnFilter,
-                           UDFFcnPtr_t fp)
+                           UDFFcnPtr_t fp, const compress::BlockRuns *blockRuns,
+                           unsigned blockRunCount, const uint64_t *selection)
 {
     uint16_t *ridArray=0;
     uint8_t *in8 = reinterpret_cast<uint8_t *>(in);
@@ -971,6 +1631,19 @@ inline void p_Col_ridArray(NewColRequestHeader *in,
         out->Max = 0;
     }
 
+    // projection steps only need the values at the rids
+    if (ridArray && in->NOPS == 0 && !fp)
+    {
+        p_Col_gather<W>(in, out, outSize, written, ridArray, block);
+        if (fStatsPtr)
+#ifdef _MSC_VER
+            fStatsPtr->markEvent(in->LBID, GetCurrentThreadId(), in->hdr.SessionID, 'K');
+#else
+            fStatsPtr->markEvent(in->LBID, pthread_self(), in->hdr.SessionID, 'K');
+#endif
+        return;
+    }
+
     const ColArgs *args=NULL;
     int64_t val=0;
     uint64_t uval=0;
@@ -1082,6 +1755,53 @@ inline void p_Col_ridArray(NewColRequestHeader *in,
     }
     // else we have a pre-parsed filter, and it's an unordered set for quick == comparisons
 
+    // blocks made of a few runs only need the filter evaluated once per run
+    if (ridArray == NULL && !fp && blockRuns != NULL && parsedColumnFilter.get() != NULL &&
+      parsedColumnFilter->evaluator != NULL &&
+      p_Col_runs<W>(in, out, outSize, written, reinterpret_cast<const uint8_t *>(block),
+      itemsPerBlk, blockRuns, blockRunCount, parsedColumnFilter.get()))
+    {
+        if (fStatsPtr)
+#ifdef _MSC_VER
+            fStatsPtr->markEvent(in->LBID, GetCurrentThreadId(), in->hdr.SessionID, 'R');
+#else
+            fStatsPtr->markEvent(in->LBID, pthread_self(), in->hdr.SessionID, 'R');
+#endif
+        return;
+    }
+
+    // whole block scans of plain comparisons go through the block scan kernel
+    if (ridArray == NULL && !fp && cops != NULL && likeOps == 0 &&
+      blockScanLevel != BLOCKSCAN_DISABLED)
+    {
+        const int64_t* rawArgVals = (argVals ? argVals : reinterpret_cast<int64_t*>(uargVals));
+        bool scanned;
+
+        if (isUnsigned((CalpontSystemCatalog::ColDataType)in->DataType))
+            scanned = p_Col_blockScan<W, typename BlockScanTypes<W>::unsigned_t>(in, out,
+              outSize, written, block, itemsPerBlk, rawArgVals, cops, rfs, selection);
+        else
+            scanned = p_Col_blockScan<W, typename BlockScanTypes<W>::signed_t>(in, out,
+              outSize, written, block, itemsPerBlk, rawArgVals, cops, rfs, selection);
+
+        if (scanned)
+        {
+            if (fStatsPtr)
+#ifdef _MSC_VER
+                fStatsPtr->markEvent(in->LBID, GetCurrentThreadId(), in->hdr.SessionID, 'K');
+#else
+                fStatsPtr->markEvent(in->LBID, pthread_self(), in->hdr.SessionID, 'K');
+#endif
+            return;
+        }
+    }
+
+    // a pre-parsed filter may have a loop specialized for its operators
+    if (!fp && parsedColumnFilter.get() != NULL && parsedColumnFilter->evaluator != NULL &&
+      parsedColumnFilter->evaluator(in, out, outSize, written, reinterpret_cast<const uint8_t *>(block),
+      itemsPerBlk, ridArray, parsedColumnFilter.get()))
+        return;
+
     if (isUnsigned((CalpontSystemCatalog::ColDataType)in->DataType))
     {
         uval = nextUnsignedColValue<W>(in->DataType, ridArray, in->NVALS, &nextRidIndex, &done, &isNull,
@@ -1392,6 +2112,32 @@ inline void p_Col_ridArray(NewColRequestHeader *in,
 #endif
 }
 
+/* Drops the rows that aren't set in selection from a whole block result */
+void selectRows(const NewColRequestHeader *in, NewColResultHeader *out, unsigned *written,
+	const uint64_t *selection)
+{
+	uint8_t *out8 = reinterpret_cast<uint8_t *>(out);
+	const unsigned entrySize = 2 +
+		((in->OutputType & (OT_TOKEN | OT_DATAVALUE)) ? in->DataSize : 0);
+	unsigned i, n, pos, newPos;
+	uint16_t rid;
+
+	out->RidFlags = 0;
+	pos = newPos = sizeof(NewColResultHeader);
+	for (i = 0, n = 0; i < out->NVALS; i++, pos += entrySize) {
+		memcpy(&rid, &out8[pos], 2);
+		if (!((selection[rid >> 6] >> (rid & 63)) & 1))
+			continue;
+		if (newPos != pos)
+			memmove(&out8[newPos], &out8[pos], entrySize);
+		out->RidFlags |= (1 << (rid >> 10));
+		newPos += entrySize;
+		n++;
+	}
+	out->NVALS = n;
+	*written = newPos;
+}
+
 } //namespace anon
 
 namespace primitives
@@ -1438,27 +2184,57 @@ void PrimitiveProcessor::p_Col(NewColRequestHeader *in, NewColResultHeader *out,
 	switch (in->DataSize)
 	{
 	case 8:
-		p_Col_ridArray<8>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp);
+		p_Col_ridArray<8>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp,
+		  blockRuns, blockRunCount, selection);
 		break;
 	case 4:
-		p_Col_ridArray<4>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp);
+		p_Col_ridArray<4>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp,
+		  blockRuns, blockRunCount, selection);
 		break;
 	case 2:
-		p_Col_ridArray<2>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp);
+		p_Col_ridArray<2>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp,
+		  blockRuns, blockRunCount, selection);
 		break;
 	case 1:
-		p_Col_ridArray<1>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp);
+		p_Col_ridArray<1>(in, out, outSize, written, block, fStatsPtr, itemsPerBlk, parsedColumnFilter, fp,
+		  blockRuns, blockRunCount, selection);
 		break;
 	default:
 		idbassert(0);
 		break;
 	}
+	// the paths other than the block scan kernel filter every row
+	if (selection != NULL && in->NVALS == 0 && (in->OutputType & OT_RID))
+		selectRows(in, out, written, selection);
 	if (fStatsPtr)
 #ifdef _MSC_VER
 		fStatsPtr->markEvent(in->LBID, GetCurrentThreadId(), in->hdr.SessionID, 'C');
 #else
 		fStatsPtr->markEvent(in->LBID, pthread_self(), in->hdr.SessionID, 'C');
 #endif
+	blockRuns = NULL;
+	blockRunCount = 0;
+	selection = NULL;
+}
+
+void PrimitiveProcessor::initBlockScan(bool enable)
+{
+	if (enable)
+		blockScanLevel = detectBlockScanLevel();
+	else
+		blockScanLevel = BLOCKSCAN_DISABLED;
+}
+
+const char* PrimitiveProcessor::blockScanName()
+{
+	switch (blockScanLevel)
+	{
+		case BLOCKSCAN_DISABLED: return "off";
+		case BLOCKSCAN_SSE42: return "sse4.2";
+		case BLOCKSCAN_AVX2: return "avx2";
+		case BLOCKSCAN_AVX512: return "avx512";
+		default: return "generic";
+	}
 }
 
 boost::shared_ptr<ParsedColumnFilter> PrimitiveProcessor::parseColumnFilter
@@ -1587,6 +2363,16 @@ boost::shared_ptr<ParsedColumnFilter> PrimitiveProcessor::parseColumnFilter
 			if (ret->prestored_rfs[argIndex] == 0)
 				ret->prestored_set->insert(ret->prestored_argVals[argIndex]);
 	}
+	else
+	{
+		switch (colWidth)
+		{
+			case 1: ret->evaluator = selectColumnFilter<1>(ret.get(), colType, filterCount, BOP); break;
+			case 2: ret->evaluator = selectColumnFilter<2>(ret.get(), colType, filterCount, BOP); break;
+			case 4: ret->evaluator = selectColumnFilter<4>(ret.get(), colType, filterCount, BOP); break;
+			case 8: ret->evaluator = selectColumnFilter<8>(ret.get(), colType, filterCount, BOP); break;
+		}
+	}
 
 	return ret;
 }
@@ -20,6 +20,8 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 #include <boost/scoped_array.hpp>
 #include <sys/types.h>
 using namespace std;
@@ -558,6 +560,124 @@ inline bool PrimitiveProcessor::isEscapedChar(char c)
 	return ('%' == c || '_' == c);
 }
 
+namespace
+{
+/* Sorts a LIKE pattern into one of the LikeKinds.  Leading and trailing '%'s are
+   allowed, a '%' anywhere else or a '_' in a contains pattern means it needs the
+   regex.  Escapes are handled the same way convertToRegexp() handles them. */
+void analyzeLike(idb_regex_t *regex, const PrimitiveProcessor::p_DataValue *str)
+{
+	string text, wild;
+	bool leadingAny = false, trailingAny = false, hasWild = false;
+	int i;
+	char c;
+
+	regex->likeKind = LIKE_REGEX;
+	regex->likeText.clear();
+	regex->likeWild.clear();
+
+	for (i = 0; i < str->len; i++) {
+		c = (char) str->data[i];
+		if (c == '%') {
+			if (text.empty())
+				leadingAny = true;
+			else
+				trailingAny = true;
+			continue;
+		}
+		if (trailingAny)
+			return;		// a '%' in the middle
+		if (c == '_') {
+			text += c;
+			wild += '\1';
+			hasWild = true;
+			continue;
+		}
+		if (c == backslash && i + 1 < str->len &&
+		  (PrimitiveProcessor::isEscapedChar(str->data[i+1]) || str->data[i+1] == backslash))
+			c = (char) str->data[++i];
+		text += c;
+		wild += '\0';
+	}
+
+	// all '%'s
+	if (text.empty() && leadingAny) {
+		regex->likeKind = LIKE_PREFIX;
+		return;
+	}
+	if (leadingAny && trailingAny) {
+		if (hasWild)
+			return;
+		regex->likeKind = LIKE_CONTAINS;
+	}
+	else if (leadingAny)
+		regex->likeKind = LIKE_SUFFIX;
+	else if (trailingAny)
+		regex->likeKind = LIKE_PREFIX;
+	else
+		regex->likeKind = LIKE_EXACT;
+
+	regex->likeText = text;
+	if (hasWild)
+		regex->likeWild = wild;
+}
+
+// compares len bytes of data against the pattern text, '_' matches any byte
+inline bool likeCompare(const char *data, const char *text, const char *wild, size_t len)
+{
+	if (!wild)
+		return (memcmp(data, text, len) == 0);
+	for (size_t i = 0; i < len; i++)
+		if (!wild[i] && data[i] != text[i])
+			return false;
+	return true;
+}
+
+inline bool isAscii(const char *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		if (data[i] & 0x80)
+			return false;
+	return true;
+}
+}
+
+int PrimitiveProcessor::likeMatch(const idb_regex_t *regex, const char *data, size_t len)
+{
+	const string &text = regex->likeText;
+	const size_t tlen = text.length();
+	const char *wild = (regex->likeWild.empty() ? NULL : regex->likeWild.data());
+
+#ifdef POSIX_REGEX
+	// regexec() stops at the first NUL
+	const char *nul = (const char *) memchr(data, 0, len);
+	if (nul)
+		len = nul - data;
+#endif
+
+	// '_' is one character, which isn't one byte outside of ASCII
+	if (wild && !isAscii(data, len))
+		return -1;
+
+	switch (regex->likeKind) {
+		case LIKE_EXACT:
+			return (len == tlen && likeCompare(data, text.data(), wild, tlen));
+		case LIKE_PREFIX:
+			return (len >= tlen && likeCompare(data, text.data(), wild, tlen));
+		case LIKE_SUFFIX:
+			return (len >= tlen && likeCompare(data + len - tlen, text.data(), wild, tlen));
+		case LIKE_CONTAINS:
+#ifdef _MSC_VER
+			return (std::search(data, data + len, text.begin(), text.end()) != data + len ||
+			  tlen == 0);
+#else
+			return (memmem(data, len, text.data(), tlen) != NULL);
+#endif
+		default:
+			return -1;
+	}
+}
+
 //FIXME: copy/pasted to dataconvert.h: refactor
 int PrimitiveProcessor::convertToRegexp(idb_regex_t *regex, const p_DataValue *str)
 {
@@ -634,11 +754,16 @@ int PrimitiveProcessor::convertToRegexp(idb_regex_t *regex, const p_DataValue *s
 	regex->regex = cBuf;
 #endif
 	regex->used = true;
+	analyzeLike(regex, str);
 	return 0;
 }
 
 bool PrimitiveProcessor::isLike(const p_DataValue *dict, const idb_regex_t *regex) throw()
 {
+	int match = likeMatch(regex, (const char *) dict->data, dict->len);
+	if (match >= 0)
+		return match;
+
 #ifdef POSIX_REGEX
 	char cBuf[dict->len + 1];
 	memcpy(cBuf, dict->data, dict->len);
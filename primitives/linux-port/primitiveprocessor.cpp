@@ -33,7 +33,8 @@ namespace primitives
 {
 
 PrimitiveProcessor::PrimitiveProcessor(int debugLevel) :
-	fDebugLevel(debugLevel), fStatsPtr(NULL), logicalBlockMode(false)
+	fDebugLevel(debugLevel), fStatsPtr(NULL), logicalBlockMode(false), blockRuns(NULL),
+	blockRunCount(0), selection(NULL)
 {
 
 // 	This does
@@ -57,7 +58,8 @@ void PrimitiveProcessor::setParsedColumnFilter(boost::shared_ptr<ParsedColumnFil
 	parsedColumnFilter = pcf;
 }
 
-ParsedColumnFilter::ParsedColumnFilter() : columnFilterMode(STANDARD), likeOps(0)
+ParsedColumnFilter::ParsedColumnFilter() : columnFilterMode(STANDARD), likeOps(0),
+	evaluator(NULL)
 {
 }
 
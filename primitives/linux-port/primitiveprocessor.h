@@ -26,6 +26,7 @@
 #define PRIMITIVEPROCESSOR_H_
 
 #include <stdexcept>
+#include <string>
 #include <vector>
 #ifndef _MSC_VER
 #include <tr1/unordered_set>
@@ -48,6 +49,7 @@
 
 #include "primitivemsg.h"
 #include "calpontsystemcatalog.h"
+#include "blockencoding.h"
 #include "stats.h"
 #include "primproc.h"
 
@@ -83,6 +85,15 @@ class pcfEqual
 typedef std::tr1::unordered_set<int64_t, pcfHasher, pcfEqual> prestored_set_t;
 typedef std::tr1::unordered_set<std::string> DictEqualityFilter;
 
+/* The shapes of LIKE pattern that don't need the regex; see convertToRegexp() */
+enum LikeKind {
+	LIKE_REGEX,
+	LIKE_EXACT,		// 'abc', 'a_c'
+	LIKE_PREFIX,	// 'abc%'
+	LIKE_SUFFIX,	// '%abc'
+	LIKE_CONTAINS	// '%abc%'
+};
+
 struct idb_regex_t
 {
 #ifdef POSIX_REGEX
@@ -91,7 +102,10 @@ struct idb_regex_t
 	boost::regex regex;
 #endif
 	bool used;
-	idb_regex_t() : used(false) { }
+	uint8_t likeKind;
+	std::string likeText;	// the pattern's literal part, unescaped
+	std::string likeWild;	// if not empty, 1 where likeText has a '_'
+	idb_regex_t() : used(false), likeKind(LIKE_REGEX) { }
 	~idb_regex_t() {
 #ifdef POSIX_REGEX
 		if (used)
@@ -100,6 +114,18 @@ struct idb_regex_t
 	}
 };
 
+struct ParsedColumnFilter;
+
+/** @brief A filter loop specialized for one width, signedness and operator set.
+ *
+ * parseColumnFilter() picks one of these when the filter allows it.  It returns
+ * false if it can't handle the request, in which case p_Col falls back to
+ * colCompare().
+ */
+typedef bool (*ColumnFilterEvaluator)(const NewColRequestHeader *in, NewColResultHeader *out,
+	unsigned outSize, unsigned *written, const uint8_t *block, unsigned itemsPerBlk,
+	const uint16_t *ridArray, const ParsedColumnFilter *filter);
+
 struct ParsedColumnFilter {
 	ColumnFilterMode columnFilterMode;
 	boost::shared_array<int64_t> prestored_argVals;
@@ -108,6 +134,7 @@ struct ParsedColumnFilter {
 	boost::shared_ptr<prestored_set_t> prestored_set;
 	boost::shared_array<idb_regex_t> prestored_regex;
 	uint8_t  likeOps;
+	ColumnFilterEvaluator evaluator;
 
 	ParsedColumnFilter();
 	~ParsedColumnFilter();
@@ -248,6 +275,37 @@ public:
 		uint colWidth, uint colType, uint filterCount, uint BOP);
 	void setParsedColumnFilter(boost::shared_ptr<ParsedColumnFilter>);
 
+	/** @brief Gives the next p_Col() the runs of equal values in its blocks
+	 *
+	 * runs has an entry for each physical block of the logical block p_Col will
+	 * filter, in order.  When they're all known, a whole block filter is
+	 * evaluated once per run instead of once per value.  Only the next p_Col()
+	 * call uses them; pass NULL for none.
+	 */
+	void setBlockRuns(const compress::BlockRuns *runs, uint count)
+	{
+		blockRuns = runs;
+		blockRunCount = count;
+	}
+
+	/** @brief Limits the next whole block p_Col() to the selected rows
+	 *
+	 * selection has a bit per row of the logical block.  p_Col still filters the
+	 * whole block, but only returns the selected rows that pass.  The request
+	 * must ask for rids.  Only the next p_Col() call uses it; pass NULL for none.
+	 */
+	void setSelection(const uint64_t *bitmap) { selection = bitmap; }
+
+	/** @brief Selects the kernel p_Col uses for whole block scans.
+	 *
+	 * Picks the widest vector instruction set the CPU supports.  If enable is false,
+	 * p_Col evaluates every block one value at a time.  Should be called once at startup.
+	 */
+	static void initBlockScan(bool enable);
+
+	/** @brief Returns the name of the selected block scan kernel */
+	static const char* blockScanName();
+
 	/** @brief The p_ColAggregate primitive processor.
 	 * 
 	 * The p_ColAggregate primitive processor.  It operates on a column block 
@@ -275,6 +333,11 @@ public:
 	};
 
 	static int convertToRegexp(idb_regex_t *regex, const p_DataValue *str);
+	/** @brief Matches a LIKE pattern without the regex when its shape allows it
+	 *
+	 * Returns 1 or 0 for a match or not, -1 if the caller has to use the regex.
+	 */
+	static int likeMatch(const idb_regex_t *regex, const char *data, size_t len);
 	inline static bool isEscapedChar(char c);
 	boost::shared_array<idb_regex_t> makeLikeFilter(const DictFilterElement *inputMsg, uint count);
 	void setLikeFilter(boost::shared_array<idb_regex_t> filter) { parsedLikeFilter = filter; }
@@ -304,6 +367,9 @@ private:
 	int fDebugLevel;
 	dbbc::Stats* fStatsPtr; // pointer for pmstats
 	bool logicalBlockMode;
+	const compress::BlockRuns *blockRuns;
+	uint blockRunCount;
+	const uint64_t *selection;
 
 	boost::shared_ptr<ParsedColumnFilter> parsedColumnFilter;
 	boost::shared_array<idb_regex_t> parsedLikeFilter;
@@ -127,6 +127,15 @@ CPPUNIT_TEST(p_Col_neg_float_1);
 // negative double column test
 CPPUNIT_TEST(p_Col_neg_double_1);
 
+// block scan kernel vs. value-at-a-time
+CPPUNIT_TEST(p_Col_blockscan_1);
+// specialized filter evaluator vs. colCompare()
+CPPUNIT_TEST(p_Col_evaluator_1);
+// filters evaluated once per run of equal values
+CPPUNIT_TEST(p_Col_runs_1);
+// whole block filter limited to a selection bitmap vs. the same rids sent as a list
+CPPUNIT_TEST(p_Col_selection_1);
+
 // some ports of TokenByScan tests to validate similar & shared code
 CPPUNIT_TEST(p_Dictionary_1);
 CPPUNIT_TEST(p_Dictionary_2);
@@ -157,6 +166,7 @@ CPPUNIT_TEST(p_Dictionary_like_5);	// "_NDO%a%"
 CPPUNIT_TEST(p_Dictionary_like_6);	// "%NIT%ING%D%"
 CPPUNIT_TEST(p_Dictionary_like_7);	// "UNI%TES"
 CPPUNIT_TEST(p_Dictionary_like_8);	// "%TH_OP%"
+CPPUNIT_TEST(p_Dictionary_like_fast_1);
 
 // CPPUNIT_TEST(p_Dictionary_like_prefixbench_1);
 // CPPUNIT_TEST(p_Dictionary_like_substrbench_1);
@@ -3310,6 +3320,313 @@ void p_Col_neg_double_1()
 	close(fd);
 }
 
+// the block scan kernel has to produce the same result as the value-at-a-time path
+void p_Col_blockscan_1()
+{
+	PrimitiveProcessor pp;
+	u_int8_t input[BLOCK_SIZE], output1[4*BLOCK_SIZE], output2[4*BLOCK_SIZE], block[BLOCK_SIZE];
+	NewColRequestHeader *in;
+	NewColResultHeader *out1, *out2;
+	ColArgs *args;
+	int32_t *vals;
+	uint written1, written2, i;
+	int tmp;
+
+	vals = reinterpret_cast<int32_t *>(block);
+	for (i = 0; i < BLOCK_SIZE/4; i++) {
+		if (i % 11 == 0)
+			vals[i] = joblist::INTEMPTYROW;
+		else if (i % 7 == 0)
+			vals[i] = joblist::INTNULL;
+		else
+			vals[i] = (i % 100) - 50;
+	}
+
+	memset(input, 0, BLOCK_SIZE);
+	memset(output1, 0, 4*BLOCK_SIZE);
+	memset(output2, 0, 4*BLOCK_SIZE);
+
+	in = reinterpret_cast<NewColRequestHeader *>(input);
+	out1 = reinterpret_cast<NewColResultHeader *>(output1);
+	out2 = reinterpret_cast<NewColResultHeader *>(output2);
+	args = reinterpret_cast<ColArgs *>(&in[1]);
+
+	in->DataSize = 4;
+	in->DataType = CalpontSystemCatalog::INT;
+	in->OutputType = OT_BOTH;
+	in->NOPS = 2;
+	in->BOP = BOP_AND;
+	in->NVALS = 0;
+
+	tmp = -10;
+	args->COP = COMPARE_GE;
+	memcpy(args->val, &tmp, in->DataSize);
+	args = reinterpret_cast<ColArgs *>(&input[sizeof(NewColRequestHeader) +
+	    sizeof(ColArgs) + in->DataSize]);
+	args->COP = COMPARE_LT;
+	tmp = 20;
+	memcpy(args->val, &tmp, in->DataSize);
+
+	pp.setBlockPtr((int*) block);
+	PrimitiveProcessor::initBlockScan(true);
+	pp.p_Col(in, out1, 4*BLOCK_SIZE, &written1);
+	PrimitiveProcessor::initBlockScan(false);
+	pp.p_Col(in, out2, 4*BLOCK_SIZE, &written2);
+	PrimitiveProcessor::initBlockScan(true);
+
+	CPPUNIT_ASSERT(out1->NVALS > 0);
+	CPPUNIT_ASSERT(out1->NVALS == out2->NVALS);
+	CPPUNIT_ASSERT(written1 == written2);
+	CPPUNIT_ASSERT(out1->ValidMinMax == out2->ValidMinMax);
+	CPPUNIT_ASSERT(out1->Min == -50 && out1->Max == 49);
+	CPPUNIT_ASSERT(out1->Min == out2->Min && out1->Max == out2->Max);
+	CPPUNIT_ASSERT(memcmp(&output1[sizeof(NewColResultHeader)], &output2[sizeof(NewColResultHeader)],
+		written1 - sizeof(NewColResultHeader)) == 0);
+}
+
+void p_Col_evaluator_1()
+{
+	PrimitiveProcessor pp;
+	u_int8_t input[BLOCK_SIZE], output1[4*BLOCK_SIZE], output2[4*BLOCK_SIZE], block[BLOCK_SIZE];
+	NewColRequestHeader *in;
+	NewColResultHeader *out1, *out2;
+	ColArgs *args;
+	int16_t *vals;
+	u_int16_t *rids;
+	uint written1, written2, i;
+	int16_t tmp;
+
+	vals = reinterpret_cast<int16_t *>(block);
+	for (i = 0; i < BLOCK_SIZE/2; i++) {
+		if (i % 13 == 0)
+			vals[i] = joblist::SMALLINTEMPTYROW;
+		else if (i % 5 == 0)
+			vals[i] = joblist::SMALLINTNULL;
+		else
+			vals[i] = (i % 300) - 150;
+	}
+
+	memset(input, 0, BLOCK_SIZE);
+	memset(output1, 0, 4*BLOCK_SIZE);
+	memset(output2, 0, 4*BLOCK_SIZE);
+
+	in = reinterpret_cast<NewColRequestHeader *>(input);
+	out1 = reinterpret_cast<NewColResultHeader *>(output1);
+	out2 = reinterpret_cast<NewColResultHeader *>(output2);
+	args = reinterpret_cast<ColArgs *>(&in[1]);
+
+	in->DataSize = 2;
+	in->DataType = CalpontSystemCatalog::SMALLINT;
+	in->OutputType = OT_BOTH;
+	in->NOPS = 2;
+	in->BOP = BOP_AND;
+	in->NVALS = 1000;
+
+	tmp = -100;
+	args->COP = COMPARE_GE;
+	memcpy(args->val, &tmp, in->DataSize);
+	args = reinterpret_cast<ColArgs *>(&input[sizeof(NewColRequestHeader) +
+	    sizeof(ColArgs) + in->DataSize]);
+	args->COP = COMPARE_LE;
+	tmp = 100;
+	memcpy(args->val, &tmp, in->DataSize);
+
+	rids = reinterpret_cast<u_int16_t *>(&input[sizeof(NewColRequestHeader) +
+		2 * (sizeof(ColArgs) + in->DataSize)]);
+	for (i = 0; i < in->NVALS; i++)
+		rids[i] = (i * 3) % (BLOCK_SIZE/2);
+
+	pp.setBlockPtr((int*) block);
+	boost::shared_ptr<ParsedColumnFilter> filter = pp.parseColumnFilter(
+		reinterpret_cast<u_int8_t *>(&in[1]), in->DataSize, in->DataType, in->NOPS, in->BOP);
+	CPPUNIT_ASSERT(filter->evaluator != NULL);
+	pp.setParsedColumnFilter(filter);
+	pp.p_Col(in, out1, 4*BLOCK_SIZE, &written1);
+	pp.setParsedColumnFilter(boost::shared_ptr<ParsedColumnFilter>());
+	pp.p_Col(in, out2, 4*BLOCK_SIZE, &written2);
+
+	CPPUNIT_ASSERT(out1->NVALS > 0);
+	CPPUNIT_ASSERT(out1->NVALS == out2->NVALS);
+	CPPUNIT_ASSERT(written1 == written2);
+	CPPUNIT_ASSERT(out1->Min == out2->Min && out1->Max == out2->Max);
+	CPPUNIT_ASSERT(memcmp(&output1[sizeof(NewColResultHeader)], &output2[sizeof(NewColResultHeader)],
+		written1 - sizeof(NewColResultHeader)) == 0);
+}
+
+void p_Col_runs_1()
+{
+	PrimitiveProcessor pp;
+	u_int8_t input[BLOCK_SIZE], output1[4*BLOCK_SIZE], output2[4*BLOCK_SIZE], block[BLOCK_SIZE];
+	NewColRequestHeader *in;
+	NewColResultHeader *out1, *out2;
+	ColArgs *args;
+	compress::BlockRuns runs;
+	int32_t *vals;
+	uint written1, written2, i;
+	int tmp;
+	const int32_t runVals[] = { 5, joblist::INTNULL, -30, 12, joblist::INTEMPTYROW, 40 };
+	const u_int16_t runStarts[] = { 0, 100, 350, 351, 1200, 1500 };
+
+	runs.count = 6;
+	runs.ordered = true;
+	for (i = 0; i < runs.count; i++) {
+		runs.values[i] = static_cast<u_int32_t>(runVals[i]);
+		runs.starts[i] = runStarts[i];
+	}
+
+	vals = reinterpret_cast<int32_t *>(block);
+	for (i = 0; i < BLOCK_SIZE/4; i++) {
+		tmp = 0;
+		while (tmp + 1 < runs.count && runStarts[tmp + 1] <= i)
+			tmp++;
+		vals[i] = runVals[tmp];
+	}
+
+	memset(input, 0, BLOCK_SIZE);
+	memset(output1, 0, 4*BLOCK_SIZE);
+	memset(output2, 0, 4*BLOCK_SIZE);
+
+	in = reinterpret_cast<NewColRequestHeader *>(input);
+	out1 = reinterpret_cast<NewColResultHeader *>(output1);
+	out2 = reinterpret_cast<NewColResultHeader *>(output2);
+	args = reinterpret_cast<ColArgs *>(&in[1]);
+
+	in->DataSize = 4;
+	in->DataType = CalpontSystemCatalog::INT;
+	in->OutputType = OT_BOTH;
+	in->NOPS = 2;
+	in->BOP = BOP_AND;
+	in->NVALS = 0;
+
+	tmp = 0;
+	args->COP = COMPARE_GT;
+	memcpy(args->val, &tmp, in->DataSize);
+	args = reinterpret_cast<ColArgs *>(&input[sizeof(NewColRequestHeader) +
+	    sizeof(ColArgs) + in->DataSize]);
+	args->COP = COMPARE_LT;
+	tmp = 20;
+	memcpy(args->val, &tmp, in->DataSize);
+
+	pp.setBlockPtr((int*) block);
+	boost::shared_ptr<ParsedColumnFilter> filter = pp.parseColumnFilter(
+		reinterpret_cast<u_int8_t *>(&in[1]), in->DataSize, in->DataType, in->NOPS, in->BOP);
+	CPPUNIT_ASSERT(filter->evaluator != NULL);
+	pp.setParsedColumnFilter(filter);
+	pp.setBlockRuns(&runs, 1);
+	pp.p_Col(in, out1, 4*BLOCK_SIZE, &written1);
+	// p_Col forgets the runs once it's used them
+	pp.p_Col(in, out2, 4*BLOCK_SIZE, &written2);
+
+	CPPUNIT_ASSERT(out1->NVALS == 100 + 849);
+	CPPUNIT_ASSERT(out1->NVALS == out2->NVALS);
+	CPPUNIT_ASSERT(written1 == written2);
+	CPPUNIT_ASSERT(out1->Min == -30 && out1->Max == 40);
+	CPPUNIT_ASSERT(out1->Min == out2->Min && out1->Max == out2->Max);
+	CPPUNIT_ASSERT(memcmp(&output1[sizeof(NewColResultHeader)], &output2[sizeof(NewColResultHeader)],
+		written1 - sizeof(NewColResultHeader)) == 0);
+
+	// the same values, described only by their distinct values
+	runs.ordered = false;
+	memset(output1, 0, 4*BLOCK_SIZE);
+	pp.setBlockRuns(&runs, 1);
+	pp.p_Col(in, out1, 4*BLOCK_SIZE, &written1);
+
+	CPPUNIT_ASSERT(out1->NVALS == out2->NVALS);
+	CPPUNIT_ASSERT(written1 == written2);
+	CPPUNIT_ASSERT(memcmp(&output1[sizeof(NewColResultHeader)], &output2[sizeof(NewColResultHeader)],
+		written1 - sizeof(NewColResultHeader)) == 0);
+}
+
+// a whole block filter with a selection bitmap has to return what the ridlist does
+void p_Col_selection_1()
+{
+	PrimitiveProcessor pp;
+	u_int8_t input[BLOCK_SIZE], output1[4*BLOCK_SIZE], output2[4*BLOCK_SIZE],
+		output3[4*BLOCK_SIZE], block[BLOCK_SIZE];
+	NewColRequestHeader *in;
+	NewColResultHeader *out1, *out2, *out3;
+	ColArgs *args;
+	int32_t *vals;
+	u_int16_t *rids;
+	uint64_t selection[BLOCK_SIZE / 64];
+	uint written1, written2, written3, i, n;
+	int tmp;
+
+	vals = reinterpret_cast<int32_t *>(block);
+	for (i = 0; i < BLOCK_SIZE/4; i++) {
+		if (i % 11 == 0)
+			vals[i] = joblist::INTEMPTYROW;
+		else if (i % 7 == 0)
+			vals[i] = joblist::INTNULL;
+		else
+			vals[i] = (i % 100) - 50;
+	}
+
+	memset(input, 0, BLOCK_SIZE);
+	memset(output1, 0, 4*BLOCK_SIZE);
+	memset(output2, 0, 4*BLOCK_SIZE);
+	memset(output3, 0, 4*BLOCK_SIZE);
+
+	in = reinterpret_cast<NewColRequestHeader *>(input);
+	out1 = reinterpret_cast<NewColResultHeader *>(output1);
+	out2 = reinterpret_cast<NewColResultHeader *>(output2);
+	out3 = reinterpret_cast<NewColResultHeader *>(output3);
+	args = reinterpret_cast<ColArgs *>(&in[1]);
+
+	in->DataSize = 4;
+	in->DataType = CalpontSystemCatalog::INT;
+	in->OutputType = OT_BOTH;
+	in->NOPS = 2;
+	in->BOP = BOP_AND;
+	in->NVALS = 0;
+
+	tmp = -10;
+	args->COP = COMPARE_GE;
+	memcpy(args->val, &tmp, in->DataSize);
+	args = reinterpret_cast<ColArgs *>(&input[sizeof(NewColRequestHeader) +
+	    sizeof(ColArgs) + in->DataSize]);
+	args->COP = COMPARE_LT;
+	tmp = 20;
+	memcpy(args->val, &tmp, in->DataSize);
+
+	// every third row, except in the second quarter
+	memset(selection, 0, sizeof(selection));
+	rids = reinterpret_cast<u_int16_t *>(&input[sizeof(NewColRequestHeader) +
+		2 * (sizeof(ColArgs) + in->DataSize)]);
+	for (i = 0, n = 0; i < BLOCK_SIZE/4; i++)
+		if (i % 3 == 0 && (i < 512 || i >= 1024)) {
+			selection[i >> 6] |= (1ULL << (i & 63));
+			rids[n++] = i;
+		}
+
+	pp.setBlockPtr((int*) block);
+	// the block scan kernel
+	pp.setSelection(selection);
+	pp.p_Col(in, out1, 4*BLOCK_SIZE, &written1);
+	// value at a time
+	PrimitiveProcessor::initBlockScan(false);
+	pp.setSelection(selection);
+	pp.p_Col(in, out2, 4*BLOCK_SIZE, &written2);
+	PrimitiveProcessor::initBlockScan(true);
+	// the ridlist
+	in->NVALS = n;
+	pp.p_Col(in, out3, 4*BLOCK_SIZE, &written3);
+
+	CPPUNIT_ASSERT(out3->NVALS > 0);
+	CPPUNIT_ASSERT(out1->NVALS == out3->NVALS && out2->NVALS == out3->NVALS);
+	CPPUNIT_ASSERT(written1 == written3 && written2 == written3);
+	CPPUNIT_ASSERT(out1->RidFlags == out3->RidFlags && out2->RidFlags == out3->RidFlags);
+	CPPUNIT_ASSERT(memcmp(&output1[sizeof(NewColResultHeader)], &output3[sizeof(NewColResultHeader)],
+		written3 - sizeof(NewColResultHeader)) == 0);
+	CPPUNIT_ASSERT(memcmp(&output2[sizeof(NewColResultHeader)], &output3[sizeof(NewColResultHeader)],
+		written3 - sizeof(NewColResultHeader)) == 0);
+
+	// p_Col forgets the selection once it's used it
+	in->NVALS = 0;
+	pp.p_Col(in, out1, 4*BLOCK_SIZE, &written1);
+	CPPUNIT_ASSERT(out1->NVALS > out3->NVALS);
+}
+
 void p_Dictionary_1()
 {
 	PrimitiveProcessor pp;
@@ -4408,6 +4725,34 @@ void p_Dictionary_like_8()
 	}
 }
 
+// the LIKE shapes that skip the regex have to agree with it
+void p_Dictionary_like_fast_1()
+{
+	const char *patterns[] = { "UNITED", "UNI%", "%TES", "%ITED ST%", "U_ITED%", "%",
+		"UNI\\%", "%ITED%ST%" };
+	const char *values[] = { "UNITED", "UNITED STATES", "UNI%", "", "UXITED KINGDOM",
+		"STATES" };
+	const uint patternCount = sizeof(patterns) / sizeof(patterns[0]);
+	const uint valueCount = sizeof(values) / sizeof(values[0]);
+	PrimitiveProcessor::p_DataValue dv;
+	uint i, j;
+	int fast;
+
+	for (i = 0; i < patternCount; i++) {
+		idb_regex_t regex;
+
+		dv.len = strlen(patterns[i]);
+		dv.data = reinterpret_cast<const u_int8_t *>(patterns[i]);
+		PrimitiveProcessor::convertToRegexp(&regex, &dv);
+		CPPUNIT_ASSERT(regex.likeKind != LIKE_REGEX || i == 7);
+		for (j = 0; j < valueCount; j++) {
+			fast = PrimitiveProcessor::likeMatch(&regex, values[j], strlen(values[j]));
+			if (fast >= 0)
+				CPPUNIT_ASSERT(fast == (regexec(&regex.regex, values[j], 0, NULL, 0) == 0));
+		}
+	}
+}
+
 void p_Dictionary_like_prefixbench_1()
 {
 	PrimitiveProcessor pp;
@@ -36,6 +36,7 @@
 #include <string>
 #include <sstream>
 #include <set>
+#include <algorithm>
 using namespace std;
 
 #include <boost/thread.hpp>
@@ -44,6 +45,7 @@ using namespace boost;
 
 #include "bpp.h"
 #include "primitiveserver.h"
+#include "numatopology.h"
 #include "errorcodes.h"
 #include "exceptclasses.h"
 #include "pp_logger.h"
@@ -74,6 +76,17 @@ extern int fCacheCount;
 extern uint connectionsPerUM;
 extern int noVB;
 
+inline uint lowestSetBit(uint64_t word)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, word);
+	return idx;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
 BatchPrimitiveProcessor::BatchPrimitiveProcessor() :
 	ot(BPS_ELEMENT_TYPE),
 	txnID(0),
@@ -106,7 +119,12 @@ BatchPrimitiveProcessor::BatchPrimitiveProcessor() :
 	filtOnString(false),
 	prefetchThreshold(0),
 	hasDictStep(false),
-	sockIndex(0)
+	raWindow(scanReadAheadChunks),
+	raNotUsed(0),
+	raNotUsedValid(false),
+	bufferNode(-1),
+	sockIndex(0),
+	topNLimit(0)
 {
 	pp.setLogicalBlockMode(true);
 	pp.setBlockPtr((int *) blockData);
@@ -145,7 +163,12 @@ BatchPrimitiveProcessor::BatchPrimitiveProcessor(ByteStream &b, double prefetch,
 	filtOnString(false),
 	prefetchThreshold(prefetch),
 	hasDictStep(false),
-	sockIndex(0)
+	raWindow(scanReadAheadChunks),
+	raNotUsed(0),
+	raNotUsedValid(false),
+	bufferNode(-1),
+	sockIndex(0),
+	topNLimit(0)
 {
 	pp.setLogicalBlockMode(true);
 	pp.setBlockPtr((int *) blockData);
@@ -370,6 +393,30 @@ void BatchPrimitiveProcessor::initBPP(ByteStream &bs)
 // 			cout << "Made an aggregator\n";
 			bs >> *(fAggregator.get());
 		}
+
+		uint32_t bloomCount;
+		bs >> bloomCount;
+		bloomFilters.resize(bloomCount);
+		for (i = 0; i < bloomCount; i++) {
+			bloomFilters[i].reset(new JoinBloomFilter());
+			bloomFilters[i]->deserialize(bs);
+		}
+
+		bs >> topNLimit;
+		if (topNLimit > 0) {
+			uint32_t specCount;
+			int32_t tmp32;
+			bs >> specCount;
+			topNSpec.resize(specCount);
+			for (i = 0; i < specCount; i++) {
+				bs >> tmp32;
+				topNSpec[i].fIndex = tmp32;
+				bs >> tmp32;
+				topNSpec[i].fAsc = tmp32;
+				bs >> tmp32;
+				topNSpec[i].fNf = tmp32;
+			}
+		}
 	}
 
 	initProcessor();
@@ -440,6 +487,41 @@ void BatchPrimitiveProcessor::resetBPP(ByteStream &bs, const SP_UM_MUTEX& w,
 #endif
 }
 
+bool BatchPrimitiveProcessor::scanLBID(const ByteStream &bs, uint64_t *lbid) const
+{
+	// a scan's first filter step is the ColumnCommand doing it, which starts with the LBID
+	if (!hasScan || hasRowGroup || filterCount == 0 ||
+	  filterSteps[0]->getCommandType() != Command::COLUMN_COMMAND)
+		return false;
+
+	// only copy the part of the msg before the LBID; this follows resetBPP()
+	const uint32_t prefixLen = sizeof(ISMPacketHeader) + 16 + sizeof(dbRoot) + sizeof(count) +
+	  sizeof(ridCount) + sizeof(ridMap) + sizeof(baseRid) + sizeof(*lbid);
+	ByteStream prefix(bs.buf(), min(bs.length(), prefixLen));
+	uint tmpDBRoot;
+	uint16_t tmpCount, tmpRidCount;
+	uint8_t tmpRidMap;
+	uint64_t tmpBaseRid;
+
+	try {
+		prefix.advance(sizeof(ISMPacketHeader) + 16);
+		prefix >> tmpDBRoot;
+		prefix >> tmpCount;
+		prefix >> tmpRidCount;
+		if (tmpRidCount != 0)
+			return false;
+		if (!gotAbsRids) {
+			prefix >> tmpRidMap;
+			prefix >> tmpBaseRid;
+		}
+		prefix >> *lbid;
+	}
+	catch (std::exception &) {
+		return false;
+	}
+	return true;
+}
+
 void BatchPrimitiveProcessor::addToJoiner(ByteStream &bs)
 {
 	uint32_t count, i, joinerNum, tlIndex;
@@ -626,6 +708,19 @@ void BatchPrimitiveProcessor::initProcessor()
 				joinFEMappings[joinerCount] = makeMapping(largeSideRG, *joinFERG);
 			}
 		}
+		if (!bloomFilters.empty()) {
+			if (!doJoin) {
+				outputRG.initRow(&oldRow);
+				outputRG.initRow(&newRow);
+				keyColumnProj.reset(new bool[projectCount]);
+				for (i = 0; i < projectCount; i++)
+					keyColumnProj[i] = false;
+			}
+			for (i = 0; i < projectCount; i++)
+				for (j = 0; j < bloomFilters.size(); j++)
+					if (projectionMap[i] == (int) bloomFilters[j]->getKeyColumn())
+						keyColumnProj[i] = true;
+		}
 		/*
 		Calculate the FE1 -> projection mapping
 		Calculate the projection step -> FE1 input mapping
@@ -732,6 +827,17 @@ void BatchPrimitiveProcessor::initProcessor()
 		else
 			fAggregator->setInputOutput(fe2 ? fe2Output : outputRG, &fAggregateRG);
 	}
+
+	if (topNLimit > 0)
+	{
+		topNRG = (fe2 ? fe2Output : outputRG);
+		topNData.reinit(topNRG, topNLimit);
+		topNRG.setData(&topNData);
+		topNRG.initRow(&topNIn);
+		topNRG.initRow(&topNRow);
+		topNCompare.reset(new ordering::OrderByData(topNSpec, topNRG));
+		resetTopN();
+	}
 	minVal = MAX64;
 	maxVal = MIN64;
 
@@ -741,6 +847,42 @@ void BatchPrimitiveProcessor::initProcessor()
 	asyncLoaded.reset(new bool[projectCount + 1]);
 }
 
+/* Sets ridBitmap from the ridlist.  Returns true if the ridlist is in ascending
+   order, which is the order a scan of the logical block produces. */
+bool BatchPrimitiveProcessor::ridsToBitmap()
+{
+	bool ascending = true;
+	uint i;
+
+	memset(ridBitmap, 0, sizeof(ridBitmap));
+	for (i = 0; i < ridCount; i++) {
+		ridBitmap[relRids[i] >> 6] |= (1ULL << (relRids[i] & 63));
+		if (i > 0 && relRids[i] <= relRids[i - 1])
+			ascending = false;
+	}
+	return ascending;
+}
+
+/* Rebuilds relRids, ridCount and ridMap from ridBitmap */
+void BatchPrimitiveProcessor::bitmapToRids()
+{
+	uint i;
+	uint64_t word;
+
+	ridCount = 0;
+	ridMap = 0;
+	for (i = 0; i < LOGICAL_BLOCK_RIDS / 64; i++) {
+		word = ridBitmap[i];
+		if (word == 0)
+			continue;
+		ridMap |= 1 << (i >> 4);   // each ridMap bit covers 1024 rids, 16 words
+		while (word != 0) {
+			relRids[ridCount++] = (i << 6) + lowestSetBit(word);
+			word &= word - 1;
+		}
+	}
+}
+
 void BatchPrimitiveProcessor::executeJoin()
 {
 	uint newRowCount, i;
@@ -757,6 +899,86 @@ void BatchPrimitiveProcessor::executeJoin()
 	ridCount = newRowCount;
 }
 
+/* Drops the rows whose key can't have a match in one of the UM joins.  This runs
+ * after the key columns are projected and before the PM joins. */
+void BatchPrimitiveProcessor::applyBloomFilters()
+{
+	uint newRowCount = 0, i, j;
+
+	outputRG.getRow(0, &oldRow);
+	outputRG.getRow(0, &newRow);
+
+	for (i = 0; i < ridCount; i++, oldRow.nextRow()) {
+		for (j = 0; j < bloomFilters.size(); j++)
+			if (!bloomFilters[j]->mayContain(bloomFilters[j]->getKey(oldRow)))
+				break;
+		if (j == bloomFilters.size()) {
+			if (i != newRowCount) {
+				values[newRowCount] = values[i];
+				relRids[newRowCount] = relRids[i];
+				copyRow(oldRow, &newRow);
+			}
+			newRowCount++;
+			newRow.nextRow();
+		}
+	}
+	ridCount = newRowCount;
+	outputRG.setRowCount(ridCount);
+}
+
+namespace {
+/* Keeps std::*_heap() from copying the OrderByData on every call */
+struct TopNLess
+{
+	TopNLess(ordering::OrderByData *o) : ob(o) { }
+	bool operator()(Row::Pointer p1, Row::Pointer p2) const { return (*ob)(p1, p2); }
+	ordering::OrderByData *ob;
+};
+}
+
+void BatchPrimitiveProcessor::resetTopN()
+{
+	topNHeap.clear();
+	topNRG.resetRowGroup(0);
+}
+
+/* Merges rg into the top-N heap, which keeps the rows that sort first at the
+ * back of the heap and the worst of them at the front.  The UM only needs
+ * those rows from each job, so the last block of the job sends them and the
+ * others send an empty rowgroup. */
+void BatchPrimitiveProcessor::processTopN(RowGroup &rg)
+{
+	TopNLess less(topNCompare.get());
+	uint i, rowCount = rg.getRowCount();
+
+	rg.getRow(0, &topNIn);
+	for (i = 0; i < rowCount; i++, topNIn.nextRow()) {
+		if (topNHeap.size() < topNLimit) {
+			topNRG.getRow(topNHeap.size(), &topNRow);
+			copyRow(topNIn, &topNRow);
+			topNHeap.push_back(topNRow.getPointer());
+			push_heap(topNHeap.begin(), topNHeap.end(), less);
+		}
+		else if (less(topNIn.getPointer(), topNHeap.front())) {
+			pop_heap(topNHeap.begin(), topNHeap.end(), less);
+			topNRow.setPointer(topNHeap.back());
+			copyRow(topNIn, &topNRow);
+			push_heap(topNHeap.begin(), topNHeap.end(), less);
+		}
+	}
+
+	if ((currentBlockOffset+1) == count) {
+		topNRG.setRowCount(topNHeap.size());
+		topNRG.setDBRoot(dbRoot);
+		topNRG.serializeRGData(*serialized);
+		resetTopN();
+	}
+	else {
+		rg.setRowCount(0);
+		rg.serializeRGData(*serialized);
+	}
+}
+
 /* This version does a join on projected rows */
 void BatchPrimitiveProcessor::executeTupleJoin()
 {
@@ -977,6 +1199,9 @@ void BatchPrimitiveProcessor::execute()
 #ifdef PRIMPROC_STOPWATCH
 stopwatch->start("BatchPrimitiveProcessor::execute first part");
 #endif
+	if (hasScan && scanReadAheadChunks > 0)
+		readAheadScanColumns();
+
 	// if only one scan step which has no predicate, async load all columns
 	if (filterCount == 1 && hasScan) {
 		ColumnCommand* col = dynamic_cast<ColumnCommand*>(filterSteps[0].get());
@@ -1037,33 +1262,24 @@ stopwatch->start("BatchPrimitiveProcessor::execute second part");
 		no longer necessary to add the loader columncommand to the filter array.
 		*/
 
-		bool accumulator[LOGICAL_BLOCK_RIDS];
 // 		uint realFilterCount = ((forHJ || hasPassThru) ? filterCount - 1 : filterCount);
 		uint realFilterCount = filterCount;
 
-		for (i = 0; i < LOGICAL_BLOCK_RIDS; i++)
-			accumulator[i] = false;
-
 		if (!hasScan)  // there are input rids
-			for (i = 0; i < ridCount; i++)
-				accumulator[relRids[i]] = true;
+			ridsToBitmap();
+		else
+			memset(ridBitmap, 0, sizeof(ridBitmap));
 		ridCount = 0;
 		for (i = 0; i < realFilterCount; ++i) {
 			filterSteps[i]->execute();
 			if (! filterSteps[i]->filterFeeder())
 			{
 				for (j = 0; j < ridCount; j++)
-					accumulator[relRids[j]] = true;
+					ridBitmap[relRids[j] >> 6] |= (1ULL << (relRids[j] & 63));
 				ridCount = 0;
 			}
 		}
-		for (ridMap = 0, i = 0; i < LOGICAL_BLOCK_RIDS; ++i) {
-			if (accumulator[i]) {
-				relRids[ridCount] = i;
-				ridMap |= 1 << (relRids[ridCount] >> 10);
-				++ridCount;
-			}
-		}
+		bitmapToRids();
 	}
 
 #ifdef PRIMPROC_STOPWATCH
@@ -1160,7 +1376,7 @@ stopwatch->start("BatchPrimitiveProcessor::execute fourth part");
 		a join.  The key columns get projected first, the join is executed to further
 		reduce the ridlist, then the rest of the columns get projected */
 
-		if (!doJoin)
+		if (!doJoin && bloomFilters.empty())
 		{
 			for (j = 0; j < projectCount; ++j) {
 // 				cout << "projectionMap[" << j << "] = " << projectionMap[j] << endl;
@@ -1179,8 +1395,9 @@ stopwatch->start("BatchPrimitiveProcessor::execute fourth part");
 		}
 		else {
 			/* project the key columns.  If there's the filter IN the join, project everything. */
+			bool projectAll = (doJoin && hasJoinFEFilters);
 			for (j = 0; j < projectCount; j++)
-				if (keyColumnProj[j] || (hasJoinFEFilters && projectionMap[j] != -1))
+				if (keyColumnProj[j] || (projectAll && projectionMap[j] != -1))
 				{
 #ifdef PRIMPROC_STOPWATCH
 					stopwatch->start("-- projectIntoRowGroup");
@@ -1191,18 +1408,23 @@ stopwatch->start("BatchPrimitiveProcessor::execute fourth part");
 #endif
 				}
 
+			if (!bloomFilters.empty())
+				applyBloomFilters();
+
+			if (doJoin) {
 #ifdef PRIMPROC_STOPWATCH
-			stopwatch->start("-- executeTupleJoin()");
-			executeTupleJoin();
-			stopwatch->stop("-- executeTupleJoin()");
+				stopwatch->start("-- executeTupleJoin()");
+				executeTupleJoin();
+				stopwatch->stop("-- executeTupleJoin()");
 #else
-		executeTupleJoin();
+				executeTupleJoin();
 #endif
+			}
 
 			/* project the non-key columns */
 			for (j = 0; j < projectCount; ++j)
 			{
-				if ((!keyColumnProj[j] && projectionMap[j] != -1) && !hasJoinFEFilters)
+				if ((!keyColumnProj[j] && projectionMap[j] != -1) && !projectAll)
 				{
 #ifdef PRIMPROC_STOPWATCH
 					stopwatch->start("-- projectIntoRowGroup");
@@ -1308,7 +1530,10 @@ stopwatch->start("BatchPrimitiveProcessor::execute fourth part");
 			if (!fAggregator) {
 				*serialized << (uint8_t) 1;  // the "count this msg" var
 				fe2Output.setDBRoot(dbRoot);
-				fe2Output.serializeRGData(*serialized);
+				if (topNLimit > 0)
+					processTopN(fe2Output);
+				else
+					fe2Output.serializeRGData(*serialized);
 				//*serialized << fe2Output.getDataSize();
 				//serialized->append(fe2Output.getData(), fe2Output.getDataSize());
 			}
@@ -1341,7 +1566,10 @@ stopwatch->start("BatchPrimitiveProcessor::execute fourth part");
 			*serialized << (uint8_t) 1;  // the "count this msg" var
 			outputRG.setDBRoot(dbRoot);
 			//cerr << "serializing " << outputRG.toString() << endl;
-			outputRG.serializeRGData(*serialized);
+			if (topNLimit > 0)
+				processTopN(outputRG);
+			else
+				outputRG.serializeRGData(*serialized);
 			//*serialized << outputRG.getDataSize();
 			//serialized->append(outputRG.getData(), outputRG.getDataSize());
 			if (doJoin) {
@@ -1677,6 +1905,8 @@ int BatchPrimitiveProcessor::operator()()
 
 	if (fAggregator && currentBlockOffset == 0)                     // @bug4507, 8k
 		fAggregator->reset();                                       // @bug4507, 8k
+	if (topNLimit > 0 && currentBlockOffset == 0)
+		resetTopN();
 
 	for (; currentBlockOffset < count; currentBlockOffset++) {
 		if (!(sessionID & 0x80000000)) {   // can't do this with syscat queries
@@ -1748,6 +1978,19 @@ int BatchPrimitiveProcessor::operator()()
 
 void BatchPrimitiveProcessor::allocLargeBuffers()
 {
+	/* The buffers kept while idle stay on the NUMA node they were made on.
+	   If this run landed on another node's pool, make new ones here. */
+	if (numaTopology) {
+		int node = numaTopology->currentNode();
+		if (node != bufferNode) {
+			outRowGroupData.reset();
+			fe1Data.reset();
+			fe2Data.reset();
+			joinedRGMem.reset();
+			bufferNode = node;
+		}
+	}
+
 	if (ot == ROW_GROUP && !outRowGroupData) {
 		//outputRG.setUseStringTable(true);
 		outRowGroupData.reset(new RGData(outputRG));
@@ -1895,6 +2138,9 @@ SBPP BatchPrimitiveProcessor::duplicate()
 			fAggregator->getGroupByCols(), fAggregator->getAggFunctions()));
 	}
 
+	bpp->bloomFilters = bloomFilters;
+	bpp->topNLimit = topNLimit;
+	bpp->topNSpec = topNSpec;
 	bpp->sendRidsAtDelivery = sendRidsAtDelivery;
 	bpp->prefetchThreshold = prefetchThreshold;
 
@@ -1991,6 +2237,70 @@ void BatchPrimitiveProcessor::asyncLoadProjectColumns()
 	}
 }
 
+// Where readahead for step's column may go from lbid, from the extent cached for it
+// if lbid is still in there.  Scans stay in one extent for many messages, so this
+// saves two BRM lookups each time.
+bool BatchPrimitiveProcessor::readAheadRange(uint step, uint64_t lbid, uint32_t colWidth,
+	uint64_t *readAheadLast)
+{
+	if (raExtents.size() <= step)
+		raExtents.resize(step + 1);
+	ReadAheadExtent &ext = raExtents[step];
+
+	if (ext.last == 0 || lbid < ext.first || lbid > ext.last) {
+		if (!scanReadAheadRange(lbid, colWidth, &ext.first, &ext.last, &ext.end)) {
+			ext = ReadAheadExtent();
+			return false;
+		}
+	}
+	*readAheadLast = ext.end;
+	return true;
+}
+
+// When a scan column enters a new chunk, or at the start of a message, ask for the
+// chunks after it so the I/O for them overlaps the processing of this one.
+void BatchPrimitiveProcessor::readAheadScanColumns()
+{
+	ColumnCommand *col;
+	uint64_t lbid;
+	uint64_t readAheadLast;
+	uint64_t notUsed;
+	bool adjusted = false;
+
+	for (uint i = 0; i < filterCount + projectCount; i++) {
+		if (i < filterCount)
+			col = dynamic_cast<ColumnCommand*>(filterSteps[i].get());
+		else
+			col = dynamic_cast<ColumnCommand*>(projectSteps[i - filterCount].get());
+		if (col == NULL || col->getLBID() == 0)
+			continue;
+
+		lbid = col->getLBID();
+		if (currentBlockOffset != 0 && lbid % blocksReadAhead >= col->getWidth())
+			continue;
+
+		// Blocks evicted before anyone read them mean the scans are reading further
+		// ahead than the cache can hold, so halve the window.  Otherwise let it grow
+		// back one chunk at a time.  The first time through only takes the baseline.
+		if (!adjusted) {
+			notUsed = blocksNotUsed();
+			if (!raNotUsedValid)
+				raNotUsedValid = true;
+			else if (notUsed > raNotUsed)
+				raWindow /= 2;
+			else if (raWindow < scanReadAheadChunks)
+				raWindow++;
+			raNotUsed = notUsed;
+			adjusted = true;
+		}
+
+		if (!readAheadRange(i, lbid, col->getWidth(), &readAheadLast))
+			continue;
+		scanReadAhead(lbid, readAheadLast, raWindow, versionInfo, txnID, col->getCompType(),
+			&cachedIO, &physIO, LBIDTrace, sessionID, &counterLock, &busyLoaderCount, &vssCache);
+	}
+}
+
 bool BatchPrimitiveProcessor::generateJoinedRowGroup(rowgroup::Row &baseRow, const uint depth)
 {
 	Row &smallRow = smallRows[depth];
@@ -50,9 +50,12 @@
 #include "tuplejoiner.h"
 #include "rowgroup.h"
 #include "rowaggregation.h"
+#include "idborderby.h"
 #include "funcexpwrapper.h"
 #include "bppsendthread.h"
 
+class ColumnCommandTest;
+
 namespace primitiveprocessor
 {
 typedef std::tr1::unordered_map<int64_t, BRM::VSSData> VSSCache;
@@ -94,6 +97,10 @@ class BatchPrimitiveProcessor
 		int operator()();
 		void setLBIDForScan(uint64_t rid);
 
+		/* Gets the LBID the scan in a BATCH_PRIMITIVE_RUN msg for this BPP starts at,
+			without consuming bs.  False if this BPP isn't a scan. */
+		bool scanLBID(const messageqcpp::ByteStream &bs, uint64_t *lbid) const;
+
 		/* Duplicate() returns a deep copy of this object as it was init'd by initBPP.
 			It's thread-safe wrt resetBPP. */
 		SBPP duplicate();
@@ -160,6 +167,13 @@ class BatchPrimitiveProcessor
 
 		uint16_t relRids[LOGICAL_BLOCK_RIDS];
 		int64_t  values[LOGICAL_BLOCK_RIDS];
+
+		/* Selection bitmap over the logical block, bit n set => relative rid n is selected.
+		   OR filters and dense AND filter steps combine their results here with bit ops
+		   instead of merging ridlists. */
+		uint64_t ridBitmap[LOGICAL_BLOCK_RIDS / 64];
+		bool ridsToBitmap();
+		void bitmapToRids();
 		boost::scoped_array<uint64_t> absRids;
 		boost::scoped_array<std::string> strValues;
 		uint16_t ridCount;
@@ -276,6 +290,10 @@ class BatchPrimitiveProcessor
 		bool hasJoinFEFilters;
 		bool hasSmallOuterJoin;
 
+		/* Runtime filters from the UM joins.  They use keyColumnProj & oldRow/newRow too. */
+		std::vector<boost::shared_ptr<joiner::JoinBloomFilter> > bloomFilters;
+		void applyBloomFilters();
+
 		/* extra typeless join vars & fcns*/
 		boost::shared_array<bool> typelessJoin;
 		boost::shared_array<std::vector<uint> > tlLargeSideKeyColumns;
@@ -327,11 +345,26 @@ class BatchPrimitiveProcessor
 		uint currentBlockOffset;
 		boost::scoped_array<uint64_t> relLBID;
 		boost::scoped_array<bool> asyncLoaded;
+
+		/* Scan readahead.  raWindow is the # of chunks to keep loading ahead of
+		   each column; it backs off when the cache evicts blocks nobody used.
+		   raExtents holds the extent each step's column was last in. */
+		struct ReadAheadExtent {
+			ReadAheadExtent() : first(0), last(0), end(0) { }
+			uint64_t first, last, end;
+		};
+		void readAheadScanColumns();
+		bool readAheadRange(uint step, uint64_t lbid, uint32_t colWidth, uint64_t *readAheadLast);
+		uint raWindow;
+		uint64_t raNotUsed;
+		bool raNotUsedValid;
+		std::vector<ReadAheadExtent> raExtents;
 		
 		/* To support a smaller memory footprint when idle */
 		static const uint64_t maxIdleBufferSize = 16*1024*1024;  // arbitrary
 		void allocLargeBuffers();
 		void freeLargeBuffers();
+		int bufferNode;		// the NUMA node they were allocated on
 
 		/* To ensure all packets of an LBID go out the same socket */
 		int sockIndex;
@@ -339,6 +372,18 @@ class BatchPrimitiveProcessor
 		/* Shared nothing vars */
 		uint dbRoot;
 
+		/* PM top-N for ORDER BY ... LIMIT.  The heap holds the best topNLimit rows
+		   of the current job; its slots are rows in topNData. */
+		uint32_t topNLimit;
+		std::vector<ordering::IdbSortSpec> topNSpec;
+		boost::scoped_ptr<ordering::OrderByData> topNCompare;
+		rowgroup::RowGroup topNRG;
+		rowgroup::RGData topNData;
+		rowgroup::Row topNIn, topNRow;
+		std::vector<rowgroup::Row::Pointer> topNHeap;
+		void processTopN(rowgroup::RowGroup &rg);
+		void resetTopN();
+
 		friend class Command;
 		friend class ColumnCommand;
 		friend class DictStep;
@@ -347,6 +392,7 @@ class BatchPrimitiveProcessor
 		friend class FilterCommand;
 		friend class ScaledFilterCmd;
 		friend class StrFilterCmd;
+		friend class ::ColumnCommandTest;
 };
 
 }
@@ -112,6 +112,28 @@ BPPSeeder::~BPPSeeder()
 {
 }
 
+bool BPPSeeder::scanLBID(uint64_t *lbid)
+{
+	BPPMap::iterator it;
+	SBPP first;
+
+	/* The BPP knows the layout of its run msgs.  Keep the BPPV it came from, so
+	   operator() doesn't have to look it up again. */
+	{
+		boost::mutex::scoped_lock scoped(bppLock);
+		if (!bppv) {
+			it = bppMap.find(uniqueID);
+			if (it == bppMap.end())
+				return false;
+			bppv = it->second;
+		}
+		if (bppv->get().empty())
+			return false;
+		first = bppv->get()[0];
+	}
+	return first->scanLBID(*bs, lbid);
+}
+
 int BPPSeeder::operator()()
 {
 	uint32_t pos;
@@ -68,6 +68,11 @@ class BPPSeeder : public threadpool::PriorityThreadPool::Functor
 
 		uint32_t getID();
 
+		/* If this is a scan, gets the LBID its first step reads so the job can
+		   go to the processor pool near it.  False for anything else, or if the
+		   BPP hasn't been created yet. */
+		bool scanLBID(uint64_t *lbid);
+
 		void priority(uint p) { _priority = p; }
 		uint priority() { return _priority; }
 
@@ -0,0 +1,285 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <unistd.h>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/scoped_ptr.hpp>
+using namespace std;
+
+#include "primitiveserver.h"
+#include "cachesnapshot.h"
+#include "primproc.h"
+#include "brm.h"
+using namespace BRM;
+
+#include "cachesnapshotfile.h"
+using namespace dbbc;
+
+#include "writeengine.h"
+#include "configcpp.h"
+using namespace config;
+
+#include "idbcompress.h"
+using namespace compress;
+
+#include "IDBDataFile.h"
+#include "IDBPolicy.h"
+using namespace idbdatafile;
+
+namespace
+{
+
+// Requests are split at 4MB file boundaries.  A compressed chunk can't span a
+// request, and since extents are multiples of it, neither can an extent.
+const uint32_t WarmRangeBlocks = 4 * 1024 * 1024 / BLOCK_SIZE;
+
+struct WarmRange
+{
+	OID_t oid;
+	uint16_t dbRoot;
+	uint32_t partNum;
+	uint16_t segNum;
+	uint32_t fbo;
+	LBID_t lbid;
+	uint32_t count;
+
+	bool operator<(const WarmRange &r) const
+	{
+		if (dbRoot != r.dbRoot)
+			return dbRoot < r.dbRoot;
+		if (oid != r.oid)
+			return oid < r.oid;
+		if (partNum != r.partNum)
+			return partNum < r.partNum;
+		if (segNum != r.segNum)
+			return segNum < r.segNum;
+		return fbo < r.fbo;
+	}
+};
+
+struct SegFile
+{
+	SegFile(OID_t o, uint16_t d, uint32_t p, uint16_t s) :
+		oid(o), dbRoot(d), partNum(p), segNum(s) { }
+	OID_t oid;
+	uint16_t dbRoot;
+	uint32_t partNum;
+	uint16_t segNum;
+
+	bool operator<(const SegFile &f) const
+	{
+		if (oid != f.oid)
+			return oid < f.oid;
+		if (dbRoot != f.dbRoot)
+			return dbRoot < f.dbRoot;
+		if (partNum != f.partNum)
+			return partNum < f.partNum;
+		return segNum < f.segNum;
+	}
+};
+
+struct SegFileInfo
+{
+	SegFileInfo() : valid(false), hwm(0), compType(0) { }
+	bool valid;
+	uint32_t hwm;
+	int compType;
+};
+
+// The compression type isn't in the snapshot; the OID may even belong to a different
+// column by now.  Ask the file.
+int readCompType(const SegFile &f, bool *ok)
+{
+	char fileName[WriteEngine::FILE_NAME_SIZE];
+	char hdr[IDBCompressInterface::HDR_BUF_LEN];
+	WriteEngine::FileOp fileOp(false);
+	IDBCompressInterface decompressor;
+	boost::scoped_ptr<IDBDataFile> fp;
+
+	*ok = false;
+	if (fileOp.getFileName(f.oid, fileName, f.dbRoot, f.partNum, f.segNum) != WriteEngine::NO_ERROR)
+		return 0;
+	fp.reset(IDBDataFile::open(IDBPolicy::getType(fileName, IDBPolicy::PRIMPROC), fileName,
+		"r", 0));
+	if (!fp || fp->pread(hdr, 0, sizeof(hdr)) != (ssize_t) sizeof(hdr))
+		return 0;
+	*ok = true;
+	if (decompressor.verifyHdr(hdr) != 0)
+		return 0;
+	return decompressor.getCompressionType(hdr);
+}
+
+}
+
+namespace primitiveprocessor
+{
+
+CacheSnapshot::CacheSnapshot(const string &file, unsigned interval, int cacheCount) :
+	fFile(file), fInterval(interval), fCacheCount(cacheCount)
+{
+}
+
+void CacheSnapshot::operator()()
+{
+	try {
+		warm();
+	}
+	catch (std::exception &e) {
+		mlp->logMessage(string("CacheSnapshot: warm up failed: ") + e.what(), false);
+	}
+
+	for (;;) {
+		sleep(fInterval);
+		try {
+			if (!write())
+				mlp->logMessage("CacheSnapshot: failed to write " + fFile, false);
+		}
+		catch (std::exception &e) {
+			mlp->logMessage("CacheSnapshot: failed to write " + fFile + ": " + e.what(), false);
+		}
+	}
+}
+
+bool CacheSnapshot::write()
+{
+	vector<LBID_t> lbids;
+
+	for (int c = 0; c < fCacheCount; c++)
+		BRPp[c]->getCachedLBIDs(lbids);
+	return writeCacheSnapshot(fFile, lbids);
+}
+
+void CacheSnapshot::warm()
+{
+	vector<LBIDRun> runs;
+	vector<WarmRange> ranges;
+	map<SegFile, SegFileInfo> segFiles;
+	map<SegFile, SegFileInfo>::iterator sit;
+	LBID_t lbid;
+	uint32_t count;
+	uint32_t n;
+	uint32_t rCount;
+	uint64_t loaded = 0;
+	WarmRange r;
+	InlineLBIDRange range;
+	int extState;
+	bool ok;
+
+	if (!readCacheSnapshot(fFile, runs))
+		return;
+
+	for (vector<LBIDRun>::iterator it = runs.begin(); it != runs.end(); ++it) {
+		lbid = it->start;
+		count = it->count;
+		while (count > 0) {
+			if (brm->lookupLocal(lbid, 0, false, r.oid, r.dbRoot, r.partNum, r.segNum, r.fbo) < 0) {
+				// the extent is gone; skip to the next 4MB boundary
+				n = WarmRangeBlocks - (lbid % WarmRangeBlocks);
+				n = min(n, count);
+				lbid += n;
+				count -= n;
+				continue;
+			}
+
+			n = WarmRangeBlocks - (r.fbo % WarmRangeBlocks);
+			n = min(n, count);
+
+			SegFile f(r.oid, r.dbRoot, r.partNum, r.segNum);
+			sit = segFiles.find(f);
+			if (sit == segFiles.end()) {
+				SegFileInfo info;
+				if (brm->getLocalHWM(r.oid, r.partNum, r.segNum, info.hwm, extState) == 0) {
+					info.compType = readCompType(f, &ok);
+					info.valid = ok;
+				}
+				sit = segFiles.insert(make_pair(f, info)).first;
+			}
+
+			// don't ask for anything past the HWM, it may have shrunk since
+			if (sit->second.valid && r.fbo <= sit->second.hwm) {
+				r.lbid = lbid;
+				r.count = min(n, sit->second.hwm - r.fbo + 1);
+				ranges.push_back(r);
+			}
+			lbid += n;
+			count -= n;
+		}
+	}
+
+	sort(ranges.begin(), ranges.end());
+
+	for (n = 0; n < ranges.size(); n++) {
+		dbbc::BlockRequestProcessor *brp = BRPp[cacheNum(ranges[n].lbid)];
+		SegFile f(ranges[n].oid, ranges[n].dbRoot, ranges[n].partNum, ranges[n].segNum);
+
+		// queries go first
+		while (brp->pendingRequests() > 0)
+			usleep(10000);
+
+		range.start = ranges[n].lbid;
+		range.size = ranges[n].count;
+		rCount = 0;
+		try {
+			brp->check(range, QueryContext(numeric_limits<VER_t>::max()), 0,
+				segFiles[f].compType, rCount);
+			loaded += rCount;
+		}
+		catch (std::exception &e) {
+			ostringstream os;
+			os << "CacheSnapshot: warm up of LBIDs " << range.start << " - " <<
+				range.start + range.size - 1 << " failed: " << e.what();
+			mlp->logMessage(os.str(), false);
+		}
+	}
+
+	logging::Message::Args args;
+	ostringstream os;
+	os << "CacheSnapshot: read " << loaded << " blocks from " << fFile;
+	args.add(os.str());
+	mlp->logInfoMessage(logging::M0000, args);
+}
+
+void startCacheSnapshots(int cacheCount)
+{
+	Config *cf = Config::makeConfig();
+	string file;
+	unsigned interval = 0;
+
+	string val = cf->getConfig("DBBC", "CacheSnapshotInterval");
+	if (val.length() > 0)
+		interval = Config::uFromText(val);
+	if (interval == 0)
+		return;
+
+	file = cf->getConfig("DBBC", "CacheSnapshotFile");
+	if (file.length() == 0)
+#ifdef _MSC_VER
+		file = "C:/Calpont/log/ppcache.snapshot";
+#else
+		file = "/var/log/Calpont/ppcache.snapshot";
+#endif
+
+	boost::thread thd(CacheSnapshot(file, interval, cacheCount));
+}
+
+}
+// vim:ts=4 sw=4:
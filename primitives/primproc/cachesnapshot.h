@@ -0,0 +1,61 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#ifndef CACHESNAPSHOT_H
+#define CACHESNAPSHOT_H
+
+#include <string>
+
+namespace primitiveprocessor
+{
+
+/** @brief Block cache warm start
+ *
+ * Every interval seconds the LBIDs held by the block caches are written
+ * to a snapshot file.  When PrimProc starts, the blocks in the last snapshot
+ * are read back in file order before snapshots resume.  The warm up only
+ * sends a request when the caches have no other requests waiting, so it
+ * stays out of the way of queries.
+ *
+ * Versions aren't kept; the current version of each block is loaded.
+ */
+class CacheSnapshot
+{
+	public:
+		CacheSnapshot(const std::string &file, unsigned interval, int cacheCount);
+
+		// the thread body, warms the caches and then takes snapshots forever
+		void operator()();
+
+		void warm();
+		// returns false if the snapshot couldn't be written
+		bool write();
+
+	private:
+		std::string fFile;
+		unsigned fInterval;
+		int fCacheCount;
+};
+
+/* Starts the warm-start thread if DBBC/CacheSnapshotInterval is set.  Call
+   it after the block caches are created. */
+void startCacheSnapshots(int cacheCount);
+
+}
+
+#endif
+// vim:ts=4 sw=4:
@@ -37,6 +37,7 @@ using namespace std;
 #include "bpp.h"
 #include "errorcodes.h"
 #include "exceptclasses.h"
+#include "idbcompress.h"
 #include "primitiveserver.h"
 #include "primproc.h"
 #include "stats.h"
@@ -55,6 +56,41 @@ namespace
 {
 using namespace primitiveprocessor;
 
+// A filter step with at least this many input rids scans the whole logical block
+// and intersects the result with the selection bitmap instead of sending the ridlist
+const uint bitmapFilterMinRids = LOGICAL_BLOCK_RIDS / 4;
+
+/* Whether any value in [min, max] could pass the filter.  min > max means the block
+   has nothing but NULLs and empty rows. */
+template<typename T>
+bool rangeMayMatch(T min, T max, const int64_t *args, const uint8_t *cops, uint count,
+	bool isOr)
+{
+	bool match;
+	T arg;
+
+	if (min > max)
+		return false;
+
+	for (uint i = 0; i < count; i++) {
+		arg = static_cast<T>(args[i]);
+		switch (cops[i]) {
+			case COMPARE_LT: match = (min < arg); break;
+			case COMPARE_LE: match = (min <= arg); break;
+			case COMPARE_EQ: match = (min <= arg && arg <= max); break;
+			case COMPARE_NE: match = !(min == arg && max == arg); break;
+			case COMPARE_GE: match = (max >= arg); break;
+			case COMPARE_GT: match = (max > arg); break;
+			default: match = false; break;
+		}
+		if (isOr && match)
+			return true;
+		if (!isOr && !match)
+			return false;
+	}
+	return !isOr;
+}
+
 double cotangent(double in)
 {
 	return (1.0 / tan(in));
@@ -103,6 +139,7 @@ extern int noVB;
 
 ColumnCommand::ColumnCommand() :
 	Command(COLUMN_COMMAND),
+	bitmapFilter(false),
 	blockCount(0),
 	loadCount(0),
 	suppressFilter(false),
@@ -115,14 +152,29 @@ ColumnCommand::~ColumnCommand() { }
 void ColumnCommand::_execute()
 {
 // 	cout << "CC: executing" << endl;
-	if (_isScan)
+	bitmapFilter = false;
+	if (_isScan) {
 		makeScanMsg();
+		if (zoneMapSkip()) {
+			processResult();
+			if (fFilterFeeder != NOT_FEEDER)
+				copyRidsForFilterCmd();
+			return;
+		}
+	}
 	else if (bpp->ridCount == 0) {   // this would cause a scan
 		blockCount += colType.colWidth;
 		return;  // a step with no input rids does nothing
 	}
-	else
-		makeStepMsg();
+	else {
+		// a dense ridlist in scan order can use the block scan kernel
+		if (bitmapScanUsable())
+			bitmapFilter = bpp->ridsToBitmap();
+		if (bitmapFilter)
+			makeBitmapScanMsg();
+		else
+			makeStepMsg();
+	}
 	issuePrimitive();
 	processResult();
 
@@ -176,6 +228,113 @@ void ColumnCommand::makeStepMsg()
 // 	cout << "lbid is " << lbid << endl;
 }
 
+/* A bitmap scan filters the whole logical block with the block scan kernel, which
+   only takes the filters parseColumnFilter() could specialize, and returns the rows
+   the ridlist selects.  It's only worth it when the ridlist is dense. */
+bool ColumnCommand::bitmapScanUsable()
+{
+	return (filterCount > 0 && !suppressFilter && !fUdfFuncPtr && bpp->bop == BOP_AND &&
+	  (primMsg->OutputType & OT_RID) && parsedColumnFilter &&
+	  parsedColumnFilter->evaluator != NULL && bpp->ridCount >= bitmapFilterMinRids);
+}
+
+/* The input ridlist is dense and in bpp->ridBitmap.  No ridlist is sent, so p_Col
+   filters the whole logical block and issuePrimitive() hands it the bitmap to select
+   the rows with.  Only the blocks the ridlist touches get loaded. */
+void ColumnCommand::makeBitmapScanMsg()
+{
+	primMsg->ism.Size = baseMsgLength;
+	primMsg->NVALS = 0;
+	primMsg->LBID = lbid;
+	primMsg->RidFlags = bpp->ridMap;
+}
+
+/* The LBIDs a scan of the current logical block loads */
+uint ColumnCommand::scanLBIDs(BRM::LBID_t *lbids)
+{
+	const uint64_t oidLastLbid = getLastLbid();
+	uint i;
+
+	for (i = 0; i < (uint) colType.colWidth; i++) {
+		lbids[i] = lbid + i;
+		if (lbid + i == oidLastLbid)
+			return i + 1;
+	}
+	return i;
+}
+
+/* The zone map is only used for filters parseColumnFilter() could specialize:
+   integer-like types, plain comparisons, no NULL arguments. */
+bool ColumnCommand::zoneMapUsable()
+{
+	return (zoneMapSize > 0 && !suppressFilter && !fUdfFuncPtr && parsedColumnFilter &&
+	  parsedColumnFilter->evaluator != NULL);
+}
+
+/* If the zone map says nothing in this logical block passes the filter, fakes an
+   empty result without loading the blocks. */
+bool ColumnCommand::zoneMapSkip()
+{
+	BRM::LBID_t lbids[8];
+	BRM::VER_t vers[8];
+	int64_t min, max;
+	uint count;
+	bool isOr, match;
+
+	if (!zoneMapUsable())
+		return false;
+
+	count = scanLBIDs(lbids);
+	if (!zoneMapVersions(lbids, count, bpp->versionInfo, bpp->txnID, &bpp->vssCache, vers) ||
+	  !zoneMapLookup(lbid, vers, count, &min, &max))
+		return false;
+
+	isOr = (filterCount > 1 && primMsg->BOP == BOP_OR);
+	if (isUnsigned(colType.colDataType))
+		match = rangeMayMatch<uint64_t>(min, max, parsedColumnFilter->prestored_argVals.get(),
+		  parsedColumnFilter->prestored_cops.get(), filterCount, isOr);
+	else
+		match = rangeMayMatch<int64_t>(min, max, parsedColumnFilter->prestored_argVals.get(),
+		  parsedColumnFilter->prestored_cops.get(), filterCount, isOr);
+	if (match)
+		return false;
+
+	outMsg->ism = primMsg->ism;
+	outMsg->hdr = primMsg->hdr;
+	outMsg->ism.Command = COL_RESULTS;
+	outMsg->LBID = lbid;
+	outMsg->OutputType = primMsg->OutputType;
+	outMsg->NVALS = 0;
+	outMsg->RidFlags = 0;
+	outMsg->CacheIO = 0;
+	outMsg->PhysicalIO = 0;
+	outMsg->ValidMinMax = true;
+	outMsg->Min = min;
+	outMsg->Max = max;
+
+	// the block's min & max are still good for the extent's CP data
+	bpp->validCPData = true;
+	bpp->lbidForCP = lbid;
+	bpp->minVal = min;
+	bpp->maxVal = max;
+	blockCount += colType.colWidth;
+	return true;
+}
+
+void ColumnCommand::zoneMapRecord()
+{
+	BRM::LBID_t lbids[8];
+	BRM::VER_t vers[8];
+	uint count;
+
+	if (!zoneMapUsable())
+		return;
+
+	count = scanLBIDs(lbids);
+	if (zoneMapVersions(lbids, count, bpp->versionInfo, bpp->txnID, &bpp->vssCache, vers))
+		zoneMapInsert(lbid, vers, count, outMsg->Min, outMsg->Max);
+}
+
 void ColumnCommand::issuePrimitive()
 {
 	int i;
@@ -271,6 +430,23 @@ void ColumnCommand::issuePrimitive()
 		bpp->pp.setParsedColumnFilter(parsedColumnFilter);
 	else
 		bpp->pp.setParsedColumnFilter(emptyFilter);
+
+	/* Blocks decoded from runs or a small dictionary let a whole block filter be
+	   evaluated once per run */
+	if (colType.compressionType == compress::IDBCompressInterface::ENCODED_COMPRESSION &&
+	  primMsg->NVALS == 0 && !wasVersioned && blocksToLoad == (uint) colType.colWidth &&
+	  !suppressFilter && !fUdfFuncPtr && parsedColumnFilter &&
+	  parsedColumnFilter->evaluator != NULL) {
+		BRM::VER_t *vers = (BRM::VER_t *) alloca(8 * sizeof(BRM::VER_t));
+		compress::BlockRuns *runs = (compress::BlockRuns *)
+			alloca(8 * sizeof(compress::BlockRuns));
+
+		if (zoneMapVersions(lbids, blocksToLoad, bpp->versionInfo, bpp->txnID, &bpp->vssCache,
+		  vers) && getBlockRuns(lbids, vers, blocksToLoad, runs))
+			bpp->pp.setBlockRuns(runs, blocksToLoad);
+	}
+	if (bitmapFilter)
+		bpp->pp.setSelection(bpp->ridBitmap);
 	bpp->pp.p_Col(primMsg, outMsg, bpp->outMsgSize, (unsigned int*)&resultSize, fUdfFuncPtr);
 
 	/* Update CP data */
@@ -281,6 +457,8 @@ void ColumnCommand::issuePrimitive()
 		bpp->lbidForCP = lbid;
 		bpp->maxVal = outMsg->Max;
 		bpp->minVal = outMsg->Min;
+		if (bpp->validCPData)
+			zoneMapRecord();
 	}
 
 } // issuePrimitive()
@@ -92,10 +92,19 @@ private:
 	void removeRowsFromRowGroup(rowgroup::RowGroup &);
 	void makeScanMsg();
 	void makeStepMsg();
+	bool bitmapScanUsable();
+	void makeBitmapScanMsg();
+	uint scanLBIDs(BRM::LBID_t *lbids);
+	bool zoneMapUsable();
+	bool zoneMapSkip();
+	void zoneMapRecord();
 	void setLBID(uint64_t rid);
 
 	bool _isScan;
 
+	// true when this step filters the whole block and selects the rows in bpp->ridBitmap
+	bool bitmapFilter;
+
 	boost::scoped_array<uint8_t> inputMsg;
 	NewColRequestHeader *primMsg;
 	NewColResultHeader *outMsg;
@@ -43,9 +43,16 @@ using namespace rowgroup;
 namespace primitiveprocessor {
 
 extern uint dictBufferSize;
+extern uint64_t dictTokenCacheSize;
 extern bool utf8;
 
-DictStep::DictStep() : Command(DICT_STEP), strValues(NULL), filterCount(0),
+namespace
+{
+// rough per-entry overhead of the token caches
+const uint64_t tokenCacheEntrySize = 48;
+}
+
+DictStep::DictStep() : Command(DICT_STEP), tokenCacheSize(0), strValues(NULL), filterCount(0),
 		bufferSize(0)
 {
 }
@@ -324,6 +331,10 @@ void DictStep::_execute()
 	i = 0;
 	while (i < bpp->ridCount) {
 		l_lbid = ((int64_t) newRidList[i].token) >> 10;
+		if (fFilterFeeder == NOT_FEEDER && l_lbid > 0 && dictTokenCacheSize > 0) {
+			filterWithCache(newRidList.get(), &i);
+			continue;
+		}
 		primMsg->LBID = l_lbid;
 		primMsg->NVALS = 0;
 
@@ -367,6 +378,71 @@ void DictStep::_execute()
  	//cout << "DS: /_execute()\n";
 }
 
+void DictStep::checkCacheSize()
+{
+	if (tokenCacheSize >= dictTokenCacheSize) {
+		filterCache.clear();
+		stringCache.clear();
+		tokenCacheSize = 0;
+	}
+}
+
+/* Filters the tokens in ot that are in the same dictionary block as ot[*i] and
+   moves *i past them.  Only the distinct tokens the cache doesn't know yet are
+   sent to p_Dictionary, using their position in ot as the rid. */
+void DictStep::filterWithCache(OrderedToken *ot, uint64_t *i)
+{
+	OldGetSigParams *pt = (OldGetSigParams *) (primMsg->tokens);
+	const int64_t l_lbid = ((int64_t) ot[*i].token) >> 10;
+	const uint64_t first = *i;
+	FilterCache::iterator it;
+	DictOutput *header;
+	uint8_t *pos;
+	uint64_t j;
+	uint k;
+
+	// the cache can't be cleared in the middle of a block
+	checkCacheSize();
+
+	primMsg->LBID = l_lbid;
+	primMsg->NVALS = 0;
+	primMsg->OutputType = OT_RID;
+	for (j = first; j < bpp->ridCount && (((int64_t) ot[j].token) >> 10) == l_lbid; j++) {
+		if ((j > first && ot[j].token == ot[j-1].token) ||
+		  filterCache.find(ot[j].token) != filterCache.end())
+			continue;
+		pt[primMsg->NVALS].rid = j;
+		pt[primMsg->NVALS].offsetIndex = ot[j].token & 0x3ff;
+		idbassert(pt[primMsg->NVALS].offsetIndex != 0);
+		primMsg->NVALS++;
+	}
+	*i = j;
+
+	if (primMsg->NVALS > 0) {
+		memcpy(&pt[primMsg->NVALS], filterString.buf(), filterString.length());
+		issuePrimitive(true);
+
+		for (k = 0; k < primMsg->NVALS; k++)
+			filterCache[ot[pt[k].rid].token] = false;
+		tokenCacheSize += primMsg->NVALS * tokenCacheEntrySize;
+
+		header = (DictOutput *) &result[0];
+		pos = &result[sizeof(DictOutput)];
+		for (k = 0; k < header->NVALS; k++, pos += 8)
+			filterCache[ot[*((uint64_t *) pos)].token] = true;
+	}
+
+	for (j = first; j < *i; j++) {
+		it = filterCache.find(ot[j].token);
+		idbassert(it != filterCache.end());
+		if (it->second) {
+			bpp->absRids[tmpResultCounter] = ot[j].rid;
+			bpp->relRids[tmpResultCounter] = ot[j].rid - bpp->baseRid;
+			tmpResultCounter++;
+		}
+	}
+}
+
 /* This will do the same thing as execute() but put the result in bpp->serialized */
 void DictStep::_project()
 {
@@ -423,13 +499,18 @@ void DictStep::_project()
 void DictStep::_projectToRG(RowGroup &rg, uint col)
 {
 	/* Need to loop over bpp->values, issuing a primitive for each LBID */
-	uint i;
+	uint i, j;
 	int64_t l_lbid=0;
 	int64_t o_lbid=0;
 	OldGetSigParams *pt;
 	StringPtr tmpStrings[LOGICAL_BLOCK_RIDS];
+	uint16_t tmpPositions[LOGICAL_BLOCK_RIDS];	// where in newRidList tmpStrings[i] goes
 	rowgroup::Row r;
 	boost::scoped_array<OrderedToken> newRidList;
+	StringCache::iterator it;
+	const bool isVarBinary =
+	  (rg.getColTypes()[col] == execplan::CalpontSystemCatalog::VARBINARY);
+	uint cachedCount = 0;
 
 	// make the OrderedToken list
 	newRidList.reset(new OrderedToken[bpp->ridCount]);
@@ -452,6 +533,8 @@ void DictStep::_projectToRG(RowGroup &rg, uint col)
 		primMsg->NVALS = 0;
 		primMsg->OutputType = OT_DATAVALUE;
 		pt = (OldGetSigParams *) (primMsg->tokens);
+		if (dictTokenCacheSize > 0)
+			checkCacheSize();
 		//@bug 972
 		//@bug 1821
 		while (i<bpp->ridCount && ((((int64_t)newRidList[i].token)>>10) == l_lbid || l_lbid == -1
@@ -478,6 +561,18 @@ void DictStep::_projectToRG(RowGroup &rg, uint col)
 			}
 			else
 			{
+				if (dictTokenCacheSize > 0 &&
+				  (it = stringCache.find(newRidList[i].token)) != stringCache.end()) {
+					rg.getRow(newRidList[i].pos, &r);
+					if (!isVarBinary)
+						r.setStringField((const uint8_t *) it->second.data(), it->second.length(), col);
+					else
+						r.setVarBinaryField((const uint8_t *) it->second.data(), it->second.length(), col);
+					cachedCount++;
+					i++;
+					continue;
+				}
+
 				if ((((int64_t)newRidList[i].token)>>10)>0 && o_lbid==0)
 					l_lbid=o_lbid=(((int64_t)newRidList[i].token)>>10);
 
@@ -485,11 +580,18 @@ void DictStep::_projectToRG(RowGroup &rg, uint col)
 			}
 			pt[primMsg->NVALS].offsetIndex = newRidList[i].token & 0x3ff;
 			idbassert(pt[primMsg->NVALS].offsetIndex > 0);
+			tmpPositions[curResultCounter + primMsg->NVALS] = i;
 			primMsg->NVALS++;
 // 			pt++;
 			i++;
 		}
-		
+
+		// everything in this block was cached
+		if (primMsg->NVALS == 0) {
+			o_lbid=0;
+			continue;
+		}
+
 		if (((int64_t)primMsg->LBID)<0 && o_lbid>0)
 			primMsg->LBID = o_lbid;
 
@@ -501,24 +603,34 @@ void DictStep::_projectToRG(RowGroup &rg, uint col)
 
         // bug 4901 - move this inside the loop and call incrementally
         // to save the unnecessary string copy
-    	if (rg.getColTypes()[col] != execplan::CalpontSystemCatalog::VARBINARY) {
-        	for (i = curResultCounter; i < tmpResultCounter; i++) {
-            	rg.getRow(newRidList[i].pos, &r);
-            	//cout << "serializing " << tmpStrings[i] << endl;
-            	r.setStringField(tmpStrings[i].ptr, tmpStrings[i].len, col);
+    	if (!isVarBinary) {
+        	for (j = curResultCounter; j < tmpResultCounter; j++) {
+            	rg.getRow(newRidList[tmpPositions[j]].pos, &r);
+            	//cout << "serializing " << tmpStrings[j] << endl;
+            	r.setStringField(tmpStrings[j].ptr, tmpStrings[j].len, col);
         	}
     	}
     	else {
-        	for (i = curResultCounter; i < tmpResultCounter; i++) {
-            	rg.getRow(newRidList[i].pos, &r);
-            	r.setVarBinaryField(tmpStrings[i].ptr, tmpStrings[i].len, col);
+        	for (j = curResultCounter; j < tmpResultCounter; j++) {
+            	rg.getRow(newRidList[tmpPositions[j]].pos, &r);
+            	r.setVarBinaryField(tmpStrings[j].ptr, tmpStrings[j].len, col);
         	}
-    	}   
+    	}
+
+		if (dictTokenCacheSize > 0) {
+			for (j = curResultCounter; j < tmpResultCounter; j++) {
+				const uint64_t token = newRidList[tmpPositions[j]].token;
+				if ((((int64_t) token) >> 10) > 0 && stringCache.find(token) == stringCache.end()) {
+					stringCache[token].assign((const char *) tmpStrings[j].ptr, tmpStrings[j].len);
+					tokenCacheSize += tmpStrings[j].len + tokenCacheEntrySize;
+				}
+			}
+		}
         curResultCounter = tmpResultCounter;
 	}
 
  	//cout << "_projectToRG() total length = " << totalResultLength << endl;
-	idbassert(tmpResultCounter == bpp->ridCount);
+	idbassert(tmpResultCounter + cachedCount == bpp->ridCount);
  	
     //cout << "DS: /projectingToRG l: " << (int64_t)primMsg->LBID
 	//	<< " len: " << tmpResultCounter
@@ -31,6 +31,12 @@
 #ifndef DICTSTEP_H_
 #define DICTSTEP_H_
 
+#ifndef _MSC_VER
+#include <tr1/unordered_map>
+#else
+#include <unordered_map>
+#endif
+
 #include "command.h"
 #include "primitivemsg.h"
 
@@ -109,6 +115,18 @@ class DictStep : public Command
 		void copyResultToTmpSpace(OrderedToken *ot);
 		void copyResultToFinalPosition(OrderedToken *ot);
 
+		/* Tokens are never reused for another string, so for the life of this BPP
+		   the filter result and the string for a token can be remembered.  Filter
+		   steps look each distinct token up once, projections skip the dictionary
+		   for tokens they've already seen. */
+		typedef std::tr1::unordered_map<uint64_t, bool> FilterCache;
+		typedef std::tr1::unordered_map<uint64_t, std::string> StringCache;
+		void filterWithCache(OrderedToken *ot, uint64_t *i);
+		void checkCacheSize();
+		FilterCache filterCache;
+		StringCache stringCache;
+		uint64_t tokenCacheSize;	// approximate bytes used by both caches
+
 		// Worst case, 8192 tokens in the msg.  Each is 10 bytes. */
 		boost::scoped_array<uint8_t> inputMsg;
 		uint tmpResultCounter;
@@ -0,0 +1,177 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#ifndef _MSC_VER
+#include <sched.h>
+#include <dirent.h>
+#endif
+using namespace std;
+
+#include "numatopology.h"
+
+namespace
+{
+
+// parses a sysfs cpu list, eg "0-7,16-23"
+void parseCPUList(const string &list, vector<int> &cpus)
+{
+	istringstream is(list);
+	string range;
+	string::size_type dash;
+	int first, last;
+
+	while (getline(is, range, ',')) {
+		if (range.empty() || range[0] < '0' || range[0] > '9')
+			continue;
+		dash = range.find('-');
+		first = atoi(range.c_str());
+		last = (dash == string::npos ? first : atoi(range.c_str() + dash + 1));
+		for (; first <= last; first++)
+			cpus.push_back(first);
+	}
+}
+
+}
+
+namespace primitiveprocessor
+{
+
+const NumaTopology *numaTopology = NULL;
+
+NumaTopology::NumaTopology()
+{
+	vector<int> allowedCPUs;
+#ifdef __linux__
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	if (sched_getaffinity(0, sizeof(mask), &mask) == 0)
+		for (int i = 0; i < CPU_SETSIZE; i++)
+			if (CPU_ISSET(i, &mask))
+				allowedCPUs.push_back(i);
+#endif
+	init("/sys/devices/system/node", allowedCPUs);
+}
+
+NumaTopology::NumaTopology(const string &nodeDir, const vector<int> &allowedCPUs)
+{
+	init(nodeDir, allowedCPUs);
+}
+
+void NumaTopology::init(const string &nodeDir, const vector<int> &allowedCPUs)
+{
+	fAllowedCPUs = allowedCPUs;
+	sort(fAllowedCPUs.begin(), fAllowedCPUs.end());
+
+#ifndef _MSC_VER
+	vector<int> nodeNums;
+	DIR *dir;
+	struct dirent *ent;
+	uint32_t i;
+
+	dir = opendir(nodeDir.c_str());
+	if (dir != NULL) {
+		while ((ent = readdir(dir)) != NULL)
+			if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' &&
+			  ent->d_name[4] <= '9')
+				nodeNums.push_back(atoi(&ent->d_name[4]));
+		closedir(dir);
+	}
+	sort(nodeNums.begin(), nodeNums.end());
+
+	for (i = 0; i < nodeNums.size(); i++) {
+		ostringstream file;
+		string list;
+		vector<int> cpus, usable;
+
+		file << nodeDir << "/node" << nodeNums[i] << "/cpulist";
+		ifstream in(file.str().c_str());
+		getline(in, list);
+		parseCPUList(list, cpus);
+
+		// skip CPUs we aren't allowed on, and nodes that are only memory
+		for (uint32_t j = 0; j < cpus.size(); j++)
+			if (binary_search(fAllowedCPUs.begin(), fAllowedCPUs.end(), cpus[j]))
+				usable.push_back(cpus[j]);
+		if (usable.empty())
+			continue;
+
+		for (uint32_t j = 0; j < usable.size(); j++) {
+			if ((int) fCPUNode.size() <= usable[j])
+				fCPUNode.resize(usable[j] + 1, 0);
+			fCPUNode[usable[j]] = fNodeCPUs.size();
+		}
+		fNodeCPUs.push_back(usable);
+	}
+#endif
+
+	// no sysfs (or Windows): one node with every CPU
+	if (fNodeCPUs.empty())
+		fNodeCPUs.push_back(fAllowedCPUs);
+}
+
+uint32_t NumaTopology::currentNode() const
+{
+#ifdef __linux__
+	int cpu = sched_getcpu();
+
+	if (cpu >= 0 && cpu < (int) fCPUNode.size())
+		return fCPUNode[cpu];
+#endif
+	return 0;
+}
+
+bool NumaTopology::bindToNode(uint32_t node) const
+{
+#ifdef __linux__
+	cpu_set_t mask;
+
+	if (node >= fNodeCPUs.size() || fNodeCPUs[node].empty())
+		return false;
+
+	CPU_ZERO(&mask);
+	for (uint32_t i = 0; i < fNodeCPUs[node].size(); i++)
+		CPU_SET(fNodeCPUs[node][i], &mask);
+	return (sched_setaffinity(0, sizeof(mask), &mask) == 0);
+#else
+	return false;
+#endif
+}
+
+void NumaTopology::unbind() const
+{
+#ifdef __linux__
+	cpu_set_t mask;
+
+	if (fAllowedCPUs.empty())
+		return;
+
+	CPU_ZERO(&mask);
+	for (uint32_t i = 0; i < fAllowedCPUs.size(); i++)
+		CPU_SET(fAllowedCPUs[i], &mask);
+	sched_setaffinity(0, sizeof(mask), &mask);
+#endif
+}
+
+}
+// vim:ts=4 sw=4:
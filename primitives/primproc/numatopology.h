@@ -0,0 +1,74 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#ifndef NUMATOPOLOGY_H
+#define NUMATOPOLOGY_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace primitiveprocessor
+{
+
+/** @brief The NUMA nodes of this machine and the CPUs in each
+ *
+ * The layout comes from /sys/devices/system/node, so there's no dependency
+ * on libnuma.  Memory placement is left to the kernel's first-touch policy:
+ * a thread bound to a node gets its new pages from that node, and threads
+ * inherit the binding of the thread that creates them.  Where the layout
+ * can't be read the machine looks like a single node and binding does
+ * nothing.
+ */
+class NumaTopology
+{
+	public:
+		NumaTopology();
+
+		/* Reads the layout from nodeDir instead of sysfs, as if the process
+		   could only run on allowedCPUs.  For the test driver. */
+		NumaTopology(const std::string &nodeDir, const std::vector<int> &allowedCPUs);
+
+		uint32_t nodeCount() const { return fNodeCPUs.size(); }
+		const std::vector<int>& cpus(uint32_t node) const { return fNodeCPUs[node]; }
+
+		// the node the calling thread is running on right now
+		uint32_t currentNode() const;
+
+		/* Binds the calling thread to the CPUs of node.  Threads it creates
+		   afterward start out bound to the same node. */
+		bool bindToNode(uint32_t node) const;
+
+		// undoes bindToNode(), the thread may run anywhere it could at startup
+		void unbind() const;
+
+	private:
+		void init(const std::string &nodeDir, const std::vector<int> &allowedCPUs);
+
+		std::vector<std::vector<int> > fNodeCPUs;
+		std::vector<int> fCPUNode;		// cpu -> node
+		std::vector<int> fAllowedCPUs;	// the affinity the process started with
+};
+
+/* Set by the PrimitiveServer when PrimitiveServers/NUMAAware is on, NULL
+   otherwise */
+extern const NumaTopology *numaTopology;
+
+}
+
+#endif
+// vim:ts=4 sw=4:
@@ -73,6 +73,7 @@ using namespace oam;
 using namespace config;
 
 #include "bppseeder.h"
+#include "numatopology.h"
 #include "primitiveprocessor.h"
 #include "pp_logger.h"
 using namespace primitives;
@@ -141,6 +142,8 @@ namespace primitiveprocessor
 	uint lowPriorityThreads;
 	int  directIOFlag = O_DIRECT;
 	int  noVB = 0;
+	uint64_t dictTokenCacheSize = 1024 * 1024;	// per DictStep, 0 turns the token caches off
+	uint scanReadAheadChunks = 2;		// 0 turns scan readahead off
 
 	const uint8_t fMaxColWidth(8);
 	BPPMap bppMap;
@@ -460,6 +463,103 @@ namespace primitiveprocessor
 		return ret;
 	}
 
+	/* Block zone map */
+	uint64_t zoneMapSize = 256 * 1024;		// max # of logical blocks it covers, 0 disables
+
+	struct ZoneMapEntry {
+		VER_t vers[8];
+		uint count;
+		int64_t min;
+		int64_t max;
+	};
+	typedef std::tr1::unordered_map<LBID_t, ZoneMapEntry> ZoneMapShard;
+	const uint zoneMapShardCount = 16;
+	ZoneMapShard zoneMapShards[zoneMapShardCount];
+	boost::mutex zoneMapLocks[zoneMapShardCount];
+
+	/* Resolves the versions loadBlocks() would use.  Returns false if any of them is in
+	   the version buffer or being modified by txn; the zone map skips those.  A block
+	   the VSS has no entry for (rc -1) is version 0, as it is to loadBlocks(). */
+	bool zoneMapVersions(const LBID_t *lbids, uint count, const QueryContext &qc, uint32_t txn,
+		VSSCache *vssCache, VER_t *vers)
+	{
+		VSSCache::iterator it;
+		bool vbFlag;
+		uint i;
+		int rc;
+
+		for (i = 0; i < count; i++) {
+			if (vssCache && (it = vssCache->find(lbids[i])) != vssCache->end()) {
+				vers[i] = it->second.verID;
+				vbFlag = it->second.vbFlag;
+				rc = it->second.returnCode;
+			}
+			else
+				rc = brm->vssLookup(lbids[i], qc, txn, &vers[i], &vbFlag);
+			if (rc == -1) {
+				vers[i] = 0;
+				vbFlag = false;
+			}
+			else if (rc != 0)   // ERR_SNAPSHOT_TOO_OLD
+				return false;
+			if (vbFlag || (txn > 0 && vers[i] == (VER_t) txn))
+				return false;
+		}
+		return true;
+	}
+
+	bool zoneMapLookup(LBID_t lbid, const VER_t *vers, uint count, int64_t *min, int64_t *max)
+	{
+		const uint shard = (lbid >> 3) % zoneMapShardCount;
+		boost::mutex::scoped_lock lk(zoneMapLocks[shard]);
+		ZoneMapShard::iterator it = zoneMapShards[shard].find(lbid);
+
+		if (it == zoneMapShards[shard].end() || it->second.count != count ||
+		  memcmp(it->second.vers, vers, count * sizeof(VER_t)) != 0)
+			return false;
+		*min = it->second.min;
+		*max = it->second.max;
+		return true;
+	}
+
+	void zoneMapInsert(LBID_t lbid, const VER_t *vers, uint count, int64_t min, int64_t max)
+	{
+		const uint shard = (lbid >> 3) % zoneMapShardCount;
+		ZoneMapEntry entry;
+
+		idbassert(count <= 8);
+		memcpy(entry.vers, vers, count * sizeof(VER_t));
+		entry.count = count;
+		entry.min = min;
+		entry.max = max;
+
+		boost::mutex::scoped_lock lk(zoneMapLocks[shard]);
+		if (zoneMapShards[shard].size() >= zoneMapSize / zoneMapShardCount)
+			zoneMapShards[shard].clear();
+		zoneMapShards[shard][lbid] = entry;
+	}
+
+	/* Version numbers alone don't cover blocks written in place by cpimport, so drop
+	   everything whenever the block cache gets flushed. */
+	void zoneMapFlush()
+	{
+		for (uint i = 0; i < zoneMapShardCount; i++) {
+			boost::mutex::scoped_lock lk(zoneMapLocks[i]);
+			zoneMapShards[i].clear();
+		}
+	}
+
+	bool getBlockRuns(const LBID_t *lbids, const VER_t *vers, uint count,
+		compress::BlockRuns *runs)
+	{
+		BlockRequestProcessor *brp = BRPp[cacheNum(lbids[0])];
+
+		for (uint i = 0; i < count; i++)
+			if (!brp->getBlockRuns(lbids[i], vers[i], runs[i]))
+				return false;
+		return true;
+	}
+
 	void loadBlock (
 		u_int64_t lbid,
 		QueryContext v,
@@ -913,6 +1013,78 @@ blockReadRetry:
 		}
 	}
 
+	bool scanReadAheadRange(uint64_t lbid, uint32_t colWidth, uint64_t *extentFirst,
+		uint64_t *extentLast, uint64_t *readAheadLast)
+	{
+		BRM::OID_t oid;
+		uint16_t dbRoot;
+		uint32_t partNum;
+		uint16_t segNum;
+		uint32_t fbo;
+		uint32_t hwm;
+		uint32_t firstFbo, lastFbo;
+		uint32_t extentBlocks;
+		int extState;
+
+		if (colWidth == 0)
+			return false;
+
+		if (brm->lookupLocal(lbid, 0, false, oid, dbRoot, partNum, segNum, fbo) < 0)
+			return false;
+		if (brm->getLocalHWM(oid, partNum, segNum, hwm, extState) < 0)
+			return false;
+
+		// segment files are made of whole extents of extentRows * colWidth bytes
+		extentBlocks = brm->getExtentRows() * colWidth / BLOCK_SIZE;
+		if (extentBlocks == 0)
+			return false;
+		firstFbo = fbo - (fbo % extentBlocks);
+		lastFbo = firstFbo + extentBlocks - 1;
+		*extentFirst = lbid - (fbo - firstFbo);
+		*extentLast = lbid + (lastFbo - fbo);
+		if (hwm < lastFbo)
+			lastFbo = hwm;
+		*readAheadLast = (lastFbo < fbo ? lbid : lbid + (lastFbo - fbo));
+		return true;
+	}
+
+	// Starts async loads of up to window chunks past the one holding lbid, up to
+	// readAheadLast from scanReadAheadRange().  Returns the # of chunks asked for;
+	// loadBlockAsync() may still drop some if the loaders are busy.
+	uint scanReadAhead(uint64_t lbid,
+						uint64_t readAheadLast,
+						uint window,
+						const QueryContext &c,
+						uint32_t txn,
+						int compType,
+						uint32_t *cCount,
+						uint32_t *rCount,
+						bool LBIDTrace,
+						uint32_t sessionID,
+						boost::mutex *m,
+						uint *busyLoaders,
+						VSSCache *vssCache)
+	{
+		uint64_t chunk;
+		uint i;
+
+		chunk = (lbid / blocksReadAhead + 1) * blocksReadAhead;
+		for (i = 0; i < window && chunk <= readAheadLast; i++, chunk += blocksReadAhead)
+			loadBlockAsync(chunk, c, txn, compType, cCount, rCount, LBIDTrace, sessionID, m,
+				busyLoaders, vssCache);
+		return i;
+	}
+
+	// The # of blocks the caches have evicted without anyone having read them
+	uint64_t blocksNotUsed()
+	{
+		uint64_t ret = 0;
+
+		for (int i = 0; i < fCacheCount; i++)
+			ret += BRPp[i]->blocksNotUsed();
+		return ret;
+	}
+
 } //namespace primitiveprocessor
 
 //#define DCT_DEBUG 1
@@ -1139,7 +1311,7 @@ struct BPPHandler
 		scoped.unlock();
 		if (it != bppMap.end())
 			it->second->abort();
-		fPrimitiveServerPtr->getProcessorThreadPool()->removeJobs(key);
+		fPrimitiveServerPtr->removeJobs(key);
 	}
 
 	void doAck(ByteStream &bs)
@@ -1305,7 +1477,7 @@ struct BPPHandler
 			cerr << "destroyed BPP instances for sessionID " << sessionID << 
 			" stepID "<< stepID << endl;
 */
-		fPrimitiveServerPtr->getProcessorThreadPool()->removeJobs(uniqueID);
+		fPrimitiveServerPtr->removeJobs(uniqueID);
 	}
 
 	void setBPPToError(uint32_t uniqueID, const string& error, logging::ErrorCodeValues errorCode)
@@ -1366,6 +1538,7 @@ struct ReadThread
 			blockCacheClient bc(*BRPp[i]);
 			bc.flushOIDs(oids, count);
 		}
+		zoneMapFlush();
 		ios->write(buildCacheOpResp(0));
 	}
 
@@ -1391,6 +1564,7 @@ struct ReadThread
 			blockCacheClient bc(*BRPp[i]);
 			bc.flushPartition(oids, partitions);
 		}
+		zoneMapFlush();
 		ios->write(buildCacheOpResp(0));
 	}
 
@@ -1401,6 +1575,7 @@ struct ReadThread
 			blockCacheClient bc(*BRPp[i]);
 			bc.flushCache();
 		}
+		zoneMapFlush();
 
 		ios->write(buildCacheOpResp(0));
 	}
@@ -1437,6 +1612,7 @@ struct ReadThread
 			blockCacheClient bc(*BRPp[i]);
 			bc.flushMany(itemp, *cntp);
 		}
+		zoneMapFlush();
 		ios->write(buildCacheOpResp(0));
 	}
 
@@ -1451,6 +1627,7 @@ struct ReadThread
 			blockCacheClient bc(*BRPp[i]);
 			bc.flushManyAllversion(itemp, *cntp);
 		}
+		zoneMapFlush();
 		ios->write(buildCacheOpResp(0));
 	}
 	
@@ -1484,8 +1661,6 @@ struct ReadThread
 
 	void operator()()
 	{
-		boost::shared_ptr<threadpool::PriorityThreadPool> procPoolPtr =
-				fPrimitiveServerPtr->getProcessorThreadPool();
 		SBS bs;
 		UmSocketSelector* pUmSocketSelector = UmSocketSelector::instance();
 
@@ -1595,7 +1770,7 @@ struct ReadThread
 						job.id = hdr->Hdr.UniqueID;;
 						job.weight = LOGICAL_BLOCK_RIDS;
 						job.priority = hdr->Hdr.Priority;
-						procPoolPtr->addJob(job);
+						fPrimitiveServerPtr->getProcessorThreadPool(hdr->LBID)->addJob(job);
 					}
 					break;
 				}
@@ -1624,11 +1799,15 @@ struct ReadThread
 						boost::thread t(*bpps);
 					else {
 						PriorityThreadPool::Job job;
+						uint64_t lbid;
 						job.functor = bpps;
 						job.id = bpps->getID();
 						job.weight = ismHdr->Size;
 						job.priority = bpps->priority();
-						procPoolPtr->addJob(job);
+						if (bpps->scanLBID(&lbid))
+							fPrimitiveServerPtr->getProcessorThreadPool(lbid)->addJob(job);
+						else
+							fPrimitiveServerPtr->getAnyProcessorThreadPool()->addJob(job);
 					}
 					break;
 				}
@@ -1883,8 +2062,10 @@ PrimitiveServer::PrimitiveServer(int serverThreads,
 								double prefetch,
 								bool multicast,
 								bool multicastloop,
-								uint64_t smallSide
+								uint64_t smallSide,
+								bool numaAware
 								):
+				fNextNode(0),
 				fServerThreads(serverThreads),
 				fServerQueueSize(serverQueueSize),
 				fProcessorWeight(processorWeight), 
@@ -1898,12 +2079,48 @@ PrimitiveServer::PrimitiveServer(int serverThreads,
 				fMulticastloop(multicastloop),
 				fPMSmallSide(smallSide)
 {
+	const NumaTopology *numa = NULL;
+	uint32_t nodes = 1;
+
 	fCacheCount=cacheCount;
 	fServerpool.setMaxThreads(fServerThreads + multicast);
 	fServerpool.setQueueSize(fServerQueueSize);
 
-	fProcessorPool.reset(new threadpool::PriorityThreadPool(fProcessorWeight, highPriorityThreads,
-			medPriorityThreads, lowPriorityThreads));
+	if (numaAware) {
+		numa = new NumaTopology();
+		nodes = numa->nodeCount();
+		// every node needs a cache of its own
+		if (nodes > (uint32_t) fCacheCount)
+			nodes = fCacheCount;
+		if (nodes > 1)
+			numaTopology = numa;
+		else {
+			delete numa;
+			numa = NULL;
+			nodes = 1;
+		}
+		logging::Message::Args args;
+		args.add(string("PrimProc NUMA aware, using nodes:"));
+		args.add((uint64_t) nodes);
+		mlp->logInfoMessage(logging::M0000, args);
+	}
+
+	if (numa == NULL)
+		fProcessorPool.reset(new threadpool::PriorityThreadPool(fProcessorWeight, highPriorityThreads,
+				medPriorityThreads, lowPriorityThreads));
+	else {
+		/* Each node's pool gets its share of the threads.  Binding this thread
+		   while the pool starts binds the pool's threads too. */
+		for (uint32_t n = 0; n < nodes; n++) {
+			numa->bindToNode(n);
+			fNodePools.push_back(boost::shared_ptr<threadpool::PriorityThreadPool>(
+				new threadpool::PriorityThreadPool(fProcessorWeight,
+				max(1U, highPriorityThreads/nodes), max(1U, medPriorityThreads/nodes),
+				max(1U, lowPriorityThreads/nodes))));
+		}
+		numa->unbind();
+		fProcessorPool = fNodePools[0];
+	}
 
 	asyncCounter = 0;
 
@@ -1912,9 +2129,17 @@ PrimitiveServer::PrimitiveServer(int serverThreads,
 	BRPp = new BlockRequestProcessor*[fCacheCount];
 	try
 	{
-		for (int i = 0; i < fCacheCount; i++)
+		/* Cache i belongs to node i % nodes.  Its I/O threads are started
+		   bound to that node, and since they're the ones that fill the cache,
+		   its blocks get allocated there. */
+		for (int i = 0; i < fCacheCount; i++) {
+			if (numa)
+				numa->bindToNode(i % nodes);
 			BRPp[i] = new BlockRequestProcessor(BRPBlocks/fCacheCount, BRPThreads/fCacheCount,
 				fMaxBlocksPerRead, deleteBlocks/fCacheCount);
+		}
+		if (numa)
+			numa->unbind();
 	}
 	catch (...)
 	{
@@ -1929,6 +2154,29 @@ PrimitiveServer::~PrimitiveServer()
 {
 }
 
+boost::shared_ptr<threadpool::PriorityThreadPool> PrimitiveServer::getProcessorThreadPool(uint64_t lbid)
+{
+	if (fNodePools.empty())
+		return fProcessorPool;
+	return fNodePools[cacheNum(lbid) % fNodePools.size()];
+}
+
+boost::shared_ptr<threadpool::PriorityThreadPool> PrimitiveServer::getAnyProcessorThreadPool()
+{
+	if (fNodePools.empty())
+		return fProcessorPool;
+	return fNodePools[atomicops::atomicInc(&fNextNode) % fNodePools.size()];
+}
+
+void PrimitiveServer::removeJobs(uint id)
+{
+	if (fNodePools.empty())
+		fProcessorPool->removeJobs(id);
+	else
+		for (uint32_t i = 0; i < fNodePools.size(); i++)
+			fNodePools[i]->removeJobs(id);
+}
+
 void PrimitiveServer::start()
 {
 	// start all the server threads
@@ -93,6 +93,36 @@ namespace primitiveprocessor
 	uint cacheNum(uint64_t lbid);
 	void buildFileName(BRM::OID_t oid, char* fileName);
 
+	/* Scan readahead.  A scan keeps up to scanReadAheadChunks chunks of
+	   ColScanReadAheadBlocks loading ahead of the one it's in.
+	   scanReadAheadRange() gets the LBID range of lbid's extent from the BRM, and
+	   the last LBID in it readahead may load, which stops at the HWM.  It holds
+	   for every LBID in the extent, so callers can keep it. */
+	extern uint scanReadAheadChunks;
+	bool scanReadAheadRange(uint64_t lbid, uint32_t colWidth, uint64_t *extentFirst,
+		uint64_t *extentLast, uint64_t *readAheadLast);
+	uint scanReadAhead(uint64_t lbid, uint64_t readAheadLast, uint window, const BRM::QueryContext &q,
+		uint32_t txn, int compType, uint32_t *cCount, uint32_t *rCount, bool LBIDTrace,
+		uint32_t sessionID, boost::mutex *m, uint *busyLoaders, VSSCache* vssCache=0);
+	uint64_t blocksNotUsed();
+
+	/* The block zone map remembers the min & max of the logical blocks scans have
+	   seen, keyed by the first LBID and the versions of its blocks, so a scan can
+	   skip a logical block its filter can't match without loading it. */
+	extern uint64_t zoneMapSize;
+	bool zoneMapVersions(const BRM::LBID_t *lbids, uint count, const BRM::QueryContext &q,
+		uint32_t txn, VSSCache *vssCache, BRM::VER_t *vers);
+	bool zoneMapLookup(BRM::LBID_t lbid, const BRM::VER_t *vers, uint count, int64_t *min,
+		int64_t *max);
+	void zoneMapInsert(BRM::LBID_t lbid, const BRM::VER_t *vers, uint count, int64_t min,
+		int64_t max);
+	void zoneMapFlush();
+
+	/* The runs of equal values in lbids@vers, as recorded when they were decoded
+	   from an encoded chunk.  False unless they're known for all of them. */
+	bool getBlockRuns(const BRM::LBID_t *lbids, const BRM::VER_t *vers, uint count,
+		compress::BlockRuns *runs);
+
     /** @brief process primitives as they arrive
      */
     class PrimitiveServer
@@ -115,7 +145,8 @@ namespace primitiveprocessor
 						double prefetchThreshold = 0,
 						bool multicast = false,
 						bool multicastloop = false,
-						uint64_t pmSmallSide = 0);
+						uint64_t pmSmallSide = 0,
+						bool numaAware = false);
 
             /** @brief dtor
              */
@@ -130,6 +161,21 @@ namespace primitiveprocessor
              */
             inline boost::shared_ptr<threadpool::PriorityThreadPool> getProcessorThreadPool() const { return fProcessorPool; }
 
+            /** @brief get the processor thread pool for a job that reads lbid first
+             *
+             * When PrimProc is NUMA aware that's the pool on the node whose
+             * block caches own the LBID.  Otherwise it's the shared pool.
+             */
+            boost::shared_ptr<threadpool::PriorityThreadPool> getProcessorThreadPool(uint64_t lbid);
+
+            /** @brief get a processor thread pool for a job with no LBID to go by
+             */
+            boost::shared_ptr<threadpool::PriorityThreadPool> getAnyProcessorThreadPool();
+
+            /** @brief remove the queued jobs with the given id from every pool
+             */
+            void removeJobs(uint id);
+
 // 			int fCacheCount;
 			const int ReadAheadBlocks() const {return fReadAheadBlocks;}
 			bool  rotatingDestination() const {return fRotatingDestination;}
@@ -149,6 +195,13 @@ namespace primitiveprocessor
              */
             boost::shared_ptr<threadpool::PriorityThreadPool> fProcessorPool;
 
+            /** @brief with PrimitiveServers/NUMAAware on, one processor pool per
+             * NUMA node with its threads bound to that node.  fProcessorPool is
+             * the first of them.  Empty otherwise.
+             */
+            std::vector<boost::shared_ptr<threadpool::PriorityThreadPool> > fNodePools;
+            volatile uint32_t fNextNode;
+
             int fServerThreads;
             int fServerQueueSize;
             int fProcessorWeight;
@@ -55,6 +55,7 @@ using namespace logging;
 
 #include "primproc.h"
 #include "primitiveserver.h"
+#include "cachesnapshot.h"
 #include "MonitorProcMem.h"
 #include "pp_logger.h"
 #include "umsocketselector.h"
@@ -82,6 +83,7 @@ extern uint medPriorityThreads;
 extern uint lowPriorityThreads;
 extern int  directIOFlag;
 extern int  noVB;
+extern uint64_t dictTokenCacheSize;
 
 
 DebugLevel gDebugLevel;
@@ -262,6 +264,13 @@ void* waitForSIGUSR1(void* p)
 				BRPp[i]->formatLRUList(out);
 				out << "###" << endl;
 			}
+#ifdef _MSC_VER
+			ofstream stats("C:/Calpont/log/trace/ppcachestats.dat");
+#else
+			ofstream stats("/var/log/Calpont/trace/ppcachestats.dat");
+#endif
+			for (int i = 0; i < cacheCount; i++)
+				BRPp[i]->formatStats(stats);
 		} else
 		if (rec_sig == SIGUSR2)
 		{
@@ -596,6 +605,31 @@ int main(int argc, char* argv[])
 		directIOFlag = 0;
 #endif
 
+	// whole block scans in p_Col use the vectorized kernel unless it's turned off
+	strVal = cf->getConfig(primitiveServers, "BlockScan");
+	primitives::PrimitiveProcessor::initBlockScan(!((strVal == "n") || (strVal == "N")));
+
+	// memory each dictionary step may use to remember tokens it has already looked up
+	strVal = cf->getConfig(primitiveServers, "DictTokenCacheSize");
+	if (strVal.length() > 0)
+		dictTokenCacheSize = cf->uFromText(strVal);
+
+	// # of logical blocks the block zone map keeps min & max for
+	strVal = cf->getConfig(primitiveServers, "ZoneMapSize");
+	if (strVal.length() > 0)
+		zoneMapSize = cf->uFromText(strVal);
+
+	// # of readahead chunks a scan keeps loading ahead of itself
+	strVal = cf->getConfig(primitiveServers, "ScanReadAheadChunks");
+	if (strVal.length() > 0)
+		scanReadAheadChunks = cf->uFromText(strVal);
+
+	// one processor pool and set of block caches per NUMA node
+	bool numaAware = false;
+	strVal = cf->getConfig(primitiveServers, "NUMAAware");
+	if ((strVal == "y") || (strVal == "Y"))
+		numaAware = true;
+
 	IDBPolicy::configIDBPolicy();
 
 	loadUDFs();
@@ -609,11 +643,15 @@ int main(int argc, char* argv[])
 		", nb = " << BRPBlocks << ", nt = " << BRPThreads << ", nc = " << cacheCount <<
 		", ra = " << blocksReadAhead <<  ", db = " << deleteBlocks << ", mb = " << maxBlocksPerRead <<
 		", rd = " << rotatingDestination << ", tr = " << PTTrace << ", mc = " << boolalpha << multicast <<
-		", ml = " << multicastloop << ", ss = " << PMSmallSide << ", bp = " << BPPCount << endl;
+		", ml = " << multicastloop << ", ss = " << PMSmallSide << ", bp = " << BPPCount <<
+		", bs = " << primitives::PrimitiveProcessor::blockScanName() << endl;
 
 	PrimitiveServer server(serverThreads, serverQueueSize, processorWeight, processorQueueSize,
 		rotatingDestination, BRPBlocks, BRPThreads, cacheCount, maxBlocksPerRead, blocksReadAhead,
-		deleteBlocks, PTTrace, prefetchThreshold, multicast, multicastloop, PMSmallSide);
+		deleteBlocks, PTTrace, prefetchThreshold, multicast, multicastloop, PMSmallSide,
+		numaAware);
+
+	startCacheSnapshots(cacheCount);
 
 #ifdef QSIZE_DEBUG
 	thread* qszMonThd;
@@ -0,0 +1,555 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+/******************************************************************************
+ * $Id$
+ *
+ *****************************************************************************/
+
+/** @file tdriver-columncommand.cpp
+ * Drives ColumnCommand scans and DictStep filters over blocks put straight
+ * into the block cache, and the BPP's top-N heap and scan readahead.
+ * The cache lookups still need the BRM, so this runs on an installed system.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "bytestream.h"
+#include "primitivemsg.h"
+#include "calpontsystemcatalog.h"
+#include "brm.h"
+#include "blockrequestprocessor.h"
+#include "batchprimitiveprocessor.h"
+#include "columncommand.h"
+#include "dictstep.h"
+#include "primitiveserver.h"
+#include "primproc.h"
+#include "idbcompress.h"
+
+using namespace messageqcpp;
+using namespace execplan;
+using namespace dbbc;
+using namespace primitiveprocessor;
+using namespace rowgroup;
+
+namespace primitiveprocessor
+{
+	extern int fCacheCount;
+	extern uint64_t dictTokenCacheSize;
+
+	// primproc.cpp's globals; it can't be linked in with its main()
+	DebugLevel gDebugLevel;
+	Logger *mlp;
+	UDFFcnMap_t UDFFcnMap;
+	bool utf8 = false;
+
+	bool isDebug(const DebugLevel level)
+	{
+		return level <= gDebugLevel;
+	}
+}
+
+class ColumnCommandTest : public CppUnit::TestFixture
+{
+
+	CPPUNIT_TEST_SUITE( ColumnCommandTest );
+
+	CPPUNIT_TEST( zoneMapSkipsBlocksWithoutVSSEntries );
+	CPPUNIT_TEST( scanUsesBlockRuns );
+	CPPUNIT_TEST( scanLBIDFromRunMsg );
+	CPPUNIT_TEST( dictFilterUsesTokenCache );
+	CPPUNIT_TEST( topNSendsTheFirstRowsOfEachJob );
+	CPPUNIT_TEST( constructorLeavesTheCachesAlone );
+	CPPUNIT_TEST( readAheadKeepsTheExtent );
+
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	static const BRM::LBID_t firstLBID = 100000;
+
+	BatchPrimitiveProcessor *bpp;
+
+	/* Caches the 8 blocks of the logical block at lbid with every value set to val.
+	   The VSS has no entries for them, like most blocks. */
+	void cacheLogicalBlock(BRM::LBID_t lbid, int64_t val)
+	{
+		int64_t block[BLOCK_SIZE / 8];
+		BRM::VSSData vd;
+		uint i;
+
+		for (i = 0; i < BLOCK_SIZE / 8; i++)
+			block[i] = val;
+		vd.verID = 0;
+		vd.vbFlag = false;
+		vd.returnCode = -1;
+		for (i = 0; i < 8; i++) {
+			BRPp[0]->fbMgr.insert(lbid + i, 0, (const uint8_t *) block);
+			bpp->vssCache[lbid + i] = vd;
+		}
+	}
+
+	/* Records each of the 8 blocks at lbid as a single run of val */
+	void recordRuns(BRM::LBID_t lbid, int64_t val)
+	{
+		compress::BlockRuns runs;
+
+		runs.count = 1;
+		runs.ordered = true;
+		runs.values[0] = val;
+		runs.starts[0] = 0;
+		for (uint i = 0; i < 8; i++)
+			BRPp[0]->fIOMgr.runIndex().insert(lbid + i, 0, runs);
+	}
+
+	/* A BIGINT scan with the filter col = arg */
+	void makeScan(ColumnCommand &cc, int compType, int64_t arg)
+	{
+		ByteStream bs, filter;
+		vector<uint64_t> lastLbid(1, firstLBID + 1023);
+
+		filter << (uint8_t) COMPARE_EQ << (uint8_t) 0 << (uint64_t) arg;
+		bs << (uint8_t) Command::COLUMN_COMMAND;
+		bs << (uint8_t) true;		// isScan
+		bs << (uint32_t) 0;			// trace flags
+		bs << filter;
+		bs << (uint8_t) CalpontSystemCatalog::BIGINT;
+		bs << (uint8_t) 8;			// width
+		bs << (uint8_t) 0;			// scale
+		bs << (uint8_t) compType;
+		bs << (uint8_t) BOP_AND;
+		bs << (uint16_t) 1;			// filter count
+		bs << (uint8_t) 0;			// no UDF
+		serializeInlineVector(bs, lastLbid);
+		bs << (uint32_t) 3000;		// OID
+		bs << (uint32_t) 1;			// tuple key
+
+		cc.setBatchPrimitiveProcessor(bpp);
+		cc.createCommand(bs);
+		cc.prep(OT_RID, false);
+	}
+
+	/* Caches a dictionary block at lbid holding strings, which get the
+	   offset indexes 1, 2, ... */
+	void cacheDictBlock(BRM::LBID_t lbid, const vector<string> &strings)
+	{
+		uint8_t block[BLOCK_SIZE];
+		uint16_t *offsets = (uint16_t *) &block[10];
+		uint16_t end = BLOCK_SIZE;
+		uint i;
+
+		memset(block, 0, sizeof(block));
+		offsets[0] = end;
+		for (i = 0; i < strings.size(); i++) {
+			end -= strings[i].length();
+			memcpy(&block[end], strings[i].data(), strings[i].length());
+			offsets[i + 1] = end;
+		}
+		offsets[i + 1] = 0xffff;
+		BRPp[0]->fbMgr.insert(lbid, 0, block);
+	}
+
+	/* A DictStep filter for col = arg */
+	void makeDictFilter(DictStep &ds, const string &arg)
+	{
+		ByteStream bs, filter;
+
+		filter << (uint8_t) COMPARE_EQ;
+		filter << (uint16_t) arg.length();
+		filter.append((const uint8_t *) arg.data(), arg.length());
+		bs << (uint8_t) Command::DICT_STEP;
+		bs << (uint8_t) BOP_AND;
+		bs << (uint8_t) 0;			// compression type
+		bs << (uint32_t) 1;			// filter count
+		bs << (uint8_t) false;		// no equality filter
+		bs << filter;
+		bs << (uint32_t) 3001;		// OID
+		bs << (uint32_t) 2;			// tuple key
+
+		ds.setBatchPrimitiveProcessor(bpp);
+		ds.createCommand(bs);
+		ds.prep(OT_RID, false);
+	}
+
+	/* Filters rid i with tokens[i] and returns the rids that pass */
+	vector<uint64_t> dictFilter(DictStep &ds, const vector<uint64_t> &tokens)
+	{
+		vector<uint64_t> ret;
+		uint i;
+
+		bpp->baseRid = 0;
+		bpp->ridCount = tokens.size();
+		for (i = 0; i < tokens.size(); i++) {
+			bpp->absRids[i] = i;
+			bpp->relRids[i] = i;
+			bpp->values[i] = tokens[i];
+		}
+		ds.execute();
+		for (i = 0; i < bpp->ridCount; i++)
+			ret.push_back(bpp->absRids[i]);
+		sort(ret.begin(), ret.end());
+		return ret;
+	}
+
+	/* One BIGINT column */
+	RowGroup makeIntRG()
+	{
+		vector<uint> pos, oids, keys, scale(1, 0), precision(1, 19);
+		vector<CalpontSystemCatalog::ColDataType> types;
+
+		pos.push_back(2);
+		pos.push_back(10);
+		oids.push_back(3000);
+		keys.push_back(1);
+		types.push_back(CalpontSystemCatalog::BIGINT);
+		return RowGroup(1, pos, oids, keys, types, scale, precision, 20);
+	}
+
+	/* Sets up the BPP's top-N the way initProcessor() does for an ORDER BY col DESC LIMIT limit */
+	void makeTopN(const RowGroup &rg, uint32_t limit)
+	{
+		bpp->topNLimit = limit;
+		bpp->topNSpec.assign(1, ordering::IdbSortSpec(0, false));
+		bpp->topNRG = rg;
+		bpp->topNData.reinit(bpp->topNRG, limit);
+		bpp->topNRG.setData(&bpp->topNData);
+		bpp->topNRG.initRow(&bpp->topNIn);
+		bpp->topNRG.initRow(&bpp->topNRow);
+		bpp->topNCompare.reset(new ordering::OrderByData(bpp->topNSpec, bpp->topNRG));
+		bpp->resetTopN();
+	}
+
+	/* Feeds vals to the top-N as block blockNum of a job of count blocks and returns
+	   the values it sent */
+	vector<int64_t> topNBlock(RowGroup &rg, const vector<int64_t> &vals, uint blockNum,
+	  uint count)
+	{
+		RGData data(rg, vals.size()), out;
+		vector<int64_t> ret;
+		Row r;
+		uint i;
+
+		rg.setData(&data);
+		rg.resetRowGroup(0);
+		rg.initRow(&r);
+		rg.getRow(0, &r);
+		for (i = 0; i < vals.size(); i++, r.nextRow())
+			r.setIntField<8>(vals[i], 0);
+		rg.setRowCount(vals.size());
+
+		bpp->count = count;
+		bpp->currentBlockOffset = blockNum;
+		bpp->serialized.reset(new ByteStream());
+		bpp->processTopN(rg);
+
+		out.deserialize(*bpp->serialized);
+		rg.setData(&out);
+		rg.getRow(0, &r);
+		for (i = 0; i < rg.getRowCount(); i++, r.nextRow())
+			ret.push_back(r.getIntField<8>(0));
+		return ret;
+	}
+
+	/* A BATCH_PRIMITIVE_RUN msg laid out like BatchPrimitiveProcessorJL::runBPP()
+	   makes it, without rids, followed by the scan's LBID */
+	void makeRunMsg(ByteStream &bs, uint16_t ridCount, bool absRids, uint64_t lbid)
+	{
+		ISMPacketHeader ism;
+
+		memset((void*)&ism, 0, sizeof(ism));
+		ism.Command = BATCH_PRIMITIVE_RUN;
+		bs.restart();
+		bs.append((uint8_t *) &ism, sizeof(ism));
+		bs << (uint32_t) 1 << (uint32_t) 2 << (uint32_t) 3 << (uint32_t) 4;
+		bs << (uint32_t) bpp->dbRoot;
+		bs << (uint16_t) 8;			// count
+		bs << ridCount;
+		if (!absRids) {
+			bs << (uint8_t) 0;		// ridMap
+			bs << (uint64_t) 0;		// baseRid
+		}
+		bs << lbid;
+	}
+
+	void scan(ColumnCommand &cc, BRM::LBID_t lbid)
+	{
+		ByteStream bs;
+
+		bs << (uint64_t) lbid;
+		cc.resetCommand(bs);
+		cc.execute();
+	}
+
+public:
+	void setUp()
+	{
+		if (brm == NULL)
+			brm = new BRM::DBRM();
+		fCacheCount = 1;
+		BRPp = new BlockRequestProcessor*[1];
+		BRPp[0] = new BlockRequestProcessor(8192, 1, 1);
+		zoneMapFlush();
+
+		bpp = new BatchPrimitiveProcessor();
+		bpp->dbRoot = 1;
+		bpp->outMsgSize = BatchPrimitiveProcessor::BUFFER_SIZE;
+		bpp->outputMsg.reset(new uint8_t[bpp->outMsgSize]);
+	}
+
+	void tearDown()
+	{
+		dictTokenCacheSize = 1024 * 1024;
+		delete bpp;
+		delete BRPp[0];
+		delete [] BRPp;
+		BRPp = NULL;
+	}
+
+	/* The first scan records the block's min & max, the second one has to skip the
+	   load because nothing in [5, 5] can be 10 */
+	void zoneMapSkipsBlocksWithoutVSSEntries()
+	{
+		ColumnCommand cc;
+
+		cacheLogicalBlock(firstLBID, 5);
+		makeScan(cc, 0, 10);
+
+		scan(cc, firstLBID);
+		CPPUNIT_ASSERT(bpp->ridCount == 0);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 8);
+
+		scan(cc, firstLBID);
+		CPPUNIT_ASSERT(bpp->ridCount == 0);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 8);
+		CPPUNIT_ASSERT(bpp->validCPData && bpp->minVal == 5 && bpp->maxVal == 5);
+	}
+
+	/* The runs recorded for the blocks disagree with what's cached, so the result
+	   shows which one the filter was evaluated against */
+	void scanUsesBlockRuns()
+	{
+		ColumnCommand cc;
+		const BRM::LBID_t lbid = firstLBID + 8;
+
+		cacheLogicalBlock(lbid, 5);
+		recordRuns(lbid, 10);
+		makeScan(cc, compress::IDBCompressInterface::ENCODED_COMPRESSION, 10);
+
+		scan(cc, lbid);
+		CPPUNIT_ASSERT(bpp->ridCount == LOGICAL_BLOCK_RIDS);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 8);
+	}
+
+	/* BPPSeeder uses this to send a scan to the processor pool on its LBID's NUMA node */
+	void scanLBIDFromRunMsg()
+	{
+		ColumnCommand *cc = new ColumnCommand();
+		ByteStream bs;
+		uint64_t lbid = 0;
+
+		makeScan(*cc, 0, 10);
+		bpp->filterSteps.push_back(SCommand(cc));
+		bpp->filterCount = 1;
+		bpp->hasScan = true;
+
+		makeRunMsg(bs, 0, false, firstLBID + 16);
+		CPPUNIT_ASSERT(bpp->scanLBID(bs, &lbid));
+		CPPUNIT_ASSERT(lbid == (uint64_t) firstLBID + 16);
+		// bs is untouched for resetBPP()
+		CPPUNIT_ASSERT(bs.length() == sizeof(ISMPacketHeader) + 16 + 4 + 2 + 2 + 1 + 8 + 8);
+
+		// absolute rids have no ridMap & baseRid
+		bpp->gotAbsRids = true;
+		makeRunMsg(bs, 0, true, firstLBID + 24);
+		CPPUNIT_ASSERT(bpp->scanLBID(bs, &lbid));
+		CPPUNIT_ASSERT(lbid == (uint64_t) firstLBID + 24);
+		bpp->gotAbsRids = false;
+
+		// input rids mean it's not a scan
+		makeRunMsg(bs, 1, false, firstLBID);
+		CPPUNIT_ASSERT(!bpp->scanLBID(bs, &lbid));
+
+		// a msg cut off before the LBID
+		makeRunMsg(bs, 0, false, firstLBID);
+		ByteStream shortMsg(bs.buf(), bs.length() - 4);
+		CPPUNIT_ASSERT(!bpp->scanLBID(shortMsg, &lbid));
+
+		bpp->hasScan = false;
+		makeRunMsg(bs, 0, false, firstLBID);
+		CPPUNIT_ASSERT(!bpp->scanLBID(bs, &lbid));
+	}
+
+	/* The second pass over the same tokens comes entirely from the token cache,
+	   and the results match the ones p_Dictionary gave */
+	void dictFilterUsesTokenCache()
+	{
+		const BRM::LBID_t dictLBID = firstLBID + 64;
+		vector<string> strings;
+		vector<uint64_t> tokens, expected, passed;
+		uint i;
+
+		strings.push_back("apple");
+		strings.push_back("banana");
+		strings.push_back("cherry");
+		strings.push_back("date");
+		cacheDictBlock(dictLBID, strings);
+		cacheDictBlock(dictLBID + 1, strings);
+		bpp->absRids.reset(new uint64_t[LOGICAL_BLOCK_RIDS]);
+
+		// banana in both blocks, repeated and out of order.  No date yet.
+		for (i = 0; i < 40; i++)
+			tokens.push_back(((dictLBID + (i % 2)) << 10) | (i % 3 + 1));
+		for (i = 0; i < tokens.size(); i++)
+			if ((tokens[i] & 0x3ff) == 2)
+				expected.push_back(i);
+
+		DictStep cached;
+		makeDictFilter(cached, "banana");
+		passed = dictFilter(cached, tokens);
+		CPPUNIT_ASSERT(passed == expected);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 2);
+
+		passed = dictFilter(cached, tokens);
+		CPPUNIT_ASSERT(passed == expected);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 2);
+
+		// a new token in a cached block only sends that token
+		tokens.push_back((dictLBID << 10) | 4);
+		passed = dictFilter(cached, tokens);
+		CPPUNIT_ASSERT(passed == expected);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 3);
+
+		// without the cache every pass goes to the blocks
+		tokens.pop_back();
+		dictTokenCacheSize = 0;
+		DictStep uncached;
+		makeDictFilter(uncached, "banana");
+		passed = dictFilter(uncached, tokens);
+		CPPUNIT_ASSERT(passed == expected);
+		passed = dictFilter(uncached, tokens);
+		CPPUNIT_ASSERT(passed == expected);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 7);
+
+		// a cache that's always full is cleared before each block
+		dictTokenCacheSize = 1;
+		DictStep tiny;
+		makeDictFilter(tiny, "banana");
+		passed = dictFilter(tiny, tokens);
+		passed = dictFilter(tiny, tokens);
+		CPPUNIT_ASSERT(passed == expected);
+		CPPUNIT_ASSERT(bpp->touchedBlocks == 11);
+	}
+
+	/* Only the last block of a job sends rows, and they're the job's best ones.
+	   The next job starts over. */
+	void topNSendsTheFirstRowsOfEachJob()
+	{
+		RowGroup rg = makeIntRG();
+		vector<int64_t> vals, all, sent;
+		uint i, block;
+
+		makeTopN(rg, 5);
+		for (block = 0; block < 3; block++) {
+			vals.clear();
+			for (i = 0; i < 100; i++)
+				vals.push_back((int64_t) ((i * 7919 + block * 104729) % 1000) - 500);
+			// ties at the cut-off
+			vals.push_back(499);
+			all.insert(all.end(), vals.begin(), vals.end());
+			sent = topNBlock(rg, vals, block, 3);
+			if (block < 2)
+				CPPUNIT_ASSERT(sent.empty());
+		}
+
+		sort(all.begin(), all.end());
+		reverse(all.begin(), all.end());
+		all.resize(5);
+		sort(sent.begin(), sent.end());
+		reverse(sent.begin(), sent.end());
+		CPPUNIT_ASSERT(sent == all);
+
+		// fewer rows than the limit
+		vals.assign(1, -1000);
+		vals.push_back(-2000);
+		sent = topNBlock(rg, vals, 0, 1);
+		sort(sent.begin(), sent.end());
+		CPPUNIT_ASSERT(sent.size() == 2 && sent[0] == -2000 && sent[1] == -1000);
+	}
+
+	/* BPPs get made for every step of every query; they mustn't have to visit
+	   each cache to get the eviction baseline */
+	void constructorLeavesTheCachesAlone()
+	{
+		BlockRequestProcessor **caches = BRPp;
+		BatchPrimitiveProcessor *b;
+
+		BRPp = NULL;
+		b = new BatchPrimitiveProcessor();
+		CPPUNIT_ASSERT(!b->raNotUsedValid);
+		CPPUNIT_ASSERT(b->raWindow == scanReadAheadChunks);
+		CPPUNIT_ASSERT(b->raExtents.empty());
+		delete b;
+		BRPp = caches;
+	}
+
+	/* LBIDs in the extent a step was last in come from the cached range.  The
+	   BRM has no extent at the LBIDs used here, so anything that asks it fails. */
+	void readAheadKeepsTheExtent()
+	{
+		const uint64_t first = 1ULL << 50;
+		BatchPrimitiveProcessor::ReadAheadExtent ext;
+		uint64_t end = 0;
+
+		ext.first = first;
+		ext.last = first + 1023;
+		ext.end = first + 511;
+		bpp->raExtents.assign(2, ext);
+
+		CPPUNIT_ASSERT(bpp->readAheadRange(1, first, 8, &end) && end == first + 511);
+		CPPUNIT_ASSERT(bpp->readAheadRange(1, first + 1023, 8, &end) && end == first + 511);
+
+		// a step past the ones seen so far gets a new entry
+		CPPUNIT_ASSERT(!bpp->readAheadRange(3, first, 8, &end));
+		CPPUNIT_ASSERT(bpp->raExtents.size() == 4 && bpp->raExtents[3].last == 0);
+
+		// leaving the extent drops it
+		CPPUNIT_ASSERT(!bpp->readAheadRange(1, first + 1024, 8, &end));
+		CPPUNIT_ASSERT(bpp->raExtents[1].last == 0);
+		CPPUNIT_ASSERT(bpp->readAheadRange(0, first + 100, 8, &end) && end == first + 511);
+	}
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( ColumnCommandTest );
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
@@ -0,0 +1,161 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+/******************************************************************************
+ * $Id$
+ *
+ *****************************************************************************/
+
+/** @file tdriver-numa.cpp
+ * Reads NUMA layouts from fake sysfs node directories.
+ */
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+using namespace std;
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "numatopology.h"
+
+using namespace primitiveprocessor;
+
+class NumaTopologyTest : public CppUnit::TestFixture
+{
+
+	CPPUNIT_TEST_SUITE( NumaTopologyTest );
+
+	CPPUNIT_TEST( parseNodes );
+	CPPUNIT_TEST( skipDisallowedCPUs );
+	CPPUNIT_TEST( noNodeDir );
+
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	string dir;
+	vector<string> made;
+
+	void addNode(int node, const string &cpulist)
+	{
+		ostringstream nodeDir;
+
+		nodeDir << dir << "/node" << node;
+		mkdir(nodeDir.str().c_str(), 0755);
+		made.push_back(nodeDir.str());
+		ofstream out((nodeDir.str() + "/cpulist").c_str());
+		out << cpulist << endl;
+	}
+
+	vector<int> cpuRange(int first, int last)
+	{
+		vector<int> ret;
+
+		for (int i = first; i <= last; i++)
+			ret.push_back(i);
+		return ret;
+	}
+
+public:
+	void setUp()
+	{
+		char path[] = "/tmp/numaXXXXXX";
+
+		CPPUNIT_ASSERT(mkdtemp(path) != NULL);
+		dir = path;
+		made.clear();
+	}
+
+	void tearDown()
+	{
+		for (uint32_t i = 0; i < made.size(); i++) {
+			unlink((made[i] + "/cpulist").c_str());
+			rmdir(made[i].c_str());
+		}
+		rmdir(dir.c_str());
+	}
+
+	// nodes are numbered by their directory, not by the order readdir() returns them
+	void parseNodes()
+	{
+		addNode(10, "8,10-11");
+		addNode(1, "4-7");
+		addNode(0, "0-3");
+		mkdir((dir + "/power").c_str(), 0755);
+		made.push_back(dir + "/power");
+
+		NumaTopology numa(dir, cpuRange(0, 15));
+		CPPUNIT_ASSERT(numa.nodeCount() == 3);
+		CPPUNIT_ASSERT(numa.cpus(0) == cpuRange(0, 3));
+		CPPUNIT_ASSERT(numa.cpus(1) == cpuRange(4, 7));
+		CPPUNIT_ASSERT(numa.cpus(2).size() == 3);
+		CPPUNIT_ASSERT(numa.cpus(2)[0] == 8 && numa.cpus(2)[1] == 10 && numa.cpus(2)[2] == 11);
+	}
+
+	// a node with no CPUs the process may use, or none at all, isn't a node
+	void skipDisallowedCPUs()
+	{
+		vector<int> allowed;
+
+		addNode(0, "0-3");
+		addNode(1, "4-7");
+		addNode(2, "");
+		allowed.push_back(5);
+		allowed.push_back(0);
+		allowed.push_back(6);
+
+		NumaTopology numa(dir, allowed);
+		CPPUNIT_ASSERT(numa.nodeCount() == 2);
+		CPPUNIT_ASSERT(numa.cpus(0).size() == 1 && numa.cpus(0)[0] == 0);
+		CPPUNIT_ASSERT(numa.cpus(1) == cpuRange(5, 6));
+
+		allowed.clear();
+		allowed.push_back(4);
+		NumaTopology one(dir, allowed);
+		CPPUNIT_ASSERT(one.nodeCount() == 1);
+		CPPUNIT_ASSERT(one.cpus(0) == allowed);
+	}
+
+	// without sysfs every allowed CPU is on one node
+	void noNodeDir()
+	{
+		NumaTopology numa(dir + "/missing", cpuRange(0, 3));
+
+		CPPUNIT_ASSERT(numa.nodeCount() == 1);
+		CPPUNIT_ASSERT(numa.cpus(0) == cpuRange(0, 3));
+		CPPUNIT_ASSERT(numa.currentNode() == 0);
+	}
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( NumaTopologyTest );
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
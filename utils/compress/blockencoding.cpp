@@ -0,0 +1,559 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation;
+   version 2.1 of the License.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <cstring>
+#include <vector>
+using namespace std;
+
+#define IDBCOMP_DLLEXPORT
+#include "blockencoding.h"
+#undef IDBCOMP_DLLEXPORT
+
+namespace
+{
+using namespace compress;
+
+const size_t ENC_BLOCK_LEN = BlockEncoding::BLOCK_LEN;
+
+inline int64_t loadValue(const char* p, unsigned width)
+{
+	int8_t v1;
+	int16_t v2;
+	int32_t v4;
+	int64_t v8;
+
+	switch (width)
+	{
+		case 1: memcpy(&v1, p, 1); return v1;
+		case 2: memcpy(&v2, p, 2); return v2;
+		case 4: memcpy(&v4, p, 4); return v4;
+		default: memcpy(&v8, p, 8); return v8;
+	}
+}
+
+// keeps the low width bytes of v
+inline void storeValue(char* p, unsigned width, uint64_t v)
+{
+	uint8_t v1;
+	uint16_t v2;
+	uint32_t v4;
+
+	switch (width)
+	{
+		case 1: v1 = v; memcpy(p, &v1, 1); break;
+		case 2: v2 = v; memcpy(p, &v2, 2); break;
+		case 4: v4 = v; memcpy(p, &v4, 4); break;
+		default: memcpy(p, &v, 8); break;
+	}
+}
+
+inline unsigned bitsNeeded(uint64_t x)
+{
+	unsigned bits = 0;
+
+	while (x != 0)
+	{
+		bits++;
+		x >>= 1;
+	}
+	return bits;
+}
+
+inline size_t packedLen(size_t n, unsigned bits)
+{
+	return (n * bits + 7) / 8;
+}
+
+// bits is < 64
+size_t pack(const uint64_t* v, size_t n, unsigned bits, char* out)
+{
+	uint64_t acc = 0;
+	unsigned fill = 0;
+	size_t pos = 0;
+
+	if (bits == 0)
+		return 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		acc |= v[i] << fill;
+		if (fill + bits >= 64)
+		{
+			memcpy(&out[pos], &acc, 8);
+			pos += 8;
+			acc = (fill == 0 ? 0 : v[i] >> (64 - fill));
+			fill = fill + bits - 64;
+		}
+		else
+			fill += bits;
+	}
+	if (fill > 0)
+	{
+		memcpy(&out[pos], &acc, (fill + 7) / 8);
+		pos += (fill + 7) / 8;
+	}
+	return pos;
+}
+
+bool unpack(const char* in, size_t inLen, size_t n, unsigned bits, uint64_t* v)
+{
+	const uint64_t mask = (bits == 64 ? ~0ULL : (1ULL << bits) - 1);
+	uint64_t word, bitPos;
+	size_t byte;
+	unsigned shift;
+	uint8_t next;
+
+	if (inLen < packedLen(n, bits))
+		return false;
+
+	if (bits == 0)
+	{
+		for (size_t i = 0; i < n; i++)
+			v[i] = 0;
+		return true;
+	}
+
+	for (size_t i = 0; i < n; i++)
+	{
+		bitPos = (uint64_t) i * bits;
+		byte = bitPos / 8;
+		shift = bitPos % 8;
+		word = 0;
+		memcpy(&word, &in[byte], min((size_t) 8, inLen - byte));
+		word >>= shift;
+		if (shift + bits > 64)
+		{
+			next = in[byte + 8];
+			word |= (uint64_t) next << (64 - shift);
+		}
+		v[i] = word & mask;
+	}
+	return true;
+}
+
+/* A small open addressed set for counting a block's distinct values.  Gives up
+   past MAX_DICT_SIZE. */
+class DictBuilder
+{
+public:
+	DictBuilder() : fCount(0)
+	{
+		memset(fUsed, 0, sizeof(fUsed));
+	}
+
+	// returns the value's code, or -1 if the dictionary is full
+	int add(int64_t v)
+	{
+		unsigned slot = (unsigned) (((uint64_t) v * 0x9E3779B97F4A7C15ULL) >> 55);
+
+		while (fUsed[slot])
+		{
+			if (fKeys[slot] == v)
+				return fCodes[slot];
+			slot = (slot + 1) % SLOTS;
+		}
+		if (fCount == BlockEncoding::MAX_DICT_SIZE)
+			return -1;
+		fUsed[slot] = true;
+		fKeys[slot] = v;
+		fCodes[slot] = fCount;
+		fValues[fCount] = v;
+		return fCount++;
+	}
+
+	unsigned count() const { return fCount; }
+	int64_t value(unsigned code) const { return fValues[code]; }
+
+private:
+	static const unsigned SLOTS = 512;
+	bool fUsed[SLOTS];
+	int64_t fKeys[SLOTS];
+	unsigned fCodes[SLOTS];
+	int64_t fValues[BlockEncoding::MAX_DICT_SIZE];
+	unsigned fCount;
+};
+
+// Encodes the n values of one block, returns the # of bytes written to out
+size_t encodeBlock(const int64_t* v, size_t n, unsigned width, char* out,
+	vector<uint64_t>& work, uint8_t* encoding)
+{
+	const unsigned maxBits = width * 8;
+	size_t plainLen = n * width;
+	size_t forLen = 0, deltaLen = 0, rleLen, dictLen = 0, best;
+	unsigned forBits, deltaBits = 0, dictBits = 0;
+	int64_t minV, maxV, minD = 0;
+	uint64_t maxE;
+	size_t runs = 1, i, pos;
+	DictBuilder dict;
+	bool dictOk = true;
+
+	// FOR
+	minV = maxV = v[0];
+	for (i = 1; i < n; i++)
+	{
+		if (v[i] < minV)
+			minV = v[i];
+		else if (v[i] > maxV)
+			maxV = v[i];
+	}
+	forBits = bitsNeeded((uint64_t) maxV - (uint64_t) minV);
+	if (forBits < maxBits)
+		forLen = 8 + 1 + packedLen(n, forBits);
+
+	// DELTA
+	if (n > 1)
+	{
+		minD = (int64_t) ((uint64_t) v[1] - (uint64_t) v[0]);
+		for (i = 2; i < n; i++)
+		{
+			int64_t d = (int64_t) ((uint64_t) v[i] - (uint64_t) v[i - 1]);
+			if (d < minD)
+				minD = d;
+		}
+		maxE = 0;
+		for (i = 1; i < n; i++)
+		{
+			uint64_t e = (uint64_t) v[i] - (uint64_t) v[i - 1] - (uint64_t) minD;
+			if (e > maxE)
+				maxE = e;
+		}
+		deltaBits = bitsNeeded(maxE);
+		if (deltaBits < maxBits)
+			deltaLen = 8 + 8 + 1 + packedLen(n - 1, deltaBits);
+	}
+
+	// RLE
+	for (i = 1; i < n; i++)
+		if (v[i] != v[i - 1])
+			runs++;
+	rleLen = 2 + runs * (width + 2);
+
+	// DICT
+	for (i = 0; i < n && dictOk; i++)
+		dictOk = (dict.add(v[i]) >= 0);
+	if (dictOk)
+	{
+		dictBits = bitsNeeded(dict.count() - 1);
+		dictLen = 2 + dict.count() * width + 1 + packedLen(n, dictBits);
+	}
+
+	best = plainLen;
+	*encoding = BlockEncoding::PLAIN;
+	if (forLen > 0 && forLen < best)
+	{
+		best = forLen;
+		*encoding = BlockEncoding::FOR;
+	}
+	if (deltaLen > 0 && deltaLen < best)
+	{
+		best = deltaLen;
+		*encoding = BlockEncoding::DELTA;
+	}
+	if (rleLen < best)
+	{
+		best = rleLen;
+		*encoding = BlockEncoding::RLE;
+	}
+	if (dictLen > 0 && dictLen < best)
+	{
+		best = dictLen;
+		*encoding = BlockEncoding::DICT;
+	}
+
+	switch (*encoding)
+	{
+		case BlockEncoding::FOR:
+			memcpy(out, &minV, 8);
+			out[8] = forBits;
+			for (i = 0; i < n; i++)
+				work[i] = (uint64_t) v[i] - (uint64_t) minV;
+			return 9 + pack(&work[0], n, forBits, &out[9]);
+
+		case BlockEncoding::DELTA:
+			memcpy(out, &v[0], 8);
+			memcpy(&out[8], &minD, 8);
+			out[16] = deltaBits;
+			for (i = 1; i < n; i++)
+				work[i - 1] = (uint64_t) v[i] - (uint64_t) v[i - 1] - (uint64_t) minD;
+			return 17 + pack(&work[0], n - 1, deltaBits, &out[17]);
+
+		case BlockEncoding::RLE:
+		{
+			uint16_t count = runs, len;
+			memcpy(out, &count, 2);
+			pos = 2;
+			for (i = 0; i < n; i += len)
+			{
+				for (len = 1; i + len < n && v[i + len] == v[i]; len++) ;
+				storeValue(&out[pos], width, v[i]);
+				memcpy(&out[pos + width], &len, 2);
+				pos += width + 2;
+			}
+			return pos;
+		}
+
+		case BlockEncoding::DICT:
+		{
+			uint16_t count = dict.count();
+			memcpy(out, &count, 2);
+			pos = 2;
+			for (i = 0; i < count; i++, pos += width)
+				storeValue(&out[pos], width, dict.value(i));
+			out[pos++] = dictBits;
+			for (i = 0; i < n; i++)
+				work[i] = dict.add(v[i]);
+			return pos + pack(&work[0], n, dictBits, &out[pos]);
+		}
+
+		default:
+			for (i = 0; i < n; i++)
+				storeValue(&out[i * width], width, v[i]);
+			return plainLen;
+	}
+}
+
+inline uint64_t rawValue(const char* p, unsigned width)
+{
+	uint64_t v = 0;
+
+	memcpy(&v, p, width);
+	return v;
+}
+
+inline uint64_t truncValue(uint64_t v, unsigned width)
+{
+	return (width == 8 ? v : v & ((1ULL << (width * 8)) - 1));
+}
+
+// Decodes one block of n values into out, false if it's malformed
+bool decodeBlock(uint8_t encoding, const char* in, size_t inLen, size_t n, unsigned width,
+	char* out, vector<uint64_t>& work, BlockRuns* runs)
+{
+	size_t i, pos;
+	unsigned bits;
+	int64_t base, minD;
+	uint64_t cur;
+	uint16_t count, len;
+
+	switch (encoding)
+	{
+		case BlockEncoding::PLAIN:
+			if (inLen != n * width)
+				return false;
+			memcpy(out, in, inLen);
+			return true;
+
+		case BlockEncoding::FOR:
+			if (inLen < 9)
+				return false;
+			memcpy(&base, in, 8);
+			bits = (uint8_t) in[8];
+			if (bits >= 64 || !unpack(&in[9], inLen - 9, n, bits, &work[0]))
+				return false;
+			for (i = 0; i < n; i++)
+				storeValue(&out[i * width], width, (uint64_t) base + work[i]);
+			if (runs && bits == 0)
+			{
+				runs->count = 1;
+				runs->ordered = true;
+				runs->values[0] = truncValue(base, width);
+				runs->starts[0] = 0;
+			}
+			return true;
+
+		case BlockEncoding::DELTA:
+			if (inLen < 17 || n < 2)
+				return false;
+			memcpy(&base, in, 8);
+			memcpy(&minD, &in[8], 8);
+			bits = (uint8_t) in[16];
+			if (bits >= 64 || !unpack(&in[17], inLen - 17, n - 1, bits, &work[0]))
+				return false;
+			cur = base;
+			storeValue(out, width, cur);
+			for (i = 1; i < n; i++)
+			{
+				cur += (uint64_t) minD + work[i - 1];
+				storeValue(&out[i * width], width, cur);
+			}
+			if (runs && bits == 0 && minD == 0)
+			{
+				runs->count = 1;
+				runs->ordered = true;
+				runs->values[0] = truncValue(base, width);
+				runs->starts[0] = 0;
+			}
+			return true;
+
+		case BlockEncoding::RLE:
+		{
+			size_t done = 0;
+			if (inLen < 2)
+				return false;
+			memcpy(&count, in, 2);
+			if (inLen < 2 + (size_t) count * (width + 2))
+				return false;
+			if (runs && count <= BlockRuns::MAX_RUNS)
+			{
+				runs->count = count;
+				runs->ordered = true;
+			}
+			else
+				runs = NULL;
+			for (pos = 2; count > 0; count--, pos += width + 2)
+			{
+				memcpy(&len, &in[pos + width], 2);
+				if (done + len > n)
+					return false;
+				if (runs)
+				{
+					runs->values[runs->count - count] = rawValue(&in[pos], width);
+					runs->starts[runs->count - count] = done;
+				}
+				for (i = 0; i < len; i++, done++)
+					memcpy(&out[done * width], &in[pos], width);
+			}
+			return (done == n);
+		}
+
+		case BlockEncoding::DICT:
+		{
+			const char* values;
+			if (inLen < 2)
+				return false;
+			memcpy(&count, in, 2);
+			if (count == 0 || count > BlockEncoding::MAX_DICT_SIZE ||
+			  inLen < 2 + (size_t) count * width + 1)
+				return false;
+			values = &in[2];
+			pos = 2 + count * width;
+			bits = (uint8_t) in[pos++];
+			if (bits >= 64 || !unpack(&in[pos], inLen - pos, n, bits, &work[0]))
+				return false;
+			for (i = 0; i < n; i++)
+			{
+				if (work[i] >= count)
+					return false;
+				memcpy(&out[i * width], &values[work[i] * width], width);
+			}
+			if (runs && count <= BlockRuns::MAX_RUNS)
+			{
+				runs->count = count;
+				runs->ordered = false;
+				for (i = 0; i < count; i++)
+					runs->values[i] = rawValue(&values[i * width], width);
+			}
+			return true;
+		}
+
+		default:
+			return false;
+	}
+}
+
+}
+
+namespace compress
+{
+
+/* static */
+size_t BlockEncoding::maxEncodedSize(size_t inLen)
+{
+	// never more than PLAIN plus the headers
+	return STREAM_HDR_LEN + inLen + ((inLen + ENC_BLOCK_LEN - 1) / ENC_BLOCK_LEN) * BLOCK_HDR_LEN;
+}
+
+/* static */
+size_t BlockEncoding::encode(const char* in, size_t inLen, unsigned width, char* out)
+{
+	vector<int64_t> values(ENC_BLOCK_LEN);
+	vector<uint64_t> work(ENC_BLOCK_LEN);
+	size_t pos = STREAM_HDR_LEN, done, blockLen, n, i, encLen;
+	uint32_t len32 = inLen, encLen32;
+	uint8_t encoding;
+
+	if (!isEncodable(width) || inLen == 0 || inLen % width != 0 || inLen > 0xffffffffULL)
+		return 0;
+
+	out[0] = width;
+	memcpy(&out[1], &len32, 4);
+
+	for (done = 0; done < inLen; done += blockLen)
+	{
+		blockLen = min(ENC_BLOCK_LEN, inLen - done);
+		n = blockLen / width;
+		for (i = 0; i < n; i++)
+			values[i] = loadValue(&in[done + i * width], width);
+
+		encLen = encodeBlock(&values[0], n, width, &out[pos + BLOCK_HDR_LEN], work, &encoding);
+		encLen32 = encLen;
+		out[pos] = encoding;
+		memcpy(&out[pos + 1], &encLen32, 4);
+		pos += BLOCK_HDR_LEN + encLen;
+	}
+
+	return pos;
+}
+
+/* static */
+size_t BlockEncoding::decodedLength(const char* in, size_t inLen)
+{
+	uint32_t len32;
+
+	if (inLen < STREAM_HDR_LEN || !isEncodable((uint8_t) in[0]))
+		return 0;
+	memcpy(&len32, &in[1], 4);
+	return len32;
+}
+
+/* static */
+size_t BlockEncoding::decode(const char* in, size_t inLen, char* out, size_t outCap,
+	BlockRuns* runs)
+{
+	vector<uint64_t> work(ENC_BLOCK_LEN);
+	size_t outLen = decodedLength(in, inLen);
+	size_t pos = STREAM_HDR_LEN, done, blockLen;
+	unsigned width;
+	uint32_t encLen;
+
+	if (outLen == 0 || outLen > outCap)
+		return 0;
+	width = (uint8_t) in[0];
+	if (outLen % width != 0)
+		return 0;
+
+	for (done = 0; done < outLen; done += blockLen)
+	{
+		blockLen = min(ENC_BLOCK_LEN, outLen - done);
+		if (inLen - pos < BLOCK_HDR_LEN)
+			return 0;
+		memcpy(&encLen, &in[pos + 1], 4);
+		if (inLen - pos - BLOCK_HDR_LEN < encLen)
+			return 0;
+		if (runs)
+			runs[done / ENC_BLOCK_LEN].count = 0;
+		if (!decodeBlock((uint8_t) in[pos], &in[pos + BLOCK_HDR_LEN], encLen, blockLen / width,
+		  width, &out[done], work, (runs ? &runs[done / ENC_BLOCK_LEN] : NULL)))
+			return 0;
+		pos += BLOCK_HDR_LEN + encLen;
+	}
+
+	return outLen;
+}
+
+}
+// vim:ts=4 sw=4:
@@ -0,0 +1,129 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation;
+   version 2.1 of the License.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+/** @file */
+
+#ifndef BLOCKENCODING_H__
+#define BLOCKENCODING_H__
+
+#include <unistd.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER) && defined(xxxIDBCOMP_DLLEXPORT)
+#define EXPORT __declspec(dllexport)
+#else
+#define EXPORT
+#endif
+
+namespace compress
+{
+
+/** @brief The runs of equal values in one block of decoded data
+ *
+ * decode() fills one of these per block for the blocks it decoded from RLE or
+ * DICT (or FOR/DELTA with nothing to pack) with at most MAX_RUNS runs or
+ * dictionary entries, which lets a filter be evaluated once per run rather
+ * than once per value.  Values are the width bytes of the column zero-extended.
+ */
+struct BlockRuns
+{
+	static const unsigned MAX_RUNS = 16;
+
+	uint16_t count;				// 0 if the block can't be described this way
+	bool ordered;				// false for a DICT block: the distinct values, starts[] unused
+	uint64_t values[MAX_RUNS];
+	uint16_t starts[MAX_RUNS];	// the index of the first value of each run
+};
+
+/** @brief Lightweight encodings of fixed width column data
+ *
+ * Data is encoded one 8KB block at a time, and each block gets whichever
+ * encoding makes it smallest:
+ *
+ *  PLAIN   the values as they are
+ *  FOR     frame of reference, the block's min and each value minus the min
+ *          bit-packed
+ *  DELTA   the first value, then the difference from the previous value minus
+ *          the smallest difference, bit-packed.  For sorted data like
+ *          timestamps and keys.
+ *  RLE     (value, run length) pairs
+ *  DICT    the block's distinct values followed by a bit-packed index into
+ *          them for each value.  For blocks with at most 256 distinct values.
+ *
+ * Values are sign-extended to 64 bits and arithmetic wraps, so any bit
+ * pattern round trips, including the NULL and empty row markers.
+ *
+ * An encoded stream is
+ *   uint8 width, uint32 decoded length
+ * then for each block
+ *   uint8 encoding, uint32 encoded length, the encoded block
+ */
+class BlockEncoding
+{
+public:
+	enum Encoding
+	{
+		PLAIN,
+		FOR,
+		DELTA,
+		RLE,
+		DICT
+	};
+
+	static const unsigned BLOCK_LEN = 8192;
+	static const unsigned STREAM_HDR_LEN = 5;
+	static const unsigned BLOCK_HDR_LEN = 5;
+	static const unsigned MAX_DICT_SIZE = 256;
+
+	/**
+	 * Is width a column width that can be encoded
+	 */
+	static bool isEncodable(unsigned width)
+		{ return (width == 1 || width == 2 || width == 4 || width == 8); }
+
+	/**
+	 * The most encode() can write for inLen bytes of input
+	 */
+	EXPORT static size_t maxEncodedSize(size_t inLen);
+
+	/**
+	 * Encodes inLen bytes of width byte values into out, which has to be at
+	 * least maxEncodedSize(inLen).  Returns the encoded length, or 0 if the
+	 * input can't be encoded.
+	 */
+	EXPORT static size_t encode(const char* in, size_t inLen, unsigned width, char* out);
+
+	/**
+	 * Returns the decoded length of the stream in, 0 if it's malformed
+	 */
+	EXPORT static size_t decodedLength(const char* in, size_t inLen);
+
+	/**
+	 * Decodes the stream in into out, which has room for outCap bytes.  Returns
+	 * the decoded length, or 0 if the stream is malformed or out is too small.
+	 * If runs isn't NULL it gets an entry for each BLOCK_LEN of output.
+	 */
+	EXPORT static size_t decode(const char* in, size_t inLen, char* out, size_t outCap,
+		BlockRuns* runs = NULL);
+};
+
+}
+
+#undef EXPORT
+
+#endif
+// vim:ts=4 sw=4:
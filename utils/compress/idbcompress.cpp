@@ -22,13 +22,19 @@
 #include <cstring>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 using namespace std;
 
+#include <boost/scoped_array.hpp>
+
 #include "blocksize.h"
 #include "logger.h"
 #include "snappy.h"
+#include "lz4.h"
+#include "lz4hc.h"
 #include "hasher.h"
 #include "version1.h"
+#include "blockencoding.h"
 
 #define IDBCOMP_DLLEXPORT
 #include "idbcompress.h"
@@ -39,6 +45,7 @@ namespace
 const uint64_t MAGIC_NUMBER = 0xfdc119a384d0778eULL;
 const uint64_t VERSION_NUM1 = 1;
 const uint64_t VERSION_NUM2 = 2;
+const uint64_t VERSION_NUM3 = 3;	// compression types 3 & 4, chunks made of sub-chunks
 const int      COMPRESSED_CHUNK_INCREMENT_SIZE = 8192;
 const int      PTR_SECTION_OFFSET = compress::IDBCompressInterface::HDR_BUF_LEN;
 
@@ -63,6 +70,44 @@ const uint8_t CHUNK_MAGIC2 = 0xfe;
  */
 const uint8_t CHUNK_MAGIC3 = 0xfd;
 
+/* version 3.0 of the chunk data (compression type 3) splits the chunk into
+ * SUBCHUNK_LEN pieces, each compressed on its own as a version 2.0 chunk.  After
+ * the usual header comes an index: the uncompressed length, the # of sub-chunks,
+ * and the offset of each sub-chunk from the start of the chunk plus one for the
+ * end.  The checksum covers the index; the sub-chunks have their own.
+ */
+const uint8_t CHUNK_MAGIC4 = 0xfc;
+const int SUBCHUNK_ULEN_OFFSET = HEADER_SIZE;
+const int SUBCHUNK_COUNT_OFFSET = HEADER_SIZE + 4;
+const int SUBCHUNK_INDEX_OFFSET = HEADER_SIZE + 8;
+
+inline unsigned subChunkIndexLen(unsigned count)
+{
+	return 8 + (count + 1) * 4;
+}
+
+/* Compression type 4 adds chunks (or sub-chunks) holding BlockEncoding output,
+ * either as is or compressed again with snappy.  The header has two more fields
+ * than version 2.0's: flags and the decoded length.  The checksum covers what
+ * follows the header.
+ */
+const uint8_t CHUNK_MAGIC5 = 0xfb;
+const int ENC_FLAGS_OFFSET = HEADER_SIZE;
+const int ENC_ULEN_OFFSET = HEADER_SIZE + 1;
+const unsigned ENC_HEADER_SIZE = HEADER_SIZE + 5;
+const uint8_t ENC_FLAG_SNAPPY = 0x1;
+
+/* Compression types 5 & 6 store LZ4 blocks, which don't record their own
+ * length, so the header has the uncompressed length after version 2.0's.  The
+ * checksum covers what follows the header.
+ */
+const uint8_t CHUNK_MAGIC6 = 0xfa;
+const int LZ4_ULEN_OFFSET = HEADER_SIZE;
+const unsigned LZ4_HEADER_SIZE = HEADER_SIZE + 4;
+
+// compress() & uncompress() output for CODEC_LZ4 starts with the uncompressed length
+const unsigned LZ4_MSG_HEADER_SIZE = 4;
+
 struct CompressedDBFileHeader
 {
 	uint64_t fMagicNumber;
@@ -83,7 +128,8 @@ void initCompressedDBFileHeader(void* hdrBuf, int compressionType, int hdrSize)
 {
 	CompressedDBFileHeaderBlock* hdr = reinterpret_cast<CompressedDBFileHeaderBlock*>(hdrBuf);
 	hdr->fHeader.fMagicNumber     = MAGIC_NUMBER;
-	hdr->fHeader.fVersionNum      = VERSION_NUM2;
+	hdr->fHeader.fVersionNum      = (compress::IDBCompressInterface::hasSubChunks(compressionType) ?
+		VERSION_NUM3 : VERSION_NUM2);
 	hdr->fHeader.fCompressionType = compressionType;
 	hdr->fHeader.fBlockCount      = 0;
 	hdr->fHeader.fHeaderSize      = hdrSize;
@@ -122,7 +168,11 @@ bool IDBCompressInterface::isCompressionAvail(int compressionType) const
 {
 	if ( (compressionType == 0) ||
 		(compressionType == 1) ||
-		(compressionType == 2) )
+		(compressionType == 2) ||
+		(compressionType == SUBCHUNK_COMPRESSION) ||
+		(compressionType == ENCODED_COMPRESSION) ||
+		(compressionType == LZ4_COMPRESSION) ||
+		(compressionType == LZ4HC_COMPRESSION) )
 		return true;
 	return false;
 }
@@ -164,11 +214,169 @@ int IDBCompressInterface::compressBlock(const char* in,
 	return ERR_OK;
 }
 
+//------------------------------------------------------------------------------
+// Compress a block of data in the format of the given compression type.  Types
+// SUBCHUNK_COMPRESSION and ENCODED_COMPRESSION compress each SUBCHUNK_LEN piece
+// on its own so a reader can decompress only the part it needs.  The LZ4 types
+// compress it whole.
+//------------------------------------------------------------------------------
+int IDBCompressInterface::compressBlock(const char* in,
+	const size_t   inLen,
+	unsigned char* out,
+	unsigned int&  outLen,
+	int            compressionType,
+	unsigned       colWidth) const
+{
+	const bool encoded = (compressionType == ENCODED_COMPRESSION &&
+		BlockEncoding::isEncodable(colWidth));
+
+	if (compressionType == LZ4_COMPRESSION || compressionType == LZ4HC_COMPRESSION)
+		return compressLZ4(in, inLen, out, outLen, compressionType == LZ4HC_COMPRESSION);
+	if (!hasSubChunks(compressionType))
+		return compressBlock(in, inLen, out, outLen);
+	if (inLen <= SUBCHUNK_LEN)
+		return (encoded ? compressEncoded(in, inLen, out, outLen, colWidth) :
+			compressBlock(in, inLen, out, outLen));
+
+	const unsigned count = (inLen + SUBCHUNK_LEN - 1) / SUBCHUNK_LEN;
+	const unsigned indexLen = subChunkIndexLen(count);
+	uint32_t *offsets = (uint32_t *) &out[SUBCHUNK_INDEX_OFFSET];
+	unsigned int pos, subLen;
+	size_t uLen;
+	int rc;
+	utils::Hasher128 hasher;
+
+	if (outLen < maxCompressedSize(inLen))
+	{
+		cerr << "got outLen = " << outLen << " for inLen = " << inLen << ", needed " <<
+			maxCompressedSize(inLen) << endl;
+		return ERR_BADOUTSIZE;
+	}
+
+	pos = HEADER_SIZE + indexLen;
+	for (unsigned i = 0; i < count; i++)
+	{
+		uLen = min((size_t) SUBCHUNK_LEN, inLen - (size_t) i * SUBCHUNK_LEN);
+		subLen = outLen - pos;
+		if (encoded)
+			rc = compressEncoded(&in[(size_t) i * SUBCHUNK_LEN], uLen, &out[pos], subLen,
+				colWidth);
+		else
+			rc = compressBlock(&in[(size_t) i * SUBCHUNK_LEN], uLen, &out[pos], subLen);
+		if (rc != ERR_OK)
+			return rc;
+		offsets[i] = pos;
+		pos += subLen;
+	}
+	offsets[count] = pos;
+
+	*((uint32_t *) &out[SUBCHUNK_ULEN_OFFSET]) = inLen;
+	*((uint32_t *) &out[SUBCHUNK_COUNT_OFFSET]) = count;
+	out[SIG_OFFSET] = CHUNK_MAGIC4;
+	*((uint32_t *) &out[CHECKSUM_OFFSET]) = hasher((char *) &out[HEADER_SIZE], indexLen);
+	*((uint32_t *) &out[LEN_OFFSET]) = pos - HEADER_SIZE;
+
+	outLen = pos;
+	return ERR_OK;
+}
+
+//------------------------------------------------------------------------------
+// Compress a piece of a type 4 chunk.  It's compressed as usual first, and
+// replaced by the encoded form, with or without snappy on top, only if that's
+// smaller, so the result is never bigger than compressBlock()'s.
+//------------------------------------------------------------------------------
+int IDBCompressInterface::compressEncoded(const char* in,
+	const size_t   inLen,
+	unsigned char* out,
+	unsigned int&  outLen,
+	unsigned       colWidth) const
+{
+	size_t encLen, snapLen = 0, payloadLen;
+	uint8_t flags = 0;
+	const char *payload;
+	utils::Hasher128 hasher;
+	int rc;
+
+	rc = compressBlock(in, inLen, out, outLen);
+	if (rc != ERR_OK || inLen % colWidth != 0)
+		return rc;
+
+	boost::scoped_array<char> encoded(new char[BlockEncoding::maxEncodedSize(inLen)]);
+	encLen = BlockEncoding::encode(in, inLen, colWidth, encoded.get());
+	if (encLen == 0)
+		return ERR_OK;
+
+	// the encodings leave repeated patterns that snappy can often still shrink
+	boost::scoped_array<char> snapped(new char[snappy::MaxCompressedLength(encLen)]);
+	snappy::RawCompress(encoded.get(), encLen, snapped.get(), &snapLen);
+	if (snapLen < encLen)
+	{
+		payload = snapped.get();
+		payloadLen = snapLen;
+		flags |= ENC_FLAG_SNAPPY;
+	}
+	else
+	{
+		payload = encoded.get();
+		payloadLen = encLen;
+	}
+
+	if (payloadLen + ENC_HEADER_SIZE >= outLen)
+		return ERR_OK;
+
+	memcpy(&out[ENC_HEADER_SIZE], payload, payloadLen);
+	out[SIG_OFFSET] = CHUNK_MAGIC5;
+	*((uint32_t *) &out[CHECKSUM_OFFSET]) = hasher(payload, payloadLen);
+	*((uint32_t *) &out[LEN_OFFSET]) = payloadLen;
+	out[ENC_FLAGS_OFFSET] = flags;
+	*((uint32_t *) &out[ENC_ULEN_OFFSET]) = inLen;
+	outLen = payloadLen + ENC_HEADER_SIZE;
+	return ERR_OK;
+}
+
+//------------------------------------------------------------------------------
+// Compress a type 5 or 6 chunk.  High compression takes several times longer
+// to compress, but decompresses at the same speed.
+//------------------------------------------------------------------------------
+int IDBCompressInterface::compressLZ4(const char* in,
+	const size_t   inLen,
+	unsigned char* out,
+	unsigned int&  outLen,
+	bool           highCompression) const
+{
+	int lz4Len;
+	utils::Hasher128 hasher;
+
+	if (inLen > (size_t) LZ4_MAX_INPUT_SIZE ||
+	  outLen < (unsigned) LZ4_compressBound(inLen) + LZ4_HEADER_SIZE)
+	{
+		cerr << "got outLen = " << outLen << " for inLen = " << inLen << ", needed " <<
+			(LZ4_compressBound(inLen) + LZ4_HEADER_SIZE) << endl;
+		return ERR_BADOUTSIZE;
+	}
+
+	if (highCompression)
+		lz4Len = LZ4_compress_HC(in, (char *) &out[LZ4_HEADER_SIZE], inLen,
+			outLen - LZ4_HEADER_SIZE, LZ4HC_CLEVEL_DEFAULT);
+	else
+		lz4Len = LZ4_compress_default(in, (char *) &out[LZ4_HEADER_SIZE], inLen,
+			outLen - LZ4_HEADER_SIZE);
+	if (lz4Len <= 0)
+		return ERR_BADOUTSIZE;
+
+	out[SIG_OFFSET] = CHUNK_MAGIC6;
+	*((uint32_t *) &out[CHECKSUM_OFFSET]) = hasher((char *) &out[LZ4_HEADER_SIZE], lz4Len);
+	*((uint32_t *) &out[LEN_OFFSET]) = lz4Len;
+	*((uint32_t *) &out[LZ4_ULEN_OFFSET]) = inLen;
+	outLen = lz4Len + LZ4_HEADER_SIZE;
+	return ERR_OK;
+}
+
 //------------------------------------------------------------------------------
 // Decompress a block of data
 //------------------------------------------------------------------------------
 int IDBCompressInterface::uncompressBlock(const char* in, const size_t inLen, unsigned char* out,
-	unsigned int& outLen) const
+	unsigned int& outLen, BlockRuns* runs) const
 {
 	bool comprc = false;
 	size_t ol = 0;
@@ -179,13 +387,110 @@ int IDBCompressInterface::uncompressBlock(const char* in, const size_t inLen, un
 	uint8_t storedMagic;
 	utils::Hasher128 hasher;
 
+	const unsigned int outCapacity = outLen;
 	outLen = 0;
 	if (inLen < 1) {
 		return ERR_BADINPUT;
 	}
 	storedMagic = *((uint8_t *) &in[SIG_OFFSET]);
 
-	if (storedMagic == CHUNK_MAGIC3)
+	if (storedMagic == CHUNK_MAGIC4)
+	{
+		uint64_t uOffset, uLen, cOffset, cLen;
+		int rc;
+
+		// all of it, one sub-chunk at a time
+		if (inLen < HEADER_SIZE + 8)
+			return ERR_BADINPUT;
+		uLen = *((uint32_t *) &in[SUBCHUNK_ULEN_OFFSET]);
+		if (uLen > outCapacity)
+			return ERR_BADOUTSIZE;
+		rc = getSubChunkRange(in, inLen, 0, uLen, cOffset, cLen, uOffset);
+		if (rc != ERR_OK)
+			return rc;
+		if (inLen < cOffset + cLen)
+			return ERR_BADINPUT;
+		unsigned int subOutLen = outCapacity;
+		rc = uncompressSubChunks(&in[cOffset], cLen, out, subOutLen, runs);
+		if (rc != ERR_OK)
+			return rc;
+		outLen = subOutLen;
+		return ERR_OK;
+	}
+	else if (storedMagic == CHUNK_MAGIC5)
+	{
+		uint32_t uLen;
+		size_t decLen;
+
+		if (inLen < ENC_HEADER_SIZE) {
+			return ERR_BADINPUT;
+		}
+		storedChecksum = *((uint32_t *) &in[CHECKSUM_OFFSET]);
+		storedLen = *((uint32_t *) (&in[LEN_OFFSET]));
+		uLen = *((uint32_t *) (&in[ENC_ULEN_OFFSET]));
+		if (inLen < storedLen + ENC_HEADER_SIZE) {
+			return ERR_BADINPUT;
+		}
+		if (uLen > outCapacity) {
+			return ERR_BADOUTSIZE;
+		}
+
+		realChecksum = hasher(&in[ENC_HEADER_SIZE], storedLen);
+		if (storedChecksum != realChecksum) {
+			return ERR_CHECKSUM;
+		}
+
+		if (in[ENC_FLAGS_OFFSET] & ENC_FLAG_SNAPPY)
+		{
+			size_t encLen;
+			if (!snappy::GetUncompressedLength(&in[ENC_HEADER_SIZE], storedLen, &encLen) ||
+			  encLen > BlockEncoding::maxEncodedSize(uLen))
+				return ERR_DECOMPRESS;
+			boost::scoped_array<char> encoded(new char[encLen]);
+			if (!snappy::RawUncompress(&in[ENC_HEADER_SIZE], storedLen, encoded.get()))
+				return ERR_DECOMPRESS;
+			decLen = BlockEncoding::decode(encoded.get(), encLen, (char *) out, outCapacity,
+				runs);
+		}
+		else
+			decLen = BlockEncoding::decode(&in[ENC_HEADER_SIZE], storedLen, (char *) out,
+				outCapacity, runs);
+
+		if (decLen != uLen)
+		{
+			cerr << "decomp failed!" << endl;
+			return ERR_DECOMPRESS;
+		}
+		outLen = decLen;
+		return ERR_OK;
+	}
+	else if (storedMagic == CHUNK_MAGIC6)
+	{
+		uint32_t uLen;
+
+		if (inLen < LZ4_HEADER_SIZE) {
+			return ERR_BADINPUT;
+		}
+		storedChecksum = *((uint32_t *) &in[CHECKSUM_OFFSET]);
+		storedLen = *((uint32_t *) (&in[LEN_OFFSET]));
+		uLen = *((uint32_t *) (&in[LZ4_ULEN_OFFSET]));
+		if (inLen < storedLen + LZ4_HEADER_SIZE) {
+			return ERR_BADINPUT;
+		}
+		if (uLen > outCapacity) {
+			return ERR_BADOUTSIZE;
+		}
+
+		realChecksum = hasher(&in[LZ4_HEADER_SIZE], storedLen);
+		if (storedChecksum != realChecksum) {
+			return ERR_CHECKSUM;
+		}
+
+		comprc = (LZ4_decompress_safe(&in[LZ4_HEADER_SIZE], (char *) out, storedLen, uLen) ==
+			(int) uLen);
+		ol = uLen;
+	}
+	else if (storedMagic == CHUNK_MAGIC3)
 	{
 		if (inLen < HEADER_SIZE) {
 			return ERR_BADINPUT;
@@ -257,6 +562,111 @@ int IDBCompressInterface::uncompressBlock(const char* in, const size_t inLen, un
 	outLen = ol;
 	//cerr << "ub: " << inLen << " : " << outLen << endl;
 
+	// nothing here was encoded
+	if (runs)
+		for (size_t i = 0; i < (ol + BlockEncoding::BLOCK_LEN - 1) / BlockEncoding::BLOCK_LEN; i++)
+			runs[i].count = 0;
+
+	return ERR_OK;
+}
+
+//------------------------------------------------------------------------------
+// Find the sub-chunks that hold [uncompOffset, uncompOffset + uncompLen) of a
+// chunk made of sub-chunks.  Only the start of the chunk is needed, see
+// SUBCHUNK_HDR_LEN.
+//------------------------------------------------------------------------------
+int IDBCompressInterface::getSubChunkRange(const char* chunkHdr,
+	const size_t hdrLen,
+	uint64_t uncompOffset,
+	uint64_t uncompLen,
+	uint64_t& compOffset,
+	uint64_t& compLen,
+	uint64_t& outOffset) const
+{
+	uint32_t count, totalULen, first, last;
+	uint32_t realChecksum;
+	const uint32_t *offsets;
+	utils::Hasher128 hasher;
+
+	if (hdrLen < HEADER_SIZE + 8 || *((uint8_t *) &chunkHdr[SIG_OFFSET]) != CHUNK_MAGIC4)
+		return ERR_BADINPUT;
+
+	totalULen = *((uint32_t *) &chunkHdr[SUBCHUNK_ULEN_OFFSET]);
+	count = *((uint32_t *) &chunkHdr[SUBCHUNK_COUNT_OFFSET]);
+	if (count == 0 || count > UNCOMPRESSED_INBUF_LEN / SUBCHUNK_LEN ||
+	  hdrLen < HEADER_SIZE + subChunkIndexLen(count))
+		return ERR_BADINPUT;
+	realChecksum = hasher(&chunkHdr[HEADER_SIZE], subChunkIndexLen(count));
+	if (*((uint32_t *) &chunkHdr[CHECKSUM_OFFSET]) != realChecksum)
+		return ERR_CHECKSUM;
+	if (uncompLen == 0 || uncompOffset + uncompLen > totalULen)
+		return ERR_BADINPUT;
+
+	offsets = (const uint32_t *) &chunkHdr[SUBCHUNK_INDEX_OFFSET];
+	first = uncompOffset / SUBCHUNK_LEN;
+	last = (uncompOffset + uncompLen - 1) / SUBCHUNK_LEN;
+	if (last >= count || offsets[last + 1] <= offsets[first])
+		return ERR_BADINPUT;
+
+	compOffset = offsets[first];
+	compLen = offsets[last + 1] - offsets[first];
+	outOffset = (uint64_t) first * SUBCHUNK_LEN;
+	return ERR_OK;
+}
+
+//------------------------------------------------------------------------------
+// Decompress a run of consecutive sub-chunks, as located by getSubChunkRange().
+//------------------------------------------------------------------------------
+int IDBCompressInterface::uncompressSubChunks(const char* in,
+	const size_t inLen,
+	unsigned char* out,
+	unsigned int& outLen,
+	BlockRuns* runs) const
+{
+	const unsigned int outCapacity = outLen;
+	size_t pos = 0;
+	uint32_t subLen;
+	size_t ul;
+	unsigned int ol, total = 0;
+	int rc;
+
+	outLen = 0;
+	while (pos < inLen)
+	{
+		if (inLen - pos < HEADER_SIZE)
+			return ERR_BADINPUT;
+		if ((uint8_t) in[pos + SIG_OFFSET] == CHUNK_MAGIC5)
+		{
+			// uncompressBlock() checks the output size of these itself
+			if (inLen - pos < ENC_HEADER_SIZE)
+				return ERR_BADINPUT;
+			subLen = *((uint32_t *) &in[pos + LEN_OFFSET]) + ENC_HEADER_SIZE;
+			if (subLen > inLen - pos)
+				return ERR_BADINPUT;
+		}
+		else if ((uint8_t) in[pos + SIG_OFFSET] == CHUNK_MAGIC3)
+		{
+			subLen = *((uint32_t *) &in[pos + LEN_OFFSET]) + HEADER_SIZE;
+			if (subLen > inLen - pos)
+				return ERR_BADINPUT;
+			// uncompressBlock() trusts the output to be big enough
+			if (!snappy::GetUncompressedLength(&in[pos + HEADER_SIZE], subLen - HEADER_SIZE, &ul) ||
+			  ul > outCapacity - total)
+				return ERR_BADOUTSIZE;
+		}
+		else
+			return ERR_BADINPUT;
+		ol = outCapacity - total;
+		// sub-chunks start on a BLOCK_LEN boundary
+		rc = uncompressBlock(&in[pos], subLen, &out[total], ol,
+			(runs ? &runs[total / BlockEncoding::BLOCK_LEN] : NULL));
+		if (rc != ERR_OK)
+			return rc;
+		total += ol;
+		pos += subLen;
+	}
+
+	outLen = total;
 	return ERR_OK;
 }
 
@@ -403,6 +813,14 @@ uint64_t IDBCompressInterface::getBlockCount(const void* hdrBuf) const
 	return (reinterpret_cast<const CompressedDBFileHeader*>(hdrBuf)->fBlockCount);
 }
 
+//------------------------------------------------------------------------------
+// Get the file's compression type
+//------------------------------------------------------------------------------
+int IDBCompressInterface::getCompressionType(const void* hdrBuf) const
+{
+	return (reinterpret_cast<const CompressedDBFileHeader*>(hdrBuf)->fCompressionType);
+}
+
 //------------------------------------------------------------------------------
 // Set the overall header size
 //------------------------------------------------------------------------------
@@ -470,7 +888,17 @@ int IDBCompressInterface::padCompressedChunks(unsigned char* buf,
 /* static */
 uint64_t IDBCompressInterface::maxCompressedSize(uint64_t uncompSize)
 {
-	return (snappy::MaxCompressedLength(uncompSize) + HEADER_SIZE);
+	uint64_t whole = max((uint64_t) snappy::MaxCompressedLength(uncompSize) + HEADER_SIZE,
+		(uint64_t) LZ4_COMPRESSBOUND(uncompSize) + LZ4_HEADER_SIZE);
+
+	if (uncompSize <= SUBCHUNK_LEN)
+		return whole;
+
+	// a chunk made of sub-chunks can be a little bigger
+	uint64_t count = (uncompSize + SUBCHUNK_LEN - 1) / SUBCHUNK_LEN;
+	uint64_t split = HEADER_SIZE + subChunkIndexLen(count) +
+		count * (snappy::MaxCompressedLength(SUBCHUNK_LEN) + HEADER_SIZE);
+	return max(whole, split);
 }
 
 int IDBCompressInterface::compress(const char *in, size_t inLen, char *out,
@@ -485,12 +913,58 @@ int IDBCompressInterface::uncompress(const char *in, size_t inLen, char *out) co
 	return !(snappy::RawUncompress(in, inLen, out));
 }
 
+int IDBCompressInterface::compress(const char *in, size_t inLen, char *out,
+		size_t *outLen, Codec codec) const
+{
+	int lz4Len;
+
+	if (codec != CODEC_LZ4)
+		return compress(in, inLen, out, outLen);
+
+	if (inLen > (size_t) LZ4_MAX_INPUT_SIZE)
+		return -1;
+	lz4Len = LZ4_compress_default(in, &out[LZ4_MSG_HEADER_SIZE], inLen,
+		LZ4_compressBound(inLen));
+	if (lz4Len <= 0)
+		return -1;
+	*((uint32_t *) out) = inLen;
+	*outLen = lz4Len + LZ4_MSG_HEADER_SIZE;
+	return 0;
+}
+
+int IDBCompressInterface::uncompress(const char *in, size_t inLen, char *out,
+		Codec codec) const
+{
+	size_t uLen;
+
+	if (codec != CODEC_LZ4)
+		return uncompress(in, inLen, out);
+
+	if (!getUncompressedSize(const_cast<char *>(in), inLen, &uLen, codec))
+		return 1;
+	return !(LZ4_decompress_safe(&in[LZ4_MSG_HEADER_SIZE], out, inLen - LZ4_MSG_HEADER_SIZE,
+		uLen) == (int) uLen);
+}
+
 /* static */
 bool IDBCompressInterface::getUncompressedSize(char *in, size_t inLen, size_t *outLen)
 {
 	return snappy::GetUncompressedLength(in, inLen, outLen);
 }
 
+/* static */
+bool IDBCompressInterface::getUncompressedSize(char *in, size_t inLen, size_t *outLen,
+		Codec codec)
+{
+	if (codec != CODEC_LZ4)
+		return getUncompressedSize(in, inLen, outLen);
+
+	if (inLen < LZ4_MSG_HEADER_SIZE)
+		return false;
+	*outLen = *((uint32_t *) in);
+	return (*outLen <= (size_t) LZ4_MAX_INPUT_SIZE);
+}
+
 #endif
 
 } // namespace compress
@@ -27,6 +27,8 @@
 #include <vector>
 #include <utility>
 
+#include "blockencoding.h"
+
 #if defined(_MSC_VER) && defined(xxxIDBCOMP_DLLEXPORT)
 #define EXPORT __declspec(dllexport)
 #else
@@ -45,6 +47,33 @@ public:
 	static const unsigned int HDR_BUF_LEN            = 4096;
 	static const unsigned int UNCOMPRESSED_INBUF_LEN = 512 * 1024 * 8;
 
+	// Compression type 3 is snappy with each chunk split into SUBCHUNK_LEN
+	// pieces that can be decompressed separately.  SUBCHUNK_HDR_LEN bytes from
+	// the start of such a chunk are enough for getSubChunkRange().
+	static const int SUBCHUNK_COMPRESSION              = 3;
+	static const unsigned int SUBCHUNK_LEN             = 64 * 1024;
+	static const unsigned int SUBCHUNK_HDR_LEN         = 17 + 4 * (UNCOMPRESSED_INBUF_LEN / SUBCHUNK_LEN + 1);
+
+	// Compression type 4 is type 3 with each sub-chunk also run through the
+	// lightweight encodings in BlockEncoding when that makes it smaller.
+	static const int ENCODED_COMPRESSION               = 4;
+
+	// Compression types 5 & 6 compress whole chunks with LZ4, type 6 with its
+	// slower high compression mode for data that's loaded once and read often.
+	// Chunks of both read back the same way and much faster than snappy's.
+	static const int LZ4_COMPRESSION                   = 5;
+	static const int LZ4HC_COMPRESSION                 = 6;
+
+	// The algorithms compress() & uncompress() can use
+	enum Codec { CODEC_SNAPPY, CODEC_LZ4 };
+
+	/**
+	 * Are chunks of compressionType made of sub-chunks
+	 */
+	static bool hasSubChunks(int compressionType)
+		{ return (compressionType == SUBCHUNK_COMPRESSION ||
+			compressionType == ENCODED_COMPRESSION); }
+
 	// error codes from uncompressBlock()
 	static const int ERR_OK = 0;
 	static const int ERR_CHECKSUM = -1;
@@ -79,12 +108,51 @@ public:
 		unsigned char* out,
 		unsigned int&  outLen) const;
 
+	/**
+	* As above, in the chunk format of compressionType.  For SUBCHUNK_COMPRESSION
+	* the result is a chunk made of sub-chunks, for LZ4_COMPRESSION and
+	* LZ4HC_COMPRESSION an LZ4 chunk; other types are the same as above.
+	* For ENCODED_COMPRESSION colWidth is the width of the values in "in", 0 for
+	* data that isn't fixed width values and shouldn't be encoded.
+	*/
+	EXPORT int compressBlock(const char* in,
+		const size_t   inLen,
+		unsigned char* out,
+		unsigned int&  outLen,
+		int            compressionType,
+		unsigned       colWidth = 0) const;
+
 	/**
  	* outLen must be initialized with the size of the out buffer before calling uncompressBlock.
  	* On return, outLen will have the number of bytes used in out.
+ 	* If runs isn't NULL it gets an entry for each BlockEncoding::BLOCK_LEN of
+ 	* output; the count is 0 for blocks that weren't encoded.
  	*/
 	EXPORT int uncompressBlock(const char* in, const size_t inLen, unsigned char* out,
-		unsigned int& outLen) const;
+		unsigned int& outLen, BlockRuns* runs = NULL) const;
+
+	/**
+	* For a chunk made of sub-chunks, finds the sub-chunks holding uncompLen bytes
+	* at uncompOffset in the uncompressed chunk.  chunkHdr is the start of the
+	* chunk, at least SUBCHUNK_HDR_LEN bytes or all of it if it's shorter.
+	* compOffset and compLen are the bytes of the chunk to read, outOffset is
+	* where in the uncompressed chunk the first of them starts.
+	* Returns ERR_BADINPUT if the chunk isn't made of sub-chunks.
+	*/
+	EXPORT int getSubChunkRange(const char* chunkHdr,
+		const size_t hdrLen,
+		uint64_t uncompOffset,
+		uint64_t uncompLen,
+		uint64_t& compOffset,
+		uint64_t& compLen,
+		uint64_t& outOffset) const;
+
+	/**
+	* Decompresses the bytes located by getSubChunkRange().  outLen and runs work
+	* as they do for uncompressBlock().
+	*/
+	EXPORT int uncompressSubChunks(const char* in, const size_t inLen, unsigned char* out,
+		unsigned int& outLen, BlockRuns* runs = NULL) const;
 
 	/**
 	 * This fcn wraps whatever compression algorithm we're using at the time, and
@@ -99,6 +167,14 @@ public:
 	 */
 	EXPORT int uncompress(const char *in, size_t inLen, char *out) const;
 
+	/**
+	 * As above, with the given algorithm.  out needs maxCompressedSize(inLen)
+	 * bytes for compress().  The other side has to use the same codec.
+	 */
+	EXPORT int compress(const char *in, size_t inLen, char *out, size_t *outLen,
+		Codec codec) const;
+	EXPORT int uncompress(const char *in, size_t inLen, char *out, Codec codec) const;
+
 	/**
 	* Initialize header buffer at start of compressed db file.
 	*
@@ -198,6 +274,11 @@ public:
 	 */
 	EXPORT uint64_t getBlockCount(const void* hdrBuf) const;
 
+	/**
+	 * getCompressionType
+	 */
+	EXPORT int getCompressionType(const void* hdrBuf) const;
+
 	/*
 	 * Mutator methods for the overall header size
 	 */
@@ -236,9 +317,22 @@ public:
 	 */
 	EXPORT static bool getUncompressedSize(char *in, size_t inLen, size_t *outLen);
 
+	/**
+	 * As above, for the output of compress() with the given codec.
+	 */
+	EXPORT static bool getUncompressedSize(char *in, size_t inLen, size_t *outLen, Codec codec);
+
 protected:
 
 private:
+	// compresses one piece of a type 4 chunk, encoded if that's smaller
+	int compressEncoded(const char* in, const size_t inLen, unsigned char* out,
+		unsigned int& outLen, unsigned colWidth) const;
+
+	// compresses a type 5 or 6 chunk
+	int compressLZ4(const char* in, const size_t inLen, unsigned char* out,
+		unsigned int& outLen, bool highCompression) const;
+
 	//defaults okay
 	//IDBCompressInterface(const IDBCompressInterface& rhs);
 	//IDBCompressInterface& operator=(const IDBCompressInterface& rhs);
@@ -251,9 +345,14 @@ inline IDBCompressInterface::IDBCompressInterface(unsigned int /*numUserPaddingB
 inline IDBCompressInterface::~IDBCompressInterface() {}
 inline bool IDBCompressInterface::isCompressionAvail(int c) const { return (c == 0); }
 inline int IDBCompressInterface::compressBlock(const char*,const size_t,unsigned char*,unsigned int&) const { return -1; }
-inline int IDBCompressInterface::uncompressBlock(const char* in, const size_t inLen, unsigned char* out, unsigned int& outLen) const { return -1; }
+inline int IDBCompressInterface::uncompressBlock(const char* in, const size_t inLen, unsigned char* out, unsigned int& outLen, BlockRuns*) const { return -1; }
+inline int IDBCompressInterface::compressBlock(const char*,const size_t,unsigned char*,unsigned int&,int,unsigned) const { return -1; }
+inline int IDBCompressInterface::getSubChunkRange(const char*,const size_t,uint64_t,uint64_t,uint64_t&,uint64_t&,uint64_t&) const { return -3; }
+inline int IDBCompressInterface::uncompressSubChunks(const char*,const size_t,unsigned char*,unsigned int&,BlockRuns*) const { return -1; }
 inline int IDBCompressInterface::compress(const char* in, size_t inLen, char* out, size_t* outLen) const { return -1; }
 inline int IDBCompressInterface::uncompress(const char* in, size_t inLen, char* out) const { return 0; }
+inline int IDBCompressInterface::compress(const char*, size_t, char*, size_t*, Codec) const { return -1; }
+inline int IDBCompressInterface::uncompress(const char*, size_t, char*, Codec) const { return 0; }
 inline void IDBCompressInterface::initHdr(void*,int) const {}
 inline void IDBCompressInterface::initHdr(void*, void*, int,int) const {}
 inline int IDBCompressInterface::verifyHdr(const void*) const { return -1; }
@@ -268,10 +367,12 @@ inline void IDBCompressInterface::locateBlock(unsigned int block,
 inline int IDBCompressInterface::padCompressedChunks(unsigned char* buf, unsigned int& len, unsigned int maxLen) const { return -1; }
 inline void IDBCompressInterface::setBlockCount(void* hdrBuf, uint64_t count) const {}
 inline uint64_t IDBCompressInterface::getBlockCount(const void* hdrBuf) const { return 0; }
+inline int IDBCompressInterface::getCompressionType(const void*) const { return 0; }
 inline void IDBCompressInterface::setHdrSize(void*, uint64_t) const {}
 inline uint64_t IDBCompressInterface::getHdrSize(const void*) const { return 0; }
 inline uint64_t IDBCompressInterface::maxCompressedSize(uint64_t uncompSize) { return uncompSize; }
 inline bool IDBCompressInterface::getUncompressedSize(char* in, size_t inLen, size_t* outLen) { return false; }
+inline bool IDBCompressInterface::getUncompressedSize(char*, size_t, size_t*, Codec) { return false; }
 #endif
 
 }
@@ -0,0 +1,563 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+// $Id$
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+using namespace std;
+
+#include <boost/scoped_array.hpp>
+using namespace boost;
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "idbcompress.h"
+#include "blockencoding.h"
+using namespace compress;
+
+class CompressTestSuite : public CppUnit::TestFixture
+{
+
+	CPPUNIT_TEST_SUITE( CompressTestSuite );
+
+	CPPUNIT_TEST( lz4Chunk );
+	CPPUNIT_TEST( lz4hcChunk );
+	CPPUNIT_TEST( lz4ChunkChecksum );
+	CPPUNIT_TEST( mixedChunkTypes );
+	CPPUNIT_TEST( lz4Network );
+	CPPUNIT_TEST( encodePlain );
+	CPPUNIT_TEST( encodeFOR );
+	CPPUNIT_TEST( encodeDelta );
+	CPPUNIT_TEST( encodeRLE );
+	CPPUNIT_TEST( encodeDict );
+	CPPUNIT_TEST( encodeStream );
+	CPPUNIT_TEST( subChunkRange );
+	CPPUNIT_TEST( encodedSubChunks );
+
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	IDBCompressInterface comp;
+
+	/* A chunk of 8-byte values that compresses well, then some noise */
+	void fillChunk(char *buf, size_t len)
+	{
+		size_t i;
+
+		srand(1);
+		for (i = 0; i + 8 <= len / 2; i += 8)
+			*((int64_t *) &buf[i]) = i / 64;
+		for (; i < len; i++)
+			buf[i] = (char) rand();
+	}
+
+	/* Compresses len bytes as compressionType and checks they come back */
+	void roundTrip(int compressionType, size_t len)
+	{
+		scoped_array<char> in(new char[len + 1]);
+		scoped_array<unsigned char> out(new unsigned char[IDBCompressInterface::maxCompressedSize(len)]);
+		scoped_array<unsigned char> back(new unsigned char[len + 1]);
+		unsigned int outLen = IDBCompressInterface::maxCompressedSize(len), backLen = len + 1;
+
+		fillChunk(in.get(), len);
+		CPPUNIT_ASSERT(comp.compressBlock(in.get(), len, out.get(), outLen, compressionType) == 0);
+		CPPUNIT_ASSERT(outLen <= IDBCompressInterface::maxCompressedSize(len));
+		CPPUNIT_ASSERT(comp.uncompressBlock((const char *) out.get(), outLen, back.get(), backLen) ==
+			IDBCompressInterface::ERR_OK);
+		CPPUNIT_ASSERT(backLen == len);
+		CPPUNIT_ASSERT(memcmp(in.get(), back.get(), len) == 0);
+	}
+
+	static const unsigned widths[4];
+
+	/* The smallest & largest signed values of a column width */
+	static int64_t minValue(unsigned width)
+	{
+		return (width == 8 ? (int64_t) (1ULL << 63) : -((int64_t) 1 << (width * 8 - 1)));
+	}
+
+	static int64_t maxValue(unsigned width)
+	{
+		return (width == 8 ? (int64_t) ((1ULL << 63) - 1) : ((int64_t) 1 << (width * 8 - 1)) - 1);
+	}
+
+	/* Stores the low width bytes of val as value i of buf */
+	static void setValue(char *buf, unsigned width, size_t i, int64_t val)
+	{
+		memcpy(&buf[i * width], &val, width);
+	}
+
+	/* What a BlockRuns entry holds for val */
+	static uint64_t runValue(unsigned width, int64_t val)
+	{
+		return (width == 8 ? (uint64_t) val : (uint64_t) val & ((1ULL << (width * 8)) - 1));
+	}
+
+	/* The value of run r of block b, enough of them different that a dictionary
+	   doesn't beat RLE */
+	static int64_t runOf(unsigned width, size_t b, size_t r)
+	{
+		return (r % 2 ? maxValue(width) : minValue(width) + (int64_t) (b + r));
+	}
+
+	/* Encodes len bytes of width byte values, checks they decode to the same bytes,
+	   and returns the encoding of the first block */
+	uint8_t encodeRoundTrip(const char *in, size_t len, unsigned width, BlockRuns *runs = NULL)
+	{
+		scoped_array<char> enc(new char[BlockEncoding::maxEncodedSize(len)]);
+		scoped_array<char> back(new char[len]);
+		size_t encLen;
+
+		encLen = BlockEncoding::encode(in, len, width, enc.get());
+		CPPUNIT_ASSERT(encLen > 0 && encLen <= BlockEncoding::maxEncodedSize(len));
+		CPPUNIT_ASSERT(BlockEncoding::decodedLength(enc.get(), encLen) == len);
+		CPPUNIT_ASSERT(BlockEncoding::decode(enc.get(), encLen, back.get(), len, runs) == len);
+		CPPUNIT_ASSERT(memcmp(in, back.get(), len) == 0);
+		return (uint8_t) enc[BlockEncoding::STREAM_HDR_LEN];
+	}
+
+	/* Compresses a 4MB chunk as compressionType, then decompresses every range
+	   through getSubChunkRange() & uncompressSubChunks() */
+	void checkSubChunks(const char *in, size_t len, int compressionType, unsigned colWidth)
+	{
+		const uint64_t S = IDBCompressInterface::SUBCHUNK_LEN;
+		const uint64_t ranges[][2] = {
+			{ 0, 1 }, { S - 1, 2 }, { S, S }, { S + 100, 2 * S }, { len - 1, 1 }, { 0, len }
+		};
+		scoped_array<unsigned char> out(new unsigned char[IDBCompressInterface::maxCompressedSize(len)]);
+		scoped_array<unsigned char> back(new unsigned char[len]);
+		unsigned int outLen = IDBCompressInterface::maxCompressedSize(len), backLen;
+		uint64_t compOffset, compLen, outOffset;
+		size_t hdrLen;
+
+		CPPUNIT_ASSERT(comp.compressBlock(in, len, out.get(), outLen, compressionType, colWidth) == 0);
+		hdrLen = min((size_t) IDBCompressInterface::SUBCHUNK_HDR_LEN, (size_t) outLen);
+
+		for (unsigned i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++)
+		{
+			const uint64_t offset = ranges[i][0], rangeLen = ranges[i][1];
+
+			CPPUNIT_ASSERT(comp.getSubChunkRange((const char *) out.get(), hdrLen, offset, rangeLen,
+				compOffset, compLen, outOffset) == IDBCompressInterface::ERR_OK);
+			CPPUNIT_ASSERT(outOffset % S == 0 && outOffset <= offset);
+			CPPUNIT_ASSERT(compOffset + compLen <= outLen);
+
+			backLen = len;
+			CPPUNIT_ASSERT(comp.uncompressSubChunks((const char *) &out[compOffset], compLen,
+				back.get(), backLen) == IDBCompressInterface::ERR_OK);
+			// whole sub-chunks, no more than needed
+			CPPUNIT_ASSERT(outOffset + backLen >= offset + rangeLen);
+			CPPUNIT_ASSERT(backLen == min(len - outOffset,
+				(offset + rangeLen - outOffset + S - 1) / S * S));
+			CPPUNIT_ASSERT(memcmp(&in[outOffset], back.get(), backLen) == 0);
+		}
+
+		// past the end
+		CPPUNIT_ASSERT(comp.getSubChunkRange((const char *) out.get(), hdrLen, len - 1, 2,
+			compOffset, compLen, outOffset) == IDBCompressInterface::ERR_BADINPUT);
+
+		// the index of offsets after the 17 byte header is checked before it's used
+		out[17] ^= 1;
+		CPPUNIT_ASSERT(comp.getSubChunkRange((const char *) out.get(), hdrLen, 0, 1,
+			compOffset, compLen, outOffset) == IDBCompressInterface::ERR_CHECKSUM);
+	}
+
+public:
+
+	void lz4Chunk()
+	{
+		CPPUNIT_ASSERT(comp.isCompressionAvail(IDBCompressInterface::LZ4_COMPRESSION));
+		roundTrip(IDBCompressInterface::LZ4_COMPRESSION, IDBCompressInterface::UNCOMPRESSED_INBUF_LEN);
+		roundTrip(IDBCompressInterface::LZ4_COMPRESSION, 8192);
+		roundTrip(IDBCompressInterface::LZ4_COMPRESSION, 1);
+	}
+
+	void lz4hcChunk()
+	{
+		CPPUNIT_ASSERT(comp.isCompressionAvail(IDBCompressInterface::LZ4HC_COMPRESSION));
+		roundTrip(IDBCompressInterface::LZ4HC_COMPRESSION, IDBCompressInterface::UNCOMPRESSED_INBUF_LEN);
+		roundTrip(IDBCompressInterface::LZ4HC_COMPRESSION, 8192);
+	}
+
+	/* A flipped bit in an LZ4 chunk is caught by the checksum, not decoded */
+	void lz4ChunkChecksum()
+	{
+		const size_t len = 65536;
+		scoped_array<char> in(new char[len]);
+		scoped_array<unsigned char> out(new unsigned char[IDBCompressInterface::maxCompressedSize(len)]);
+		scoped_array<unsigned char> back(new unsigned char[len]);
+		unsigned int outLen = IDBCompressInterface::maxCompressedSize(len), backLen = len;
+
+		fillChunk(in.get(), len);
+		CPPUNIT_ASSERT(comp.compressBlock(in.get(), len, out.get(), outLen,
+			IDBCompressInterface::LZ4_COMPRESSION) == 0);
+		out[outLen - 1] ^= 1;
+		CPPUNIT_ASSERT(comp.uncompressBlock((const char *) out.get(), outLen, back.get(), backLen) ==
+			IDBCompressInterface::ERR_CHECKSUM);
+	}
+
+	/* Chunks are decoded by their own header, whatever the file's type */
+	void mixedChunkTypes()
+	{
+		const size_t len = 65536;
+		scoped_array<char> in(new char[len]);
+		scoped_array<unsigned char> snappyOut(new unsigned char[IDBCompressInterface::maxCompressedSize(len)]);
+		scoped_array<unsigned char> lz4Out(new unsigned char[IDBCompressInterface::maxCompressedSize(len)]);
+		scoped_array<unsigned char> back(new unsigned char[len]);
+		unsigned int snappyLen = IDBCompressInterface::maxCompressedSize(len);
+		unsigned int lz4Len = snappyLen, backLen;
+
+		fillChunk(in.get(), len);
+		CPPUNIT_ASSERT(comp.compressBlock(in.get(), len, snappyOut.get(), snappyLen) == 0);
+		CPPUNIT_ASSERT(comp.compressBlock(in.get(), len, lz4Out.get(), lz4Len,
+			IDBCompressInterface::LZ4_COMPRESSION) == 0);
+
+		backLen = len;
+		CPPUNIT_ASSERT(comp.uncompressBlock((const char *) snappyOut.get(), snappyLen, back.get(),
+			backLen) == IDBCompressInterface::ERR_OK);
+		CPPUNIT_ASSERT(backLen == len && memcmp(in.get(), back.get(), len) == 0);
+
+		memset(back.get(), 0, len);
+		backLen = len;
+		CPPUNIT_ASSERT(comp.uncompressBlock((const char *) lz4Out.get(), lz4Len, back.get(),
+			backLen) == IDBCompressInterface::ERR_OK);
+		CPPUNIT_ASSERT(backLen == len && memcmp(in.get(), back.get(), len) == 0);
+	}
+
+	/* What CompressedInetStreamSocket sends with Algorithm=lz4 */
+	void lz4Network()
+	{
+		const size_t len = 100000;
+		scoped_array<char> in(new char[len]);
+		scoped_array<char> out(new char[IDBCompressInterface::maxCompressedSize(len)]);
+		scoped_array<char> back;
+		size_t outLen = IDBCompressInterface::maxCompressedSize(len), backLen;
+
+		fillChunk(in.get(), len);
+		CPPUNIT_ASSERT(comp.compress(in.get(), len, out.get(), &outLen,
+			IDBCompressInterface::CODEC_LZ4) == 0);
+		CPPUNIT_ASSERT(outLen < len);
+		CPPUNIT_ASSERT(IDBCompressInterface::getUncompressedSize(out.get(), outLen, &backLen,
+			IDBCompressInterface::CODEC_LZ4));
+		CPPUNIT_ASSERT(backLen == len);
+
+		back.reset(new char[backLen]);
+		CPPUNIT_ASSERT(comp.uncompress(out.get(), outLen, back.get(),
+			IDBCompressInterface::CODEC_LZ4) == 0);
+		CPPUNIT_ASSERT(memcmp(in.get(), back.get(), len) == 0);
+	}
+
+	/* Values over the whole range of the width don't encode any smaller */
+	void encodePlain()
+	{
+		char in[BlockEncoding::BLOCK_LEN];
+
+		for (unsigned w = 0; w < 4; w++)
+		{
+			const unsigned width = widths[w];
+
+			srand(2);
+			for (size_t i = 0; i < sizeof(in); i++)
+				in[i] = (char) rand();
+			setValue(in, width, 0, minValue(width));
+			setValue(in, width, 1, maxValue(width));
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width) == BlockEncoding::PLAIN);
+		}
+	}
+
+	/* Values within 2^bits - 1 of each other are packed to every bit width there is,
+	   at the bottom & the top of the range */
+	void encodeFOR()
+	{
+		char in[BlockEncoding::BLOCK_LEN];
+
+		for (unsigned w = 0; w < 4; w++)
+		{
+			const unsigned width = widths[w];
+			const size_t n = sizeof(in) / width;
+
+			for (unsigned bits = 1; bits < width * 8; bits++)
+			{
+				const uint64_t mask = (1ULL << bits) - 1;
+				const int64_t bases[2] = { minValue(width), maxValue(width) - (int64_t) mask };
+				uint8_t encoding;
+
+				for (unsigned b = 0; b < 2; b++)
+				{
+					srand(bits);
+					setValue(in, width, 0, bases[b]);
+					setValue(in, width, 1, bases[b] + (int64_t) mask);
+					for (size_t i = 2; i < n; i++)
+						setValue(in, width, i, bases[b] + (int64_t) (((uint64_t) rand() << 32 ^
+							(uint64_t) rand() << 16 ^ (uint64_t) rand()) & mask));
+					encoding = encodeRoundTrip(in, sizeof(in), width);
+					// a 2 or 4 entry dictionary packs to the same bits & can undercut
+					// FOR's 8 byte base on a narrow column
+					if (bits > 2)
+						CPPUNIT_ASSERT(encoding == BlockEncoding::FOR);
+					else
+						CPPUNIT_ASSERT(encoding == BlockEncoding::FOR ||
+							encoding == BlockEncoding::DICT);
+				}
+			}
+		}
+	}
+
+	/* Rising & falling values that run up to the end of the range, and an
+	   arithmetic sequence that packs to 0 bits */
+	void encodeDelta()
+	{
+		char in[BlockEncoding::BLOCK_LEN];
+		BlockRuns runs;
+
+		// a 1 byte column never has enough distinct values for it to pay off
+		for (unsigned w = 1; w < 4; w++)
+		{
+			const unsigned width = widths[w];
+			const size_t n = sizeof(in) / width;
+			int64_t val;
+			size_t i;
+
+			srand(3);
+			val = maxValue(width);
+			for (i = n; i > 0; i--, val -= 3 + rand() % 2)
+				setValue(in, width, i - 1, val);
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width) == BlockEncoding::DELTA);
+
+			val = maxValue(width);
+			for (i = 0; i < n; i++, val -= 3 + rand() % 2)
+				setValue(in, width, i, val);
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width) == BlockEncoding::DELTA);
+
+			val = minValue(width);
+			for (i = 0; i < n; i++, val += 7)
+				setValue(in, width, i, val);
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width, &runs) == BlockEncoding::DELTA);
+			CPPUNIT_ASSERT(runs.count == 0);
+		}
+	}
+
+	/* Long runs, up to a whole block of a 1 byte column, and the runs that
+	   come back with them */
+	void encodeRLE()
+	{
+		char in[BlockEncoding::BLOCK_LEN * 3];
+		BlockRuns runs[3];
+
+		for (unsigned w = 0; w < 4; w++)
+		{
+			const unsigned width = widths[w];
+			const size_t n = BlockEncoding::BLOCK_LEN / width;
+			size_t i;
+
+			// 2 runs, the second one only 1 value long
+			for (i = 0; i < n - 1; i++)
+				setValue(in, width, i, maxValue(width));
+			setValue(in, width, n - 1, minValue(width));
+			CPPUNIT_ASSERT(encodeRoundTrip(in, BlockEncoding::BLOCK_LEN, width, runs) ==
+				BlockEncoding::RLE);
+			CPPUNIT_ASSERT(runs[0].count == 2 && runs[0].ordered);
+			CPPUNIT_ASSERT(runs[0].values[0] == runValue(width, maxValue(width)));
+			CPPUNIT_ASSERT(runs[0].values[1] == runValue(width, minValue(width)));
+			CPPUNIT_ASSERT(runs[0].starts[0] == 0 && runs[0].starts[1] == n - 1);
+
+			// 3 blocks of 16 runs, the most a BlockRuns holds, then 17 runs
+			for (i = 0; i < n * 3; i++)
+				setValue(in, width, i, runOf(width, i / n, (i % n) / (n / 16)));
+			setValue(in, width, n * 3 - 1, 0);
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width, runs) == BlockEncoding::RLE);
+			for (unsigned b = 0; b < 2; b++)
+			{
+				CPPUNIT_ASSERT(runs[b].count == 16 && runs[b].ordered);
+				for (unsigned r = 0; r < 16; r++)
+				{
+					CPPUNIT_ASSERT(runs[b].starts[r] == r * (n / 16));
+					CPPUNIT_ASSERT(runs[b].values[r] == runValue(width, runOf(width, b, r)));
+				}
+			}
+			CPPUNIT_ASSERT(runs[2].count == 0);
+		}
+	}
+
+	/* One value is a 1 entry dictionary packed to 0 bits, except on an 8 byte column
+	   where FOR's 0 bits are smaller.  Then the biggest dictionary there is. */
+	void encodeDict()
+	{
+		char in[BlockEncoding::BLOCK_LEN];
+		int64_t dict[BlockEncoding::MAX_DICT_SIZE + 1];
+		BlockRuns runs;
+
+		for (unsigned w = 0; w < 4; w++)
+		{
+			const unsigned width = widths[w];
+			const size_t n = sizeof(in) / width;
+			size_t i;
+
+			for (i = 0; i < n; i++)
+				setValue(in, width, i, maxValue(width));
+			if (width == 8)
+			{
+				CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width, &runs) == BlockEncoding::FOR);
+				CPPUNIT_ASSERT(runs.ordered && runs.starts[0] == 0);
+			}
+			else
+			{
+				CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width, &runs) == BlockEncoding::DICT);
+				CPPUNIT_ASSERT(!runs.ordered);
+			}
+			CPPUNIT_ASSERT(runs.count == 1 && runs.values[0] == runValue(width, maxValue(width)));
+
+			if (width == 1)
+				continue;
+
+			// values far apart, with both ends of the range among them
+			srand(4);
+			dict[0] = minValue(width);
+			dict[1] = maxValue(width);
+			for (i = 2; i <= BlockEncoding::MAX_DICT_SIZE; i++)
+				dict[i] = (int64_t) ((uint64_t) minValue(width) + i * (runValue(width, -1) / 300));
+			for (i = 0; i < n; i++)
+				setValue(in, width, i, dict[i < 16 ? i : rand() % 16]);
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width, &runs) == BlockEncoding::DICT);
+			CPPUNIT_ASSERT(runs.count == 16 && !runs.ordered);
+			for (i = 0; i < 16; i++)
+				CPPUNIT_ASSERT(find(runs.values, runs.values + 16, runValue(width, dict[i])) !=
+					runs.values + 16);
+
+			for (i = 0; i < n; i++)
+				setValue(in, width, i, dict[i < BlockEncoding::MAX_DICT_SIZE ? i :
+					rand() % BlockEncoding::MAX_DICT_SIZE]);
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width, &runs) == BlockEncoding::DICT);
+			CPPUNIT_ASSERT(runs.count == 0);
+
+			// one too many
+			setValue(in, width, n - 1, dict[BlockEncoding::MAX_DICT_SIZE]);
+			CPPUNIT_ASSERT(encodeRoundTrip(in, sizeof(in), width) != BlockEncoding::DICT);
+		}
+	}
+
+	/* Several blocks with a short one at the end, and what isn't a stream */
+	void encodeStream()
+	{
+		const size_t len = BlockEncoding::BLOCK_LEN * 5 + 12;
+		scoped_array<char> in(new char[len]);
+		scoped_array<char> enc(new char[BlockEncoding::maxEncodedSize(len)]);
+		scoped_array<char> back(new char[len]);
+		size_t encLen, i;
+
+		srand(5);
+		for (i = 0; i < len / 4; i++)
+			setValue(in.get(), 4, i, (i < len / 8 ? (int64_t) (i / 1000) : (int64_t) rand()));
+		encLen = BlockEncoding::encode(in.get(), len, 4, enc.get());
+		CPPUNIT_ASSERT(encLen > 0);
+		CPPUNIT_ASSERT(BlockEncoding::decode(enc.get(), encLen, back.get(), len) == len);
+		CPPUNIT_ASSERT(memcmp(in.get(), back.get(), len) == 0);
+
+		// too little room, cut short
+		CPPUNIT_ASSERT(BlockEncoding::decode(enc.get(), encLen, back.get(), len - 1) == 0);
+		CPPUNIT_ASSERT(BlockEncoding::decode(enc.get(), encLen - 1, back.get(), len) == 0);
+
+		// widths it doesn't do, and a partial value
+		CPPUNIT_ASSERT(BlockEncoding::encode(in.get(), len, 3, enc.get()) == 0);
+		CPPUNIT_ASSERT(BlockEncoding::encode(in.get(), len, 16, enc.get()) == 0);
+		CPPUNIT_ASSERT(BlockEncoding::encode(in.get(), 10, 4, enc.get()) == 0);
+		CPPUNIT_ASSERT(BlockEncoding::encode(in.get(), 0, 4, enc.get()) == 0);
+	}
+
+	/* Snappy sub-chunks of a full chunk and one that ends partway through one */
+	void subChunkRange()
+	{
+		const size_t len = IDBCompressInterface::UNCOMPRESSED_INBUF_LEN;
+		scoped_array<char> in(new char[len]);
+
+		fillChunk(in.get(), len);
+		checkSubChunks(in.get(), len, IDBCompressInterface::SUBCHUNK_COMPRESSION, 0);
+		checkSubChunks(in.get(), IDBCompressInterface::SUBCHUNK_LEN * 3 + 100,
+			IDBCompressInterface::SUBCHUNK_COMPRESSION, 0);
+	}
+
+	/* Encoded sub-chunks, and the runs of each block of the part decompressed */
+	void encodedSubChunks()
+	{
+		const size_t len = IDBCompressInterface::UNCOMPRESSED_INBUF_LEN;
+		const size_t blocks = len / BlockEncoding::BLOCK_LEN;
+		const size_t perBlock = BlockEncoding::BLOCK_LEN / 8;
+		const size_t perSubChunk = IDBCompressInterface::SUBCHUNK_LEN / BlockEncoding::BLOCK_LEN;
+		scoped_array<char> in(new char[len]);
+		scoped_array<unsigned char> out(new unsigned char[IDBCompressInterface::maxCompressedSize(len)]);
+		scoped_array<unsigned char> back(new unsigned char[len]);
+		scoped_array<BlockRuns> runs(new BlockRuns[blocks]);
+		unsigned int outLen = IDBCompressInterface::maxCompressedSize(len), backLen = len;
+		uint64_t compOffset, compLen, outOffset;
+		size_t i;
+
+		// every block a single value, every other one noise
+		srand(6);
+		for (i = 0; i < len / 8; i++)
+			setValue(in.get(), 8, i, ((i / perBlock) % 2 ? (int64_t) rand() : (int64_t) (i / perBlock)));
+		checkSubChunks(in.get(), len, IDBCompressInterface::ENCODED_COMPRESSION, 8);
+		// whole values, but a short last block
+		checkSubChunks(in.get(), IDBCompressInterface::SUBCHUNK_LEN * 3 + 104,
+			IDBCompressInterface::ENCODED_COMPRESSION, 8);
+
+		CPPUNIT_ASSERT(comp.compressBlock(in.get(), len, out.get(), outLen,
+			IDBCompressInterface::ENCODED_COMPRESSION, 8) == 0);
+		CPPUNIT_ASSERT(comp.getSubChunkRange((const char *) out.get(), outLen,
+			IDBCompressInterface::SUBCHUNK_LEN * 5 + 10, 1, compOffset, compLen, outOffset) ==
+			IDBCompressInterface::ERR_OK);
+		CPPUNIT_ASSERT(outOffset == IDBCompressInterface::SUBCHUNK_LEN * 5);
+		CPPUNIT_ASSERT(comp.uncompressSubChunks((const char *) &out[compOffset], compLen,
+			back.get(), backLen, runs.get()) == IDBCompressInterface::ERR_OK);
+		CPPUNIT_ASSERT(backLen == IDBCompressInterface::SUBCHUNK_LEN);
+		for (i = 0; i < perSubChunk; i++)
+		{
+			const size_t block = perSubChunk * 5 + i;
+
+			if (block % 2)
+				CPPUNIT_ASSERT(runs[i].count == 0);
+			else
+				CPPUNIT_ASSERT(runs[i].count == 1 && runs[i].values[0] == block);
+		}
+
+		backLen = len;
+		CPPUNIT_ASSERT(comp.uncompressBlock((const char *) out.get(), outLen, back.get(), backLen,
+			runs.get()) == IDBCompressInterface::ERR_OK);
+		CPPUNIT_ASSERT(backLen == len && memcmp(in.get(), back.get(), len) == 0);
+		for (i = 0; i < blocks; i++)
+			CPPUNIT_ASSERT(runs[i].count == (i % 2 ? 0 : 1));
+	}
+
+};
+
+const unsigned CompressTestSuite::widths[4] = { 1, 2, 4, 8 };
+
+CPPUNIT_TEST_SUITE_REGISTRATION( CompressTestSuite );
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
@@ -0,0 +1,151 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; version 2 of
+   the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+// $Id$
+
+#include <string>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "bytestream.h"
+#include "rowgroup.h"
+#include "tuplejoiner.h"
+
+using namespace messageqcpp;
+using namespace execplan;
+using namespace rowgroup;
+using namespace joiner;
+
+class JoinerTestSuite : public CppUnit::TestFixture
+{
+
+	CPPUNIT_TEST_SUITE( JoinerTestSuite );
+
+	CPPUNIT_TEST( bloomFilter_unsigned );
+	CPPUNIT_TEST( bloomFilter_unsigned_stringTable );
+
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+
+	/* An unsigned int key and a varchar long enough to go in the string table */
+	RowGroup makeRG(bool stringTable)
+	{
+		vector<uint> pos, oids, keys, scale(2, 0), precision(2, 10);
+		vector<CalpontSystemCatalog::ColDataType> types;
+
+		pos.push_back(2);
+		pos.push_back(6);
+		pos.push_back(46);
+		oids.push_back(3000);
+		oids.push_back(3001);
+		keys.push_back(1);
+		keys.push_back(2);
+		types.push_back(CalpontSystemCatalog::UINT);
+		types.push_back(CalpontSystemCatalog::VARCHAR);
+		return RowGroup(2, pos, oids, keys, types, scale, precision, 20, stringTable);
+	}
+
+	void fill(RowGroup &rg, RGData &data, const uint32_t *vals, uint count)
+	{
+		Row r;
+
+		rg.setData(&data);
+		rg.resetRowGroup(0);
+		rg.initRow(&r);
+		rg.getRow(0, &r);
+		for (uint i = 0; i < count; i++, r.nextRow()) {
+			r.setUintField<4>(vals[i], 0);
+			r.setStringField("abc", 1);
+		}
+		rg.setRowCount(count);
+	}
+
+	/* Keys with the high bit set read differently w/getIntField() & getUintField(),
+	   so the PM has to read them the way the UM join does or it drops matches */
+	void checkHighBitKeys(bool stringTable)
+	{
+		const uint32_t smallVals[] = { 0x80000001, 0xfffffff0 };
+		const uint32_t largeVals[] = { 0x80000001, 0xfffffff0, 5 };
+		RowGroup smallRG = makeRG(stringTable), largeRG = makeRG(stringTable);
+		RGData smallData(smallRG, 2), largeData(largeRG, 3);
+		boost::shared_ptr<JoinBloomFilter> bf;
+		JoinBloomFilter pmFilter;
+		ByteStream bs;
+		Row r;
+		uint i;
+
+		CPPUNIT_ASSERT(smallRG.usesStringTable() == stringTable);
+		fill(smallRG, smallData, smallVals, 2);
+		fill(largeRG, largeData, largeVals, 3);
+
+		TupleJoiner tj(smallRG, largeRG, 0, 0, joblist::INNER);
+		tj.setInUM();
+		smallRG.initRow(&r);
+		smallRG.getRow(0, &r);
+		for (i = 0; i < 2; i++, r.nextRow())
+			tj.insert(r);
+		tj.doneInserting();
+
+		bf = tj.makeBloomFilter(1024 * 1024);
+		CPPUNIT_ASSERT(bf);
+		bf->serialize(bs);
+		pmFilter.deserialize(bs);
+
+		largeRG.initRow(&r);
+		largeRG.getRow(0, &r);
+		for (i = 0; i < 2; i++, r.nextRow()) {
+			vector<Row::Pointer> matches;
+
+			tj.match(r, i, 0, &matches);
+			CPPUNIT_ASSERT(matches.size() == 1);
+			CPPUNIT_ASSERT(pmFilter.mayContain(pmFilter.getKey(r)));
+		}
+		// 5 is out of the small side's range either way
+		CPPUNIT_ASSERT(!pmFilter.mayContain(pmFilter.getKey(r)));
+	}
+
+public:
+
+	void bloomFilter_unsigned()
+	{
+		checkHighBitKeys(false);
+	}
+
+	void bloomFilter_unsigned_stringTable()
+	{
+		checkHighBitKeys(true);
+	}
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION( JoinerTestSuite );
+
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/ui/text/TestRunner.h>
+
+int main( int argc, char **argv)
+{
+	CppUnit::TextUi::TestRunner runner;
+	CppUnit::TestFactoryRegistry &registry = CppUnit::TestFactoryRegistry::getRegistry();
+	runner.addTest( registry.makeTest() );
+	bool wasSuccessful = runner.run( "", false );
+	return (wasSuccessful ? 0 : 1);
+}
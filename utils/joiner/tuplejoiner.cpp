@@ -580,6 +580,111 @@ void TupleJoiner::updateCPData(const Row &r)
 	}
 }
 
+boost::shared_ptr<JoinBloomFilter> TupleJoiner::makeBloomFilter(uint64_t maxSize)
+{
+	boost::shared_ptr<JoinBloomFilter> ret;
+	uint64_t keyCount;
+	uint smallKey = smallKeyColumns[0];
+	CalpontSystemCatalog::ColDataType type;
+	int64_t key, min, max;
+	bool isUnsigned;
+
+	/* Dropping a large-side row w/o a match is only OK if it wouldn't be in the result */
+	if (!inUM() || typelessJoin ||
+	  (joinType & (LARGEOUTER | ANTI | MATCHNULLS | SCALAR)))
+		return ret;
+
+	keyCount = size();
+	if (JoinBloomFilter::sizeFor(keyCount) > maxSize)
+		return ret;
+
+	/* With a string table, insert() & match() read unsigned keys as signed ints too */
+	ret.reset(new JoinBloomFilter(keyCount, largeKeyColumns[0], smallRG.usesStringTable()));
+	isUnsigned = (smallRG.isUnsigned(smallKey) && !smallRG.usesStringTable());
+	min = (isUnsigned ? (int64_t) numeric_limits<uint64_t>::max() : numeric_limits<int64_t>::max());
+	max = (isUnsigned ? 0 : numeric_limits<int64_t>::min());
+
+	/* The keys are already normalized the way match() expects; NULLs never match, so skip them */
+	if (!smallRG.usesStringTable()) {
+		for (iterator it = h->begin(); it != h->end(); ++it) {
+			key = it->first;
+			if (key == (int64_t) getJoinNullValue())
+				continue;
+			ret->insert(key);
+			if (isUnsigned) {
+				if ((uint64_t) key < (uint64_t) min) min = key;
+				if ((uint64_t) key > (uint64_t) max) max = key;
+			}
+			else {
+				if (key < min) min = key;
+				if (key > max) max = key;
+			}
+		}
+	}
+	else {
+		for (sthash_t::iterator it = sth->begin(); it != sth->end(); ++it) {
+			key = it->first;
+			if (key == (int64_t) getJoinNullValue())
+				continue;
+			ret->insert(key);
+			if (key < min) min = key;
+			if (key > max) max = key;
+		}
+	}
+
+	/* Char keys are compared as raw bytes & floats as bit patterns, so only
+	 * integer keys get a range check */
+	type = smallRG.getColType(smallKey);
+	if (!bSignedUnsignedJoin && !smallRG.isCharType(smallKey) &&
+	  type != CalpontSystemCatalog::FLOAT && type != CalpontSystemCatalog::UFLOAT &&
+	  type != CalpontSystemCatalog::DOUBLE && type != CalpontSystemCatalog::UDOUBLE &&
+	  type != CalpontSystemCatalog::LONGDOUBLE)
+		ret->setRange(min, max, isUnsigned);
+	return ret;
+}
+
+uint64_t TupleJoiner::keyHash(const Row &r, const vector<uint> &keyCols) const
+{
+	Hasher_r hasher;
+	uint32_t ret = 0, len = 0;
+	uint i, j;
+	CalpontSystemCatalog::ColDataType type;
+
+	if (!typelessJoin) {
+		int64_t key;
+
+		if (!smallRG.usesStringTable() && r.isUnsigned(keyCols[0]))
+			key = (int64_t) r.getUintField(keyCols[0]);
+		else
+			key = r.getIntField(keyCols[0]);
+		return fmix((uint64_t) key);
+	}
+
+	/* Covers the same bytes makeTypelessKey() would */
+	for (i = 0; i < keyCols.size(); i++) {
+		type = r.getColTypes()[keyCols[i]];
+		if (type == CalpontSystemCatalog::VARCHAR || type == CalpontSystemCatalog::CHAR) {
+			const uint8_t *str = r.getStringPointer(keyCols[i]);
+			uint width = r.getStringLength(keyCols[i]);
+			for (j = 0; j < width && str[j] != 0; j++)
+				;
+			ret = hasher((const char *) str, j, ret);
+			len += j + 1;
+		}
+		else {
+			uint64_t val;
+
+			if (r.isUnsigned(keyCols[i]))
+				val = r.getUintField(keyCols[i]);
+			else
+				val = r.getIntField(keyCols[i]);
+			ret = hasher((const char *) &val, 8, ret);
+			len += 8;
+		}
+	}
+	return fmix((uint64_t) hasher.finalize(ret, len));
+}
+
 size_t TupleJoiner::size() const
 {
 	if (joinAlg == UM || joinAlg == INSERTING) {
@@ -715,6 +820,80 @@ void TypelessData::deserialize(messageqcpp::ByteStream &b, utils::PoolAllocator
 	b.advance(len);
 }
 
+JoinBloomFilter::JoinBloomFilter() : mask(0), keyColumn(0), signedKeys(false),
+	hasRange(false), rangeUnsigned(false), minKey(0), maxKey(0)
+{
+}
+
+JoinBloomFilter::JoinBloomFilter(uint64_t keyCount, uint largeKeyColumn, bool sk) :
+	keyColumn(largeKeyColumn), signedKeys(sk), hasRange(false), rangeUnsigned(false),
+	minKey(0), maxKey(0)
+{
+	words.resize(sizeFor(keyCount) / sizeof(uint64_t), 0);
+	mask = words.size() - 1;
+}
+
+uint64_t JoinBloomFilter::sizeFor(uint64_t keyCount)
+{
+	/* 16 bits per key gives ~1% false positives w/4 bits per key in a 64-bit block */
+	uint64_t wordCount = 1;
+
+	while (wordCount * 4 < keyCount)
+		wordCount <<= 1;
+	return wordCount * sizeof(uint64_t);
+}
+
+void JoinBloomFilter::insert(int64_t key)
+{
+	uint64_t hash = mix((uint64_t) key);
+	words[hash & mask] |= pattern(hash);
+}
+
+void JoinBloomFilter::setRange(int64_t min, int64_t max, bool isUnsigned)
+{
+	hasRange = true;
+	rangeUnsigned = isUnsigned;
+	minKey = min;
+	maxKey = max;
+}
+
+void JoinBloomFilter::serialize(messageqcpp::ByteStream &b) const
+{
+	b << (uint32_t) keyColumn;
+	b << (uint8_t) signedKeys;
+	b << (uint8_t) hasRange;
+	b << (uint8_t) rangeUnsigned;
+	b << (uint64_t) minKey;
+	b << (uint64_t) maxKey;
+	b << (uint64_t) words.size();
+	b.append((const uint8_t *) &words[0], words.size() * sizeof(uint64_t));
+}
+
+void JoinBloomFilter::deserialize(messageqcpp::ByteStream &b)
+{
+	uint32_t tmp32;
+	uint8_t tmp8;
+	uint64_t tmp64;
+
+	b >> tmp32;
+	keyColumn = tmp32;
+	b >> tmp8;
+	signedKeys = tmp8;
+	b >> tmp8;
+	hasRange = tmp8;
+	b >> tmp8;
+	rangeUnsigned = tmp8;
+	b >> tmp64;
+	minKey = (int64_t) tmp64;
+	b >> tmp64;
+	maxKey = (int64_t) tmp64;
+	b >> tmp64;
+	words.resize(tmp64);
+	mask = tmp64 - 1;
+	memcpy(&words[0], b.buf(), tmp64 * sizeof(uint64_t));
+	b.advance(tmp64 * sizeof(uint64_t));
+}
+
 bool TupleJoiner::hasNullJoinColumn(const Row &r) const
 {
 	uint64_t key;
@@ -85,6 +85,88 @@ extern TypelessData makeTypelessKey(const rowgroup::Row &,
 extern TypelessData makeTypelessKey(const rowgroup::Row &,
 	const std::vector<uint> &, utils::PoolAllocator *fa);
 
+/* A bloom filter over the small-side keys of a UM join, plus their min & max.
+ * The large-side BPP runs it on the PM to drop rows that can't have a match
+ * before they're sent to the UM.  It's a 'blocked' filter; each key sets 4 bits
+ * in a single 64-bit word so a probe touches one cache line.  False positives
+ * are fine, the UM join still does the real match.
+ */
+class JoinBloomFilter
+{
+public:
+	JoinBloomFilter();
+	JoinBloomFilter(uint64_t keyCount, uint largeKeyColumn, bool signedKeys);
+
+	void insert(int64_t key);
+	inline bool mayContain(int64_t key) const;
+
+	/* The key of a large-side row, read the way TupleJoiner::match() reads it */
+	inline int64_t getKey(const rowgroup::Row &r) const;
+
+	/* The range check is only meaningful for integer keys of the same signedness */
+	void setRange(int64_t min, int64_t max, bool isUnsigned);
+	inline uint getKeyColumn() const { return keyColumn; }
+	inline uint64_t getSize() const { return words.size() * sizeof(uint64_t); }
+
+	void serialize(messageqcpp::ByteStream &) const;
+	void deserialize(messageqcpp::ByteStream &);
+
+	// the number of bytes a filter for keyCount keys will use
+	static uint64_t sizeFor(uint64_t keyCount);
+
+private:
+	static inline uint64_t mix(uint64_t key);
+	static inline uint64_t pattern(uint64_t hash);
+
+	std::vector<uint64_t> words;   // the size is a power of 2
+	uint64_t mask;
+	uint keyColumn;    // the key column in the large side RG
+	bool signedKeys;   // unsigned keys are read w/getIntField() too (string table joins)
+	bool hasRange;
+	bool rangeUnsigned;
+	int64_t minKey, maxKey;
+};
+
+inline uint64_t JoinBloomFilter::mix(uint64_t key)
+{
+	// the 64-bit finalizer from MurmurHash3
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+	return key;
+}
+
+inline uint64_t JoinBloomFilter::pattern(uint64_t hash)
+{
+	// the low bits pick the word, the high 24 bits pick 4 bits in it
+	return (1ULL << ((hash >> 40) & 63)) | (1ULL << ((hash >> 46) & 63)) |
+		(1ULL << ((hash >> 52) & 63)) | (1ULL << (hash >> 58));
+}
+
+inline bool JoinBloomFilter::mayContain(int64_t key) const
+{
+	if (hasRange) {
+		if (rangeUnsigned) {
+			if ((uint64_t) key < (uint64_t) minKey || (uint64_t) key > (uint64_t) maxKey)
+				return false;
+		}
+		else if (key < minKey || key > maxKey)
+			return false;
+	}
+
+	uint64_t hash = mix((uint64_t) key);
+	uint64_t bits = pattern(hash);
+	return (words[hash & mask] & bits) == bits;
+}
+
+inline int64_t JoinBloomFilter::getKey(const rowgroup::Row &r) const
+{
+	if (!signedKeys && r.isUnsigned(keyColumn))
+		return (int64_t) r.getUintField(keyColumn);
+	return r.getIntField(keyColumn);
+}
 
 class TupleJoiner
 {
@@ -174,6 +256,16 @@ public:
 	inline const boost::scoped_array<std::vector<int64_t> > &getCPData() { return cpValues; }
 	inline void setUniqueLimit(uint limit) { uniqueLimit = limit; }
 
+	/* Runtime join filter support.  Returns a filter the large side can apply on the PM
+	 * if this is a UM join that only keeps matching large-side rows and the filter
+	 * fits in maxSize bytes.  Otherwise it returns NULL. */
+	boost::shared_ptr<JoinBloomFilter> makeBloomFilter(uint64_t maxSize);
+
+	/* Disk-based join support.  Hashes the join key the way match() compares it, so
+	 * a small-side row and the large-side rows that can match it hash the same. */
+	uint64_t getSmallKeyHash(const rowgroup::Row &r) const { return keyHash(r, smallKeyColumns); }
+	uint64_t getLargeKeyHash(const rowgroup::Row &r) const { return keyHash(r, largeKeyColumns); }
+
 	/* Semi-join interface */
 	inline bool semiJoin() { return ((joinType & joblist::SEMI) != 0); }
 	inline bool antiJoin() { return ((joinType & joblist::ANTI) != 0); }
@@ -250,6 +342,8 @@ private:
 	// will have to change when/if we need to support that for compound or string joins
 	int64_t nullValueForJoinColumn;
 	
+	uint64_t keyHash(const rowgroup::Row &r, const std::vector<uint> &keyCols) const;
+
 	/* Runtime casual partitioning support */
 	void updateCPData(const rowgroup::Row &r);
 	boost::scoped_array<bool> discreteValues;
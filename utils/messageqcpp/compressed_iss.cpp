@@ -74,6 +74,17 @@ CompressedInetStreamSocket::CompressedInetStreamSocket()
 		useCompression = true;
 	else
 		useCompression = false;
+
+	val.clear();
+	try {
+		val = config->getConfig("NetworkCompression", "Algorithm");
+	}
+	catch(...) { }
+
+	if (val == "lz4" || val == "LZ4")
+		codec = IDBCompressInterface::CODEC_LZ4;
+	else
+		codec = IDBCompressInterface::CODEC_SNAPPY;
 }
 	
 Socket * CompressedInetStreamSocket::clone() const
@@ -87,17 +98,24 @@ const SBS CompressedInetStreamSocket::read(const struct timespec* timeout, bool*
 	SBS readBS, ret;
 	size_t uncompressedSize;	
 	bool err;
+	IDBCompressInterface::Codec readCodec;
 	
 	readBS = InetStreamSocket::read(timeout, isTimeOut, stats);
 	if (readBS->length() == 0 || fMagicBuffer == BYTESTREAM_MAGIC)
 		return readBS;
 
-	err = alg.getUncompressedSize((char *) readBS->buf(), readBS->length(), &uncompressedSize);
+	// the sender's codec, not necessarily ours
+	readCodec = (fMagicBuffer == LZ4_BYTESTREAM_MAGIC ? IDBCompressInterface::CODEC_LZ4 :
+		IDBCompressInterface::CODEC_SNAPPY);
+	err = alg.getUncompressedSize((char *) readBS->buf(), readBS->length(), &uncompressedSize,
+		readCodec);
 	if (!err)
 		return SBS(new ByteStream(0));
 
 	ret.reset(new ByteStream(uncompressedSize));
-	alg.uncompress((char *) readBS->buf(), readBS->length(), (char *) ret->getInputPtr());
+	if (alg.uncompress((char *) readBS->buf(), readBS->length(), (char *) ret->getInputPtr(),
+	  readCodec) != 0)
+		return SBS(new ByteStream(0));
 	ret->advanceInputPtr(uncompressedSize);
 	
 	return ret;
@@ -111,10 +129,12 @@ void CompressedInetStreamSocket::write(const ByteStream &msg, Stats *stats)
 	if (useCompression && (len > 512)) {
 		ByteStream smsg(alg.maxCompressedSize(len));
 	
-		alg.compress((char *) msg.buf(), len, (char *) smsg.getInputPtr(), &outLen);
-		smsg.advanceInputPtr(outLen);
-		if (outLen < len)
-			do_write(smsg, COMPRESSED_BYTESTREAM_MAGIC, stats);
+		if (alg.compress((char *) msg.buf(), len, (char *) smsg.getInputPtr(), &outLen,
+		  codec) == 0 && outLen < len) {
+			smsg.advanceInputPtr(outLen);
+			do_write(smsg, (codec == IDBCompressInterface::CODEC_LZ4 ?
+				LZ4_BYTESTREAM_MAGIC : COMPRESSED_BYTESTREAM_MAGIC), stats);
+		}
 		else
 			InetStreamSocket::write(msg, stats);
 	}
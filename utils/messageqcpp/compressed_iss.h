@@ -52,6 +52,7 @@ public:
 private:
 	compress::IDBCompressInterface alg;
 	bool useCompression;
+	compress::IDBCompressInterface::Codec codec;	// what write() uses; read() takes either
 };
 
 } //namespace messageqcpp
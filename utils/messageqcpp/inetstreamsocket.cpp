@@ -302,7 +302,8 @@ bool InetStreamSocket::readToMagic(long msecs, bool* isTimeOut, Stats *stats) co
 	pfd[0].fd = fSocketParms.sd();
 	pfd[0].events = POLLIN;
 	
-	while ((fMagicBuffer != BYTESTREAM_MAGIC) && (fMagicBuffer != COMPRESSED_BYTESTREAM_MAGIC)) {
+	while ((fMagicBuffer != BYTESTREAM_MAGIC) && (fMagicBuffer != COMPRESSED_BYTESTREAM_MAGIC) &&
+	  (fMagicBuffer != LZ4_BYTESTREAM_MAGIC)) {
 
 		if (msecs >= 0) {
 			pfd[0].revents = 0;
@@ -49,6 +49,7 @@ class IOSocket;
 /// random # marking the beginning of a ByteStream in the stream
 const uint32_t BYTESTREAM_MAGIC = 0x14fbc137;
 const uint32_t COMPRESSED_BYTESTREAM_MAGIC = 0x14fbc138;
+const uint32_t LZ4_BYTESTREAM_MAGIC = 0x14fbc139;
 
 /** An Inet Stream Socket
  *
@@ -23,6 +23,7 @@ using namespace std;
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/scoped_array.hpp>
@@ -33,6 +34,7 @@ using namespace std;
 #include "messagequeue.h"
 #include "socketparms.h"
 #include "inetstreamsocket.h"
+#include "compressed_iss.h"
 #include "socketclosed.h"
 using namespace messageqcpp;
 #include "configcpp.h"
@@ -1183,6 +1185,7 @@ CPPUNIT_TEST( mq_16 );	// test the fix for bug #224
 CPPUNIT_TEST( mq_17 );
 CPPUNIT_TEST( mq_18 );
 CPPUNIT_TEST( mq_19 );
+CPPUNIT_TEST( mq_20 );
 
 CPPUNIT_TEST_SUITE_END();
 
@@ -1693,6 +1696,46 @@ void mq_19()
 	CPPUNIT_ASSERT(InetStreamSocket::ping("10.100.4.254", &ts) == -1);
 }
 
+// A compressed message from a socket set to snappy or lz4 reads back on a socket
+// set to either one; the codec is taken from the config when the socket is made.
+void mq_20()
+{
+	Config* cf = Config::makeConfig();
+	const char* codecs[] = { "snappy", "lz4" };
+	SocketParms parms(AF_UNIX, SOCK_STREAM, 0);
+	int sv[2];
+
+	bs.reset();
+	for (uint32_t i = 0; i < 100000; i++)
+		bs << i % 1000;
+
+	cf->setConfig("NetworkCompression", "Enabled", "Y");
+	for (int w = 0; w < 2; w++)
+		for (int r = 0; r < 2; r++)
+		{
+			CPPUNIT_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+			cf->setConfig("NetworkCompression", "Algorithm", codecs[w]);
+			CompressedInetStreamSocket writer;
+			parms.sd(sv[0]);
+			writer.socketParms(parms);
+
+			cf->setConfig("NetworkCompression", "Algorithm", codecs[r]);
+			CompressedInetStreamSocket reader;
+			parms.sd(sv[1]);
+			reader.socketParms(parms);
+
+			// the message compresses to far less than the socket buffer
+			writer.write(bs);
+			SBS back = reader.read();
+			CPPUNIT_ASSERT(*back == bs);
+
+			writer.close();
+			reader.close();
+		}
+	Config::deleteInstanceMap();
+}
+
 }; 
 
 CPPUNIT_TEST_SUITE_REGISTRATION( ByteStreamTestSuite );
@@ -829,6 +829,11 @@ void RowAggregationUM::aggregateRowWithRemap(Row& row)
 		// if it was successfully inserted, fix the inserted values
 		if (++fTotalRowCount > fMaxTotalRowCount && !newRowGroup())
 		{
+			fExtKeyMap->erase(inserted.first);
+			fTotalRowCount--;
+			if (spillRow(row))
+				return;
+
 			throw logging::IDBExcept(logging::IDBErrorInfo::instance()->
 				errorMsg(logging::ERR_AGGREGATION_TOO_BIG), logging::ERR_AGGREGATION_TOO_BIG);
 		}
@@ -877,6 +882,12 @@ void RowAggregation::aggregateRow(Row& row)
 			// if it was successfully inserted, fix the inserted values
 			if (++fTotalRowCount > fMaxTotalRowCount && !newRowGroup())
 			{
+				// no room for the new group, it may go to disk instead
+				fAggMapPtr->erase(inserted.first);
+				fTotalRowCount--;
+				if (spillRow(row))
+					return;
+
 				throw logging::IDBExcept(logging::IDBErrorInfo::instance()->
 					errorMsg(logging::ERR_AGGREGATION_TOO_BIG), logging::ERR_AGGREGATION_TOO_BIG);
 			}
@@ -1783,7 +1794,9 @@ RowAggregationUM::RowAggregationUM(const vector<SP_ROWAGG_GRPBY_t>& rowAggGroupB
                                    const vector<SP_ROWAGG_FUNC_t>&  rowAggFunctionCols,
                                    joblist::ResourceManager *r) :
 	RowAggregation(rowAggGroupByCols, rowAggFunctionCols), fHasAvg(false), fKeyOnHeap(false),
-	fHasStatsFunc(false), fTotalMemUsage(0), fRm(r), fLastMemUsage(0), fNextRGIndex(0)
+	fHasStatsFunc(false), fTotalMemUsage(0), fRm(r), fLastMemUsage(0), fNextRGIndex(0),
+	fAllowDiskAgg(false), fSpillPartitions(0), fSpillLevel(0), fSpillMemUsage(0),
+	fNextPartition(0)
 {
 	// Check if there are any avg functions.
 	for (uint64_t i = 0; i < fFunctionCols.size(); i++)
@@ -1818,7 +1831,12 @@ RowAggregationUM::RowAggregationUM(const RowAggregationUM& rhs) :
 	fConstantAggregate(rhs.fConstantAggregate),
 	fGroupConcat(rhs.fGroupConcat),
 	fLastMemUsage(rhs.fLastMemUsage),
-	fNextRGIndex(0)
+	fNextRGIndex(0),
+	fAllowDiskAgg(rhs.fAllowDiskAgg),
+	fSpillPartitions(rhs.fSpillPartitions),
+	fSpillLevel(rhs.fSpillLevel),
+	fSpillMemUsage(0),
+	fNextPartition(0)
 {
 
 }
@@ -1833,6 +1851,7 @@ RowAggregationUM::~RowAggregationUM()
 	// fAggMapPtr deleted by base destructor.
 
 	fRm->returnMemory(fTotalMemUsage);
+	fRm->returnMemory(fSpillMemUsage);
 }
 
 
@@ -2707,6 +2726,10 @@ bool RowAggregationUM::newRowGroup()
 	uint64_t memDiff = 0;
 	bool     ret = false;
 
+	// once groups are going to disk, new ones never come back into memory
+	if (fSpillFiles)
+		return false;
+
 	allocSize = fRowGroupOut->getSizeWithStrings();
 	if (fKeyOnHeap)
 		memDiff = fKeyStore->getMemUsage() + fExtKeyMapAlloc->getMemUsage() - fLastMemUsage;
@@ -2770,11 +2793,154 @@ bool RowAggregationUM::nextRowGroup()
 		fRowGroupOut->setData(fResultDataVec.back());
 		fResultDataVec.pop_back();
 	}
+	else
+	{
+		more = nextSpilledRowGroup();
+	}
 
 	return more;
 }
 
 
+//------------------------------------------------------------------------------
+// Sets the row aside in a partition file, starting the partitions if this is
+// the first row that doesn't fit.  All the rows of a group land in the same
+// partition, and groups that are already in memory never get here, so each
+// partition can be aggregated by itself.  The partition is picked with a
+// different mix of the key hash at each level, so a partition that is still
+// too big is split again when it is aggregated.
+//
+// row(in)    - the row of a group that is not in memory
+// return     - false if the row can't go to disk
+//------------------------------------------------------------------------------
+bool RowAggregationUM::spillRow(const Row& row)
+{
+	const uint MAX_SPILL_LEVEL = 4;
+
+	if (!fAllowDiskAgg || fGroupByCols.empty() || fSpillLevel >= MAX_SPILL_LEVEL)
+		return false;
+
+	if (!fSpillFiles)
+	{
+		uint partitions = (fSpillPartitions > 0) ? fSpillPartitions : fRm->aggSpillPartitions();
+		fSpillFiles.reset(new RowGroupPartitioner(fRowGroupIn, partitions,
+			fRm->getScTempDiskPath(), "Agg"));
+	}
+
+	uint64_t h = row.hash(fGroupByCols.size() - 1) + (fSpillLevel + 1) * 0x9e3779b97f4a7c15ULL;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	fSpillFiles->insert(row, h % fSpillFiles->partitionCount());
+
+	// the buffer of a partition's first row; the memory is short already, but
+	// this is what it takes to get out of it, so it's charged either way
+	if (fSpillFiles->memUsage() > fSpillMemUsage)
+	{
+		fRm->getMemory(fSpillFiles->memUsage() - fSpillMemUsage);
+		fSpillMemUsage = fSpillFiles->memUsage();
+	}
+	return true;
+}
+
+
+//------------------------------------------------------------------------------
+// Returns the next RowGroup of the groups that went to disk.  The first call
+// frees the in-memory groups, which have all been delivered, and then each
+// partition is aggregated by a copy of this aggregator in turn.
+//
+// return     - false indicates all the spilled groups have been returned.
+//------------------------------------------------------------------------------
+bool RowAggregationUM::nextSpilledRowGroup()
+{
+	if (!fSpillFiles)
+		return false;
+
+	if (fNextPartition == 0 && !fPartitionAgg)
+	{
+		fSpillFiles->flush();
+		fRm->returnMemory(fSpillMemUsage);
+		fSpillMemUsage = 0;
+		releaseInMemoryGroups();
+	}
+
+	while (true)
+	{
+		if (fPartitionAgg && fPartitionAgg->nextRowGroup())
+		{
+			fRowGroupOut->setData(fPartitionAgg->getOutputRowGroup()->getRGData());
+			return true;
+		}
+
+		fPartitionAgg.reset();
+		if (fNextPartition == fSpillFiles->partitionCount())
+			return false;
+
+		aggregatePartition(fNextPartition++);
+	}
+}
+
+
+//------------------------------------------------------------------------------
+// Drops the hash map and the RowGroups holding the in-memory groups, and gives
+// their memory back to the ResourceManager for the partitions to use.
+//------------------------------------------------------------------------------
+void RowAggregationUM::releaseInMemoryGroups()
+{
+	delete fAggMapPtr;
+	fAggMapPtr = NULL;
+	fAlloc.reset();
+	if (fKeyOnHeap)
+	{
+		fExtKeyMap.reset();
+		fExtKeyMapAlloc.reset();
+		fKeyStore.reset();
+	}
+
+	fResultDataVec.clear();
+	fSecondaryRowDataVec.clear();
+	fGroupConcatAg.clear();
+
+	fRm->returnMemory(fTotalMemUsage);
+	fTotalMemUsage = 0;
+	fLastMemUsage = 0;
+}
+
+
+//------------------------------------------------------------------------------
+// Reads one partition back and aggregates it with a fresh copy of this
+// aggregator, which spills at the next level if the partition doesn't fit.
+//
+// partition(in) - the partition to aggregate
+//------------------------------------------------------------------------------
+void RowAggregationUM::aggregatePartition(uint partition)
+{
+	// a partition no row went to has no file, and partition() would make one
+	if (fSpillFiles->partitionRows(partition) > 0)
+	{
+		RowGroupFile& file = fSpillFiles->partition(partition);
+
+		fPartitionAgg.reset(clone());
+		fPartitionAgg->fSpillLevel = fSpillLevel + 1;
+		fPartitionRowGroupOut = *fRowGroupOut;
+		fPartitionRowData.reinit(fPartitionRowGroupOut, AGG_ROWGROUP_SIZE);
+		fPartitionRowGroupOut.setData(&fPartitionRowData);
+		fPartitionAgg->setInputOutput(fRowGroupIn, &fPartitionRowGroupOut);
+
+		RowGroup rowGroup(fRowGroupIn);
+		RGData rgData;
+		file.rewind();
+		while (file.read(rgData))
+		{
+			rowGroup.setData(&rgData);
+			fPartitionAgg->addRowGroup(&rowGroup);
+		}
+	}
+
+	fSpillFiles->release(partition);
+}
+
+
 //------------------------------------------------------------------------------
 // Row Aggregation constructor used on UM
 // For 2nd phase of two-phase case, from partial RG to final aggregated RG
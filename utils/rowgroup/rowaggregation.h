@@ -49,6 +49,7 @@
 #include "hasher.h"
 #include "stlpoolallocator.h"
 #include "returnedcolumn.h"
+#include "rowgroupfile.h"
 
 // To do: move code that depends on joblist to a proper subsystem.
 namespace joblist
@@ -478,6 +479,9 @@ class RowAggregation : public messageqcpp::Serializeable
 		virtual bool newRowGroup();
 		virtual void clearAggMap() { if (fAggMapPtr) fAggMapPtr->clear(); }
 
+		// called when there is no memory for the row's new group; true if it was set aside
+		virtual bool spillRow(const Row& row) { return false; }
+
 		inline bool isNull(const RowGroup* pRowGroup, const Row& row, int64_t col);
 		inline void makeAggFieldsNull(Row& row);
 		inline void copyNullRow(Row& row) {	copyRow(fNullRow, &row); }
@@ -550,7 +554,8 @@ class RowAggregationUM : public RowAggregation
 	public:
 		/** @brief RowAggregationUM constructor
 		 */
-		RowAggregationUM() {}
+		RowAggregationUM() : fAllowDiskAgg(false), fSpillPartitions(0), fSpillLevel(0),
+			fSpillMemUsage(0), fNextPartition(0) {}
 		RowAggregationUM(
 			const std::vector<SP_ROWAGG_GRPBY_t>& rowAggGroupByCols,
 			const std::vector<SP_ROWAGG_FUNC_t>&  rowAggFunctionCols,
@@ -577,6 +582,33 @@ class RowAggregationUM : public RowAggregation
 		 */
 		bool nextRowGroup();
 
+		/** @brief Lets the group by finish on disk when it outgrows the memory limit.
+		 *
+		 * Once the hash map can't grow, rows of groups that are not in memory
+		 * are hash-partitioned to files under TempDiskPath, and each partition
+		 * is aggregated by itself after the in-memory groups are delivered.
+		 * Only for a caller that is done with each result RowGroup before it
+		 * asks for the next one, because that memory is reused.
+		 */
+		void allowDiskAggregation(bool b) { fAllowDiskAgg = b; }
+		bool allowDiskAggregation() const { return fAllowDiskAgg; }
+
+		/** @brief How many files the groups that don't fit are spread over.
+		 *
+		 * Every bucket aggregator of a step spills on its own, so the step gives
+		 * each its share of RowAggregation/RowAggrSpillPartitions.  0 uses it all.
+		 */
+		void spillPartitions(uint n) { fSpillPartitions = n; }
+
+		/** @brief Returns the next RowGroup of the groups that went to disk.
+		 *
+		 * nextRowGroup() calls this once the in-memory groups are delivered;
+		 * a caller that takes resultDataVec() directly calls it itself.
+		 *
+		 * @returns true if more data, else false if no more data.
+		 */
+		bool nextSpilledRowGroup();
+
 		/** @brief Add an aggregator for DISTINCT aggregation
 		 */
 		void distinctAggregator(const boost::shared_ptr<RowAggregation>& da)
@@ -618,6 +650,11 @@ class RowAggregationUM : public RowAggregation
 		{ fRow.setIntField<8>(fRow.getIntField<8>(0) + pRG->getRowCount(), 0); return true; }
 
 		bool newRowGroup();
+		bool spillRow(const Row& row);
+
+		// disk-based aggregation
+		void releaseInMemoryGroups();
+		void aggregatePartition(uint partition);
 
 		// calculate the average after all rows received. UM only function.
 		void calculateAvgColumns();
@@ -674,6 +711,18 @@ class RowAggregationUM : public RowAggregation
 	private:
 		uint64_t fLastMemUsage;
 		uint32_t fNextRGIndex;
+
+		// disk-based aggregation: fSpillLevel is 0 for the aggregator fed by the
+		// step, n for one aggregating a partition spilled at level n-1.
+		bool fAllowDiskAgg;
+		uint fSpillPartitions;
+		uint fSpillLevel;
+		boost::scoped_ptr<RowGroupPartitioner> fSpillFiles;
+		uint64_t fSpillMemUsage;	// the partition buffers, charged to fRm
+		uint fNextPartition;
+		RowGroup fPartitionRowGroupOut;
+		RGData fPartitionRowData;
+		boost::scoped_ptr<RowAggregationUM> fPartitionAgg;
 };
 
 
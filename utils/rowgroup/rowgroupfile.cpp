@@ -0,0 +1,160 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation;
+   version 2.1 of the License.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+using namespace std;
+
+#include "atomicops.h"
+#include "rowgroupfile.h"
+
+namespace
+{
+volatile uint32_t fileCounter = 0;
+}
+
+namespace rowgroup
+{
+
+RowGroupFile::RowGroupFile(const string& dir, const string& prefix) :
+	fRowCount(0), fSize(0)
+{
+	ostringstream os;
+	os << dir << "/" << prefix << "-" << getpid() << "-0x" << hex << (ptrdiff_t) this << dec
+		<< "-" << atomicops::atomicInc(&fileCounter);
+	fFilename = os.str();
+
+	fFile.open(fFilename.c_str(), ios_base::in | ios_base::out | ios_base::trunc | ios_base::binary);
+	if (!fFile)
+	{
+		int e = errno;
+		throw runtime_error("RowGroupFile: could not create " + fFilename + ": " + strerror(e));
+	}
+}
+
+RowGroupFile::~RowGroupFile()
+{
+	fFile.close();
+	unlink(fFilename.c_str());
+}
+
+void RowGroupFile::write(const RowGroup& rg)
+{
+	uint32_t len;
+
+	fBs.restart();
+	rg.serializeRGData(fBs);
+	len = fBs.length();
+	fFile.write((const char *) &len, sizeof(len));
+	fFile.write((const char *) fBs.buf(), len);
+	if (!fFile)
+	{
+		int e = errno;
+		throw runtime_error("RowGroupFile: write to " + fFilename + " failed: " + strerror(e));
+	}
+
+	fRowCount += rg.getRowCount();
+	fSize += len + sizeof(len);
+}
+
+void RowGroupFile::rewind()
+{
+	fFile.flush();
+	fFile.clear();
+	fFile.seekg(0);
+}
+
+bool RowGroupFile::read(RGData& rgData)
+{
+	uint32_t len;
+
+	if (!fFile.read((char *) &len, sizeof(len)))
+		return false;
+
+	fBs.restart();
+	fBs.needAtLeast(len);
+	fFile.read((char *) fBs.getInputPtr(), len);
+	if (!fFile)
+		throw runtime_error("RowGroupFile: " + fFilename + " is truncated");
+	fBs.advanceInputPtr(len);
+	rgData.deserialize(fBs);
+	return true;
+}
+
+
+RowGroupPartitioner::RowGroupPartitioner(const RowGroup& rg, uint partitionCount,
+	const string& dir, const string& prefix, uint rowsPerBuffer) :
+	fRowGroup(rg), fRowsPerBuffer(rowsPerBuffer), fDir(dir), fPrefix(prefix),
+	fBuffers(new RGData[partitionCount]), fMemUsage(0)
+{
+	fRowGroup.initRow(&fRow);
+	fFiles.resize(partitionCount);
+}
+
+void RowGroupPartitioner::insert(const Row& row, uint partition)
+{
+	uint n;
+
+	if (!fBuffers[partition].rowData)
+	{
+		if (!fFiles[partition])
+			fFiles[partition].reset(new RowGroupFile(fDir, fPrefix));
+		fBuffers[partition].reinit(fRowGroup, fRowsPerBuffer);
+		fRowGroup.setData(&fBuffers[partition]);
+		fRowGroup.resetRowGroup(0);
+		fMemUsage += fRowGroup.getDataSize(fRowsPerBuffer);
+	}
+
+	fRowGroup.setData(&fBuffers[partition]);
+	n = fRowGroup.getRowCount();
+	fRowGroup.getRow(n, &fRow);
+	copyRow(row, &fRow);
+	fRowGroup.incRowCount();
+
+	if (n + 1 == fRowsPerBuffer)
+	{
+		fFiles[partition]->write(fRowGroup);
+		fRowGroup.resetRowGroup(0);
+	}
+}
+
+RowGroupFile& RowGroupPartitioner::partition(uint i)
+{
+	if (!fFiles[i])
+		fFiles[i].reset(new RowGroupFile(fDir, fPrefix));
+	return *fFiles[i];
+}
+
+void RowGroupPartitioner::flush()
+{
+	for (uint i = 0; i < fFiles.size(); i++)
+	{
+		if (!fBuffers[i].rowData)
+			continue;
+
+		fRowGroup.setData(&fBuffers[i]);
+		if (fRowGroup.getRowCount() > 0)
+			fFiles[i]->write(fRowGroup);
+		fBuffers[i] = RGData();
+	}
+	fMemUsage = 0;
+}
+
+}
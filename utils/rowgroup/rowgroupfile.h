@@ -0,0 +1,119 @@
+/* Copyright (C) 2013 Calpont Corp.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation;
+   version 2.1 of the License.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+   MA 02110-1301, USA. */
+
+/** @file */
+
+#ifndef ROWGROUPFILE_H_
+#define ROWGROUPFILE_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_array.hpp>
+
+#include "bytestream.h"
+#include "rowgroup.h"
+
+namespace rowgroup
+{
+
+/** @brief A temporary file of RowGroups
+ *
+ * For the UM steps that run out of memory: RowGroups are appended to a file
+ * under the given directory (normally SystemConfig/TempDiskPath) and read back
+ * in the order they were written.  All writes come before the first rewind().
+ * The file is removed when the object goes away.
+ */
+class RowGroupFile
+{
+public:
+	RowGroupFile(const std::string& dir, const std::string& prefix);
+	~RowGroupFile();
+
+	/** @brief Appends the rows in rg, as RowGroup::serializeRGData() would send them */
+	void write(const RowGroup& rg);
+
+	/** @brief Positions the file at the first RowGroup written */
+	void rewind();
+
+	/** @brief Reads the next RowGroup; false at the end of the file */
+	bool read(RGData& rgData);
+
+	uint64_t rowCount() const { return fRowCount; }
+	uint64_t size() const { return fSize; }
+	const std::string& filename() const { return fFilename; }
+
+private:
+	RowGroupFile(const RowGroupFile&);
+	RowGroupFile& operator=(const RowGroupFile&);
+
+	std::string fFilename;
+	std::fstream fFile;
+	messageqcpp::ByteStream fBs;
+	uint64_t fRowCount;
+	uint64_t fSize;
+};
+
+
+/** @brief Rows spread over a set of RowGroupFiles
+ *
+ * Each partition buffers rowsPerBuffer rows of rg before writing them to its
+ * file, so the memory used is at most partitionCount buffers no matter how
+ * many rows go to disk.  A partition's file and buffer are made by its first
+ * row.  Call flush() after the last insert(); it frees the buffers.
+ */
+class RowGroupPartitioner
+{
+public:
+	RowGroupPartitioner(const RowGroup& rg, uint partitionCount, const std::string& dir,
+		const std::string& prefix, uint rowsPerBuffer = 1024);
+
+	/** @brief Copies the row to the end of the partition */
+	void insert(const Row& row, uint partition);
+
+	/** @brief Writes out the partially filled buffers and frees them */
+	void flush();
+
+	uint partitionCount() const { return fFiles.size(); }
+
+	/** @brief The partition's file, an empty one if no row went to it */
+	RowGroupFile& partition(uint i);
+
+	/** @brief The rows written to the partition's file, without making one */
+	uint64_t partitionRows(uint i) const { return (fFiles[i] ? fFiles[i]->rowCount() : 0); }
+
+	/** @brief The bytes held by the buffers */
+	uint64_t memUsage() const { return fMemUsage; }
+
+	/** @brief Removes the partition's file once it has been read back */
+	void release(uint i) { fFiles[i].reset(); }
+
+private:
+	RowGroup fRowGroup;
+	Row fRow;
+	uint fRowsPerBuffer;
+	std::string fDir;
+	std::string fPrefix;
+	std::vector<boost::shared_ptr<RowGroupFile> > fFiles;
+	boost::scoped_array<RGData> fBuffers;
+	uint64_t fMemUsage;
+};
+
+}
+
+#endif
@@ -24,119 +24,264 @@
 #include <stdexcept>
 #include <unistd.h>
 #include <exception>
+#include <algorithm>
 using namespace std;
 
 #include "messageobj.h"
 #include "messagelog.h"
 using namespace logging;
 
+#include "atomicops.h"
+using namespace atomicops;
+
 #include "prioritythreadpool.h"
 using namespace boost;
 
+namespace
+{
+// how often an idle thread looks at a queue before the others; LOW, MEDIUM, HIGH
+const uint queueWeights[] = { 1, 2, 4 };
+}
+
 namespace threadpool
 {
 
 PriorityThreadPool::PriorityThreadPool(uint targetWeightPerRun, uint highThreads,
 		uint midThreads, uint lowThreads) :
+		workerCount(highThreads + midThreads + lowThreads), queuedJobs(0), sleepers(0),
 		_stop(false), weightPerRun(targetWeightPerRun)
 {
+	threadCounts[HIGH] = highThreads;
+	threadCounts[MEDIUM] = midThreads;
+	threadCounts[LOW] = lowThreads;
+	firstWorker[HIGH] = 0;
+	firstWorker[MEDIUM] = highThreads;
+	firstWorker[LOW] = highThreads + midThreads;
+	for (uint i = 0; i < _COUNT; i++)
+		nextWorker[i] = 0;
+
+	// every thread can steal from every other, so they all exist before any start
+	workers.reset(new Worker[max(workerCount, 1U)]);
 	for (uint i = 0; i < highThreads; i++)
-		threads.create_thread(ThreadHelper(this, HIGH));
+		threads.create_thread(ThreadHelper(this, HIGH, firstWorker[HIGH] + i));
 	for (uint i = 0; i < midThreads; i++)
-		threads.create_thread(ThreadHelper(this, MEDIUM));
+		threads.create_thread(ThreadHelper(this, MEDIUM, firstWorker[MEDIUM] + i));
 	for (uint i = 0; i < lowThreads; i++)
-		threads.create_thread(ThreadHelper(this, LOW));
+		threads.create_thread(ThreadHelper(this, LOW, firstWorker[LOW] + i));
 	cout << "started " << highThreads << " high, " << midThreads << " med, " << lowThreads
 			<< " low.\n";
-	threadCounts[HIGH] = highThreads;
-	threadCounts[MEDIUM] = midThreads;
-	threadCounts[LOW] = lowThreads;
 }
 
 PriorityThreadPool::~PriorityThreadPool()
 {
 	stop();
+	for (uint i = 0; i < max(workerCount, 1U); i++)
+		drainInbox(workers[i]);
 }
 
-void PriorityThreadPool::addJob(const Job &job, bool useLock)
+PriorityThreadPool::Priority PriorityThreadPool::queueFor(const Job &job)
 {
-	mutex::scoped_lock lk(mutex, defer_lock_t());
-
-	if (useLock)
-		lk.lock();
-
 	if (job.priority > 66)
-		jobQueues[HIGH].push_back(job);
+		return HIGH;
 	else if (job.priority > 33)
-		jobQueues[MEDIUM].push_back(job);
+		return MEDIUM;
 	else
-		jobQueues[LOW].push_back(job);
+		return LOW;
+}
+
+void PriorityThreadPool::addJob(const Job &job)
+{
+	Priority queue = queueFor(job);
+	InboxEntry *entry = new InboxEntry();
+	uintptr_t head;
+	uint target, i;
 
-	if (useLock)
-		newJob.notify_one();
+	entry->job = job;
+
+	// round robin over the threads started for this priority, if there are any
+	if (threadCounts[queue] > 0)
+		target = firstWorker[queue] + atomicInc(&nextWorker[queue]) % threadCounts[queue];
+	else if (workerCount > 0)
+		target = atomicInc(&nextWorker[queue]) % workerCount;
+	else
+		target = 0;
+
+	// but a sleeping one will get to it sooner
+	if (sleepers > 0)
+		for (i = 0; i < workerCount; i++)
+			if (workers[(target + i) % workerCount].sleeping) {
+				target = (target + i) % workerCount;
+				break;
+			}
+
+	Worker &w = workers[target];
+	do {
+		head = w.inbox;
+		entry->next = reinterpret_cast<InboxEntry *>(head);
+	} while (!atomicCAS(&w.inbox, head, reinterpret_cast<uintptr_t>(entry)));
+	atomicInc(&w.jobCount);
+	atomicInc(&queuedJobs);
+
+	/* A thread going to sleep marks itself before it checks queuedJobs, so either
+	   it sees this job or this sees it sleeping. */
+	if (w.sleeping) {
+		mutex::scoped_lock lk(w.mutex);
+		w.wakeup.notify_one();
+	}
+	else if (sleepers > 0)
+		wakeSleepers(1);
 }
 
 void PriorityThreadPool::removeJobs(uint id)
 {
-	list<Job>::iterator it;
+	deque<Job>::iterator it;
+	uint removed;
 
-	mutex::scoped_lock lk(mutex);
+	for (uint i = 0; i < workerCount; i++) {
+		Worker &w = workers[i];
+		mutex::scoped_lock lk(w.mutex);
 
-	for (uint i = 0; i < _COUNT; i++)
-		for (it = jobQueues[i].begin(); it != jobQueues[i].end();)
-			if (it->id == id)
-				it = jobQueues[i].erase(it);
-			else
-				++it;
+		drainInbox(w);
+		removed = 0;
+		for (uint q = 0; q < _COUNT; q++)
+			for (it = w.jobQueues[q].begin(); it != w.jobQueues[q].end();)
+				if (it->id == id) {
+					it = w.jobQueues[q].erase(it);
+					removed++;
+				}
+				else
+					++it;
+		if (removed > 0) {
+			atomicSub(&w.jobCount, removed);
+			atomicSub(&queuedJobs, removed);
+		}
+	}
 }
 
-PriorityThreadPool::Priority PriorityThreadPool::pickAQueue(Priority preference)
+/* The thread's preferred queue comes first.  The other two are ordered by
+   queueWeights, taking turns so a busy higher priority can't starve a lower one. */
+void PriorityThreadPool::pickQueues(Priority preference, uint &turn, Priority order[_COUNT]) const
 {
-	if (!jobQueues[preference].empty())
-		return preference;
-	else if (!jobQueues[HIGH].empty())
-		return HIGH;
-	else if (!jobQueues[MEDIUM].empty())
-		return MEDIUM;
-	else
-		return LOW;
+	Priority others[_COUNT - 1];
+	uint i, n, slot;
+
+	for (i = HIGH + 1, n = 0; i-- > 0;)
+		if (i != (uint) preference)
+			others[n++] = (Priority) i;
+
+	slot = turn++ % (queueWeights[others[0]] + queueWeights[others[1]]);
+	order[0] = preference;
+	if (slot < queueWeights[others[0]]) {
+		order[1] = others[0];
+		order[2] = others[1];
+	}
+	else {
+		order[1] = others[1];
+		order[2] = others[0];
+	}
+}
+
+/* Moves the jobs in w's inbox to its queues in the order they were added.
+   w.mutex must be held. */
+void PriorityThreadPool::drainInbox(Worker &w)
+{
+	uintptr_t head;
+	InboxEntry *entry, *next, *oldestFirst = NULL;
+
+	do {
+		head = w.inbox;
+	} while (head != 0 && !atomicCAS(&w.inbox, head, (uintptr_t) 0));
+
+	for (entry = reinterpret_cast<InboxEntry *>(head); entry != NULL; entry = next) {
+		next = entry->next;
+		entry->next = oldestFirst;
+		oldestFirst = entry;
+	}
+	for (entry = oldestFirst; entry != NULL; entry = next) {
+		next = entry->next;
+		w.jobQueues[queueFor(entry->job)].push_back(entry->job);
+		delete entry;
+	}
+}
+
+/* Takes a run's worth of jobs from one of w's queues.  w.mutex must be held. */
+uint PriorityThreadPool::takeJobs(Worker &w, Priority queue, vector<Job> &runList)
+{
+	deque<Job> &jobs = w.jobQueues[queue];
+	uint queueSize = jobs.size();
+	uint weight = 0, taken = 0;
+
+	// 3 conditions stop this thread from grabbing all jobs in the queue
+	//
+	// 1: The weight limit has been exceeded
+	// 2: The queue is empty
+	// 3: It has grabbed more than half of the jobs available &
+	//     should leave some to the other threads
+
+	while ((weight < weightPerRun) && (!jobs.empty()) && (taken <= queueSize/2)) {
+		runList.push_back(jobs.front());
+		jobs.pop_front();
+		weight += runList.back().weight;
+		taken++;
+	}
+	if (taken > 0) {
+		atomicSub(&w.jobCount, taken);
+		atomicSub(&queuedJobs, taken);
+	}
+	return taken;
 }
 
-void PriorityThreadPool::threadFcn(const Priority preferredQueue) throw()
+void PriorityThreadPool::wakeSleepers(uint count)
 {
-	Priority queue;
-	uint weight, i;
+	for (uint i = 0; i < workerCount && count > 0; i++)
+		if (workers[i].sleeping) {
+			mutex::scoped_lock lk(workers[i].mutex);
+			workers[i].wakeup.notify_one();
+			count--;
+		}
+}
+
+void PriorityThreadPool::threadFcn(const Priority preferredQueue, const uint worker) throw()
+{
+	Worker &me = workers[worker];
+	Priority order[_COUNT];
+	uint turn = 0, q, i;
 	vector<Job> runList;
 	vector<bool> reschedule;
 	uint rescheduleCount;
-	uint queueSize;
 
 	while (!_stop) {
 
-		mutex::scoped_lock lk(mutex);
+		pickQueues(preferredQueue, turn, order);
 
-		queue = pickAQueue(preferredQueue);
-		if (jobQueues[queue].empty()) {
-			newJob.wait(lk);
-			continue;
+		{
+			mutex::scoped_lock lk(me.mutex);
+			drainInbox(me);
+			for (q = 0; q < _COUNT && runList.empty(); q++)
+				takeJobs(me, order[q], runList);
 		}
 
-		queueSize = jobQueues[queue].size();
-		weight = 0;
-		// 3 conditions stop this thread from grabbing all jobs in the queue
-		//
-		// 1: The weight limit has been exceeded
-		// 2: The queue is empty
-		// 3: It has grabbed more than half of the jobs available &
-		//     should leave some to the other threads
-
-		while ((weight < weightPerRun) && (!jobQueues[queue].empty())
-		  && (runList.size() <= queueSize/2)) {
-			runList.push_back(jobQueues[queue].front());
-			jobQueues[queue].pop_front();
-			weight += runList.back().weight;
+		// nothing of our own, steal some starting with the next thread over
+		for (q = 0; q < _COUNT && runList.empty() && queuedJobs > 0; q++)
+			for (i = 1; i < workerCount && runList.empty(); i++) {
+				Worker &victim = workers[(worker + i) % workerCount];
+				if (victim.jobCount == 0)
+					continue;
+				mutex::scoped_lock lk(victim.mutex);
+				drainInbox(victim);
+				takeJobs(victim, order[q], runList);
+			}
+
+		if (runList.empty()) {
+			mutex::scoped_lock lk(me.mutex);
+			me.sleeping = true;
+			atomicInc(&sleepers);
+			if (queuedJobs == 0 && !_stop)
+				me.wakeup.wait(lk);
+			me.sleeping = false;
+			atomicDec(&sleepers);
+			continue;
 		}
-		lk.unlock();
 
 		reschedule.resize(runList.size());
 		rescheduleCount = 0;
@@ -157,15 +302,15 @@ void PriorityThreadPool::threadFcn(const Priority preferredQueue) throw()
 			usleep(1000);
 
 		if (rescheduleCount > 0) {
-			lk.lock();
+			mutex::scoped_lock lk(me.mutex);
 			for (i = 0; i < runList.size(); i++)
 				if (reschedule[i])
-					addJob(runList[i], false);
-			if (rescheduleCount > 1)
-				newJob.notify_all();
-			else
-				newJob.notify_one();
+					me.jobQueues[queueFor(runList[i])].push_back(runList[i]);
+			atomicAdd(&me.jobCount, rescheduleCount);
+			atomicAdd(&queuedJobs, rescheduleCount);
 			lk.unlock();
+			if (sleepers > 0)
+				wakeSleepers(rescheduleCount);
 		}
 		runList.clear();
 	}
@@ -174,6 +319,10 @@ void PriorityThreadPool::threadFcn(const Priority preferredQueue) throw()
 void PriorityThreadPool::stop()
 {
 	_stop = true;
+	for (uint i = 0; i < workerCount; i++) {
+		mutex::scoped_lock lk(workers[i].mutex);
+		workers[i].wakeup.notify_all();
+	}
 	threads.join_all();
 }
 
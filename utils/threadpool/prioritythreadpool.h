@@ -30,15 +30,26 @@
 #include <cstdlib>
 #include <sstream>
 #include <stdexcept>
+#include <stdint.h>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/condition.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_array.hpp>
 #include <boost/function.hpp>
+#include <deque>
 
 namespace threadpool
 {
 
+/** @brief A pool of threads that run jobs by priority.
+ *
+ * Each thread has a queue of its own for each priority.  addJob() hands a job
+ * to a thread without taking a lock, preferring one that's asleep, and a thread
+ * that runs out of work steals from the others' queues.  Threads prefer the
+ * priority they were started for, and otherwise pick a queue by weight so the
+ * lower priorities still make progress.
+ */
 class PriorityThreadPool
 {
 public:
@@ -77,8 +88,9 @@ public:
     		uint lowThreads);
     virtual ~PriorityThreadPool();
 
+    /** @brief drops the queued jobs with the given id; running ones finish */
     void removeJobs(uint id);
-    void addJob(const Job &job, bool useLock = true);
+    void addJob(const Job &job);
     void stop();
 
     /** @brief for use in debugging
@@ -89,25 +101,50 @@ protected:
 
 private:
     struct ThreadHelper {
-        ThreadHelper(PriorityThreadPool *impl, Priority queue) : ptp(impl), preferredQueue(queue) { }
-        void operator()() { ptp->threadFcn(preferredQueue); }
+        ThreadHelper(PriorityThreadPool *impl, Priority queue, uint num) : ptp(impl),
+            preferredQueue(queue), worker(num) { }
+        void operator()() { ptp->threadFcn(preferredQueue, worker); }
         PriorityThreadPool *ptp;
         Priority preferredQueue;
+        uint worker;
+    };
+
+    // jobs handed to a Worker, pushed without a lock & moved to its queues by whoever locks it
+    struct InboxEntry {
+        Job job;
+        InboxEntry *next;
+    };
+
+    struct Worker {
+        Worker() : inbox(0), jobCount(0), sleeping(false) { }
+        volatile uintptr_t inbox;   // an InboxEntry *, the newest first
+        std::deque<Job> jobQueues[_COUNT];  // higher indexes = higher priority
+        volatile uint jobCount;     // in the inbox & jobQueues
+        boost::mutex mutex;         // protects jobQueues, and the sleep on wakeup
+        boost::condition wakeup;
+        volatile bool sleeping;
     };
 
     explicit PriorityThreadPool();
     explicit PriorityThreadPool(const PriorityThreadPool &);
     PriorityThreadPool & operator=(const PriorityThreadPool &);
 
-    Priority pickAQueue(Priority preference);
-    void threadFcn(const Priority preferredQueue) throw();
-
-    std::list<Job> jobQueues[3];  // higher indexes = higher priority
-    uint threadCounts[3];
-    boost::mutex mutex;
-    boost::condition newJob;
+    static Priority queueFor(const Job &job);
+    void pickQueues(Priority preference, uint &turn, Priority order[_COUNT]) const;
+    void drainInbox(Worker &w);
+    uint takeJobs(Worker &w, Priority queue, std::vector<Job> &runList);
+    void wakeSleepers(uint count);
+    void threadFcn(const Priority preferredQueue, const uint worker) throw();
+
+    boost::scoped_array<Worker> workers;
+    uint workerCount;
+    uint threadCounts[_COUNT];
+    uint firstWorker[_COUNT];   // the workers preferring each priority are contiguous
+    volatile uint nextWorker[_COUNT];
+    volatile uint queuedJobs;
+    volatile uint sleepers;
     boost::thread_group threads;
-    bool _stop;
+    volatile bool _stop;
     uint weightPerRun;
 };
 
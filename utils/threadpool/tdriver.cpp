@@ -24,6 +24,7 @@ using namespace std;
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/scoped_array.hpp>
@@ -32,9 +33,13 @@ using namespace std;
 #include <cppunit/extensions/HelperMacros.h>
 
 #include "threadpool.h"
+#include "prioritythreadpool.h"
 
 int thecount = 0;
 boost::mutex mutex;
+int blocked = 0;
+bool released = false;
+boost::condition gate;
 
 
 
@@ -44,6 +49,8 @@ class ThreadPoolTestSuite : public CppUnit::TestFixture
     CPPUNIT_TEST_SUITE( ThreadPoolTestSuite );
 
     CPPUNIT_TEST( test_1 );
+    CPPUNIT_TEST( test_priority_1 );
+    CPPUNIT_TEST( test_priority_2 );
 
     CPPUNIT_TEST_SUITE_END();
 
@@ -77,6 +84,71 @@ private:
 
     };
 
+    // PriorityThreadPool job that asks to be rescheduled a few times
+    struct bar : public threadpool::PriorityThreadPool::Functor
+    {
+        bar(int r) : fReschedule(r) { }
+
+        int operator()()
+        {
+            if (fReschedule-- > 0)
+                return 1;
+            boost::mutex::scoped_lock lock(mutex);
+            ++thecount;
+            return 0;
+        }
+
+        int fReschedule;
+    };
+
+    // PriorityThreadPool job that holds its thread until the gate opens
+    struct blocker : public threadpool::PriorityThreadPool::Functor
+    {
+        int operator()()
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            ++blocked;
+            while (!released)
+                gate.wait(lock);
+            --blocked;
+            return 0;
+        }
+    };
+
+    // PriorityThreadPool job that takes a while, then counts itself
+    struct slow : public threadpool::PriorityThreadPool::Functor
+    {
+        slow(int &c) : fCount(c) { }
+
+        int operator()()
+        {
+            usleep(1000);
+            boost::mutex::scoped_lock lock(mutex);
+            ++fCount;
+            return 0;
+        }
+
+        int &fCount;
+    };
+
+    // polls until thecount or blocked reaches the target, returns what it got to
+    int waitFor(int &var, int target)
+    {
+        int val = 0;
+
+        for (int i = 0; i < 1000; i++)
+        {
+            {
+                boost::mutex::scoped_lock lock(mutex);
+                val = var;
+            }
+            if (val == target)
+                break;
+            usleep(10000);
+        }
+        return val;
+    }
+
 public:
     void setUp()
     {}
@@ -107,6 +179,98 @@ public:
 
     }
 
+    void test_priority_1()
+    {
+        threadpool::PriorityThreadPool pool( 10, 2, 2, 1 );
+        threadpool::PriorityThreadPool::Job job;
+        int count;
+
+        thecount = 0;
+        for (int i = 0; i < 3000; i++)
+        {
+            job.functor.reset(new bar(i % 7 == 0 ? 2 : 0));
+            job.weight = 1;
+            job.priority = (i * 37) % 100;
+            job.id = 1;
+            pool.addJob(job);
+        }
+
+        // the threads steal from each other, so every job runs whichever got it
+        CPPUNIT_ASSERT(waitFor(thecount, 3000) == 3000);
+
+        // tie up all 5 threads, one at a time so no thread takes 2 of them
+        job.weight = 10;
+        job.priority = 50;
+        job.id = 3;
+        for (int i = 1; i <= 5; i++)
+        {
+            job.functor.reset(new blocker());
+            pool.addJob(job);
+            CPPUNIT_ASSERT(waitFor(blocked, i) == i);
+        }
+
+        // jobs still queued when they're removed never run
+        job.weight = 1;
+        job.id = 2;
+        for (int i = 0; i < 3000; i++)
+        {
+            job.functor.reset(new bar(0));
+            job.priority = (i * 37) % 100;
+            pool.addJob(job);
+        }
+        pool.removeJobs(2);
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            released = true;
+            gate.notify_all();
+        }
+        CPPUNIT_ASSERT(waitFor(blocked, 0) == 0);
+        usleep(100000);
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            count = thecount;
+        }
+        CPPUNIT_ASSERT(count == 3000);
+
+        // the threads are still there to run whatever's queued
+        job.functor.reset(new bar(0));
+        job.id = 1;
+        pool.addJob(job);
+        CPPUNIT_ASSERT(waitFor(thecount, 3001) == 3001);
+        pool.stop();
+    }
+
+    // a flood of high priority jobs doesn't hold up the low priority ones
+    void test_priority_2()
+    {
+        threadpool::PriorityThreadPool pool( 10, 2, 2, 1 );
+        threadpool::PriorityThreadPool::Job job;
+        int high = 0, low = 0, count;
+
+        job.weight = 1;
+        job.id = 1;
+        job.priority = 100;
+        for (int i = 0; i < 5000; i++)
+        {
+            job.functor.reset(new slow(high));
+            pool.addJob(job);
+        }
+        job.priority = 0;
+        for (int i = 0; i < 20; i++)
+        {
+            job.functor.reset(new slow(low));
+            pool.addJob(job);
+        }
+
+        CPPUNIT_ASSERT(waitFor(low, 20) == 20);
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            count = high;
+        }
+        CPPUNIT_ASSERT(count < 5000);
+        pool.stop();
+    }
+
 };
 
 
@@ -314,6 +314,15 @@ OrderByData::OrderByData(const std::vector<IdbSortSpec>& spec, const rowgroup::R
 }
 
 
+OrderByData::~OrderByData()
+{
+	// delete compare objects
+	vector<Compare*>::iterator i = fRule.fCompares.begin();
+	while (i != fRule.fCompares.end())
+		delete *i++;
+}
+
+
 // IdbOrderBy class implementation
 IdbOrderBy::IdbOrderBy() :
 	fDistinct(false), fMemSize(0), fRowsPerRG(8192), fErrorCode(0), fRm(NULL)
@@ -193,7 +193,7 @@ class OrderByData : public IdbCompare
 {
 public:
 	OrderByData(const std::vector<IdbSortSpec>&, const rowgroup::RowGroup&);
-	virtual ~OrderByData() {};
+	virtual ~OrderByData();
 
 	bool operator() (rowgroup::Row::Pointer p1, rowgroup::Row::Pointer p2) { return fRule.less(p1, p2); }
 	const CompareRule& rule() const { return fRule; }
@@ -369,7 +369,9 @@ int ColumnBufferCompressed::compressAndFlush( bool bFinishingFile )
         reinterpret_cast<char*>(fToBeCompressedBuffer),
         fToBeCompressedCapacity,
         compressedOutBuf,
-        outputLen );
+        outputLen,
+        fColInfo->column.compressionType,
+        fColInfo->column.width );
     if (rc != 0)
     {
         return ERR_COMP_COMPRESS;
@@ -799,7 +799,10 @@ int ChunkManager::writeChunkToFile(CompFileData* fileData, ChunkData* chunkData)
         if (fCompressor.compressBlock((char*)chunkData->fBufUnCompressed,
                                         chunkData->fLenUnCompressed,
                                         (unsigned char*)fBufCompressed,
-                                        fLenCompressed) != 0)
+                                        fLenCompressed,
+                                        fCompressor.getCompressionType(
+                                            fileData->fFileHeader.fControlData),
+                                        fileData->fDctnryCol ? 0 : fileData->fColWidth) != 0)
         {
             logMessage(ERR_COMP_COMPRESS, logging::LOG_TYPE_ERROR, __LINE__);
             return ERR_COMP_COMPRESS;
@@ -1689,7 +1692,10 @@ int ChunkManager::reallocateChunks(CompFileData* fileData)
             if ((rc = fCompressor.compressBlock((char*)chunkData->fBufUnCompressed,
                                             chunkData->fLenUnCompressed,
                                             (unsigned char*)fBufCompressed,
-                                            fLenCompressed)) != 0)
+                                            fLenCompressed,
+                                            fCompressor.getCompressionType(
+                                                fileData->fFileHeader.fControlData),
+                                            fileData->fDctnryCol ? 0 : fileData->fColWidth)) != 0)
             {
                 ostringstream oss;
                 oss << "Compress data failed @line:" << __LINE__ << "with retCode:" << rc